@@ -30,43 +30,66 @@
 #include <stdio.h>
 
 #include "LynkeosFileReader.h"
+#include "SER.h"
 
 /**
  * \page libraries Libraries needed to compile Lynkeos
- * The Dcraw plugin needs a dcraw compiled executable to be put in the build 
- * folder.
+ * The Dcraw plugin builds the dcraw source, found in ThirdPartySources, as an
+ * in-process decoder.
  * It can be found at http://www.cybercom.net/~dcoffin/dcraw/
  */
 
+/*!
+ * @abstract State of the raw conversion
+ */
+typedef enum
+{
+   ConversionIdle,         //!< No converted image in memory
+   ConversionRunning,      //!< The decoder thread is running
+   ConversionDone          //!< The converted image is in the pool
+} ConversionState_t;
+
 /*!
  * @class DcrawReader
  * @abstract Class for reading digital cameras raw image file formats.
- * @discussion This reader uses an external program, dcraw for converting the
- *   raw file into a temporary PPM file, and retrieve the data from this PPM
- *   file.
+ * @discussion This reader uses the dcraw code, built in process, for
+ *   converting the raw file into an image in memory.
+ *
+ *   The conversions are scheduled by a queue shared by all the readers.
+ *   When a reader gets called, its image is converted if needed. The images
+ *   which will be processed next are converted ahead in background threads,
+ *   when the processing asks to prefetch them. The converted images are kept
+ *   in a pool of bounded size, and the least recently used are evicted to
+ *   make room for the next ones.
  *
- *   The conversion is started in the background when the reader is created.
- *   When the reader gets called, it waits for conversion end if needed, before
- *   accessing the PPM file data.
+ *   When told so by the preferences, the sensor Bayer mosaic is kept. The
+ *   images are then provided in the same custom format as the Bayer SER
+ *   movies, and the colors get interpolated after alignment.
  * @ingroup FileAccess
  */
 @interface DcrawReader : NSObject <LynkeosCustomImageFileReader>
 {
 @private
    NSURL        *_url;             //!< The RAW file to read
-   NSTask       *_dcrawTask;       //!< The converter task
-   NSString     *_ppmFilePath;     //!< Converted PPM file path
+   ConversionState_t _conversionState; //!< Protected by the queue lock
+   u_int        _pixelsUsers;      //!< Number of ongoing reads of the pixels
+   BOOL         _aheadRequested;   //!< Converted ahead and not yet read
+   u_short      *_pixels;          //!< Converted samples, interleaved
+   u_short      _pixelPlanes;      //!< Number of samples per pixel
+   LynkeosImageBuffer *_conversionDark; //!< Dark frame used by the conversion
    u_short      _numberOfPlanes;   //!< Cached number of planes
    u_short      _width;            //!< Cached width
    u_short      _height;           //!< Cached height
    NSMutableDictionary *_metadata; //!< Meta data dictionary
    u_short      _baseWidth;        //!< Width of image before any rotation
    u_short      _baseHeight;       //!< Width of image before any rotation
-   u_long       _ppmDataOffset;    //!< Offset of image data in PPM file
    u_short      _dataMax;          //!< Maximum pixel value
    ListMode_t   _mode;             //!< Image mode for this instance
+   BOOL         _isBayer;          //!< Whether the Bayer mosaic is kept
+   ColorID_t    _bayerFormat;      //!< Bayer pattern of the mosaic
+   u_short      _bayerPlanes[2][2]; //!< Bayer mosaic pattern (Y first)
    LynkeosImageBuffer* _dark;  //!< The dark frame (weak ref)
-   NSTimer     *_conversionTimer;  //!< Used to delay the start of conversion
+   LynkeosImageBuffer* _flat;  //!< The flat field, for the Bayer mosaic
 }
 
 @end
@@ -24,22 +24,72 @@
 
 #include <LynkeosCore/LynkeosImageBuffer.h>
 #include <LynkeosCore/LynkeosMetadata.h>
+#include <LynkeosCore/LynkeosMemoryBudget.h>
 #include "processing_core.h"
 #include "DcrawReaderPrefs.h"
 #include "DcrawReader.h"
-
-#define K_COUNTER_KEY @"ImageCount"
+#include "SER_ImageBuffer.h"
+#include "dcraw.h"
 
 static NSMutableArray *rawFilesTypes = nil;
 
-static NSCursor *watchCursor = nil;
-static NSPanel *progressPanel = nil;
-static NSProgressIndicator *progressIndicator = nil;
-static NSModalSession progressSession = nil;
-static NSMutableArray *pendingConversions = nil, *ongoingConversions = nil;
+/*!
+ * @abstract Maximum memory used by the pool of converted images
+ * @discussion The pool nevertheless keeps one image more than the number of
+ *    processors.
+ */
+#define K_RAW_POOL_MEMORY (1024*1024*1024UL)
+
+static NSCondition *conversionCondition = nil; //!< Protects the queue
+static NSMutableArray *aheadQueue = nil;    //!< Readers to convert ahead
+static NSMutableArray *convertedPool = nil; //!< Least recently used first
+static u_short runningConversions = 0;
 static u_short maxConversions = 0;
-static NSTimer *convWaitTimer = nil;
-static BOOL isWaitingConversion = NO;
+
+/*!
+ * @abstract Get the Bayer format of an identified raw image
+ * @param info The dcraw identification result
+ * @param planes The color plane of each pixel in the 2x2 pattern, Y first
+ * @result The SER Bayer format, or SER_MONO if the mosaic cannot be kept
+ */
+static ColorID_t bayerFormat( const dcraw_image_t *info, u_short planes[2][2] )
+{
+   u_short r, c;
+
+   // Only RGB 2x2 patterns, and images not resampled by dcraw
+   if ( info->colors != 3 || info->filters < 1000
+        || info->filters != (info->filters & 0xff)*0x01010101
+        || info->out_width != info->width || info->out_height != info->height )
+      return( SER_MONO );
+
+   for( r = 0; r < 2; r++ )
+   {
+      for( c = 0; c < 2; c++ )
+      {
+         // Same as dcraw FC() macro
+         planes[r][c] = info->filters >> (((r << 1) | c) << 1) & 3;
+         if ( planes[r][c] == 3 )
+            planes[r][c] = 1;    // Second green
+      }
+   }
+
+   if ( planes[0][1] == 1 && planes[1][0] == 1 )
+   {
+      if ( planes[0][0] == 0 && planes[1][1] == 2 )
+         return( SER_BAYER_RGGB );
+      if ( planes[0][0] == 2 && planes[1][1] == 0 )
+         return( SER_BAYER_BGGR );
+   }
+   else if ( planes[0][0] == 1 && planes[1][1] == 1 )
+   {
+      if ( planes[0][1] == 0 && planes[1][0] == 2 )
+         return( SER_BAYER_GRBG );
+      if ( planes[0][1] == 2 && planes[1][0] == 0 )
+         return( SER_BAYER_GBRG );
+   }
+
+   return( SER_MONO );
+}
 
 /*!
  * @abstract The RAW custom image class
@@ -48,14 +98,14 @@ static BOOL isWaitingConversion = NO;
  */
 @interface DcrawCustomImage : LynkeosImageBuffer
 {
-   NSString *_pgmFilePath;
+   u_short *_rawSamples;   //!< Samples converted for dcraw dark subtraction
 }
 
-- (NSString*) fileName;
-@end
-
-@interface DcrawCustomImage(Private)
-- (void) saveAsPgm;
+/*!
+ * @abstract Samples of the dark frame in dcraw format
+ * @discussion They are converted at first call.
+ */
+- (const u_short*) rawSamples;
 @end
 
 /*!
@@ -63,88 +113,78 @@ static BOOL isWaitingConversion = NO;
  * @ingroup FileAccess
  */
 @interface DcrawReader(Private)
+/*!
+ * @abstract Identify the raw file
+ * @param info The identification result
+ * @param mosaic Whether the Bayer mosaic is to be kept
+ * @result 0 on success
+ */
+- (int) identify:(dcraw_image_t*)info asMosaic:(BOOL)mosaic ;
+
 /*!
  * @abstract Extract image informations
  */
 - (void) getImageInfo ;
 
 /*!
- * @abstract Launch the conversion
+ * @abstract Build the dcraw options for the conversion
+ * @result The options, without the program name
  */
-- (void) launchConversion ;
+- (NSArray*) conversionArguments ;
 
 /*!
- * @abstract Wait for the dcraw task to complete the conversion.
- * @result None
+ * @abstract Launch the conversion in a background thread
+ * @discussion Called with the conversion condition locked.
  */
-- (void) waitForConversion ;
+- (void) launchConversion ;
 
 /*!
- * @abstract Extract a data sample in the converted PPM file
- * @param data The data buffer to fill
- * @param x X coordinate of the sample
- * @param y Y coordinate of the sample
- * @param w Width of the sample
- * @param h Height of the sample
+ * @abstract Body of the conversion thread
+ * @param args The dcraw command line options
  */
-- (void) getPPMsample:(u_short*)data 
-                  atX:(u_short)x Y:(u_short)y 
-                    W:(u_short)w H:(u_short)h;
-@end
-
-@implementation DcrawCustomImage(Private)
-
-- (void) saveAsPgm
-{
-   NSUserDefaults *pref = [NSUserDefaults standardUserDefaults];
-   int cnt;
-   const char *tmpdir = NULL;
-   FILE *pgmFile;
-   u_short x, y;
-
-   // Create a temporary filename for the PGM file
-   NSString *tmpdirStr = [pref stringForKey:K_TMPDIR_KEY];
-   if ( tmpdirStr != nil )
-      tmpdir = [[tmpdirStr stringByExpandingTildeInPath] UTF8String];
-   if ( tmpdir == NULL || *tmpdir == '\0' )
-      tmpdir = getenv("TMPDIR");
-   if ( tmpdir == NULL || *tmpdir == '\0' )
-      tmpdir = "/tmp";
-   // with a count suffix shared by all documents
-   cnt = [pref integerForKey:K_COUNTER_KEY] % 10000;
-   _pgmFilePath = [[NSString stringWithFormat:@"%s/dark%04d.pgm",
-                    tmpdir, cnt] retain];
-   cnt++;
-   [pref setInteger:cnt forKey:K_COUNTER_KEY];
-
-   pgmFile = fopen([_pgmFilePath fileSystemRepresentation], "wb");
-
-   fprintf( pgmFile, "P5\n" );
+- (void) convertWithArguments:(NSArray*)args ;
 
-   fprintf( pgmFile, "%d %d\n", _w, _h );
-   fprintf( pgmFile, "%d\n", 65535 );
+/*!
+ * @abstract Release the converted image
+ * @discussion Called with the conversion condition locked.
+ */
+- (void) evictConversion ;
 
-   for( y = 0; y < _h; y++ )
-   {
-      for( x = 0; x < _w; x++ )
-      {
-         REAL v = GET_SAMPLE(_data,x,y,_padw);
-         u_short outValue;
+/*!
+ * @abstract Evict the least recently used images until there is room in
+ *    the pool for this reader image
+ * @discussion Called with the conversion condition locked. The images being
+ *    read are never evicted. The images converted ahead, and not yet read,
+ *    are evicted only for an image which is read now.
+ * @param onDemand Whether the image is read now
+ * @result Whether the room was made
+ */
+- (BOOL) makeRoomInPool:(BOOL)onDemand ;
 
-         if ( v < 0.0 )
-            v = 0.0;
-         else if ( v > 65535.0 )
-            v = 65535.0;
+/*!
+ * @abstract Convert in advance the images asked by prefetchImage
+ * @discussion Called with the conversion condition locked. The images are
+ *    converted in the order of the requests, as long as there is room in the
+ *    pool.
+ */
++ (void) convertAhead ;
 
-         outValue = NSSwapHostShortToBig((u_short)(v+0.5));
+/*!
+ * @abstract Get the converted image, converting it if needed
+ * @discussion The image cannot be evicted until unlockPixels is called.
+ * @result The converted samples, or NULL if the conversion failed
+ */
+- (const u_short*) lockPixels ;
 
-         fwrite( &outValue, 1, 2, pgmFile );
-      }
-   }
-   
-   fclose( pgmFile );
-}
+/*!
+ * @abstract Allow the converted image to be evicted
+ */
+- (void) unlockPixels ;
 
+/*!
+ * @abstract Drop the converted image, if any, after a settings change
+ */
+- (void) invalidateConversion ;
 @end
 
 @implementation DcrawCustomImage
@@ -153,32 +193,47 @@ static BOOL isWaitingConversion = NO;
 {
    self = [super init];
    if ( self != nil )
-      _pgmFilePath = nil;
+      _rawSamples = NULL;
 
    return( self );
 }
 
 - (void) dealloc
 {
-   NSError *err;
-
-   if ( _pgmFilePath != nil )
-   {
-      if ( ![[NSFileManager defaultManager] removeItemAtURL:
-                                            [NSURL fileURLWithPath:_pgmFilePath]
-                                                  error:&err] )
-      NSLog( @"Could not remove temporary raw saved dark image %@. %@", _pgmFilePath, [err description]);
-   }
+   if ( _rawSamples != NULL )
+      free( _rawSamples );
 
    [super dealloc];
 }
 
-- (NSString*) fileName
+- (const u_short*) rawSamples
 {
-   if ( _pgmFilePath == nil )
-      [self saveAsPgm];
+   @synchronized(self)
+   {
+      if ( _rawSamples == NULL )
+      {
+         u_short x, y;
+
+         _rawSamples = (u_short*)malloc( (u_long)_w*_h*sizeof(u_short) );
+
+         for( y = 0; y < _h; y++ )
+         {
+            for( x = 0; x < _w; x++ )
+            {
+               REAL v = GET_SAMPLE(_data,x,y,_padw);
+
+               if ( v < 0.0 )
+                  v = 0.0;
+               else if ( v > 65535.0 )
+                  v = 65535.0;
 
-   return( _pgmFilePath );
+               _rawSamples[(u_long)y*_w+x] = (u_short)(v+0.5);
+            }
+         }
+      }
+   }
+
+   return( _rawSamples );
 }
 
 - (void) calibrateWithDarkFrame:(LynkeosImageBuffer*)darkFrame
@@ -193,411 +248,350 @@ static BOOL isWaitingConversion = NO;
 @end
 
 @implementation DcrawReader(Private)
-- (void) delayedLaunch:(NSTimer*)timer
+- (int) identify:(dcraw_image_t*)info asMosaic:(BOOL)mosaic
 {
-   _conversionTimer = nil;
-   [self launchConversion];
-}
+   const char *argv[6];
+   int argc = 0;
 
-- (void) getImageInfo
-{
-   NSAssert(_mode != UnsetListMode, @"Attempt to get image info without mode set");
-
-   // Prepare a task
-   NSTask *infoTask = [[NSTask alloc] init];
-
-   NSAssert(infoTask != nil, @"Failed to create a task to get RAW info");
-
-   // Set its executable path to dcraw in our ressources
-   NSString *dcrawPath = [[NSBundle bundleForClass:[self class]] pathForResource:@"dcraw"
-                                                                          ofType:nil];
-   [infoTask setLaunchPath:dcrawPath];
-
-   // Connect its output to a pipe
-   NSPipe *infoPipe = [NSPipe pipe];
-   [infoTask setStandardOutput:infoPipe];
-
-   // Options : "verbose informations"
-   NSMutableArray *args = [NSMutableArray arrayWithObjects: @"-i", @"-v", nil];
+   // Options : "identify"
+   argv[argc++] = "dcraw";
+   argv[argc++] = "-i";
    // And maybe no image rotation
-   if ( _mode == DarkFrameMode ||
+   if ( mosaic || _mode == DarkFrameMode ||
         ![[NSUserDefaults standardUserDefaults] boolForKey:K_ROTATION_KEY] )
    {
-      [args addObject:@"-t"];
-      [args addObject:@"0"];
+      argv[argc++] = "-t";
+      argv[argc++] = "0";
    }
+   // Nor any resampling of the mosaic
+   if ( mosaic )
+      argv[argc++] = "-j";
 
    // The last arg is the file to convert
-   [args addObject:[_url path]];
+   argv[argc++] = [[_url path] fileSystemRepresentation];
 
-   [infoTask setArguments:args];
+   return( dcraw_process( argc, argv, NULL, info ) );
+}
 
-   // Run to get the information
-   [infoTask launch];
+- (void) getImageInfo
+{
+   NSAssert(_mode != UnsetListMode, @"Attempt to get image info without mode set");
 
-   // Read the output
-   NSData *info = [[infoPipe fileHandleForReading] readDataToEndOfFile];
+   const BOOL mosaic = ( _mode != DarkFrameMode &&
+                         [[NSUserDefaults standardUserDefaults] boolForKey:K_BAYER_KEY] );
+   dcraw_image_t info;
+   int status = [self identify:&info asMosaic:mosaic];
 
-   while ([infoTask isRunning])
+   _isBayer = NO;
+   _bayerFormat = SER_MONO;
+   if ( mosaic && status == 0 )
    {
-      if (progressSession != nil)
-         [NSApp runModalSession:progressSession];
-      [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+      _bayerFormat = bayerFormat( &info, _bayerPlanes );
+      _isBayer = (_bayerFormat != SER_MONO);
+
+      // Otherwise, the colors will be interpolated by dcraw
+      if ( !_isBayer )
+         status = [self identify:&info asMosaic:NO];
    }
 
-   NSAssert( [infoTask terminationStatus] == 0,
-             @"Could not get information on %@", _url );
-   [infoTask release];
-
-   // Scan the output to find the image information
-   NSScanner *scan = [NSScanner scannerWithString:
-                         [[[NSString alloc] initWithData:info
-                                                encoding:NSUTF8StringEncoding]
-                                                                  autorelease]];
-   [scan setCharactersToBeSkipped:[NSCharacterSet whitespaceCharacterSet]];
-   BOOL success = YES;
-   int w = 0, h = 0;
-   while ( success && ![scan isAtEnd] )
+   NSAssert( status == 0, @"Could not get information on %@", _url );
+
+   _width = info.out_width;
+   _height = info.out_height;
+   _baseWidth = info.width;
+   _baseHeight = info.height;
+
+   [_metadata setObject:[NSString stringWithFormat:@"%s %s", info.make, info.model]
+                 forKey:LynkeosMD_CameraModel()];
+   if ( info.shutter > 0.0 )
+      [_metadata setObject:[NSNumber numberWithDouble:info.shutter]
+                    forKey:LynkeosMD_ExposureTime()];
+   if ( info.aperture > 0.0 )
+      [_metadata setObject:[NSNumber numberWithDouble:info.aperture]
+                    forKey:LynkeosMD_Aperture()];
+   if ( info.iso_speed > 0.0 )
+      [_metadata setObject:[NSNumber numberWithInt:(int)info.iso_speed]
+                    forKey:LynkeosMD_ISOSpeed()];
+   // TODO : get the remaining info
+}
+
+- (NSArray*) conversionArguments
+{
+   NSUserDefaults *prefs = [NSUserDefaults standardUserDefaults];
+
+   // Common option to DCRAW is : "16 bits linear"
+   NSMutableArray *args = [NSMutableArray arrayWithObject: @"-4"];
+
+   switch ( _mode )
    {
-      NSString *token, *marker = @":";
+      case DarkFrameMode:
+         // Dark frames are extracted without rotation,
+         [args addObject:@"-t"];
+         [args addObject:@"0"];
+         // in "raw document mode"
+         [args addObject:@"-D"];
+         break;
 
-      // Get to the start of the next token
-      [scan scanUpToCharactersFromSet:[NSCharacterSet alphanumericCharacterSet]
-                           intoString:NULL];
+      case ImageMode:
+         // The dark frame is given in memory to the decoder
 
-      success = [scan scanUpToString:marker intoString:&token];
-      if ( success )
-         success = [scan scanString:marker intoString:NULL];
+         // Fall through to options common with flat field
 
-      if ( success )
-      {
-         if ( [token isEqualToString:@"Output size"] )
+      case FlatFieldMode:
+         // User preferences options
+
+         if ( _isBayer )
          {
-            if ( [scan scanInt:&w]
-                 && [scan scanString:@"x" intoString:NULL]
-                 && [scan scanInt:&h] )
-            {
-               _width = w;
-               _height = h;
-            }
+            // The mosaic, neither rotated nor resampled
+            [args addObject:@"-t"];
+            [args addObject:@"0"];
+            [args addObject:@"-j"];
+            [args addObject:@"-d"];
          }
-         else if ( [token isEqualToString:@"Image size"] )
+         // Image rotation
+         else if ( ![prefs boolForKey:K_ROTATION_KEY] )
          {
-            if ( [scan scanInt:&w]
-                 && [scan scanString:@"x" intoString:NULL]
-                 && [scan scanInt:&h] )
-            {
-               _baseWidth = w;
-               _baseHeight = h;
-            }
+            // Or not
+            [args addObject:@"-t"];
+            [args addObject:@"0"];
          }
-         else if ( [token isEqualToString:@"Camera"] )
-         {
-            NSString *camera;
-            if ([scan scanUpToCharactersFromSet: [NSCharacterSet newlineCharacterSet]
-                                     intoString: &camera])
-               [_metadata setObject: camera forKey: LynkeosMD_CameraModel()];
-         }
-         else if ( [token isEqualToString:@"Shutter"] )
-         {
-            double numerator, denominator;
-            if ( [scan scanDouble: &numerator] )
-            {
-               if ( [scan scanString:@"/" intoString:NULL] )
-               {
-                  if ( ![scan scanDouble: &denominator] )
-                     // Invalid format
-                     denominator = 0.0;
-               }
-               else
-                  denominator = 1.0;
-               if (denominator != 0.0)
-                  [_metadata setObject: [NSNumber numberWithDouble: numerator/denominator]
-                                forKey: LynkeosMD_ExposureTime()];
-            }
-         }
-         else if ( [token isEqualToString:@"Aperture"] )
+
+         if ( [prefs boolForKey:K_MANUALWB_KEY] )
          {
-            if ( [scan scanString:@"f/" intoString:NULL] )
-            {
-               double aperture;
-               if ( [scan scanDouble: &aperture] )
-                  [_metadata setObject: [NSNumber numberWithDouble: aperture]
-                                forKey: LynkeosMD_Aperture()];
-            }
+            // Custom white balance
+            [args addObject:@"-r"];
+            [args addObject:[prefs stringForKey:K_RED_KEY]];
+            [args addObject:[prefs stringForKey:K_GREEN1_KEY]];
+            [args addObject:[prefs stringForKey:K_BLUE_KEY]];
+            [args addObject:[prefs stringForKey:K_GREEN2_KEY]];
          }
-         else if ( [token isEqualToString:@"ISO speed"] )
+         else
+            [args addObject:@"-w"];    // Camera white balance
+
+         if ( [prefs boolForKey:K_LEVELS_KEY] )
          {
-            int iso;
-            if ( [scan scanInt:&iso] )
-                [_metadata setObject: [NSNumber numberWithInt:iso] forKey: LynkeosMD_ISOSpeed()];
+            // Custom dark and saturation levels
+            [args addObject:@"-k"];
+            [args addObject:[prefs stringForKey:K_DARK_KEY]];
+            [args addObject:@"-S"];
+            [args addObject:[prefs stringForKey:K_SATURATION_KEY]];
          }
-         // TODO : get the remaining info
-
-         [scan scanUpToCharactersFromSet: [NSCharacterSet newlineCharacterSet]
-                              intoString: NULL];
-      }
+         break;
+      default:
+         NSAssert(NO, @"Invalid image mode %d", _mode );
+         break;
    }
+
+   // The last arg is the file to convert
+   [args addObject:[_url path]];
+
+   return( args );
 }
 
 - (void) launchConversion
 {
    NSAssert(_mode != UnsetListMode, @"Cannot convert without the mode");
+   NSAssert( _conversionState == ConversionIdle,
+             @"Conversion launched twice" );
 
-   // Abort ongoing conversion, if any
-   if (_dcrawTask != nil && [_dcrawTask isRunning] )
-   {
-      [_dcrawTask terminate];
-      [_dcrawTask waitUntilExit];
-      [_dcrawTask release];
-      _dcrawTask = nil;
-      [ongoingConversions removeObject:self];
-   }
+   if ( _mode == ImageMode && _dark != nil )
+      _conversionDark = [_dark retain];
 
-   // Start the conversion if one cpu is available
-   if (ongoingConversions.count < maxConversions)
-   {
-      // OK go on
-      // Prepare a task for the conversion
-      _dcrawTask = [[NSTask alloc] init];
-
-      if ( _dcrawTask != nil )
-      {
-         NSFileManager *fileMgr = [NSFileManager defaultManager];
-         NSUserDefaults *prefs = [NSUserDefaults standardUserDefaults];
-
-         // Set its executable path to dcraw in our ressources
-         NSString *dcrawPath
-            = [[NSBundle bundleForClass:[self class]] pathForResource:@"dcraw"
-                                                               ofType:nil];
-         [_dcrawTask setLaunchPath:dcrawPath];
+   _conversionState = ConversionRunning;
+   runningConversions++;
 
-         // Create an empty file by this name
-         [fileMgr createFileAtPath:_ppmFilePath contents:nil attributes:nil];
-         [_dcrawTask setStandardOutput: [NSFileHandle fileHandleForWritingAtPath:_ppmFilePath]];
-
-         // Common option to DCRAW is : "output on stdout, 16 bits" PPM"
-         NSMutableArray *args = [NSMutableArray arrayWithObjects: @"-c", @"-4", nil];
-
-         switch ( _mode )
-         {
-            case DarkFrameMode:
-               // Dark frames are extracted without rotation,
-               [args addObject:@"-t"];
-               [args addObject:@"0"];
-               // in "raw document mode"
-               [args addObject:@"-D"];
-               break;
-
-            case ImageMode:
-               if ( _dark != nil )
-               {
-                  // Dark frame option
-                  [args addObject:@"-K"];
-                  [args addObject:[(DcrawCustomImage*)_dark fileName]];
-               }
-
-               // Fall through to options common with flat field
-            
-            case FlatFieldMode:
-               // User preferences options
+   [NSThread detachNewThreadSelector:@selector(convertWithArguments:)
+                            toTarget:self
+                          withObject:[self conversionArguments]];
+}
 
-               // Image rotation
-               if ( ![prefs boolForKey:K_ROTATION_KEY] )
-               {
-                  // Or not
-                  [args addObject:@"-t"];
-                  [args addObject:@"0"];
-               }
+- (void) convertWithArguments:(NSArray*)args
+{
+   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+   const int argc = (int)[args count] + 1;
+   const char **argv = (const char**)malloc( argc*sizeof(char*) );
+   dcraw_dark_t dark, *darkPtr = NULL;
+   dcraw_image_t result;
+   int i, status;
+
+   argv[0] = "dcraw";
+   for( i = 1; i < argc; i++ )
+      argv[i] = [[args objectAtIndex:i-1] fileSystemRepresentation];
+
+   if ( _conversionDark != nil )
+   {
+      dark.data = [(DcrawCustomImage*)_conversionDark rawSamples];
+      dark.width = _conversionDark->_w;
+      dark.height = _conversionDark->_h;
+      darkPtr = &dark;
+   }
 
-               if ( [prefs boolForKey:K_MANUALWB_KEY] )
-               {
-                  // Custom white balance
-                  [args addObject:@"-r"];
-                  [args addObject:[prefs stringForKey:K_RED_KEY]];
-                  [args addObject:[prefs stringForKey:K_GREEN1_KEY]];
-                  [args addObject:[prefs stringForKey:K_BLUE_KEY]];
-                  [args addObject:[prefs stringForKey:K_GREEN2_KEY]];
-               }
-               else
-                  [args addObject:@"-w"];    // Camera white balance
+   status = dcraw_process( argc, argv, darkPtr, &result );
+   free( argv );
 
-               if ( [prefs boolForKey:K_LEVELS_KEY] )
-               {
-                  // Custom dark and saturation levels
-                  [args addObject:@"-k"];
-                  [args addObject:[prefs stringForKey:K_DARK_KEY]];
-                  [args addObject:@"-S"];
-                  [args addObject:[prefs stringForKey:K_SATURATION_KEY]];
-               }
-               break;
-            default:
-               NSAssert(NO, @"Invalid image mode %d", _mode );
-               break;
-         }
+   if ( status == 0
+        && (result.out_width != _width || result.out_height != _height
+            || result.colors != _pixelPlanes) )
+   {
+      NSLog( @"Image size inconsistent after conversion of %@", _url );
+      free( result.data );
+      status = 1;
+   }
+   else if ( status != 0 )
+      NSLog( @"Could not convert %@", _url );
 
-         // The last arg is the file to convert
-         [args addObject:[_url path]];
+   [conversionCondition lock];
+   if ( status == 0 )
+   {
+      _pixels = result.data;
+      _dataMax = result.maximum;
+      [LynkeosMemoryBudget allocatedMemory:
+                      (u_long)_width*_height*_pixelPlanes*sizeof(u_short)];
+   }
+   // A failed conversion stays in the pool, it will be read as black
+   _conversionState = ConversionDone;
+   [convertedPool addObject:self];
+   [_conversionDark release];
+   _conversionDark = nil;
+   runningConversions--;
 
-         [_dcrawTask setArguments:args];
+   // Keep the processors busy
+   [DcrawReader convertAhead];
 
-         // Start the conversion
-         [_dcrawTask launch];
+   [conversionCondition broadcast];
+   [conversionCondition unlock];
 
-         [ongoingConversions addObject:self];
+   [pool release];
+}
 
-         NSAssert( _dcrawTask != nil && ([_dcrawTask isRunning] || [_dcrawTask terminationStatus] == 0),
-                  @"Could not start the conversion of %@", _url );
-      }
-   }
-   else
-   {
-      // Nope, queue it for later processing
-      [pendingConversions addObject:self];
-   }
+- (void) evictConversion
+{
+   NSAssert( _conversionState == ConversionDone && _pixelsUsers == 0,
+             @"Eviction of an image in use" );
 
-   // Schedule waiting for conversion end, but letting time to coalesce several conversions
-   if ( !isWaitingConversion )
+   if ( _pixels != NULL )
    {
-      if (convWaitTimer != nil)
-         [convWaitTimer invalidate];
-
-      convWaitTimer = [NSTimer scheduledTimerWithTimeInterval:0.5 repeats:NO block:
-                       ^(NSTimer *timer)
-                       {
-                          isWaitingConversion = YES;
-                          convWaitTimer = nil;
-
-                          [progressIndicator stopAnimation:self];
-                          progressIndicator.indeterminate = NO;
-
-                          while (ongoingConversions.count > 0)
-                          {
-                             DcrawReader *firstConv = [ongoingConversions objectAtIndex:0];
-                             [firstConv waitForConversion];
-                          }
-
-                          isWaitingConversion = NO;
-                       }];
+      [LynkeosMemoryBudget freedMemory:
+                      (u_long)_width*_height*_pixelPlanes*sizeof(u_short)];
+      free( _pixels );
+      _pixels = NULL;
    }
+   _conversionState = ConversionIdle;
+   [convertedPool removeObject:self];
 }
 
-- (void) waitForConversion
+- (BOOL) makeRoomInPool:(BOOL)onDemand
 {
-   // If the conversion is not finished, wait for its completion
-   if (  _dcrawTask != nil )
+   const u_long imageSize = (u_long)_width*_height*_pixelPlanes
+                            *sizeof(u_short);
+   NSUInteger capacity = K_RAW_POOL_MEMORY/imageSize;
+   NSUInteger i;
+   BOOL evictAhead;
+
+   if ( capacity > 2*numberOfCpus+1 )
+      capacity = 2*numberOfCpus+1;
+   if ( capacity < numberOfCpus+1 )
+      capacity = numberOfCpus+1;
+
+   // The images converted ahead go last, they may have been abandoned
+   for( evictAhead = NO; evictAhead <= onDemand; evictAhead++ )
    {
-      FILE *ppmFile;
-
-      if ( [_dcrawTask isRunning] )
+      for( i = 0;
+           [convertedPool count] + runningConversions >= capacity
+           && i < [convertedPool count]; )
       {
-         // For a reason not fully understood, we shall wait a bit before
-         // setting the cursor to a watch icon
-         [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
-         [watchCursor push];
+         DcrawReader *reader = [convertedPool objectAtIndex:i];
 
-         while ([_dcrawTask isRunning])
+         if ( reader->_pixelsUsers == 0
+              && (!reader->_aheadRequested || evictAhead) )
          {
-            if (progressSession != nil)
-               [NSApp runModalSession: progressSession];
-            [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+            reader->_aheadRequested = NO;
+            [reader evictConversion];
          }
-
-         [NSCursor pop];
-      }
-       // Todo: run code after dcraw finished processing - domnt poll !
-       
-      // When succesful, initialize the PPM file info
-      if ( [_dcrawTask terminationStatus] == 0 )
-      {
-         char line[40];
-         u_short w, h;
-
-         ppmFile = fopen( [_ppmFilePath fileSystemRepresentation], "rb" );
-
-         fgets( line, 40, ppmFile ); // First line of input "P5" or "P6"
-         if ( strcmp( "P5\n", line ) == 0 )
-            NSAssert( _numberOfPlanes == 1,
-                      @"Number of planes inconsistent after conversion" );
-         else if ( strcmp( "P6\n", line ) == 0 )
-            NSAssert( _numberOfPlanes == 3,
-                      @"Number of planes inconsistent after conversion" );
-
-         fgets( line, 40, ppmFile ); // Second line "w h"
-         NSAssert( sscanf( line, "%hu %hu", &w, &h ) == 2,
-                   @"Cannot read image size after conversion" );
-         NSAssert( w == _width && h == _height,
-                   @"Image size inconsistent after conversion" );
-         fgets( line, 40, ppmFile ); // Third line "max"
-         if ( sscanf( line, "%hu", &_dataMax ) != 1 )
-            _dataMax = 0;
-
-         _ppmDataOffset = ftell( ppmFile );
-
-         // Don(t keep the file open, it may overflow the maximum number of open
-         // file descriptors
-         fclose( ppmFile );
+         else
+            i++;
       }
+   }
 
-      // Anyway, the task has ended
-      [_dcrawTask release];
-      _dcrawTask = nil;
+   return( [convertedPool count] + runningConversions < capacity );
+}
 
-      [ongoingConversions removeObject:self];
-      progressIndicator.doubleValue += 1.0;
++ (void) convertAhead
+{
+   while ( [aheadQueue count] != 0 && runningConversions < maxConversions )
+   {
+      DcrawReader *reader = [aheadQueue objectAtIndex:0];
 
-      // Find the next image to convert, if any
-      DcrawReader *nextReader = nil;
-      if ([pendingConversions count] != 0)
+      // It may have been read, or invalidated, meanwhile
+      if ( reader->_aheadRequested
+           && reader->_conversionState == ConversionIdle )
       {
-         nextReader = (DcrawReader*)[pendingConversions objectAtIndex:0];
-         [pendingConversions removeObjectAtIndex:0];
-      }
-      // Start the next conversion, if any
-      if (nextReader != nil)
-         [nextReader launchConversion];
-
-      // When finished, remove the loading progress panel
-      if (ongoingConversions.count == 0 && pendingConversions.count == 0)
-      {
-//         [NSApp runModalSession:progressSession];
-//         [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
-         if (progressSession != nil)
-         {
-            [NSApp endModalSession:progressSession];
-            progressSession = nil;
-         }
-         [progressPanel close];
+         if ( ![reader makeRoomInPool:NO] )
+            break;
+         [reader launchConversion];
       }
+      [aheadQueue removeObjectAtIndex:0];
    }
 }
 
-- (void) getPPMsample:(u_short*)data 
-                  atX:(u_short)x Y:(u_short)y 
-                    W:(u_short)w H:(u_short)h
+- (const u_short*) lockPixels
 {
-   FILE * ppmFile;
+   const u_short *pixels;
 
-   [self waitForConversion];
+   NSAssert(_mode != UnsetListMode, @"Attempt to read an image without mode");
 
-   // Open and close the file at each read, to keep open file descriptors number low
-   ppmFile = fopen( [_ppmFilePath fileSystemRepresentation], "rb");
-   if( ppmFile != NULL )
+   [conversionCondition lock];
+
+   _pixelsUsers++;
+   _aheadRequested = NO;
+   if ( _conversionState == ConversionIdle )
    {
-      u_short ys;
+      // The requested image is converted, even if the pool is full
+      [self makeRoomInPool:YES];
+      [self launchConversion];
+   }
+   else if ( _conversionState == ConversionDone )
+   {
+      // Now the most recently used
+      [convertedPool removeObject:self];
+      [convertedPool addObject:self];
+   }
 
-      // Transfer "w" pixels from "h" lines
-      for( ys = 0; ys < h; ys++ )
-      {
-         // Jump to the line start
-         fseek( ppmFile,
-                _ppmDataOffset + sizeof(u_short)*_numberOfPlanes*((y+ys)*_width+x),
-                SEEK_SET );
-         fread( &data[ys*w*_numberOfPlanes], _numberOfPlanes*sizeof(u_short), w, ppmFile );
-      }
+   [DcrawReader convertAhead];
+
+   while ( _conversionState == ConversionRunning )
+      [conversionCondition wait];
+
+   pixels = _pixels;
+
+   [conversionCondition unlock];
+
+   return( pixels );
+}
 
-      fclose( ppmFile );
+- (void) unlockPixels
+{
+   [conversionCondition lock];
+   NSAssert( _pixelsUsers > 0, @"Unbalanced unlock of raw pixels" );
+   _pixelsUsers--;
+   if ( _pixelsUsers == 0 )
+   {
+      // Some room may have been waited for
+      [DcrawReader convertAhead];
+      [conversionCondition broadcast];
    }
+   [conversionCondition unlock];
+}
+
+- (void) invalidateConversion
+{
+   [conversionCondition lock];
+   while ( _conversionState == ConversionRunning || _pixelsUsers != 0 )
+      [conversionCondition wait];
+   _aheadRequested = NO;
+   if ( _conversionState == ConversionDone )
+      [self evictConversion];
+   [conversionCondition unlock];
 }
 @end
 
@@ -610,22 +604,11 @@ static BOOL isWaitingConversion = NO;
 
 + (void) initialize
 {
-    
-   pendingConversions = [[NSMutableArray alloc] init];
-   ongoingConversions = [[NSMutableArray alloc] init];
-   maxConversions = numberOfCpus + 1;
-
-   progressPanel = [[NSPanel alloc] initWithContentRect:NSMakeRect(0.0, 0.0, 250.0, 50.0)
-                                              styleMask:NSWindowStyleMaskTitled
-                                                backing:NSBackingStoreBuffered
-                                                  defer:YES];
-   progressPanel.title = @"Converting RAW image";
-   progressPanel.releasedWhenClosed = NO;
-   progressIndicator = [[NSProgressIndicator alloc] initWithFrame:NSMakeRect(0.0, 0.0, 250.0, 50.0)];
-   progressIndicator.style = NSProgressIndicatorStyleBar;
-   progressIndicator.minValue = 0.0;
-   progressIndicator.usesThreadedAnimation = YES;
-   progressPanel.contentView = progressIndicator;
+   conversionCondition = [[NSCondition alloc] init];
+   // The queues do not retain the readers, which leave them when deallocated
+   aheadQueue = (NSMutableArray*)CFArrayCreateMutable( NULL, 0, NULL );
+   convertedPool = (NSMutableArray*)CFArrayCreateMutable( NULL, 0, NULL );
+   maxConversions = numberOfCpus;
 }
 
 + (void) lynkeosFileTypes:(NSArray**)fileTypes
@@ -675,19 +658,24 @@ static BOOL isWaitingConversion = NO;
    if ( self != nil )
    {
       _url = nil;
-      _dcrawTask = nil;
-      _ppmFilePath = nil;
-      _ppmDataOffset = 0;
+      _conversionState = ConversionIdle;
+      _pixelsUsers = 0;
+      _aheadRequested = NO;
+      _pixels = NULL;
+      _conversionDark = nil;
       _dataMax = 0;
       _width = 0;
       _height = 0;
       _baseWidth = 0;
       _baseHeight = 0;
       _numberOfPlanes = 0;
+      _pixelPlanes = 0;
+      _isBayer = NO;
+      _bayerFormat = SER_MONO;
       _mode = UnsetListMode;
       _dark = nil;
+      _flat = nil;
       _metadata = [[NSMutableDictionary dictionary] retain];
-      _conversionTimer = nil;
    }
    return( self );
 }
@@ -706,99 +694,45 @@ static BOOL isWaitingConversion = NO;
    }
 
    if ( self != nil )
-   {
       _url = [url retain];
 
-      // If not yet done, pop the load progress panel
-      if ( progressSession == nil )
-      {
-         progressIndicator.maxValue = 0.0;
-         progressIndicator.doubleValue = 0.0;
-         progressIndicator.indeterminate = YES;
-         [progressIndicator startAnimation:self];
-         progressSession = [NSApp beginModalSessionForWindow: progressPanel];
-         [progressIndicator sizeToFit];
-      }
-      else
-         [NSApp runModalSession:progressSession];
-
-      // Count the ongoing conversions
-      progressIndicator.maxValue += 1.0;
-   }
-
    return( self );
 }
 
 - (void) dealloc
 {
-   NSError *err;
-
-   if ( _dcrawTask != nil )
+   // The conversion thread retains us, it cannot be running here
+   [conversionCondition lock];
+   [aheadQueue removeObjectIdenticalTo:self];
+   [convertedPool removeObject:self];
+   [conversionCondition unlock];
+   [_conversionDark release];
+   if ( _pixels != NULL )
    {
-      if ( [_dcrawTask isRunning] )
-         [_dcrawTask terminate];
-      [_dcrawTask release];
-   }
-
-   if ( _ppmFilePath != nil )
-   {
-      if ( ![[NSFileManager defaultManager] removeItemAtURL:
-                                            [NSURL fileURLWithPath:_ppmFilePath]
-                                                      error:&err] )
-         NSLog( @"Could not remove temporary raw converted image %@. %@", _ppmFilePath, [err description]);
+      [LynkeosMemoryBudget freedMemory:
+                      (u_long)_width*_height*_pixelPlanes*sizeof(u_short)];
+      free( _pixels );
    }
 
+   [_flat release];
    [_metadata release];
    if ( _url != nil )
       [_url release];
 
-   if (_conversionTimer != nil)
-      [_conversionTimer invalidate];
    [super dealloc];
 }
 
 - (void) setMode:(ListMode_t)mode
 {
-   NSFileManager *fileMgr = [NSFileManager defaultManager];
-   NSUserDefaults *pref = [NSUserDefaults standardUserDefaults];
-   int cnt;
-   const char *tmpdir = NULL;
+   [self invalidateConversion];
 
    _mode = mode;
 
-   // Create a temporary filename for the converted PPM
-   NSString *tmpdirStr = [pref stringForKey:K_TMPDIR_KEY];
-   if ( tmpdirStr != nil )
-      tmpdir = [[tmpdirStr stringByExpandingTildeInPath] UTF8String];
-   if ( tmpdir == NULL || *tmpdir == '\0' )
-      tmpdir = getenv("TMPDIR");
-   if ( tmpdir == NULL || *tmpdir == '\0' )
-      tmpdir = "/tmp";
-   // with a count suffix shared by all documents
-   cnt = [pref integerForKey:K_COUNTER_KEY] % 10000;
-   _ppmFilePath = [[NSString stringWithFormat:@"%s/%@%04d.%s",
-                                        tmpdir,
-                                        [fileMgr displayNameAtPath:[_url path]],
-                                        cnt,
-                                        (mode == DarkFrameMode ? "pgm" : "ppm")]
-                   retain];
-   cnt++;
-   [pref setInteger:cnt forKey:K_COUNTER_KEY];
-
    // Retrieve image information
    [self getImageInfo];
    _numberOfPlanes = (mode == DarkFrameMode ? 1 : 3);
+   _pixelPlanes = (mode == DarkFrameMode || _isBayer ? 1 : 3);
    _dataMax = 65535;
-
-   // Schedule the conversion, letting time for the dark frame if not aleady set
-   if ( _dark == nil )
-      _conversionTimer = [NSTimer scheduledTimerWithTimeInterval:0.1
-                                                          target:self
-                                                        selector:@selector(delayedLaunch:)
-                                                        userInfo:nil
-                                                         repeats:NO];
-   else
-      [self launchConversion];
 }
 
 - (void) setDarkFrame:(LynkeosImageBuffer*)dark
@@ -806,24 +740,21 @@ static BOOL isWaitingConversion = NO;
    NSAssert( dark == nil || _mode == ImageMode || _mode == UnsetListMode,
              @"Inconsistent combination of image mode and calibration frames" );
 
-   _dark = dark;
+   // An image converted without this dark frame is now obsolete
+   if ( dark != _dark )
+      [self invalidateConversion];
 
-   if ( _mode != UnsetListMode )
-   {
-      // We got the dark frame, and the mode is set : convert
-      // But don't forget to cancel the scheduled conversion, if any
-      if (_conversionTimer != nil)
-      {
-         [_conversionTimer invalidate];
-         _conversionTimer = nil;
-      }
-      [self launchConversion];
-   }
+   _dark = dark;
 }
 
 - (void) setFlatField:(LynkeosImageBuffer*)flat
 {
-   // We don't care ;o)
+   // Only the Bayer mosaic needs it, other images are calibrated by the core
+   if ( flat != _flat )
+   {
+      [_flat release];
+      _flat = [flat retain];
+   }
 }
 
 - (void) imageWidth:(u_short*)w height:(u_short*)h
@@ -872,7 +803,6 @@ static BOOL isWaitingConversion = NO;
    if ( bitmap != nil )
    {
       u_char *pixels = (u_char*)[bitmap bitmapData];
-      u_short *sample = (u_short*)malloc( sizeof(u_short)*_numberOfPlanes*_width*_height );
       u_long x, y, p;
       double scale =  256.0 / ((double)_dataMax + 1.0);
       int bpp = (int)[bitmap bitsPerPixel];
@@ -881,20 +811,44 @@ static BOOL isWaitingConversion = NO;
       NSAssert( (bpp%8) == 0, @"Hey, I do not intend to work on non byte boudaries" );
       bpp /= 8;
 
-      [self getPPMsample:sample atX:0 Y:0 W:_width H:_height];
+      const u_short *raw = [self lockPixels];
 
       for( y = 0; y < _height; y++ )
       {
          for( x = 0; x < _width; x++ )
          {
-            u_short *v = &sample[(y*_width+x)*_numberOfPlanes];
+            if ( raw != NULL && _isBayer )
+            {
+               // Show each 2x2 cell of the mosaic in its colors
+               const u_short cx = (x < (_width & ~1) ? x & ~1 : _width - 2);
+               const u_short cy = (y < (_height & ~1) ? y & ~1 : _height - 2);
+               u_long sum[3] = {0, 0, 0};
+               u_short n[3] = {0, 0, 0}, xl, yl;
+
+               for( yl = cy; yl < cy+2; yl++ )
+               {
+                  for( xl = cx; xl < cx+2; xl++ )
+                  {
+                     p = _bayerPlanes[yl%2][xl%2];
+                     sum[p] += raw[yl*_width+xl];
+                     n[p]++;
+                  }
+               }
+               for ( p = 0 ; p < 3; p++ )
+                  pixels[y*bpr+x*bpp+p] = sum[p]/n[p]*scale;
+            }
+            else
+            {
+               const u_short *v = (raw != NULL ?
+                                   &raw[(y*_width+x)*_pixelPlanes] : NULL);
 
-            for ( p = 0 ; p < _numberOfPlanes; p++ )
-               pixels[y*bpr+x*bpp+p] = CFSwapInt16BigToHost(v[p])*scale;
+               for ( p = 0 ; p < _numberOfPlanes; p++ )
+                  pixels[y*bpr+x*bpp+p] = (v != NULL ? v[p]*scale : 0);
+            }
          }
       }
 
-      free( sample );
+      [self unlockPixels];
 
       image = [[[NSImage alloc] initWithSize:NSMakeSize(_width,_height)]
                                                                    autorelease];
@@ -916,41 +870,71 @@ static BOOL isWaitingConversion = NO;
               lineWidth:(u_short)lineW
 {
    const double scale = (_numberOfPlanes == 1 ? 1.0 : 1.0/256.0);
+   const u_short *raw;
    u_short xs, ys, cs;
-   u_short *ppmData;
 
    NSAssert( x+w <= _width && y+h <= _height, 
              @"Sample at least partly outside the image" );
 
-   ppmData = (u_short*)malloc( sizeof(u_short)*_numberOfPlanes*w*h );
+   if ( _isBayer )
+   {
+      // Interpolate the colors of the mosaic
+      const NSAffineTransformStruct ident = {1.0, 0.0, 0.0, 1.0, 0.0, 0.0};
+      LynkeosImageBuffer* customImage = [self getCustomImageSampleAtX:x Y:y W:w H:h
+                                                        withTransform:ident
+                                                          withOffsets:NULL];
+      [customImage convertToPlanar:sample withPlanes:nPlanes lineWidth:lineW];
+      return;
+   }
 
-   [self getPPMsample:ppmData atX:x Y:y W:w H:h];
+   raw = [self lockPixels];
+
+   if ( raw == NULL )
+   {
+      // Failed conversion
+      for( cs = 0; cs < nPlanes; cs++ )
+         for ( ys = 0; ys < h; ys++ )
+            memset( &sample[cs][ys*lineW], 0, w*sizeof(REAL) );
+      [self unlockPixels];
+      return;
+   }
 
    for ( ys = 0; ys < h; ys++ )
    {
+      const u_short *line = &raw[((u_long)(y+ys)*_width+x)*_pixelPlanes];
+
       for( xs = 0; xs < w; xs++ )
       {
-         if ( nPlanes == 1 && _numberOfPlanes != 1 )
-         {
-            u_short *v = &ppmData[(ys*w+xs)*_numberOfPlanes];
+         const u_short *v = &line[xs*_pixelPlanes];
 
+         if ( nPlanes == 1 && _numberOfPlanes != 1 )
             // Convert to monochrome
             SET_SAMPLE( sample[0],xs,ys,lineW,
-                        (CFSwapInt16BigToHost(v[0])
-                         +CFSwapInt16BigToHost(v[1])
-                         +CFSwapInt16BigToHost(v[2]))/3.0*scale );
-         }
+                        (v[0] + v[1] + v[2])/3.0*scale );
          else
          {
             for( cs = 0; cs < nPlanes; cs++ )
-               SET_SAMPLE( sample[cs],xs,ys,lineW,
-                           CFSwapInt16BigToHost(
-                              ppmData[(ys*w+xs)*_numberOfPlanes+cs])*scale );
+               SET_SAMPLE( sample[cs],xs,ys,lineW, v[cs]*scale );
          }
       }
    }
 
-   free( ppmData );
+   [self unlockPixels];
+}
+
+- (void) prefetchImage
+{
+   [conversionCondition lock];
+   if ( _mode != UnsetListMode && !_aheadRequested )
+   {
+      _aheadRequested = YES;
+      if ( _conversionState == ConversionIdle )
+      {
+         [aheadQueue addObject:self];
+         [DcrawReader convertAhead];
+      }
+   }
+   [conversionCondition unlock];
 }
 
 - (NSDictionary*) getMetaData 
@@ -963,6 +947,32 @@ static BOOL isWaitingConversion = NO;
                                       withTransform:(NSAffineTransformStruct)transform
                                         withOffsets:(const NSPoint*)offsets
 {
+   if ( _isBayer )
+   {
+      // The whole mosaic is needed for calibration and interpolation
+      const u_long size = (u_long)_width*_height;
+      REAL *imageData = (REAL*)malloc( size*sizeof(REAL) );
+      const u_short *raw = [self lockPixels];
+      LynkeosImageBuffer *image;
+      u_long i;
+
+      // Same scale as the interpolated images
+      for( i = 0; i < size; i++ )
+         imageData[i] = (raw != NULL ? raw[i]/256.0 : 0.0);
+
+      [self unlockPixels];
+
+      // The dark frame was already subtracted by dcraw
+      image = [[[SER_ImageBuffer alloc] initWithData:imageData format:_bayerFormat
+                                               width:_width lineW:_width height:_height
+                                                 atX:x Y:y W:w H:h
+                                       withTransform:transform withOffsets:offsets
+                                            withDark:nil withFlat:_flat] autorelease];
+      free( imageData );
+
+      return( image );
+   }
+
    // Only allow non-transformed image, LynkeosCore will re-call us without transformation,
    // and use an interpolator
    if (transform.m11 != 1.0 || transform.m12 != 0.0 || transform.m21 != 0.0 || transform.m22 != 1.0
@@ -28,8 +28,6 @@
 
 #include "LynkeosCore/LynkeosPreferences.h"
 
-//! Temporary directory used for image conversion
-extern NSString * const K_TMPDIR_KEY;
 //! Wether to use manual or automatic white balance
 extern NSString * const K_MANUALWB_KEY;
 //! Wether to rotate images according to their setting
@@ -48,6 +46,8 @@ extern NSString * const K_LEVELS_KEY;
 extern NSString * const K_DARK_KEY;
 //! Manual saturation (white) level
 extern NSString * const K_SATURATION_KEY;
+//! Wether to keep the Bayer mosaic instead of interpolating the colors
+extern NSString * const K_BAYER_KEY;
 
 /*!
  * @abstract Preferences for RAW files conversion
@@ -56,8 +56,6 @@ extern NSString * const K_SATURATION_KEY;
 {
    //! Our view inside the preferences window
    IBOutlet NSView*           _prefsView;
-   //! Text field for setting the temporary directory
-   IBOutlet NSTextField*      _tmpDirText;
    //! Check box for auto/manual white balance
    IBOutlet NSButton*         _manualWbButton;
    //! Checkbox for auto image rotation
@@ -76,9 +74,9 @@ extern NSString * const K_SATURATION_KEY;
    IBOutlet NSTextField*      _darkText;
    //! Text field for the saturation level
    IBOutlet NSTextField*      _saturationText;
+   //! Check box for keeping the Bayer mosaic
+   IBOutlet NSButton*         _bayerButton;
 
-   //! Temporary directory used for image conversion
-   NSString*                  _tmpDir;
    //! Wether to use manual or automatic white balance
    BOOL                       _manualWB;
    //! Wether to rotate images according to their setting
@@ -97,13 +95,10 @@ extern NSString * const K_SATURATION_KEY;
    double                     _dark;
    //! Manual saturation (white) level
    double                     _saturation;
+   //! Wether to keep the Bayer mosaic instead of interpolating the colors
+   BOOL                       _bayerMosaic;
 }
 
-/*!
- * @abstract Set the temporary directory
- * @param sender The GUI control sending this action
- */
-- (IBAction)changeTmpDir:(id)sender;
 /*!
  * @abstract Set auto or manual white balance
  * @param sender The GUI control sending this action
@@ -149,6 +144,11 @@ extern NSString * const K_SATURATION_KEY;
  * @param sender The GUI control sending this action
  */
 - (IBAction)changeSaturation:(id)sender;
+/*!
+ * @abstract Set whether to keep the Bayer mosaic
+ * @param sender The GUI control sending this action
+ */
+- (IBAction)changeBayerMosaic:(id)sender;
 
 @end
 
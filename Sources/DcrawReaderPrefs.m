@@ -22,7 +22,6 @@
 
 #include "DcrawReaderPrefs.h"
 
-NSString * const K_TMPDIR_KEY = @"RAW files conversion folder";
 NSString * const K_MANUALWB_KEY = @"RAW manual white balance";
 NSString * const K_RED_KEY = @"RAW red weight";
 NSString * const K_GREEN1_KEY = @"RAW first green weight";
@@ -32,6 +31,7 @@ NSString * const K_LEVELS_KEY = @"RAW manual levels";
 NSString * const K_DARK_KEY = @"RAW dark level";
 NSString * const K_SATURATION_KEY = @"RAW saturation level";
 NSString * const K_ROTATION_KEY = @"RAW image rotation";
+NSString * const K_BAYER_KEY = @"RAW Bayer mosaic";
 
 //! DcrawReaderPrefs singleton instance
 static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
@@ -52,7 +52,6 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
 - (void) initPrefs
 {
    // Set the factory defaults
-   _tmpDir = nil;
    _manualWB = NO;
    _autoRotation = YES;
    _red = 1.0;
@@ -61,21 +60,13 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
    _green2 = 1.0;
    _dark = -HUGE;
    _saturation = HUGE;
+   _bayerMosaic = NO;
 }
 
 - (void) readPrefs
 {
    NSUserDefaults *user = [NSUserDefaults standardUserDefaults];
-   NSFileManager *fileMgr = [NSFileManager defaultManager];
-   BOOL isDir;
-
-   _tmpDir = [user stringForKey:K_TMPDIR_KEY];
-   if ( _tmpDir != nil &&
-        (![fileMgr fileExistsAtPath:[_tmpDir stringByExpandingTildeInPath]
-                       isDirectory:&isDir]
-         || !isDir ) )
-      // Bad path
-      _tmpDir = nil;
+
    if ( [user objectForKey:K_MANUALWB_KEY] != nil )
       _manualWB = [user boolForKey:K_MANUALWB_KEY];
    if ( [user objectForKey:K_ROTATION_KEY] != nil )
@@ -87,14 +78,11 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
    _manualLevels = [user boolForKey:K_LEVELS_KEY];
    getNumericPref(&_dark, K_DARK_KEY, 0.0, 65536.0);
    getNumericPref(&_saturation, K_SATURATION_KEY, 0.0, 65536.0);
+   _bayerMosaic = [user boolForKey:K_BAYER_KEY];
 }
 
 - (void) updatePanel
 {
-   if ( _tmpDir != nil )
-      [_tmpDirText setStringValue:_tmpDir];
-   else
-      [_tmpDirText setStringValue:@""];
    [_manualWbButton setState:(_manualWB ? NSOnState : NSOffState)];
    [_autoRotationButton setState:(_autoRotation ? NSOnState : NSOffState)];
    [_redText setDoubleValue:_red];
@@ -104,6 +92,7 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
    [_manualLevelsButton setState:(_manualLevels ? NSOnState : NSOffState)];
    [_darkText setDoubleValue:_dark];
    [_saturationText setDoubleValue:_saturation];
+   [_bayerButton setState:(_bayerMosaic ? NSOnState : NSOffState)];
 
    [_redText setEnabled:_manualWB];
    [_green1Text setEnabled:_manualWB];
@@ -167,7 +156,6 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
 
 - (void) savePreferences:(NSUserDefaults*)prefs
 {
-   [prefs setObject:_tmpDir     forKey:K_TMPDIR_KEY];
    [prefs setBool:_manualWB     forKey:K_MANUALWB_KEY];
    [prefs setBool:_autoRotation forKey:K_ROTATION_KEY];
    [prefs setFloat:_red         forKey:K_RED_KEY];
@@ -177,6 +165,7 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
    [prefs setBool:_manualLevels forKey:K_LEVELS_KEY];
    [prefs setFloat:_dark        forKey:K_DARK_KEY];
    [prefs setFloat:_saturation  forKey:K_SATURATION_KEY];
+   [prefs setBool:_bayerMosaic  forKey:K_BAYER_KEY];
 }
 
 - (void) revertPreferences
@@ -192,31 +181,6 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
    [self updatePanel];
 }
 
-- (IBAction)changeTmpDir:(id)sender
-{
-   BOOL isDir;
-
-   if ( _tmpDir != nil )
-      [_tmpDir release];
-
-   _tmpDir = [sender stringValue];
-
-   if ( [_tmpDir length] <= 0
-        || ![[NSFileManager defaultManager] fileExistsAtPath:
-                                          [_tmpDir stringByExpandingTildeInPath]
-                       isDirectory:&isDir]
-         || !isDir )
-   {
-//      if ( [_tmpDir length] > 0 )
-         // Bad path
-//         SysBeep(1);
-      _tmpDir = nil;
-      [sender setStringValue:@""];
-   }
-   else
-      [_tmpDir retain];
-}
-
 - (IBAction)changeManualWB:(id)sender
 {
    _manualWB = ([sender state] == NSOnState);
@@ -264,4 +228,9 @@ static DcrawReaderPrefs *dcrawReaderPrefsInstance = nil;
 {
    _saturation = [sender doubleValue];
 }
+
+- (IBAction)changeBayerMosaic:(id)sender
+{
+   _bayerMosaic = ([sender state] == NSOnState);
+}
 @end
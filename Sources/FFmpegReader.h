@@ -30,6 +30,8 @@
 #ifndef __FFMPEGREADER_H
 #define __FFMPEGREADER_H
 
+#include <pthread.h>
+
 #include "LynkeosFileReader.h"
 
 #include <libavcodec/avcodec.h>
@@ -53,11 +55,41 @@ typedef struct
    int64_t timestamp;      //!< Timestamp of the key frame
 } KeyFrames_t;
 
+/*!
+ * @struct FrameTableHeader_t
+ * @abstract Header of the frame table sidecar file.
+ * @discussion The header is followed by the KeyFrames_t table, then by the
+ *    presentation timestamps array.
+ */
+typedef struct
+{
+   char     magic[8];      //!< File signature
+   int64_t  fileSize;      //!< Size of the movie file
+   int64_t  fileTime;      //!< Modification time of the movie file, in ns
+   uint64_t nFrames;       //!< Number of frames in the movie
+} FrameTableHeader_t;
+
 typedef enum {DataNeeded, DataRepeat, EndOfFile, Flushing} DecoderState_t;
 
+/*!
+ * @struct DecodedFrame_t
+ * @abstract Slot of the decode ahead ring
+ */
+typedef struct
+{
+   u_long  index;          //!< Index of the frame held, NSNotFound if none
+   u_short readers;        //!< Number of threads copying from this slot
+   REAL   *data;           //!< Planar float frame, one plane after the other
+} DecodedFrame_t;
+
 /*!
  * @class FFmpegReader
  * @abstract Class for reading movie file formats non supported by Cocoa.
+ * @discussion The frames for processing are decoded ahead in "runs", each one
+ *    with its own decoder, ring and thread. A request is served by the run
+ *    which is heading for that frame, or else restarts the least recently
+ *    used run. Each processing thread thus keeps its own sequential decoding
+ *    of its chunk of frames.
  * @ingroup FileAccess
  */
 @interface FFmpegReader : NSObject <LynkeosMovieFileReader>
@@ -73,13 +105,25 @@ typedef enum {DataNeeded, DataRepeat, EndOfFile, Flushing} DecoderState_t;
    struct SwsContext *_procConverter;       //!< Context for processing conversion
    u_short           *_convBuffer;          //!< Temporary buffer for conversion
    int                _bufLineLength;       //<! Temporary buffer line length for each plane
+   REAL              *_chromaRows;          //!< Chroma rows for the direct YUV conversion
    int               _videoStream;          //!< Index of the selected video stream
    AVPacket          _packet;               //!< Last packet read
    DecoderState_t    _decoderState;         //! State of the decoder with respect to packet data
    u_long            _numberOfFrames;       //!< Number of image frames in the movie
    KeyFrames_t      *_times;                //!< Times of key frames
+   int64_t          *_pts;                  //!< Presentation timestamp of each frame
    NSLock           *_mutex;                //!< Mutex to allow reading from multiple threads
    u_long	         _nextIndex;            //!< Index of the next frame to decode
+
+   NSURL            *_url;                  //!< Movie location, for the decode runs
+   NSCondition      *_ringCondition;        //!< Access to the decode runs
+   NSMutableArray   *_runs;                 //!< Decode runs, one per chunk of frames
+   u_short           _maxRuns;              //!< Maximum number of decode runs
+   u_short           _runsCap;              //!< Runs allowed under memory pressure
+   u_short           _openingRuns;          //!< Decode runs being created
+   u_short           _ringSize;             //!< Number of slots in each run ring
+   u_short           _ringAhead;            //!< Frames decoded ahead of the requests
+   u_long            _clock;                //!< Age of the last run use
 }
 
 @end
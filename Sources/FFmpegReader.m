@@ -23,12 +23,16 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // 
 
+#include <sys/stat.h>
+#include <CommonCrypto/CommonDigest.h>
+
 #include <AVFoundation/AVFoundation.h>
 #import <AppKit/NSGraphics.h>
 
 #include <libavutil/imgutils.h>
 
 #include <LynkeosCore/LynkeosProcessing.h>
+#include <LynkeosCore/LynkeosMemoryBudget.h>
 #include "MyCachePrefs.h"
 
 #include "FFmpegReader.h"
@@ -39,6 +43,211 @@
 
 #define K_TIME_PAGE_SIZE 256
 
+//! Memory allowed for the decode ahead rings of each movie, when there is no
+//! memory budget. Otherwise, the rings can take a quarter of the budget.
+#define K_DECODE_AHEAD_MEMORY (256*1024*1024)
+//! Frames kept in a run ring at and behind its highest request
+#define K_RUN_FRAMES_BEHIND 2
+//! Maximum number of frames decoded ahead of the highest request of a run
+#define K_RUN_FRAMES_AHEAD 6
+
+//! Number of samples processed at once in the direct conversions
+#define FF_NLANES (sizeof(REALVECT)/sizeof(REAL))
+
+typedef uint8_t FF_u8vect __attribute__ ((vector_size (FF_NLANES)));
+typedef uint16_t FF_u16vect __attribute__ ((vector_size (FF_NLANES*sizeof(uint16_t))));
+typedef int32_t FF_maskvect __attribute__ ((vector_size (sizeof(REALVECT))));
+
+/*!
+ * @abstract Clamp the vector elements between 0 and 255
+ */
+static inline REALVECT clamp255( REALVECT v )
+{
+   const REALVECT vmin = {0.0, 0.0, 0.0, 0.0},
+                  vmax = {255.0, 255.0, 255.0, 255.0};
+   FF_maskvect m;
+
+   m = (FF_maskvect)(v > vmin);
+   v = (REALVECT)(m & (FF_maskvect)v);
+   m = (FF_maskvect)(v < vmax);
+   return( (REALVECT)((m & (FF_maskvect)v) | (~m & (FF_maskvect)vmax)) );
+}
+
+/*!
+ * @abstract Convert a row of 8 bits gray samples
+ */
+static void convertGray8Row( const uint8_t *src, REAL *dst, u_short w )
+{
+   u_short x = 0;
+
+   for ( ; x + FF_NLANES <= w; x += FF_NLANES )
+   {
+      FF_u8vect iv;
+      REALVECT v;
+
+      memcpy( &iv, &src[x], sizeof(iv) );
+      v = __builtin_convertvector(iv, REALVECT);
+      memcpy( &dst[x], &v, sizeof(v) );
+   }
+   for ( ; x < w; x++ )
+      dst[x] = (REAL)src[x];
+}
+
+/*!
+ * @abstract Convert a row of 16 bits gray samples, scaled to 8 bits range
+ */
+static void convertGray16Row( const uint16_t *src, REAL *dst, u_short w,
+                              BOOL swap )
+{
+   const REALVECT scale = {1.0/256.0, 1.0/256.0, 1.0/256.0, 1.0/256.0};
+   u_short x = 0;
+
+   if ( !swap )
+   {
+      for ( ; x + FF_NLANES <= w; x += FF_NLANES )
+      {
+         FF_u16vect iv;
+         REALVECT v;
+
+         memcpy( &iv, &src[x], sizeof(iv) );
+         v = __builtin_convertvector(iv, REALVECT)*scale;
+         memcpy( &dst[x], &v, sizeof(v) );
+      }
+   }
+   for ( ; x < w; x++ )
+   {
+      const uint16_t v = (swap ? (uint16_t)((src[x] >> 8) | (src[x] << 8))
+                               : src[x]);
+      dst[x] = (REAL)v/(REAL)256.0;
+   }
+}
+
+/*!
+ * @abstract Upsample a chroma row to the luma width
+ * @discussion The vertical interpolation is between two chroma rows, the
+ *    horizontal one considers the chroma samples cosited with the even luma
+ *    samples, as in MPEG-2 and H.264.
+ * @param c0 Upper chroma row
+ * @param c1 Lower chroma row
+ * @param fy Weight of the lower chroma row
+ * @param cw Chroma row width
+ * @param tmp Temporary row of cw samples
+ * @param out The upsampled row
+ * @param w The luma width
+ * @param subsampled Whether the chroma is horizontally subsampled
+ */
+static void upsampleChromaRow( const uint8_t *c0, const uint8_t *c1, REAL fy,
+                               u_short cw, REAL *tmp, REAL *out, u_short w,
+                               BOOL subsampled )
+{
+   const REAL wy0 = (REAL)1.0 - fy;
+   const REALVECT v0 = {wy0, wy0, wy0, wy0}, v1 = {fy, fy, fy, fy};
+   REAL *vrow = (subsampled ? tmp : out);
+   u_short x = 0;
+
+   for ( ; x + FF_NLANES <= cw; x += FF_NLANES )
+   {
+      FF_u8vect i0, i1;
+      REALVECT v;
+
+      memcpy( &i0, &c0[x], sizeof(i0) );
+      memcpy( &i1, &c1[x], sizeof(i1) );
+      v = __builtin_convertvector(i0, REALVECT)*v0
+          + __builtin_convertvector(i1, REALVECT)*v1;
+      memcpy( &vrow[x], &v, sizeof(v) );
+   }
+   for ( ; x < cw; x++ )
+      vrow[x] = (REAL)c0[x]*wy0 + (REAL)c1[x]*fy;
+
+   if ( subsampled )
+   {
+      for ( x = 0; x < w; x++ )
+      {
+         const u_short cx = x/2;
+
+         if ( (x & 1) == 0 || cx + 1 >= cw )
+            out[x] = tmp[cx];
+         else
+            out[x] = (tmp[cx] + tmp[cx+1])*(REAL)0.5;
+      }
+   }
+}
+
+/*!
+ * @abstract Convert a row of YCbCr samples to RGB planes
+ * @discussion The ITU-R BT.601 matrix is used, like swscale does by default.
+ */
+static void convertYUVRow( const uint8_t *luma, const REAL *cb, const REAL *cr,
+                           REAL *r, REAL *g, REAL *b, u_short w,
+                           BOOL fullRange )
+{
+   const REAL ys = (fullRange ? 1.0 : 255.0/219.0),
+              yo = (fullRange ? 0.0 : 16.0),
+              cs = (fullRange ? 1.0 : 255.0/224.0);
+   const REALVECT yScale = {ys, ys, ys, ys}, yOffset = {yo, yo, yo, yo},
+                  cScale = {cs, cs, cs, cs},
+                  cOffset = {128.0, 128.0, 128.0, 128.0},
+                  rCr = {1.402, 1.402, 1.402, 1.402},
+                  gCb = {0.344136, 0.344136, 0.344136, 0.344136},
+                  gCr = {0.714136, 0.714136, 0.714136, 0.714136},
+                  bCb = {1.772, 1.772, 1.772, 1.772};
+   u_short x = 0;
+
+   for ( ; x + FF_NLANES <= w; x += FF_NLANES )
+   {
+      FF_u8vect iy;
+      REALVECT y, u, v, c;
+
+      memcpy( &iy, &luma[x], sizeof(iy) );
+      memcpy( &u, &cb[x], sizeof(u) );
+      memcpy( &v, &cr[x], sizeof(v) );
+      y = (__builtin_convertvector(iy, REALVECT) - yOffset)*yScale;
+      u = (u - cOffset)*cScale;
+      v = (v - cOffset)*cScale;
+
+      c = clamp255( y + rCr*v );
+      memcpy( &r[x], &c, sizeof(c) );
+      c = clamp255( y - gCb*u - gCr*v );
+      memcpy( &g[x], &c, sizeof(c) );
+      c = clamp255( y + bCb*u );
+      memcpy( &b[x], &c, sizeof(c) );
+   }
+   for ( ; x < w; x++ )
+   {
+      const REAL y = ((REAL)luma[x] - yo)*ys,
+                 u = (cb[x] - (REAL)128.0)*cs,
+                 v = (cr[x] - (REAL)128.0)*cs;
+      REAL c;
+
+      c = y + (REAL)1.402*v;
+      r[x] = (c < 0.0 ? 0.0 : (c > 255.0 ? 255.0 : c));
+      c = y - (REAL)0.344136*u - (REAL)0.714136*v;
+      g[x] = (c < 0.0 ? 0.0 : (c > 255.0 ? 255.0 : c));
+      c = y + (REAL)1.772*u;
+      b[x] = (c < 0.0 ? 0.0 : (c > 255.0 ? 255.0 : c));
+   }
+}
+
+//! Signature of the frame table sidecar files
+static const char K_FRAME_TABLE_MAGIC[8] = "LYNFTB01";
+
+/*!
+ * @abstract Packet information gathered while building the frame table
+ */
+typedef struct
+{
+   int64_t pts;      //!< Presentation timestamp of the packet
+   BOOL    key;      //!< Whether this packet holds a key frame
+} PacketInfo_t;
+
+static int comparePackets( const void *p1, const void *p2 )
+{
+   const int64_t t1 = ((const PacketInfo_t*)p1)->pts,
+                 t2 = ((const PacketInfo_t*)p2)->pts;
+
+   return( t1 < t2 ? -1 : (t1 > t2 ? 1 : 0) );
+}
+
 /*!
  * @abstract ObjC container for a FFMpeg AVFrame
  */
@@ -66,6 +275,32 @@
 }
 @end
 
+/*!
+ * @abstract Sequential decoding of a chunk of frames, ahead of its reader
+ * @discussion Each run has its own FFmpeg decoder, which is a private
+ *    FFmpegReader on the same movie, and its own thread. All the fields are
+ *    protected by the ring condition of the reader owning the run.
+ */
+@interface MyFFmpegDecodeRun : NSObject
+{
+@public
+   FFmpegReader     *_decoder;        //!< Private reader decoding this run
+   FFmpegReader     *_owner;          //!< Reader owning the run (weak)
+   DecodedFrame_t   *_ring;           //!< Ring of decoded frames
+   pthread_t         _thread;         //!< Decode ahead thread
+   BOOL              _running;        //!< Whether the thread was started
+   BOOL              _stop;           //!< Order for the thread to exit
+   u_long            _runStart;       //!< First frame of the sequential run
+   u_long            _decodeIndex;    //!< Next frame for the decode thread
+   u_long            _highestRequest; //!< Highest frame requested in the run
+   u_long            _generation;     //!< Incremented at each run restart
+   u_long            _lastUse;        //!< Reader clock at the last request
+}
+@end
+
+@implementation MyFFmpegDecodeRun
+@end
+
 /*!
  * @category FFmpegReader(Private)
  * @abstract Internals of the FFmpeg reader
@@ -77,7 +312,7 @@
  *   on wood) works.
  * @ingroup FileAccess
  */
-@interface FFmpegReader(Private)
+@interface FFmpegReader(Private) <LynkeosMemoryConsumer>
 
 /*!
  * @method nextFrame
@@ -87,14 +322,165 @@
 - (BOOL) nextFrame ;
 
 /*!
- * @method getFrame:
+ * @method getFrame:cached:
  * @abstract Get the needed frame
  * @param index The index of the frame to get
+ * @param cached Whether to use the movie cache. The frames decoded for the
+ *    ring are not kept twice.
+ */
+- (AVFrame*) getFrame :(u_long) index cached:(BOOL)cached ;
+
+/*!
+ * @method indexOfTimestamp:
+ * @abstract Retrieve the frame index from its presentation timestamp
+ * @param ts The presentation timestamp
+ * @result The frame index, or NSNotFound if no frame has this timestamp
+ */
+- (u_long) indexOfTimestamp:(int64_t)ts ;
+
+/*!
+ * @method buildFrameTableFromPackets
+ * @abstract Build the frame table by demuxing the packets, without decoding
+ * @result Wether all the video packets had a usable timestamp
+ */
+- (BOOL) buildFrameTableFromPackets ;
+
+/*!
+ * @method buildFrameTableByDecoding
+ * @abstract Fallback which counts the frames by decoding the whole movie
+ * @discussion All frames are attached to the first one, hence only a
+ *    sequential access is possible.
+ */
+- (void) buildFrameTableByDecoding ;
+
+/*!
+ * @method frameTableURLForURL:size:time:
+ * @abstract Get the location of the frame table sidecar for a movie
+ * @param url The movie URL
+ * @param size Filled with the movie file size
+ * @param time Filled with the movie modification time
+ * @result The sidecar URL, or nil if the movie file cannot be examined
+ */
+- (NSURL*) frameTableURLForURL:(NSURL*)url size:(int64_t*)size
+                          time:(int64_t*)time ;
+
+/*!
+ * @method loadFrameTableForURL:
+ * @abstract Read the frame table from its sidecar, if it is still valid
+ * @param url The movie URL
+ * @result Wether the frame table was read
+ */
+- (BOOL) loadFrameTableForURL:(NSURL*)url ;
+
+/*!
+ * @method saveFrameTableForURL:
+ * @abstract Save the frame table in its sidecar file
+ * @param url The movie URL
+ */
+- (void) saveFrameTableForURL:(NSURL*)url ;
+
+/*!
+ * @method convertFrame:toPlanes:
+ * @abstract Convert a decoded frame to planar float
+ * @param frame The decoded frame
+ * @param data The destination planes, each one width x height
  */
-- (AVFrame*) getFrame :(u_long) index ;
+- (void) convertFrame:(AVFrame*)frame toPlanes:(REAL*)data ;
+
+/*!
+ * @method convertFrameDirectly:toPlanes:
+ * @abstract Convert a decoded frame to planar float, without swscale
+ * @param frame The decoded frame
+ * @param data The destination planes, each one width x height
+ * @result Whether the frame pixel format was handled
+ */
+- (BOOL) convertFrameDirectly:(AVFrame*)frame toPlanes:(REAL*)data ;
+
+/*!
+ * @method openURL:threads:
+ * @abstract Open the movie and its decoder
+ * @param url The movie URL
+ * @param nThreads The number of codec threads, 0 to let the codec choose
+ * @result Whether the movie could be decoded
+ */
+- (BOOL) openURL:(NSURL*)url threads:(int)nThreads ;
+
+/*!
+ * @method initDecoderOfReader:
+ * @abstract Initialize a private reader, decoding a run for another reader
+ * @discussion The frame table is copied from the other reader.
+ * @param reader The reader which owns the run
+ * @result The initialized decoder, or nil if the movie could not be opened
+ */
+- (id) initDecoderOfReader:(FFmpegReader*)reader ;
+
+/*!
+ * @method sizeDecodeRings
+ * @abstract Size the rings for all the runs to fit in the memory allowance
+ * @discussion Called with the ring condition locked, before the first run.
+ */
+- (void) sizeDecodeRings ;
+
+/*!
+ * @method newDecodeRunAtFrame:
+ * @abstract Create a decode run and start its thread
+ * @discussion Called with the ring condition unlocked, as opening the
+ *    decoder is slow. The run is not yet in the runs list.
+ * @param index The first frame of the run
+ * @result The new run, or nil if no decoder could be created
+ */
+- (MyFFmpegDecodeRun*) newDecodeRunAtFrame:(u_long)index ;
+
+/*!
+ * @method deleteDecodeRun:
+ * @abstract Stop the thread of a run and free its ring
+ * @discussion Called with the ring condition unlocked.
+ * @param run The run to delete
+ */
+- (void) deleteDecodeRun:(MyFFmpegDecodeRun*)run ;
+
+/*!
+ * @method decodeAheadLoop:
+ * @abstract Body of the decode ahead thread of a run
+ * @discussion It decodes sequentially into the run ring, up to some frames
+ *    ahead of the highest frame requested in the run.
+ * @param run The run decoded by the calling thread
+ */
+- (void) decodeAheadLoop:(MyFFmpegDecodeRun*)run ;
+
+/*!
+ * @method runForFrame:
+ * @abstract Find the run heading for a frame, or restart one at that frame
+ * @discussion Called with the ring condition locked. The lock is released
+ *    while a new run is opened.
+ * @param index The index of the frame
+ * @result The run, or nil if none could be created
+ */
+- (MyFFmpegDecodeRun*) runForFrame:(u_long)index ;
+
+/*!
+ * @method acquireFrame:
+ * @abstract Wait for a frame to be available in a run ring
+ * @discussion Called with the ring condition locked. The slot is protected
+ *    against overwriting until its readers count is decremented.
+ * @param index The index of the frame
+ * @result The slot containing the frame, or NULL if no run is available
+ */
+- (DecodedFrame_t*) acquireFrame:(u_long)index ;
 
 @end
 
+static void *decodeAheadThread( void *arg )
+{
+   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+   MyFFmpegDecodeRun *run = (MyFFmpegDecodeRun*)arg;
+
+   [run->_owner decodeAheadLoop:run];
+
+   [pool release];
+   return( NULL );
+}
+
 @implementation FFmpegReader(Private)
 
 - (BOOL) nextFrame
@@ -182,19 +568,34 @@
    }
 
    if ( frameFinished )
-      _nextIndex ++;
+   {
+      // Rely on the frame timestamp, as the decoder may output frames which
+      // precede the key frame we seeked to
+      const int64_t ts = _pCurrentFrame->best_effort_timestamp;
+      u_long i = NSNotFound;
+
+      if ( _pts != NULL && ts != AV_NOPTS_VALUE )
+         i = [self indexOfTimestamp:ts];
+
+      if ( i != NSNotFound )
+         _nextIndex = i + 1;
+      else
+         _nextIndex ++;
+   }
 
    return( frameFinished );
 }
 
-- (AVFrame*) getFrame :(u_long) index
+- (AVFrame*) getFrame :(u_long) index cached:(BOOL)cached
 {
-   NSString *key = [NSString stringWithFormat:@"%s&%06ld", _pFormatCtx->url, index];
-   LynkeosObjectCache *movieCache = [LynkeosObjectCache movieCache];
+   LynkeosObjectCache *movieCache =
+                              (cached ? [LynkeosObjectCache movieCache] : nil);
    MyAVFrameContainer *pix;
 
    if ( movieCache != nil &&
-        (pix = (MyAVFrameContainer*)[movieCache getObjectForKey:key]) != nil )
+        (pix = (MyAVFrameContainer*)[movieCache getObjectForOwner:self
+                                                              index:index])
+          != nil )
       return( pix->_frame );
 
    int ret;
@@ -206,9 +607,9 @@
 
 //   for( ;; )
 //   {
-      // Go to the previous key frame if needed
-      if ( index < _nextIndex
-          || _times[index].keyFrame != _times[_nextIndex].keyFrame )
+      // Go to the previous key frame if needed, or if there is a key frame
+      // between the current position and the requested frame
+      if ( index < _nextIndex || _times[index].keyFrame > _nextIndex )
       {
          // Reset the decoder
          if ( _packet.data != NULL )
@@ -247,8 +648,7 @@
                   av_frame_ref(frameCopy, _pCurrentFrame);
                   [movieCache setObject:
                      [[[MyAVFrameContainer alloc] initWithAVFrame: frameCopy] autorelease]
-                                 forKey:
-                     [NSString stringWithFormat:@"%s&%06ld", _pFormatCtx->url,_nextIndex-1]];
+                               forOwner:self index:_nextIndex-1];
                }
             }
          }
@@ -276,6 +676,838 @@
    return( _pCurrentFrame );
 }
 
+- (u_long) indexOfTimestamp:(int64_t)ts
+{
+   u_long low = 0, high = _numberOfFrames;
+
+   while ( low < high )
+   {
+      const u_long mid = (low + high)/2;
+
+      if ( _pts[mid] < ts )
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   if ( low < _numberOfFrames && _pts[low] == ts )
+      return( low );
+
+   return( NSNotFound );
+}
+
+- (BOOL) buildFrameTableFromPackets
+{
+   PacketInfo_t *packets = NULL;
+   u_long arraySize = 0, nPackets = 0, i, keyIndex;
+   int64_t keyTimestamp;
+   AVPacket packet;
+   BOOL success = YES;
+
+   av_init_packet(&packet);
+   packet.data = NULL;
+   packet.size = 0;
+
+   // Only demux, the decoder is not involved
+   while ( success && av_read_frame(_pFormatCtx, &packet) >= 0 )
+   {
+      if ( packet.stream_index == _videoStream )
+      {
+         const int64_t ts = (packet.pts != AV_NOPTS_VALUE ?
+                             packet.pts : packet.dts);
+
+         if ( ts == AV_NOPTS_VALUE )
+            success = NO;
+
+         else
+         {
+            if ( nPackets >= arraySize )
+            {
+               arraySize += K_TIME_PAGE_SIZE;
+               packets = (PacketInfo_t*)realloc( packets,
+                                               arraySize*sizeof(PacketInfo_t) );
+            }
+            packets[nPackets].pts = ts;
+            packets[nPackets].key = ((packet.flags & AV_PKT_FLAG_KEY) != 0);
+            nPackets++;
+         }
+      }
+      av_packet_unref( &packet );
+   }
+
+   if ( success && nPackets != 0 )
+   {
+      // Frames get out of the decoder in presentation order
+      qsort( packets, nPackets, sizeof(PacketInfo_t), comparePackets );
+
+      _times = (KeyFrames_t*)malloc( nPackets*sizeof(KeyFrames_t) );
+      _pts = (int64_t*)malloc( nPackets*sizeof(int64_t) );
+
+      // The first frame is the origin of the sequential read anyway
+      keyIndex = 0;
+      keyTimestamp = packets[0].pts;
+      for( i = 0; i < nPackets; i++ )
+      {
+         if ( packets[i].key )
+         {
+            keyIndex = i;
+            keyTimestamp = packets[i].pts;
+         }
+         _times[i].keyFrame = keyIndex;
+         _times[i].timestamp = keyTimestamp;
+         _pts[i] = packets[i].pts;
+      }
+      _numberOfFrames = nPackets;
+   }
+   else
+      success = NO;
+
+   if ( packets != NULL )
+      free( packets );
+
+   // Rewind the demuxer
+   av_seek_frame( _pFormatCtx, _videoStream,
+                  (success ? _pts[0] : 0), AVSEEK_FLAG_BACKWARD );
+   avcodec_flush_buffers(_pCodecCtx);
+   _decoderState = DataNeeded;
+
+   return( success );
+}
+
+- (void) buildFrameTableByDecoding
+{
+   u_long arraySize = 0;
+   BOOL validFrame;
+
+   _numberOfFrames = 0;
+   for( validFrame = YES; validFrame; )
+   {
+      validFrame = [self nextFrame];
+
+      if ( validFrame )
+      {
+         if ( _numberOfFrames >= arraySize )
+         {
+            arraySize += K_TIME_PAGE_SIZE;
+            _times = (KeyFrames_t*)realloc( _times, arraySize*sizeof(KeyFrames_t) );
+         }
+
+         _times[_numberOfFrames].timestamp = 0;
+         _times[_numberOfFrames].keyFrame = 0;
+
+         _numberOfFrames ++;
+      }
+   }
+}
+
+- (NSURL*) frameTableURLForURL:(NSURL*)url size:(int64_t*)size
+                          time:(int64_t*)time
+{
+   struct stat st;
+   const char *path = [[url path] fileSystemRepresentation];
+
+   if ( stat( path, &st ) != 0 )
+      return( nil );
+
+   *size = st.st_size;
+   *time = (int64_t)st.st_mtimespec.tv_sec*1000000000
+           + st.st_mtimespec.tv_nsec;
+
+   NSURL *dir = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory
+                                                        inDomains:NSUserDomainMask]
+                 firstObject];
+   if ( dir == nil )
+      return( nil );
+
+   // The sidecar is named after a digest of the movie path
+   unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+   NSMutableString *name = [NSMutableString string];
+   int i;
+
+   CC_SHA1( path, (CC_LONG)strlen(path), digest );
+   for( i = 0; i < CC_SHA1_DIGEST_LENGTH; i++ )
+      [name appendFormat:@"%02x", digest[i]];
+   [name appendString:@".frames"];
+
+   NSString *bundleId = [[NSBundle mainBundle] bundleIdentifier];
+   if ( bundleId != nil )
+      dir = [dir URLByAppendingPathComponent:bundleId isDirectory:YES];
+   dir = [dir URLByAppendingPathComponent:@"FrameTables" isDirectory:YES];
+
+   return( [dir URLByAppendingPathComponent:name isDirectory:NO] );
+}
+
+- (BOOL) loadFrameTableForURL:(NSURL*)url
+{
+   int64_t size, time;
+   NSURL *tableURL = [self frameTableURLForURL:url size:&size time:&time];
+
+   if ( tableURL == nil )
+      return( NO );
+
+   NSData *table = [NSData dataWithContentsOfURL:tableURL
+                                         options:NSDataReadingMappedIfSafe
+                                           error:nil];
+   if ( table == nil || [table length] < sizeof(FrameTableHeader_t) )
+      return( NO );
+
+   const FrameTableHeader_t *header = (const FrameTableHeader_t*)[table bytes];
+   if ( memcmp( header->magic, K_FRAME_TABLE_MAGIC, sizeof(header->magic) ) != 0
+        || header->fileSize != size || header->fileTime != time
+        || header->nFrames == 0
+        || [table length] != sizeof(FrameTableHeader_t)
+                             + header->nFrames*(sizeof(KeyFrames_t)
+                                                + sizeof(int64_t)) )
+      return( NO );
+
+   const KeyFrames_t *times = (const KeyFrames_t*)(header + 1);
+   const int64_t *pts = (const int64_t*)(times + header->nFrames);
+
+   _numberOfFrames = (u_long)header->nFrames;
+   _times = (KeyFrames_t*)malloc( _numberOfFrames*sizeof(KeyFrames_t) );
+   _pts = (int64_t*)malloc( _numberOfFrames*sizeof(int64_t) );
+   memcpy( _times, times, _numberOfFrames*sizeof(KeyFrames_t) );
+   memcpy( _pts, pts, _numberOfFrames*sizeof(int64_t) );
+
+   return( YES );
+}
+
+- (void) saveFrameTableForURL:(NSURL*)url
+{
+   int64_t size, time;
+   NSURL *tableURL = [self frameTableURLForURL:url size:&size time:&time];
+   FrameTableHeader_t header;
+
+   if ( tableURL == nil )
+      return;
+
+   memcpy( header.magic, K_FRAME_TABLE_MAGIC, sizeof(header.magic) );
+   header.fileSize = size;
+   header.fileTime = time;
+   header.nFrames = _numberOfFrames;
+
+   NSMutableData *table = [NSMutableData dataWithBytes:&header
+                                                length:sizeof(header)];
+   [table appendBytes:_times length:_numberOfFrames*sizeof(KeyFrames_t)];
+   [table appendBytes:_pts length:_numberOfFrames*sizeof(int64_t)];
+
+   [[NSFileManager defaultManager] createDirectoryAtURL:
+                                    [tableURL URLByDeletingLastPathComponent]
+                            withIntermediateDirectories:YES
+                                             attributes:nil error:nil];
+   // Failing to save only costs a rescan at the next opening
+   [table writeToURL:tableURL atomically:YES];
+}
+
+- (BOOL) convertFrameDirectly:(AVFrame*)frame toPlanes:(REAL*)data
+{
+   const u_long planeSize = (u_long)_width*_height;
+   BOOL fullRange = NO, swap = NO;
+   u_short y;
+
+   // Scaled frames are left to swscale
+   if ( frame->width != _width || frame->height != _height )
+      return( NO );
+
+   switch( frame->format )
+   {
+      case AV_PIX_FMT_GRAY8:
+         if ( _numberOfPlanes != 1 )
+            return( NO );
+         for( y = 0; y < _height; y++ )
+            convertGray8Row( frame->data[0] + (long)frame->linesize[0]*y,
+                             &data[(u_long)_width*y], _width );
+         return( YES );
+
+      case AV_PIX_FMT_GRAY16BE:
+      case AV_PIX_FMT_GRAY16LE:
+         if ( _numberOfPlanes != 1 )
+            return( NO );
+         swap = (frame->format != AV_PIX_FMT_GRAY16);
+         for( y = 0; y < _height; y++ )
+            convertGray16Row( (const uint16_t*)(frame->data[0]
+                                           + (long)frame->linesize[0]*y),
+                              &data[(u_long)_width*y], _width, swap );
+         return( YES );
+
+      case AV_PIX_FMT_YUVJ420P:
+      case AV_PIX_FMT_YUVJ422P:
+      case AV_PIX_FMT_YUVJ444P:
+         fullRange = YES;
+         // Fall through
+      case AV_PIX_FMT_YUV420P:
+      case AV_PIX_FMT_YUV422P:
+      case AV_PIX_FMT_YUV444P:
+      {
+         if ( _numberOfPlanes != 3 )
+            return( NO );
+
+         const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+         const u_short cw = AV_CEIL_RSHIFT(_width, desc->log2_chroma_w),
+                       ch = AV_CEIL_RSHIFT(_height, desc->log2_chroma_h);
+         const BOOL subsampled = (desc->log2_chroma_w != 0);
+         REAL *tmp = _chromaRows,
+              *cb = _chromaRows + _width,
+              *cr = _chromaRows + 2*_width;
+
+         for( y = 0; y < _height; y++ )
+         {
+            int cy0, cy1;
+            REAL fy;
+
+            if ( desc->log2_chroma_h == 0 )
+            {
+               cy0 = cy1 = y;
+               fy = 0.0;
+            }
+            else
+            {
+               // Chroma samples are centered between two luma rows
+               const REAL cy = ((REAL)y - (REAL)0.5)/(REAL)2.0;
+
+               cy0 = (int)floor(cy);
+               fy = cy - (REAL)cy0;
+               cy1 = cy0 + 1;
+               if ( cy0 < 0 )
+                  cy0 = 0;
+               if ( cy1 >= ch )
+                  cy1 = ch - 1;
+            }
+
+            upsampleChromaRow( frame->data[1] + (long)frame->linesize[1]*cy0,
+                               frame->data[1] + (long)frame->linesize[1]*cy1,
+                               fy, cw, tmp, cb, _width, subsampled );
+            upsampleChromaRow( frame->data[2] + (long)frame->linesize[2]*cy0,
+                               frame->data[2] + (long)frame->linesize[2]*cy1,
+                               fy, cw, tmp, cr, _width, subsampled );
+            convertYUVRow( frame->data[0] + (long)frame->linesize[0]*y, cb, cr,
+                           &data[(u_long)_width*y],
+                           &data[planeSize + (u_long)_width*y],
+                           &data[2*planeSize + (u_long)_width*y],
+                           _width, fullRange );
+         }
+         return( YES );
+      }
+
+      default:
+         // Bayer and other formats need swscale
+         return( NO );
+   }
+}
+
+- (void) convertFrame:(AVFrame*)frame toPlanes:(REAL*)data
+{
+   const u_long planeSize = (u_long)_width*_height;
+   u_short x, y, c;
+   int ret;
+
+   if ( [self convertFrameDirectly:frame toPlanes:data] )
+      return;
+
+   // Convert the whole image, as only a slice seems to fail
+   ret = sws_scale(_procConverter, (const uint8_t *const *)frame->data, frame->linesize,
+                   0, _height,
+                   (uint8_t *const *)&_convBuffer, &_bufLineLength);
+   if ( ret < 0 )
+   {
+      NSLog( @"Could not convert image : %s", av_err2str(ret) );
+      memset( data, 0, planeSize*_numberOfPlanes*sizeof(REAL) );
+      return;
+   }
+
+   const u_short samplesPerLine = _bufLineLength / sizeof(u_short);
+   for ( y = 0; y < _height; y++ )
+   {
+      const u_short *line = &_convBuffer[samplesPerLine*y];
+      REAL *dst = &data[(u_long)_width*y];
+
+      for( x = 0; x < _width; x++ )
+         for( c = 0; c < _numberOfPlanes; c++ )
+            dst[planeSize*c + x] = (REAL)line[x*_numberOfPlanes + c]/(REAL)256.0;
+   }
+}
+
+- (BOOL) openURL:(NSURL*)url threads:(int)nThreads
+{
+   unsigned int       i;
+   int                ret;
+   AVCodec           *pCodec;
+   AVCodecParameters *codecParams;
+
+   // Open video file
+   ret = avformat_open_input( &_pFormatCtx,
+                             [[url path] fileSystemRepresentation],
+//                             [[url absoluteString] UTF8String],
+                             NULL, NULL );
+   if ( ret < 0 )
+   {
+      NSLog( @"Could not open file %@\n%s", [url absoluteString], av_err2str(ret) );
+      return( NO );
+   }
+
+   // Retrieve stream information
+   ret = avformat_find_stream_info(_pFormatCtx, NULL);
+   if ( ret < 0 )
+   {
+      NSLog( @"Could not find any stream info");
+      return( NO );
+   }
+
+   // Find the first video stream
+   _videoStream = -1;
+   for ( i = 0; i < _pFormatCtx->nb_streams; i++ )
+   {
+      if( _pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+      {
+         _videoStream = i;
+         codecParams = _pFormatCtx->streams[i]->codecpar;
+         break;
+      }
+   }
+
+   if( _videoStream == -1 )
+   {
+      NSLog( @"Could not find a video stream");
+      return( NO );
+   }
+
+   // Find the decoder for the video stream
+   pCodec = avcodec_find_decoder(codecParams->codec_id);
+   if ( pCodec == NULL )
+   {
+      NSLog( @"Codec not found");
+      return( NO );
+   }
+
+   // Allocate a codec context for the video stream
+   _pCodecCtx = avcodec_alloc_context3(pCodec);
+
+   // Inform the codec that we can handle truncated bitstreams -- i.e.,
+   // bitstreams where frame boundaries can fall in the middle of packets
+   if ( pCodec->capabilities & AV_CODEC_CAP_TRUNCATED )
+      _pCodecCtx->flags |= AV_CODEC_FLAG_TRUNCATED;
+
+   // Open codec
+   if ( avcodec_parameters_to_context(_pCodecCtx, codecParams) >= 0 )
+   {
+      // Decode with frame and slice threading
+      _pCodecCtx->thread_count = nThreads;
+      _pCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+      ret = avcodec_open2(_pCodecCtx, pCodec, NULL);
+   }
+   else
+      ret = -1;
+   if ( ret < 0 )
+   {
+      NSLog( @"Can't open the codec" );
+      return( NO );
+   }
+
+   AVRational aspect = _pCodecCtx->sample_aspect_ratio;
+   if (aspect.num == 0 || aspect.den == 0)
+   {
+      _width = _pCodecCtx->width;
+      _height = _pCodecCtx->height;
+   }
+   else if (aspect.num >= aspect.den)
+   {
+      _width = (_pCodecCtx->width * aspect.num) / aspect.den;
+      _height = _pCodecCtx->height;
+   }
+   else
+   {
+      _width = _pCodecCtx->width;
+      _height = (_pCodecCtx->height * aspect.num) / aspect.den;
+   }
+   const AVPixFmtDescriptor *fmtDesc = av_pix_fmt_desc_get(_pCodecCtx->pix_fmt);
+   if (fmtDesc == nil)
+   {
+      NSLog( @"Unknown pixel format" );
+      return( NO );
+   }
+   _numberOfPlanes = (fmtDesc->nb_components == 1 ? 1 : 3);
+
+   // Allocate video frame
+   _pCurrentFrame = av_frame_alloc();
+
+   // Allocate a RGB converter for NSImage conversion
+   _displayConverter = sws_getContext(_pCodecCtx->width, _pCodecCtx->height,
+                                      _pCodecCtx->pix_fmt,
+                                      _width, _height,
+                                      AV_PIX_FMT_RGBA, SWS_LANCZOS,
+                                      NULL, NULL, NULL);
+
+   // And allocate another for getImageSample
+   _procConverter = sws_getContext(_pCodecCtx->width, _pCodecCtx->height,
+                                   _pCodecCtx->pix_fmt,
+                                   _width, _height,
+                                   _numberOfPlanes == 3 ? AV_PIX_FMT_RGB48 : AV_PIX_FMT_GRAY16,
+                                   SWS_LANCZOS, NULL, NULL, NULL);
+
+   // Allocate also the conversion buffer
+   const int vectSize = sizeof(u_short __attribute__  ((vector_size (8))));
+   _bufLineLength = (_width * _numberOfPlanes * sizeof(u_short) + vectSize - 1) / vectSize;
+   _bufLineLength *= vectSize;
+   _convBuffer = (u_short*)malloc(_bufLineLength * _height);
+   // And the rows for the direct chroma conversion
+   _chromaRows = (REAL*)malloc(3*_width*sizeof(REAL));
+
+   if(_displayConverter == NULL || _procConverter == NULL)
+   {
+      NSLog(@"Cannot initialize the conversion context!");
+      return( NO );
+   }
+
+   return( YES );
+}
+
+- (id) initDecoderOfReader:(FFmpegReader*)reader
+{
+   self = [self init];
+
+   if ( self != nil )
+   {
+      // Share the codec threads between the runs
+      NSInteger nThreads = [[NSUserDefaults standardUserDefaults]
+                                      integerForKey:K_PREF_MOVIE_DECODE_THREADS];
+      if ( nThreads <= 0 )
+      {
+         nThreads = numberOfCpus/reader->_maxRuns;
+         if ( nThreads < 1 )
+            nThreads = 1;
+      }
+
+      if ( ![self openURL:reader->_url threads:(int)nThreads] )
+      {
+         [self release];
+         return( nil );
+      }
+
+      NSAssert( _width == reader->_width && _height == reader->_height
+                && _numberOfPlanes == reader->_numberOfPlanes,
+                @"Inconsistent decoder for the same movie" );
+
+      _numberOfFrames = reader->_numberOfFrames;
+      _times = (KeyFrames_t*)malloc( _numberOfFrames*sizeof(KeyFrames_t) );
+      memcpy( _times, reader->_times, _numberOfFrames*sizeof(KeyFrames_t) );
+      if ( reader->_pts != NULL )
+      {
+         _pts = (int64_t*)malloc( _numberOfFrames*sizeof(int64_t) );
+         memcpy( _pts, reader->_pts, _numberOfFrames*sizeof(int64_t) );
+      }
+
+      // We are now pointing beyond sequence end
+      _nextIndex = _numberOfFrames + 1;
+   }
+
+   return( self );
+}
+
+- (void) sizeDecodeRings
+{
+   const u_long frameSize = (u_long)_width*_height*_numberOfPlanes*sizeof(REAL);
+   const u_long budget = [LynkeosMemoryBudget budget];
+   const u_long allowed = (budget != 0 ? budget/4 : K_DECODE_AHEAD_MEMORY);
+   const u_long minSize = K_RUN_FRAMES_BEHIND + 2;
+   u_long size;
+
+   // Less runs for big frames, rather than rings too short to decode ahead
+   if ( allowed/(minSize*frameSize) < _maxRuns )
+      _maxRuns = (u_short)(allowed/(minSize*frameSize) > 0 ?
+                           allowed/(minSize*frameSize) : 1);
+   size = allowed/(frameSize*_maxRuns);
+
+   if ( size > K_RUN_FRAMES_BEHIND + K_RUN_FRAMES_AHEAD )
+      size = K_RUN_FRAMES_BEHIND + K_RUN_FRAMES_AHEAD;
+   if ( size < minSize )
+      size = minSize;
+   _ringSize = (u_short)size;
+   _ringAhead = _ringSize - K_RUN_FRAMES_BEHIND;
+   if ( _runsCap > _maxRuns )
+      _runsCap = _maxRuns;
+}
+
+- (MyFFmpegDecodeRun*) newDecodeRunAtFrame:(u_long)index
+{
+   const u_long frameSize = (u_long)_width*_height*_numberOfPlanes*sizeof(REAL);
+   MyFFmpegDecodeRun *run;
+   u_short i;
+
+   run = [[MyFFmpegDecodeRun alloc] init];
+   run->_owner = self;
+   run->_decoder = [[FFmpegReader alloc] initDecoderOfReader:self];
+   if ( run->_decoder == nil )
+   {
+      [run release];
+      return( nil );
+   }
+
+   run->_ring = (DecodedFrame_t*)malloc( _ringSize*sizeof(DecodedFrame_t) );
+   for( i = 0; i < _ringSize; i++ )
+   {
+      run->_ring[i].index = NSNotFound;
+      run->_ring[i].readers = 0;
+      run->_ring[i].data = (REAL*)malloc( frameSize );
+   }
+   // The ring memory counts in the images budget
+   [LynkeosMemoryBudget allocatedMemory:_ringSize*frameSize];
+
+   run->_runStart = index;
+   run->_decodeIndex = index;
+   run->_highestRequest = index;
+   run->_generation = 0;
+   run->_lastUse = 0;
+   run->_stop = NO;
+
+   // The thread does not retain the reader, dealloc waits for its end
+   run->_running = ( pthread_create( &run->_thread, NULL,
+                                     decodeAheadThread, run ) == 0 );
+   if ( !run->_running )
+   {
+      NSLog( @"Could not start a decode ahead thread" );
+      [self deleteDecodeRun:run];
+      [run release];
+      return( nil );
+   }
+
+   return( run );
+}
+
+- (void) deleteDecodeRun:(MyFFmpegDecodeRun*)run
+{
+   u_short i;
+
+   if ( run->_running )
+   {
+      [_ringCondition lock];
+      run->_stop = YES;
+      [_ringCondition broadcast];
+      [_ringCondition unlock];
+      pthread_join( run->_thread, NULL );
+      run->_running = NO;
+   }
+
+   if ( run->_ring != NULL )
+   {
+      for( i = 0; i < _ringSize; i++ )
+         free( run->_ring[i].data );
+      free( run->_ring );
+      run->_ring = NULL;
+      [LynkeosMemoryBudget freedMemory:
+                  _ringSize*(u_long)_width*_height*_numberOfPlanes*sizeof(REAL)];
+   }
+
+   [run->_decoder release];
+   run->_decoder = nil;
+}
+
+- (void) decodeAheadLoop:(MyFFmpegDecodeRun*)run
+{
+   [_ringCondition lock];
+
+   while ( !run->_stop )
+   {
+      // Wait for some room ahead of the requests
+      if ( run->_decodeIndex >= _numberOfFrames
+           || run->_decodeIndex > run->_highestRequest + _ringAhead )
+      {
+         [_ringCondition wait];
+         continue;
+      }
+
+      const u_long index = run->_decodeIndex;
+      const u_long generation = run->_generation;
+      DecodedFrame_t *slot = &run->_ring[index % _ringSize];
+
+      if ( slot->readers != 0 )
+      {
+         [_ringCondition wait];
+         continue;
+      }
+      slot->index = NSNotFound;
+
+      [_ringCondition unlock];
+
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      AVFrame *frame;
+
+      // The run decoder is used by this thread only
+      frame = [run->_decoder getFrame:index cached:NO];
+      if ( frame != NULL )
+         [run->_decoder convertFrame:frame toPlanes:slot->data];
+      else
+         memset( slot->data, 0,
+                 (u_long)_width*_height*_numberOfPlanes*sizeof(REAL) );
+
+      [pool release];
+
+      [_ringCondition lock];
+
+      // Discard the frame if the run was restarted meanwhile
+      if ( generation == run->_generation )
+      {
+         slot->index = index;
+         run->_decodeIndex = index + 1;
+         [_ringCondition broadcast];
+      }
+   }
+
+   [_ringCondition unlock];
+}
+
+- (MyFFmpegDecodeRun*) runForFrame:(u_long)index
+{
+   BOOL canOpen = YES;
+
+   for( ;; )
+   {
+      NSEnumerator *list = [_runs objectEnumerator];
+      MyFFmpegDecodeRun *run, *oldest = nil;
+
+      // Look for the run which holds or is heading for this frame
+      while ( (run = [list nextObject]) != nil )
+      {
+         if ( index >= run->_runStart && index < run->_decodeIndex + _ringSize )
+            return( run );
+         if ( oldest == nil || run->_lastUse < oldest->_lastUse )
+            oldest = run;
+      }
+
+      if ( _ringSize == 0 )
+         [self sizeDecodeRings];
+
+      // Raise the cap set under memory pressure, one run at a time
+      if ( _runsCap < _maxRuns && [_runs count] + _openingRuns >= _runsCap )
+      {
+         const u_long budget = [LynkeosMemoryBudget budget];
+         const u_long ringMemory =
+             _ringSize*(u_long)_width*_height*_numberOfPlanes*sizeof(REAL);
+
+         if ( budget == 0
+              || [LynkeosMemoryBudget usedMemory] + ringMemory <= budget )
+            _runsCap++;
+      }
+
+      // Start a new run for this chunk
+      if ( canOpen && [_runs count] + _openingRuns < _runsCap )
+      {
+         // Reserve its place, and let the other threads read while opening it
+         _openingRuns++;
+         [_ringCondition unlock];
+         run = [self newDecodeRunAtFrame:index];
+         [_ringCondition lock];
+         _openingRuns--;
+
+         if ( run != nil )
+         {
+            [_runs addObject:run];
+            [run release];
+            [_ringCondition broadcast];
+            return( run );
+         }
+
+         // The runs may have changed meanwhile, look again
+         canOpen = NO;
+         [_ringCondition broadcast];
+         continue;
+      }
+
+      if ( oldest == nil )
+      {
+         // Wait for the runs being opened by other threads, if any
+         if ( _openingRuns == 0 )
+            return( nil );
+         [_ringCondition wait];
+         continue;
+      }
+
+      // Or take over the least recently used
+      oldest->_runStart = index;
+      oldest->_decodeIndex = index;
+      oldest->_highestRequest = index;
+      oldest->_generation++;
+      [_ringCondition broadcast];
+
+      return( oldest );
+   }
+}
+
+- (DecodedFrame_t*) acquireFrame:(u_long)index
+{
+   for( ;; )
+   {
+      MyFFmpegDecodeRun *run = [self runForFrame:index];
+
+      if ( run == nil )
+         return( NULL );
+
+      DecodedFrame_t *slot = &run->_ring[index % _ringSize];
+
+      run->_lastUse = ++_clock;
+
+      if ( index < run->_decodeIndex )
+      {
+         if ( slot->index == index )
+         {
+            slot->readers++;
+            return( slot );
+         }
+
+         // Otherwise, the frame was evicted : restart the run at that frame
+         run->_runStart = index;
+         run->_decodeIndex = index;
+         run->_highestRequest = index;
+         run->_generation++;
+         [_ringCondition broadcast];
+      }
+      else
+      {
+         // It is coming, let the decoder reach it
+         if ( index > run->_highestRequest )
+         {
+            run->_highestRequest = index;
+            [_ringCondition broadcast];
+         }
+         [_ringCondition wait];
+      }
+   }
+}
+
+- (void) releaseMemory
+{
+   NSMutableArray *idle = [NSMutableArray array];
+   MyFFmpegDecodeRun *run, *latest = nil;
+   NSEnumerator *list;
+   u_short i;
+
+   [_ringCondition lock];
+   // Keep only the most recently used run, and the runs being read
+   // (the runs being opened are not listed yet, and will be kept)
+   list = [_runs objectEnumerator];
+   while ( (run = [list nextObject]) != nil )
+      if ( latest == nil || run->_lastUse > latest->_lastUse )
+         latest = run;
+   list = [_runs objectEnumerator];
+   while ( (run = [list nextObject]) != nil )
+   {
+      BOOL inUse = (run == latest);
+
+      for( i = 0; i < _ringSize && !inUse; i++ )
+         inUse = (run->_ring[i].readers != 0);
+      if ( !inUse )
+         [idle addObject:run];
+   }
+   [_runs removeObjectsInArray:idle];
+   // And do not create them again until the budget recovers
+   if ( [_runs count] < _runsCap )
+      _runsCap = ([_runs count] > 0 ? [_runs count] : 1);
+   [_ringCondition unlock];
+
+   list = [idle objectEnumerator];
+   while ( (run = [list nextObject]) != nil )
+      [self deleteDecodeRun:run];
+}
+
 @end
 
 @implementation FFmpegReader
@@ -327,6 +1559,7 @@
       _procConverter = NULL;
       _convBuffer = NULL;
       _bufLineLength = 0;
+      _chromaRows = NULL;
       _videoStream = -1;
       av_init_packet(&_packet);
       _packet.data = NULL;
@@ -336,183 +1569,59 @@
       _nextIndex = 0;
       _mutex = [[NSLock alloc] init];
       _times = NULL;
+      _pts = NULL;
+      _ringCondition = [[NSCondition alloc] init];
+      _url = nil;
+      _runs = [[NSMutableArray alloc] init];
+      _maxRuns = (numberOfCpus > 1 ? numberOfCpus : 1);
+      _runsCap = _maxRuns;
+      _ringSize = 0;
+      _ringAhead = 0;
+      _openingRuns = 0;
+      _clock = 0;
    }
    return( self );
 }
 
 - (id) initWithURL:(NSURL*)url
 {
-   unsigned int       i;
-   int                ret;
-   AVCodec           *pCodec;
-   AVCodecParameters *codecParams;
-   u_long             arraySize;
-   BOOL               validFrame;
-   int64_t         /* startTime, timestamp,*/ keyTimestamp;
-   u_long             keyIndex;
-
    self = [self init];
 
    if ( self != nil )
    {
-      // Open video file
-      ret = avformat_open_input( &_pFormatCtx,
-                                [[url path] fileSystemRepresentation],
-//                                [[url absoluteString] UTF8String],
-                                NULL, NULL );
-      if ( ret < 0 )
-      {
-         NSLog( @"Could not open file %@\n%s", [url absoluteString], av_err2str(ret) );
-         [self release];
-         return( nil );
-      }
-
-      // Retrieve stream information
-      ret = avformat_find_stream_info(_pFormatCtx, NULL);
-      if ( ret < 0 )
+      // Decode with frame and slice threading, 0 lets the codec choose
+      // the number of threads
+      NSInteger nThreads = [[NSUserDefaults standardUserDefaults]
+                                      integerForKey:K_PREF_MOVIE_DECODE_THREADS];
+      if ( ![self openURL:url threads:(nThreads > 0 ? (int)nThreads : 0)] )
       {
-         NSLog( @"Could not find any stream info");
          [self release];
          return( nil );
       }
+      _url = [url retain];
+      // The decode ahead rings give back memory when over budget
+      [LynkeosMemoryBudget addConsumer:self];
 
-      // Find the first video stream
-      _videoStream = -1;
-      for ( i = 0; i < _pFormatCtx->nb_streams; i++ )
+      // Get the frames times, from the sidecar if it is up to date, or else
+      // from the packets. Decode the whole movie only as a last resort
+      if ( ![self loadFrameTableForURL:url] )
       {
-         if( _pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+         if ( [self buildFrameTableFromPackets] )
+            [self saveFrameTableForURL:url];
+         else
          {
-            _videoStream = i;
-            codecParams = _pFormatCtx->streams[i]->codecpar;
-            break;
+            NSLog( @"Missing timestamps, reverting to sequential read" );
+            if ( _times != NULL )
+               free( _times );
+            _times = NULL;
+            if ( _pts != NULL )
+               free( _pts );
+            _pts = NULL;
+            _numberOfFrames = 0;
+            [self buildFrameTableByDecoding];
          }
       }
 
-      if( _videoStream == -1 )
-      {
-         NSLog( @"Could not find a video stream");
-         [self release];
-         return( nil );
-      }
-
-      // Find the decoder for the video stream
-      pCodec = avcodec_find_decoder(codecParams->codec_id);
-      if ( pCodec == NULL )
-      {
-         NSLog( @"Codec not found");
-         [self release];
-         return( nil );
-      }
-
-      // Allocate a codec context for the video stream
-      _pCodecCtx = avcodec_alloc_context3(pCodec);
-
-      // Inform the codec that we can handle truncated bitstreams -- i.e.,
-      // bitstreams where frame boundaries can fall in the middle of packets
-      if ( pCodec->capabilities & AV_CODEC_CAP_TRUNCATED )
-         _pCodecCtx->flags |= AV_CODEC_FLAG_TRUNCATED;
-
-      // Open codec
-      if (   avcodec_parameters_to_context(_pCodecCtx, codecParams) < 0
-          || avcodec_open2(_pCodecCtx, pCodec, NULL) < 0)
-      {
-         NSLog( @"Can't open the codec" );
-         [self release];
-         return( nil );
-      }
-
-      AVRational aspect = _pCodecCtx->sample_aspect_ratio;
-      if (aspect.num == 0 || aspect.den == 0)
-      {
-         _width = _pCodecCtx->width;
-         _height = _pCodecCtx->height;
-      }
-      else if (aspect.num >= aspect.den)
-      {
-         _width = (_pCodecCtx->width * aspect.num) / aspect.den;
-         _height = _pCodecCtx->height;
-      }
-      else
-      {
-         _width = _pCodecCtx->width;
-         _height = (_pCodecCtx->height * aspect.num) / aspect.den;
-      }
-      const AVPixFmtDescriptor *fmtDesc = av_pix_fmt_desc_get(_pCodecCtx->pix_fmt);
-      if (fmtDesc == nil)
-      {
-         NSLog( @"Unknown pixel format" );
-         [self release];
-         return( nil );
-      }
-      _numberOfPlanes = (fmtDesc->nb_components == 1 ? 1 : 3);
-
-      // Allocate video frame
-      _pCurrentFrame = av_frame_alloc();
-
-      // Allocate a RGB converter for NSImage conversion
-      _displayConverter = sws_getContext(_pCodecCtx->width, _pCodecCtx->height,
-                                         _pCodecCtx->pix_fmt,
-                                         _width, _height,
-                                         AV_PIX_FMT_RGBA, SWS_LANCZOS,
-                                         NULL, NULL, NULL);
-
-      // And allocate another for getImageSample
-      _procConverter = sws_getContext(_pCodecCtx->width, _pCodecCtx->height,
-                                      _pCodecCtx->pix_fmt,
-                                      _width, _height,
-                                      _numberOfPlanes == 3 ? AV_PIX_FMT_RGB48 : AV_PIX_FMT_GRAY16,
-                                      SWS_LANCZOS, NULL, NULL, NULL);
-
-      // Allocate also the conversion buffer
-      const int vectSize = sizeof(u_short __attribute__  ((vector_size (8))));
-      _bufLineLength = (_width * _numberOfPlanes * sizeof(u_short) + vectSize - 1) / vectSize;
-      _bufLineLength *= vectSize;
-      _convBuffer = (u_short*)malloc(_bufLineLength * _height);
-
-      if(_displayConverter == NULL || _procConverter == NULL)
-      {
-         NSLog(@"Cannot initialize the conversion context!");
-         [self release];
-         return( nil );
-      }
-
-      // Get the frames times
-      arraySize = 0;
-//      startTime = _pFormatCtx->streams[_videoStream]->start_time;
-      //frameDuration = (int64_t)
-      //          ((double)_pFormatCtx->streams[_videoStream]->r_frame_rate.den
-      //	  / (double)_pFormatCtx->streams[_videoStream]->r_frame_rate.num
-      //	  * (double)_pFormatCtx->streams[_videoStream]->time_base.den
-      //	  / (double)_pFormatCtx->streams[_videoStream]->time_base.num
-      //	  + 0.5 );
-//      timestamp = startTime;
-      keyIndex = 0;
-      keyTimestamp = 0/*startTime*/;
-      for( validFrame = YES; validFrame; )
-      {
-         validFrame = [self nextFrame];
-
-         if ( validFrame )
-         {
-            if ( _numberOfFrames >= arraySize )
-            {
-               arraySize += K_TIME_PAGE_SIZE;
-               _times = (KeyFrames_t*)realloc( _times, arraySize*sizeof(KeyFrames_t) );
-            }
-/*
-            if ( _pCurrentFrame->key_frame )
-            {
-               keyTimestamp = timestamp;
-               keyIndex = _numberOfFrames;
-            }
- */
-            _times[_numberOfFrames].timestamp = keyTimestamp;
-            _times[_numberOfFrames].keyFrame = keyIndex;
-
-            _numberOfFrames ++;
-//            timestamp = _pFormatCtx->streams[_videoStream]->cur_dts;
-         }
-      }
       // We are now pointing beyond sequence end
       _nextIndex = _numberOfFrames + 1;
    }
@@ -522,6 +1631,21 @@
 
 - (void) dealloc
 {
+   NSEnumerator *list;
+   MyFFmpegDecodeRun *run;
+
+   // Neither the cache nor the budget retain us
+   [LynkeosMemoryBudget removeConsumer:self];
+   [LynkeosObjectCache forgetOwner:self];
+
+   // Stop the decode ahead threads before anything else
+   list = [_runs objectEnumerator];
+   while ( (run = [list nextObject]) != nil )
+      [self deleteDecodeRun:run];
+   [_runs release];
+   [_ringCondition release];
+   [_url release];
+
    [_mutex release];
    if ( _pCodecCtx != NULL )
       avcodec_close(_pCodecCtx);
@@ -534,12 +1658,16 @@
       sws_freeContext( _procConverter );
    if (_convBuffer != NULL)
       free(_convBuffer);
+   if (_chromaRows != NULL)
+      free(_chromaRows);
    if ( _packet.data != NULL )
       av_packet_unref( &_packet );
    if ( _pFormatCtx != NULL )
       avformat_close_input( &_pFormatCtx );
    if ( _times != NULL )
       free( _times );
+   if ( _pts != NULL )
+      free( _pts );
 
    [super dealloc];
 }
@@ -595,7 +1723,7 @@
 
       [_mutex lock];
 
-      frame = [self getFrame:index];
+      frame = [self getFrame:index cached:YES];
 
       if ( frame != NULL )
       {
@@ -621,64 +1749,57 @@
               lineWidth:(u_short)lineW
 {
    u_short xs, ys, cs;
-   int ret;
+   DecodedFrame_t *slot;
 
    NSAssert( index < _numberOfFrames, @"Access beyond sequence end" );
    NSAssert( x+w <= _width && y+h <= _height,
              @"Sample at least partly outside the image" );
 
-   [_mutex lock];
-
-   AVFrame *frame;
-   frame = [self getFrame:index];
+   // Get the frame from the run decoding this part of the movie
+   [_ringCondition lock];
+   slot = [self acquireFrame:index];
+   [_ringCondition unlock];
 
-   if ( frame == NULL )
+   if ( slot == NULL )
    {
-      [_mutex unlock];
-      NSAssert( NO, @"Could not access FFMpeg frame" );
-   }
-
-   // Convert the whole image, as only a slice seems to fail
-   ret = sws_scale(_procConverter, (const uint8_t *const *)frame->data, frame->linesize,
-                   0, _height,
-                   (uint8_t *const *)&_convBuffer, &_bufLineLength);
-   if ( ret < 0 )
-   {
-      NSLog( @"Could not convert image : %s", av_err2str(ret) );
-      [_mutex unlock];
+      // Do not leave garbage in the sample
+      NSLog( @"Could not access FFMpeg frame" );
+      for( cs = 0; cs < nPlanes; cs++ )
+         for ( ys = 0; ys < h; ys++ )
+            memset( &sample[cs][(u_long)lineW*ys], 0, w*sizeof(REAL) );
       return;
    }
 
-   const u_short samplesPerLine = _bufLineLength / sizeof(u_short);
+   const u_long planeSize = (u_long)_width*_height;
    for ( ys = 0; ys < h; ys++ )
    {
-      const u_short yy = y + ys;
+      const REAL *line = &slot->data[(u_long)_width*(y + ys) + x];
 
-      for( xs = 0; xs < w; xs++ )
+      if ( nPlanes != _numberOfPlanes && nPlanes == 1 )
       {
-         const u_short xx = x + xs;
-         REAL v;
-
-         if ( nPlanes != _numberOfPlanes && nPlanes == 1 )
+         // Convert to monochrome
+         for( xs = 0; xs < w; xs++ )
          {
-            // Convert to monochrome
-            v = 0;
+            REAL v = 0;
             for (cs = 0; cs < _numberOfPlanes; cs++)
-               v += _convBuffer[samplesPerLine*yy + xx * _numberOfPlanes + cs];
-            SET_SAMPLE( sample[0], xs, ys, lineW, v/(REAL)_numberOfPlanes/256.0 );
-         }
-         else
-         {
-            for( cs = 0; cs < nPlanes; cs++ )
-            {
-               v = (REAL)_convBuffer[samplesPerLine*yy + xx * _numberOfPlanes + cs];
-               SET_SAMPLE( sample[cs], xs, ys, lineW, v/256.0);
-            }
+               v += line[planeSize*cs + xs];
+            SET_SAMPLE( sample[0], xs, ys, lineW, v/(REAL)_numberOfPlanes );
          }
       }
+      else
+      {
+         for( cs = 0; cs < nPlanes; cs++ )
+            memcpy( &sample[cs][(u_long)lineW*ys],
+                    &line[planeSize*(cs < _numberOfPlanes ? cs : 0)],
+                    w*sizeof(REAL) );
+      }
    }
 
-   [_mutex unlock];
+   // Release the slot
+   [_ringCondition lock];
+   slot->readers--;
+   [_ringCondition broadcast];
+   [_ringCondition unlock];
 }
 
 - (NSDictionary*) getMetaData 
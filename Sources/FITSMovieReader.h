@@ -0,0 +1,75 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+/*!
+ * @header
+ * @abstract Reader for FITS data cubes and multi extension files
+ */
+#ifndef __FITSMOVIEREADER_H
+#define __FITSMOVIEREADER_H
+
+#include <fitsio.h>
+
+#include "LynkeosFileReader.h"
+#include "FITSReader.h"
+
+/*!
+ * @abstract Location of one frame in the FITS file
+ */
+typedef struct
+{
+   int         hdu;           //!< Number of the HDU holding the frame
+   u_long      levels;        //!< Index of the levels of this HDU
+   long        plane;         //!< Plane of the frame in the HDU data cube
+   off_t       offset;        //!< Start of the frame data in the file
+   size_t      size;          //!< Size of the frame data in the file
+} FITSFrame_t;
+
+/*!
+ * @class FITSMovieReader
+ * @abstract Class for reading FITS files holding several images.
+ * @discussion The frames are the planes of 3 dimensional images (NAXIS3),
+ *    and the images of all the HDU which have the same size as the first one.
+ *    Each HDU keeps its own scaling and levels, the frames are read with the
+ *    ones of their HDU. A file holding only one image is left to FITSReader.
+ *
+ *    Each reading thread uses its own CFITSIO handle, taken from a pool, for
+ *    the reads not to be serialized.
+ * @ingroup FileAccess
+ */
+@interface FITSMovieReader : NSObject <LynkeosMovieFileReader>
+{
+   @private
+   NSString       *_fileName;      //< File name given to CFITSIO
+   NSLock         *_handlesLock;   //< Protects the handles pool
+   NSMutableArray *_freeHandles;   //< CFITSIO handles not used by a thread
+   FITSFrame_t    *_frames;        //< Location of each frame
+   u_long         _numberOfFrames; //< Number of frames in the file
+   u_short        _width;          //< Cached width
+   u_short        _height;         //< Cached height
+   FITSLevels_t   *_levels;        //< Levels of each HDU
+   u_long         _numberOfLevels; //< Number of HDU holding frames
+}
+
+@end
+
+#endif
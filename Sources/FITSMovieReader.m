@@ -0,0 +1,461 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+#include "LynkeosObjectCache.h"
+#include "LynkeosReadAhead.h"
+
+#include "FITSMovieReader.h"
+
+/*!
+ * @abstract Private methods of FITSMovieReader
+ */
+@interface FITSMovieReader(Private)
+/*!
+ * @abstract Get a CFITSIO handle for the calling thread
+ * @result The handle, or NULL if the file could not be opened
+ */
+- (fitsfile*) acquireHandle ;
+
+/*!
+ * @abstract Give back a handle to the pool
+ * @param fits The handle
+ */
+- (void) releaseHandle:(fitsfile*)fits ;
+
+/*!
+ * @abstract Read a rectangle of a frame, in the FITS orientation
+ * @param fits The handle to read with
+ * @param index The frame index
+ * @param type The CFITSIO type of the output samples
+ * @param scale The scale to apply to the values of the frame HDU
+ * @param zero The zero to apply to the values of the frame HDU
+ * @param x X origin of the rectangle, in Lynkeos coordinates
+ * @param y Y origin of the rectangle, in Lynkeos coordinates
+ * @param w Width of the rectangle
+ * @param h Height of the rectangle
+ * @param buf The buffer to fill, lines from bottom to top
+ * @result A CFITSIO error code
+ */
+- (int) readFrame:(u_long)index withHandle:(fitsfile*)fits
+             type:(int)type scale:(double)scale zero:(double)zero
+              atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+           buffer:(void*)buf ;
+@end
+
+@implementation FITSMovieReader(Private)
+
+- (fitsfile*) acquireHandle
+{
+   fitsfile *fits = NULL;
+   int err = 0;
+
+   [_handlesLock lock];
+   if ( [_freeHandles count] != 0 )
+   {
+      fits = [[_freeHandles lastObject] pointerValue];
+      [_freeHandles removeLastObject];
+   }
+   [_handlesLock unlock];
+
+   // No free handle, this thread will get its own
+   if ( fits == NULL )
+   {
+      fits_open_file( &fits, [_fileName fileSystemRepresentation],
+                      READONLY, &err );
+      if ( err != 0 )
+      {
+         fits_report_error( stderr, err );
+         fits = NULL;
+      }
+   }
+
+   return( fits );
+}
+
+- (void) releaseHandle:(fitsfile*)fits
+{
+   [_handlesLock lock];
+   [_freeHandles addObject:[NSValue valueWithPointer:fits]];
+   [_handlesLock unlock];
+}
+
+- (int) readFrame:(u_long)index withHandle:(fitsfile*)fits
+             type:(int)type scale:(double)scale zero:(double)zero
+              atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+           buffer:(void*)buf
+{
+   const FITSFrame_t *frame = &_frames[index];
+   // Convert to FITS coordinate system
+   long first[3] = {x+1, _height-y-h+1, frame->plane+1};
+   long last[3] = {x+w, _height-y, frame->plane+1};
+   long inc[3] = {1, 1, 1};
+   int hdu, err = 0;
+
+   if ( fits_get_hdu_num( fits, &hdu ) != frame->hdu )
+      fits_movabs_hdu( fits, frame->hdu, NULL, &err );
+
+   // The HDU was moved to, the scaling is set for each read
+   fits_set_bscale( fits, scale, zero, &err );
+
+   fits_read_subset( fits, type, first, last, inc, NULL, buf, NULL, &err );
+
+   return( err );
+}
+
+@end
+
+@implementation FITSMovieReader
+
++ (void) load
+{
+   // Nothing to do, this is just to force the runtime to load this class
+}
+
++ (void) lynkeosFileTypes:(NSArray**)fileTypes
+{
+   // Tried before FITSReader, which reads the single image files.
+   // Compressed files are left to it, as each handle would decompress them
+   NSNumber *pri = [NSNumber numberWithInt:1];
+
+   *fileTypes = [NSArray arrayWithObjects:pri,@"fits",pri,@"fts",pri,@"fit",
+                                          nil];
+}
+
+- (id) init
+{
+   self = [super init];
+   if ( self != nil )
+   {
+      _fileName = nil;
+      _handlesLock = [[NSLock alloc] init];
+      _freeHandles = [[NSMutableArray alloc] init];
+      _frames = NULL;
+      _numberOfFrames = 0;
+      _levels = NULL;
+      _numberOfLevels = 0;
+      _width = 0;
+      _height = 0;
+   }
+   return( self );
+}
+
+- (id) initWithURL:(NSURL*)url
+{
+   fitsfile *fits;
+   int err = 0, hdu, hduType;
+
+   self = [self init];
+
+   if ( self == nil )
+      return( self );
+
+   // Unfortunately, CFITSIO does not handle correctly the
+   // file://localhost/... URL given by Cocoa
+   if ( [url isFileURL] )
+      _fileName = [[url path] retain];
+   else
+      _fileName = [[url absoluteString] retain];
+
+   fits = [self acquireHandle];
+   if ( fits == NULL )
+   {
+      [self release];
+      return( nil );
+   }
+
+   // Collect the frames in all the image HDU
+   for( hdu = 1;
+        fits_movabs_hdu( fits, hdu, &hduType, &err ) == 0;
+        hdu++ )
+   {
+      int nbits, dimension;
+      long size[3] = {0, 0, 1}, plane;
+      LONGLONG headStart, dataStart, dataEnd;
+
+      if ( hduType != IMAGE_HDU )
+         continue;
+
+      fits_get_img_param( fits, 3, &nbits, &dimension, size, &err );
+      if ( err != 0 )
+         break;
+
+      // Skip the empty primary HDU, and the images of another size
+      if ( dimension < 2 || dimension > 3 )
+         continue;
+      if ( _numberOfLevels == 0 )
+      {
+         _width = size[0];
+         _height = size[1];
+      }
+      else if ( size[0] != _width || size[1] != _height )
+         continue;
+
+      // Each HDU has its own scaling and levels
+      _levels = (FITSLevels_t*)realloc( _levels,
+                            (_numberOfLevels+1)*sizeof(FITSLevels_t) );
+      err = FITS_read_levels( fits, nbits, _width, _height,
+                              &_levels[_numberOfLevels] );
+      if ( err != 0 )
+         break;
+      if ( _levels[_numberOfLevels].scale == 0.0 )
+      {
+         NSLog(@"Unknown FITS levels, HDU %d skipped in %@",
+               hdu, [url absoluteString] );
+         continue;
+      }
+
+      // Location of the data, for the read ahead
+      fits_get_hduaddrll( fits, &headStart, &dataStart, &dataEnd, &err );
+      if ( err != 0 )
+         break;
+
+      _frames = (FITSFrame_t*)realloc( _frames,
+                         (_numberOfFrames+size[2])*sizeof(FITSFrame_t) );
+      for( plane = 0; plane < size[2]; plane++ )
+      {
+         FITSFrame_t *frame = &_frames[_numberOfFrames];
+
+         frame->hdu = hdu;
+         frame->levels = _numberOfLevels;
+         frame->plane = plane;
+         frame->size = (size_t)size[0]*size[1]*(abs(nbits)/8);
+         frame->offset = (off_t)dataStart + plane*frame->size;
+         _numberOfFrames++;
+      }
+      _numberOfLevels++;
+   }
+   if ( err == END_OF_FILE )
+      err = 0;
+
+   [self releaseHandle:fits];
+
+   if ( err != 0 || _numberOfFrames <= 1 )
+   {
+      // Single images are read by FITSReader
+      if ( err != 0 )
+      {
+         NSLog(@"Unable to open FITS movie : %@", [url absoluteString] );
+         fits_report_error( stderr, err );
+      }
+      [self release];
+      self = nil;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   NSEnumerator *list = [_freeHandles objectEnumerator];
+   NSValue *handle;
+   int err = 0;
+
+   // The frames cache does not retain us
+   [LynkeosObjectCache forgetOwner:self];
+
+   // No read can be ongoing here, all the handles are free
+   while ( (handle = [list nextObject]) != nil )
+      fits_close_file( (fitsfile*)[handle pointerValue], &err );
+
+   NSAssert( err == 0, @"FITS closing error" );
+
+   [_freeHandles release];
+   [_handlesLock release];
+   [_fileName release];
+   if ( _frames != NULL )
+      free( _frames );
+   if ( _levels != NULL )
+      free( _levels );
+
+   [super dealloc];
+}
+
+- (void) imageWidth:(u_short*)w height:(u_short*)h
+{
+   *w = _width;
+   *h = _height;
+}
+
+- (u_short) numberOfPlanes
+{
+   return( 1 );
+}
+
+- (void) getMinLevel:(double*)vmin maxLevel:(double*)vmax
+{
+   u_long i;
+
+   // The range covers the physical values of all the HDU
+   *vmin = HUGE;
+   *vmax = -HUGE;
+   for( i = 0; i < _numberOfLevels; i++ )
+   {
+      const FITSLevels_t *levels = &_levels[i];
+      double lmin, lmax;
+
+      if ( levels->minValue >= levels->maxValue || levels->imageScale == 0.0 )
+      {
+         *vmin = 0.0;
+         *vmax = 255.0;
+         return;
+      }
+
+      lmin = levels->minValue*levels->imageScale + levels->imageZero;
+      lmax = levels->maxValue*levels->imageScale + levels->imageZero;
+      // A negative scale swaps the bounds
+      if ( lmin > lmax )
+      {
+         double t = lmin;
+         lmin = lmax;
+         lmax = t;
+      }
+      if ( lmin < *vmin )
+         *vmin = lmin;
+      if ( lmax > *vmax )
+         *vmax = lmax;
+   }
+}
+
+- (u_long) numberOfFrames
+{
+   return( _numberOfFrames );
+}
+
+- (NSImage*) getNSImageAtIndex:(u_long)index
+{
+   NSImage *image = nil;
+   NSBitmapImageRep* bitmap;
+
+   NSAssert( index < _numberOfFrames, @"Access beyond FITS movie end" );
+
+   bitmap = [[[NSBitmapImageRep alloc] initWithBitmapDataPlanes:nil
+                                   pixelsWide:_width
+                                   pixelsHigh:_height
+                                bitsPerSample:8
+                              samplesPerPixel:1
+                                     hasAlpha:NO
+                                     isPlanar:NO
+                               colorSpaceName:NSCalibratedWhiteColorSpace
+                                  bytesPerRow:0
+                                 bitsPerPixel:8] autorelease];
+
+   if ( bitmap != nil )
+   {
+      u_char *pixels = (u_char*)[bitmap bitmapData];
+      u_char *buf = (u_char*)malloc( (u_long)_width*_height );
+      // Retrieve the geometry allocated by the runtime
+      int bpr = (int)[bitmap bytesPerRow];
+      fitsfile *fits = [self acquireHandle];
+      int err = 0;
+      u_short y;
+
+      NSAssert( [bitmap bitsPerPixel] == 8, @"Hey, I asked bpp to be 8 !" );
+
+      if ( fits != NULL )
+      {
+         const FITSLevels_t *levels = &_levels[_frames[index].levels];
+
+         err = [self readFrame:index withHandle:fits type:TBYTE
+                         scale:levels->scale zero:levels->zero
+                           atX:0 Y:0 W:_width H:_height buffer:buf];
+         [self releaseHandle:fits];
+      }
+
+      if ( err != 0 )
+         fits_report_error( stderr, err );
+      else if ( fits != NULL )
+      {
+         // FITS lines are stored from bottom to top
+         for( y = 0; y < _height; y++ )
+            memcpy( &pixels[(_height-y-1)*bpr], &buf[(u_long)y*_width],
+                    _width );
+      }
+      free( buf );
+
+      image = [[[NSImage alloc] initWithSize:NSMakeSize(_width,_height)]
+                                                                   autorelease];
+
+      if ( image != nil )
+         [image addRepresentation:bitmap];
+   }
+
+   return( image );
+}
+
+- (void) getImageSample:(REAL * const * const)sample atIndex:(u_long)index
+             withPlanes:(u_short)nPlanes
+                    atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+              lineWidth:(u_short)lineW
+{
+   REAL *buf = (REAL*)malloc( (u_long)w*h*sizeof(REAL) );
+   fitsfile *fits = [self acquireHandle];
+   int err = 0;
+   u_short yl;
+
+   NSAssert( nPlanes == 1, @"Try to read multiplane FITS" );
+   NSAssert( index < _numberOfFrames, @"Access beyond FITS movie end" );
+
+   if ( fits != NULL )
+   {
+      const FITSLevels_t *levels = &_levels[_frames[index].levels];
+
+      // Only the requested rectangle is read
+      err = [self readFrame:index withHandle:fits
+                       type:(PROCESSING_PRECISION == DOUBLE_PRECISION ?
+                             TDOUBLE : TFLOAT)
+                      scale:(levels->imageScale == 0.0 ?
+                             levels->scale : levels->imageScale)
+                       zero:(levels->imageScale == 0.0 ?
+                             levels->zero : levels->imageZero)
+                        atX:x Y:y W:w H:h buffer:buf];
+      [self releaseHandle:fits];
+   }
+
+   if ( err != 0 )
+      fits_report_error( stderr, err );
+
+   // Flip the lines to the top to bottom order
+   for( yl = 0; yl < h; yl++ )
+   {
+      if ( fits != NULL && err == 0 )
+         memcpy( &sample[0][yl*lineW], &buf[(u_long)(h-yl-1)*w],
+                 w*sizeof(REAL) );
+      else
+         memset( &sample[0][yl*lineW], 0, w*sizeof(REAL) );
+   }
+
+   free( buf );
+}
+
+- (void) prefetchFrameAtIndex:(u_long)index
+{
+   if ( index < _numberOfFrames && [_fileName isAbsolutePath] )
+      [LynkeosReadAhead advisePath:_fileName offset:_frames[index].offset
+                            length:_frames[index].size];
+}
+
+- (NSDictionary*) getMetaData
+{
+   return( nil );
+}
+
+@end
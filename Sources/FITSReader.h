@@ -37,6 +37,34 @@
 
 #include "LynkeosFileReader.h"
 
+/*!
+ * @abstract Levels of a FITS image
+ */
+typedef struct
+{
+   double      scale;         //!< Value scale to apply for NSImage conversion
+   double      imageScale;    //!< Value scale of image, 0 if none
+   double      zero;          //!< Zero value to apply for NSImage conversion
+   double      imageZero;     //!< Zero value of image
+   double      minValue;      //!< Minimum value of data
+   double      maxValue;      //!< Maximum value of data
+} FITSLevels_t;
+
+/*!
+ * @abstract Read the levels of the current HDU image
+ * @discussion When the data range is not in the header, it is computed on
+ *    the first plane of the image.
+ * @param fits The CFITSIO handle, positioned on the image HDU
+ * @param nbits The image BITPIX
+ * @param width The image width
+ * @param height The image height
+ * @param levels The levels to fill
+ * @result A CFITSIO error code
+ */
+extern int FITS_read_levels( fitsfile *fits, int nbits,
+                             u_short width, u_short height,
+                             FITSLevels_t *levels );
+
 /*!
 * @class FITSReader
  * @abstract Class for reading FITS image file format.
@@ -48,12 +76,7 @@
    fitsfile    *_fits;        //< CFITSIO handle on the FITS file
    u_short     _width;        //< Cached width
    u_short     _height;       //< Cached height
-   double      _scale;        //< Value scale to apply for NSImage conversion
-   double      _imageScale;   //< Value scale of image
-   double      _zero;         //< Zero value to apply for NSImage conversion
-   double      _imageZero;    //< Zero value of image
-   double      _minValue;     //< Minimum value of data
-   double      _maxValue;     //< Maximum value of data
+   FITSLevels_t _levels;      //< Levels and conversion factors
 }
 
 @end
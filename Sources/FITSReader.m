@@ -23,6 +23,123 @@
 
 #include "FITSReader.h"
 
+int FITS_read_levels( fitsfile *fits, int nbits,
+                      u_short width, u_short height,
+                      FITSLevels_t *levels )
+{
+   int err = 0;
+
+   levels->scale = 0.0;
+
+   // Save the image scale and zero for sample read
+   if ( fits_read_key(fits, TDOUBLE, "BSCALE", &levels->imageScale, NULL, &err)
+        != 0 || 
+        fits_read_key(fits, TDOUBLE, "BZERO", &levels->imageZero, NULL, &err)
+        != 0 )
+      levels->imageScale = 0.0;
+   err = 0;
+
+   if ( fits_read_key( fits, TDOUBLE, "DATAMIN", &levels->minValue, NULL, &err)
+        != 0 )
+      levels->minValue = HUGE;
+   err = 0;
+   if ( fits_read_key( fits, TDOUBLE, "DATAMAX", &levels->maxValue, NULL, &err)
+        != 0 )
+      levels->maxValue = -HUGE;
+   err = 0;
+
+   // Determine the scale and zero to use when converting to a NSImage
+   switch( nbits )
+   {
+      case BYTE_IMG :
+         levels->scale = 1.0;
+         levels->zero = 0.0;
+         if ( levels->minValue < 0.0 || levels->maxValue >= 256.0 )
+         {
+            // Inconsistents min and max, that may come from a bug in
+            // Lynkeos prior to V2.3
+            levels->minValue = 0.0;
+            levels->maxValue = 255.0;
+         }
+         break;
+      case SHORT_IMG :
+         levels->scale = 127.49/SHRT_MAX;
+         levels->zero = 128.0;
+         if ( levels->minValue < SHRT_MIN || levels->maxValue > SHRT_MAX )
+         {
+            // Inconsistents min and max, that may come from a bug in
+            // Lynkeos prior to V2.3
+            levels->minValue = SHRT_MIN;
+            levels->maxValue = SHRT_MAX;
+         }
+         break;
+      case LONG_IMG :
+         levels->scale = 127.49/LONG_MAX;
+         levels->zero = 128.0;
+         if ( levels->minValue < LONG_MIN || levels->maxValue > LONG_MAX )
+         {
+            // Inconsistents min and max, that may come from a bug in
+            // Lynkeos prior to V2.3
+            levels->minValue = LONG_MIN;
+            levels->maxValue = LONG_MAX;
+         }
+         break;
+      case LONGLONG_IMG :
+         levels->scale = 127.49/LLONG_MAX;
+         levels->zero = 128.0;
+         if ( levels->minValue < LLONG_MIN || levels->maxValue > LLONG_MAX )
+         {
+            // Inconsistents min and max
+            levels->minValue = LLONG_MIN;
+            levels->maxValue = LLONG_MAX;
+         }
+         break;
+      case FLOAT_IMG :
+      case DOUBLE_IMG :
+      {
+         if ( levels->minValue >= levels->maxValue )
+         {
+            // No information, we need to read all the data of the first plane
+            double *buf = (double*)malloc( sizeof(double)*width );
+            int anyNull;
+            u_short x, y;
+
+            fits_set_bscale( fits, 1.0, 0.0, &err );
+
+            for( y = 1; y <= height && err == 0; y++ )
+            {
+               long first[3] = {1,y,1};
+               fits_read_pix( fits, TDOUBLE, first, width,
+                              NULL, buf, &anyNull, &err );
+               for( x = 0; x < width; x++ )
+               {
+                  if ( buf[x] < levels->minValue )
+                     levels->minValue = buf[x];
+                  if ( buf[x] > levels->maxValue )
+                     levels->maxValue = buf[x];
+               }
+            }
+
+            // Discard an impossible to understand error
+            if ( err != 0 )
+               fits_report_error( stderr, err );
+            err = 0;
+            free( buf );
+         }
+         if ( err == 0 )
+         {
+            levels->scale = 255.49/(levels->maxValue-levels->minValue);
+            levels->zero = -levels->minValue * levels->scale;
+         }
+         break;
+      }
+      default:
+         NSCAssert1( NO, @"FITS : Unexpected BITPIX value%d", nbits );
+   }
+
+   return( err );
+}
+
 @implementation FITSReader
 
 + (void) load
@@ -66,122 +183,17 @@
       else
          file = [[url absoluteString] UTF8String];
 
-      fits_open_file( &_fits, file, READONLY, &err );
+      // Go to the first image, which is an extension in tile compressed files
+      fits_open_image( &_fits, file, READONLY, &err );
       fits_get_img_param( _fits, 2, &nbits, &dimension, size, &err );
 
       _width = size[0];
       _height = size[1];
 
       if ( err == 0 && dimension == 2 )
-      {
-         // Save the image scale and zero for sample read
-         if ( fits_read_key(_fits, TDOUBLE, "BSCALE", &_imageScale, NULL, &err)
-              != 0 || 
-              fits_read_key(_fits, TDOUBLE, "BZERO", &_imageZero, NULL, &err)
-              != 0 )
-            _imageScale = 0.0;
-         err = 0.0;
-
-         if ( fits_read_key( _fits, TDOUBLE, "DATAMIN", &_minValue, NULL, &err)
-              != 0 )
-            _minValue = HUGE;
-         err = 0.0;
-         if ( fits_read_key( _fits, TDOUBLE, "DATAMAX", &_maxValue, NULL, &err)
-              != 0 )
-            _maxValue = -HUGE;
-         err = 0.0;
-
-         // Determine the scale and zero to use when converting to a NSImage
-         switch( nbits )
-         {
-            case BYTE_IMG :
-               _scale = 1.0;
-               _zero = 0.0;
-               if ( _minValue < 0.0 || _maxValue >= 256.0 )
-               {
-                  // Inconsistents min and max, that may come from a bug in
-                  // Lynkeos prior to V2.3
-                  _minValue = 0.0;
-                  _maxValue = 255.0;
-               }
-               break;
-            case SHORT_IMG :
-               _scale = 127.49/SHRT_MAX;
-               _zero = 128.0;
-               if ( _minValue < SHRT_MIN || _maxValue > SHRT_MAX )
-               {
-                  // Inconsistents min and max, that may come from a bug in
-                  // Lynkeos prior to V2.3
-                  _minValue = SHRT_MIN;
-                  _maxValue = SHRT_MAX;
-               }
-               break;
-            case LONG_IMG :
-               _scale = 127.49/LONG_MAX;
-               _zero = 128.0;
-               if ( _minValue < LONG_MIN || _maxValue > LONG_MAX )
-               {
-                  // Inconsistents min and max, that may come from a bug in
-                  // Lynkeos prior to V2.3
-                  _minValue = LONG_MIN;
-                  _maxValue = LONG_MAX;
-               }
-               break;
-            case LONGLONG_IMG :
-               _scale = 127.49/LLONG_MAX;
-               _zero = 128.0;
-               if ( _minValue < LLONG_MIN || _maxValue > LLONG_MAX )
-               {
-                  // Inconsistents min and max
-                  _minValue = LLONG_MIN;
-                  _maxValue = LLONG_MAX;
-               }
-               break;
-            case FLOAT_IMG :
-            case DOUBLE_IMG :
-            {
-               if ( _minValue >= _maxValue )
-               {
-                  // No information, we need to read all the data
-                  double *buf = (double*)malloc( sizeof(double)*_width );
-                  int anyNull;
-                  u_short x, y;
-
-                  fits_set_bscale( _fits, 1.0, 0.0, &err );
-
-                  for( y = 1; y <= _height && err == 0; y++ )
-                  {
-                     long first[2] = {1,y};
-                     fits_read_pix( _fits, TDOUBLE, first, _width,
-                                    NULL, buf, &anyNull, &err );
-                     for( x = 0; x < _width; x++ )
-                     {
-                        if ( buf[x] < _minValue )
-                           _minValue = buf[x];
-                        if ( buf[x] > _maxValue )
-                           _maxValue = buf[x];
-                     }
-                  }
-
-                  // Discard an impossible to understand error
-                  if ( err != 0 )
-                     fits_report_error( stderr, err );
-                  err = 0;
-                  free( buf );
-               }
-               if ( err == 0 )
-               {
-                  _scale = 255.49/(_maxValue-_minValue);
-                  _zero = -_minValue * _scale;
-               }
-               break;
-            }
-            default:
-               NSAssert1( NO, @"FITS : Unexpected BITPIX value%d", nbits );
-         }
-      }
+         err = FITS_read_levels( _fits, nbits, _width, _height, &_levels );
 
-      if ( err != 0 || dimension != 2 || _scale == 0.0 )
+      if ( err != 0 || dimension != 2 || _levels.scale == 0.0 )
       {
          NSLog(@"Unable to open FITS image : %@", [url absoluteString] );
          fits_report_error( stderr, err );
@@ -216,10 +228,10 @@
 
 - (void) getMinLevel:(double*)vmin maxLevel:(double*)vmax
 {
-   if ( _minValue < _maxValue && _imageScale != 0.0 )
+   if ( _levels.minValue < _levels.maxValue && _levels.imageScale != 0.0 )
    {
-      *vmin = _minValue*_imageScale + _imageZero;
-      *vmax = _maxValue*_imageScale + _imageZero;
+      *vmin = _levels.minValue*_levels.imageScale + _levels.imageZero;
+      *vmax = _levels.maxValue*_levels.imageScale + _levels.imageZero;
    }
    else
    {
@@ -255,7 +267,7 @@
 
       NSAssert( [bitmap bitsPerPixel] == 8, @"Hey, I asked bpp to be 8 !" );
 
-      fits_set_bscale( _fits, _scale, _zero, &err );
+      fits_set_bscale( _fits, _levels.scale, _levels.zero, &err );
 
       if ( err == 0 )
       {
@@ -294,10 +306,10 @@
 
    NSAssert( nPlanes == 1, @"Try to read multiplane FITS" );
 
-   if ( _imageScale == 0.0 )
-      fits_set_bscale( _fits, _scale, _zero, &err );
+   if ( _levels.imageScale == 0.0 )
+      fits_set_bscale( _fits, _levels.scale, _levels.zero, &err );
    else
-      fits_set_bscale( _fits, _imageScale, _imageZero, &err );
+      fits_set_bscale( _fits, _levels.imageScale, _levels.imageZero, &err );
 
 
    if ( err == 0 )
@@ -35,6 +35,8 @@
 /*!
  * @class FITSWriter
  * @abstract FITS file format writer class.
+ * @discussion The image can be compressed as a whole with gzip, or by tiles
+ *    of some lines, with Rice or gzip, in a compressed image extension.
  * @ingroup FileAccess
  */
 @interface FITSWriter : NSObject <LynkeosImageFileWriter>
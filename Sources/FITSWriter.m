@@ -24,8 +24,167 @@
 
 #include "FITSWriter.h"
 
-#define K_NO_COMPRESSION   0
-#define K_GZIP_COMPRESSION 1
+#define K_NO_COMPRESSION        0
+#define K_GZIP_COMPRESSION      1
+#define K_RICE_COMPRESSION      2
+#define K_TILE_GZIP_COMPRESSION 3
+
+//! Number of image lines in each compressed tile
+#define K_TILE_LINES 16
+
+/*!
+ * @abstract Record of data needed for the parallel conversion
+ */
+@interface FITSConversionArgs : NSObject
+{
+@public
+   const REAL *data;       //!< Plane to save
+   void       *buf;        //!< Converted samples, or NULL for extrema only
+   int        imgType;     //!< Kind of samples to convert to
+   u_short    w;           //!< Image width
+   u_short    lineW;       //!< Width of the data lines
+   u_short    h;           //!< Image height
+   double     scale;       //!< Scale applied to the samples
+   double     offset;      //!< Offset applied to the samples
+   double     max;         //!< Maximum value of the integer samples
+   u_short    *y;          //!< Next FITS line to convert
+   NSConditionLock *lock;  //!< Counts the threads which are done
+   double     datamin;     //!< Minimum value of all lines
+   double     datamax;     //!< Maximum value of all lines
+}
+@end
+
+@implementation FITSConversionArgs
+@end
+
+/*!
+ * @abstract Convert one FITS line (counted from the bottom)
+ * @param args The conversion arguments
+ * @param y The FITS line to convert
+ * @param vmin Minimum value found until now
+ * @param vmax Maximum value found until now
+ */
+static void convertLine( FITSConversionArgs *args, u_short y,
+                         double *vmin, double *vmax )
+{
+   const REAL * const line = &args->data[(u_long)(args->h-y-1)*args->lineW];
+   const u_long first = (u_long)y*args->w;
+   u_short x;
+
+   for( x = 0; x < args->w; x++ )
+   {
+      double v = line[x]*args->scale + args->offset;
+
+      // Still look for extrema
+      if ( v < *vmin )
+         *vmin = v;
+      if ( v > *vmax )
+         *vmax = v;
+
+      if ( args->buf == NULL )
+         continue;
+
+      if ( args->imgType == FLOAT_IMG )
+         ((float*)args->buf)[first+x] = (float)v;
+      else if ( args->imgType == DOUBLE_IMG )
+         ((double*)args->buf)[first+x] = v;
+      else
+      {
+         // CFITSIO is given the native integer type, clip and round here
+         if ( v < 0.0 )
+            v = 0.0;
+         if ( v > args->max )
+            v = args->max;
+         v += 0.5;
+
+         switch( args->imgType )
+         {
+            case BYTE_IMG:
+               ((u_char*)args->buf)[first+x] = (u_char)v;
+               break;
+            case USHORT_IMG:
+               ((u_short*)args->buf)[first+x] = (u_short)v;
+               break;
+            case ULONG_IMG:
+               ((u_int*)args->buf)[first+x] = (u_int)v;
+               break;
+         }
+      }
+   }
+}
+
+/*!
+ * @abstract Private methods of FITSWriter
+ */
+@interface FITSWriter(Private)
+/*!
+ * @abstract Convert lines shared with the other threads
+ * @param args The conversion arguments
+ */
+- (void) oneThreadConvert:(FITSConversionArgs*)args ;
+
+/*!
+ * @abstract Convert the whole image in parallel
+ * @param args The conversion arguments
+ */
+- (void) parallelConvert:(FITSConversionArgs*)args ;
+@end
+
+@implementation FITSWriter(Private)
+
+- (void) oneThreadConvert:(FITSConversionArgs*)args
+{
+   double vmin = HUGE, vmax = -HUGE;
+   u_short ourY;
+
+   // Process by sharing lines with other threads
+   for(;;)
+   {
+      ourY = *(args->y);
+      if ( ourY >= args->h )
+         break;
+      if ( __sync_bool_compare_and_swap(args->y, ourY, ourY + 1) )
+         convertLine( args, ourY, &vmin, &vmax );
+   }
+
+   // Merge our extrema and count down on exit
+   [args->lock lock];
+   if ( vmin < args->datamin )
+      args->datamin = vmin;
+   if ( vmax > args->datamax )
+      args->datamax = vmax;
+   [args->lock unlockWithCondition:[args->lock condition]+1];
+}
+
+- (void) parallelConvert:(FITSConversionArgs*)args
+{
+   u_short y = 0;
+   int i;
+
+   args->y = &y;
+   args->lock = [[NSConditionLock alloc] initWithCondition:0];
+   args->datamin = HUGE;
+   args->datamax = -HUGE;
+
+   // Start a thread for each "other processor"
+   for( i = 1; i < numberOfCpus; i++ )
+      [NSThread detachNewThreadSelector:@selector(oneThreadConvert:)
+                               toTarget:self
+                             withObject:args];
+
+   // Do our part of the job
+   [self oneThreadConvert:args];
+
+   // Finally, wait for all threads completion
+   [args->lock lockWhenCondition:numberOfCpus];
+   [args->lock unlock];
+
+   [args->lock release];
+   args->lock = nil;
+   args->y = NULL;
+}
+
+@end
 
 @implementation FITSWriter
 
@@ -78,13 +237,16 @@
               metaData:(NSDictionary*)metaData
 {
    fitsfile *fits;
-   double *buf = nil;
-   u_short x, y;
-   double max, offset, scale, datamax, datamin;
-   int err = 0;
-   NSString *suffix = ( _compression == K_NO_COMPRESSION ? @"" : @".gz" );
+   FITSConversionArgs *args;
+   double max, offset, datamax, datamin;
+   int err = 0, dataType;
+   size_t sampleSize;
+   NSString *suffix = ( _compression == K_GZIP_COMPRESSION ? @".gz" : @"" );
    const char *file;
    long size[2] = {w,h};
+   BOOL tiled = ( _compression == K_RICE_COMPRESSION
+                  || _compression == K_TILE_GZIP_COMPRESSION );
+   BOOL direct;
 
    // Unfortunately, CFITSIO does not handle correctly the 
    // file://localhost/... URL given by Cocoa
@@ -103,6 +265,26 @@
       return;
    }
 
+   if ( tiled )
+   {
+      // Tiles of some lines, the image goes in a compressed extension
+      long tile[2] = {w, K_TILE_LINES};
+
+      if ( _imgType == FLOAT_IMG || _imgType == DOUBLE_IMG )
+      {
+         // Floating point samples are kept lossless : no quantization, and
+         // Rice, which needs integers, is replaced by shuffled Gzip
+         fits_set_compression_type( fits, GZIP_2, &err );
+         fits_set_quantize_level( fits, 0.0, &err );
+      }
+      else
+         fits_set_compression_type( fits,
+                                    (_compression == K_RICE_COMPRESSION ?
+                                     RICE_1 : GZIP_1),
+                                    &err );
+      fits_set_tile_dim( fits, 2, tile, &err );
+   }
+
    fits_create_img(fits, _imgType, 2, size, &err);
 
    offset = 0.0;
@@ -110,51 +292,85 @@
    {
       case BYTE_IMG:
          max = 255.4;
+         dataType = TBYTE;
+         sampleSize = sizeof(u_char);
          break;
       case USHORT_IMG:
          max = 65535.4;
+         dataType = TUSHORT;
+         sampleSize = sizeof(u_short);
          break;
       case ULONG_IMG:
          max = 4294967295.4;
+         dataType = TUINT;
+         sampleSize = sizeof(u_int);
          break;
       case FLOAT_IMG:
+         // No translation
+         max = white;
+         offset = black;
+         dataType = TFLOAT;
+         sampleSize = sizeof(float);
+         break;
       case DOUBLE_IMG:
       default:
          // No translation
          max = white;
          offset = black;
+         dataType = TDOUBLE;
+         sampleSize = sizeof(double);
          break;
    }
-   scale = max - offset;
-
-   // Allocate a translation buffer
-   buf = (double*)malloc( w*sizeof(double) );
-   NSAssert( buf != NULL, @"Could not allocate write buffer" );
 
-   // Save line by line and convert to the FITS coordinate system
-   datamin = HUGE;
-   datamax = -HUGE;
-   for( y = 0; y < h; y++ )
+   // Single precision samples which need no translation are saved as is,
+   // line by line, when there are no tiles to fill at once
+   direct = ( !tiled && _imgType == FLOAT_IMG
+              && PROCESSING_PRECISION == SINGLE_PRECISION
+              && max - offset == 1.0 && offset == 0.0 );
+
+   args = [[FITSConversionArgs alloc] init];
+   args->data = data[0];
+   args->imgType = _imgType;
+   args->w = w;
+   args->lineW = lineW;
+   args->h = h;
+   args->scale = max - offset;
+   args->offset = offset;
+   args->max = max;
+   if ( direct )
+      args->buf = NULL;
+   else
    {
-      long first[2] = {1,y+1};
+      // Convert the whole image in the FITS coordinate system and sample type
+      args->buf = malloc( (size_t)w*h*sampleSize );
+      NSAssert( args->buf != NULL, @"Could not allocate write buffer" );
+   }
 
-      // Translate the values in a buffer before saving
-      for( x = 0; x < w; x++ )
-      {
-         double v = GET_SAMPLE(data[0],x,h-y-1,lineW);
+   [self parallelConvert:args];
+   datamin = args->datamin;
+   datamax = args->datamax;
 
-         v = v*scale + offset;
+   if ( direct )
+   {
+      u_short y;
 
-         // Still look for extrema
-         if ( v < datamin )
-            datamin = v;
-         if ( v > datamax )
-            datamax = v;
+      for( y = 0; y < h; y++ )
+      {
+         long first[2] = {1,y+1};
 
-         buf[x] = v;
+         fits_write_pix( fits, TFLOAT, first, w,
+                         (void*)&data[0][(u_long)(h-y-1)*lineW], &err );
       }
-      fits_write_pix( fits, TDOUBLE, first, w, buf, &err );
    }
+   else
+   {
+      // In one call, for CFITSIO to compress each tile only once
+      long first[2] = {1,1};
+
+      fits_write_pix( fits, dataType, first, (LONGLONG)w*h, args->buf, &err );
+      free( args->buf );
+   }
+   [args release];
 
    // Adjust extrema to the coding
    switch( _imgType )
@@ -197,8 +413,6 @@
 
    if ( err != 0 )
       fits_report_error( stderr, err );
-
-   free( buf );
 }
 
 - (IBAction) changeCompression :(id)sender
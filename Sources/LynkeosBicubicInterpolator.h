@@ -39,11 +39,20 @@
    LynkeosImageBuffer* _image;
    u_short                     _numberOfPlanes;
    NSAffineTransform          *_inverseTransform;
+   NSAffineTransformStruct     _inverseStruct;
    NSPoint                    *_offsets;
    NSPoint                     _origin;
    int                         _x;
    int                         _y;
    REALVECT                    _a[3][4];
+
+   // Vertically interpolated row cache, for the vector interpolation
+   REAL                       *_row;
+   u_short                     _rowPlane;
+   int                         _rowY;
+   double                      _rowDy;
+   int                         _rowFirst;
+   int                         _rowLast;
 }
 @end
 
@@ -32,10 +32,79 @@ static inline void range( CGFloat *v, CGFloat l )
       *v = l - 1.0;
 }
 
+/* Clamp a pixel index to the image */
+static inline int clampIndex( int i, int l )
+{
+   if ( i < 0 )
+      return( 0 );
+   else if ( i >= l )
+      return( l - 1 );
+   else
+      return( i );
+}
+
+/* Catmull-Rom (Keys, a = -0.5) weights for a scalar fractional offset */
+static inline void catmullRomWeights( double t, double w[4] )
+{
+   const double t2 = t*t, t3 = t2*t;
+
+   w[0] = 0.5*(-t + 2.0*t2 - t3);
+   w[1] = 0.5*(2.0 - 5.0*t2 + 3.0*t3);
+   w[2] = 0.5*(t + 4.0*t2 - 3.0*t3);
+   w[3] = 0.5*(t3 - t2);
+}
+
+/* Same, for a vector of fractional offsets */
+static inline void catmullRomWeightsVect( REALVECT t, REALVECT w[4] )
+{
+   const REALVECT half  = {0.5, 0.5, 0.5, 0.5};
+   const REALVECT two   = {2.0, 2.0, 2.0, 2.0};
+   const REALVECT three = {3.0, 3.0, 3.0, 3.0};
+   const REALVECT four  = {4.0, 4.0, 4.0, 4.0};
+   const REALVECT five  = {5.0, 5.0, 5.0, 5.0};
+   const REALVECT t2 = t*t, t3 = t2*t;
+
+   w[0] = half*(two*t2 - t - t3);
+   w[1] = half*(two - five*t2 + three*t3);
+   w[2] = half*(t + four*t2 - three*t3);
+   w[3] = half*(t3 - t2);
+}
+
+/* Vertical pass of the 4 rows window on the columns [from, to[ */
+static void interpolateRowWindow( REAL *row, const REAL * const r[4],
+                                  const double wy[4], int from, int to )
+{
+   const REALVECT w0 = {wy[0], wy[0], wy[0], wy[0]};
+   const REALVECT w1 = {wy[1], wy[1], wy[1], wy[1]};
+   const REALVECT w2 = {wy[2], wy[2], wy[2], wy[2]};
+   const REALVECT w3 = {wy[3], wy[3], wy[3], wy[3]};
+   const int nLanes = sizeof(REALVECT)/sizeof(REAL);
+   int x = from;
+
+   for ( ; x + nLanes <= to; x += nLanes )
+   {
+      REALVECT v0, v1, v2, v3, v;
+
+      // The window is not aligned on vectors, hence the memcpy
+      memcpy( &v0, &r[0][x], sizeof(REALVECT) );
+      memcpy( &v1, &r[1][x], sizeof(REALVECT) );
+      memcpy( &v2, &r[2][x], sizeof(REALVECT) );
+      memcpy( &v3, &r[3][x], sizeof(REALVECT) );
+      v = w0*v0 + w1*v1 + w2*v2 + w3*v3;
+      memcpy( &row[x], &v, sizeof(REALVECT) );
+   }
+
+   for ( ; x < to; x++ )
+      row[x] = wy[0]*r[0][x] + wy[1]*r[1][x] + wy[2]*r[2][x] + wy[3]*r[3][x];
+}
+
 @interface LynkeosBicubicInterpolator(Private)
 
 - (void) cacheMatrixAtX:(int)x Y:(int)y ;
 
+- (const REAL*) rowInPlane:(u_short)plane atY:(int)y0 dy:(double)dy
+                      from:(int)first to:(int)last ;
+
 @end
 
 @implementation LynkeosBicubicInterpolator(Private)
@@ -160,6 +229,47 @@ static inline void range( CGFloat *v, CGFloat l )
    _y = y;
 }
 
+- (const REAL*) rowInPlane:(u_short)plane atY:(int)y0 dy:(double)dy
+                      from:(int)first to:(int)last
+{
+   REAL * const * const data = [_image colorPlanes];
+   const REAL *r[4];
+   double wy[4];
+   int j;
+
+   // Restart the cache on another row, or if the columns are not contiguous
+   if ( plane != _rowPlane || y0 != _rowY || dy != _rowDy
+        || last < _rowFirst || first > _rowLast )
+   {
+      _rowPlane = plane;
+      _rowY = y0;
+      _rowDy = dy;
+      _rowFirst = first;
+      _rowLast = first;
+   }
+
+   if ( first >= _rowFirst && last <= _rowLast )
+      return( _row );
+
+   for ( j = 0; j < 4; j++ )
+      r[j] = &data[plane][clampIndex(y0 + j - 1, _image->_h)*_image->_padw];
+   catmullRomWeights( dy, wy );
+
+   // Extend the cached columns range where needed
+   if ( first < _rowFirst )
+   {
+      interpolateRowWindow( _row, r, wy, first, _rowFirst );
+      _rowFirst = first;
+   }
+   if ( last > _rowLast )
+   {
+      interpolateRowWindow( _row, r, wy, _rowLast, last );
+      _rowLast = last;
+   }
+
+   return( _row );
+}
+
 @end
 
 @implementation LynkeosBicubicInterpolator
@@ -196,6 +306,12 @@ static inline void range( CGFloat *v, CGFloat l )
       _origin = NSZeroPoint;
       _x = INT_MIN;
       _y = INT_MIN;
+      _row = NULL;
+      _rowPlane = 0;
+      _rowY = INT_MIN;
+      _rowDy = 0.0;
+      _rowFirst = 0;
+      _rowLast = 0;
    }
 
    return( self );
@@ -239,7 +355,9 @@ static inline void range( CGFloat *v, CGFloat l )
       _inverseTransform = [[NSAffineTransform alloc] init];
       _inverseTransform.transformStruct = transform;
       [_inverseTransform invert];
+      _inverseStruct = _inverseTransform.transformStruct;
       _origin = NSPointFromIntegerPoint(rect.origin);
+      _row = (REAL*)malloc(_image->_w*sizeof(REAL));
 
       _offsets = (NSPoint*)malloc(nPlanes*sizeof(NSPoint));
       for (i = 0; i < nPlanes; i++)
@@ -256,6 +374,8 @@ static inline void range( CGFloat *v, CGFloat l )
    [_image release];
    if (_offsets != NULL)
       free(_offsets);
+   if (_row != NULL)
+      free(_row);
    if (_inverseTransform != nil)
       [_inverseTransform release];
 
@@ -302,13 +422,79 @@ static inline void range( CGFloat *v, CGFloat l )
 - (REALVECT) interpolateVectInPLane:(u_short)plane
                                 atX:(double)x atY:(double)y
 {
-   // Pending a better implementation
-   u_long i;
-   REALVECT result;
-   for (i = 0; i < sizeof(REALVECT)/sizeof(REAL); i++)
+   const int nLanes = sizeof(REALVECT)/sizeof(REAL);
+   NSPoint p = NSMakePoint(x + _origin.x - _offsets[plane].x,
+                           y + _origin.y - _offsets[plane].y);
+   int x0[nLanes], y0[nLanes];
+   double dy[nLanes];
+   int xmin = INT_MAX, xmax = INT_MIN;
+   REALVECT dx, wx[4], v[4], result;
+   int i, j, k;
+
+   // Source coordinates of each lane, consecutive x are one column step apart
+   p = [_inverseTransform transformPoint:p];
+   for ( k = 0; k < nLanes; k++ )
    {
-      result[i] = [self interpolateInPLane:plane atX:x+(u_short)i atY:y];
+      CGFloat sx = p.x + (CGFloat)k*_inverseStruct.m11,
+              sy = p.y + (CGFloat)k*_inverseStruct.m12;
+
+      range(&sx, (CGFloat)_image->_w);
+      range(&sy, (CGFloat)_image->_h);
+      x0[k] = (int)floor(sx);
+      y0[k] = (int)floor(sy);
+      dx[k] = sx - (double)x0[k];
+      dy[k] = sy - (double)y0[k];
+      if ( x0[k] < xmin )
+         xmin = x0[k];
+      if ( x0[k] > xmax )
+         xmax = x0[k];
    }
-   return (result);
+
+   if ( _inverseStruct.m12 == 0.0 && xmax - xmin <= 4*nLanes )
+   {
+      // All lanes lie on the same row, use the vertically interpolated row
+      const REAL *row = [self rowInPlane:plane atY:y0[0] dy:dy[0]
+                                    from:clampIndex(xmin - 1, _image->_w)
+                                      to:clampIndex(xmax + 2, _image->_w) + 1];
+
+      for ( i = 0; i < 4; i++ )
+         for ( k = 0; k < nLanes; k++ )
+            v[i][k] = row[clampIndex(x0[k] + i - 1, _image->_w)];
+   }
+   else
+   {
+      // Arbitrary transform, each lane has its own 4x4 window
+      REAL * const * const data = [_image colorPlanes];
+
+      for ( k = 0; k < nLanes; k++ )
+      {
+         double wy[4];
+
+         catmullRomWeights( dy[k], wy );
+         for ( i = 0; i < 4; i++ )
+         {
+            const int xi = clampIndex(x0[k] + i - 1, _image->_w);
+            double s = 0.0;
+
+            for ( j = 0; j < 4; j++ )
+               s += wy[j]*GET_SAMPLE(data[plane], xi,
+                                     clampIndex(y0[k] + j - 1, _image->_h),
+                                     _image->_padw);
+            v[i][k] = s;
+         }
+      }
+   }
+
+   // Horizontal pass, on all lanes at once
+   catmullRomWeightsVect( dx, wx );
+   result = wx[0]*v[0] + wx[1]*v[1] + wx[2]*v[2] + wx[3]*v[3];
+
+   for ( k = 0; k < nLanes; k++ )
+   {
+      if ( isnan(result[k]) )
+         result[k] = 0.0;
+   }
+
+   return( result );
 }
 @end
@@ -0,0 +1,70 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+/*!
+ * @header
+ * @abstract Pool of aligned buffers for the images data
+ */
+#ifndef __LYNKEOSBUFFERPOOL_H
+#define __LYNKEOSBUFFERPOOL_H
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract Pool of the buffers holding the image pixels
+ * @discussion The buffers are aligned for SIMD, and sorted in size classes,
+ *    each one being an eighth of a power of two. A released buffer is kept in
+ *    its class, for the next image of a close size to reuse it without any
+ *    allocation nor page fault.
+ *
+ *    The pooled memory counts in the memory budget, and the pool is the first
+ *    to give it back when the budget is exceeded.
+ * @ingroup Processing
+ */
+@interface LynkeosBufferPool : NSObject
+{
+}
+
+/*!
+ * @abstract Get a buffer from the pool
+ * @discussion The buffer content is not initialized.
+ * @param size The needed size, in bytes
+ * @result A buffer of at least this size
+ */
++ (void*) allocateBuffer:(size_t)size ;
+
+/*!
+ * @abstract Give a buffer back to the pool
+ * @param buffer The buffer obtained with allocateBuffer:
+ * @param size The size which was asked for this buffer
+ */
++ (void) releaseBuffer:(void*)buffer size:(size_t)size ;
+
+/*!
+ * @abstract Free all the buffers waiting in the pool
+ */
++ (void) drain ;
+
+@end
+
+#endif
@@ -0,0 +1,180 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "LynkeosProcessing.h"
+#include "LynkeosMemoryBudget.h"
+#include "LynkeosBufferPool.h"
+
+//! Alignment of the buffers, enough for any SIMD and a cache line
+#define K_POOL_ALIGNMENT 64
+//! Size of the smallest class, all the smaller buffers fall in it
+#define K_POOL_MIN_SHIFT 12
+//! Number of classes between two powers of two
+#define K_POOL_DIVISIONS 8
+//! Size of the biggest class
+#define K_POOL_MAX_SHIFT 40
+//! Number of size classes
+#define K_POOL_CLASSES (1 + (K_POOL_MAX_SHIFT-K_POOL_MIN_SHIFT)*K_POOL_DIVISIONS)
+
+/*!
+ * @abstract Free buffers of a size class
+ */
+typedef struct
+{
+   void     **buffers;     //!< Stack of free buffers
+   u_int    count;         //!< Number of free buffers
+} PoolClass_t;
+
+//! Protects the classes
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+//! The free buffers by size class
+static PoolClass_t poolClasses[K_POOL_CLASSES];
+//! Maximum number of free buffers kept in a class
+static u_int poolClassDepth = 0;
+
+/*!
+ * @abstract Find the class of a buffer size
+ * @param size The requested size
+ * @param[out] index The index of the class
+ * @result The size of the buffers in that class
+ */
+static size_t sizeClass( size_t size, u_int *index )
+{
+   u_int shift;
+   size_t step, n;
+
+   if ( size <= ((size_t)1 << K_POOL_MIN_SHIFT) )
+   {
+      *index = 0;
+      return( (size_t)1 << K_POOL_MIN_SHIFT );
+   }
+
+   // The size is in ]2^shift, 2^(shift+1)]
+   for( shift = K_POOL_MIN_SHIFT; ((size-1) >> (shift+1)) != 0; shift++ )
+      ;
+
+   if ( shift >= K_POOL_MAX_SHIFT )
+   {
+      // Not pooled
+      *index = K_POOL_CLASSES;
+      return( size );
+   }
+
+   step = ((size_t)1 << shift)/K_POOL_DIVISIONS;
+   n = (size + step - 1)/step;
+   *index = 1 + (shift - K_POOL_MIN_SHIFT)*K_POOL_DIVISIONS
+              + (u_int)(n - K_POOL_DIVISIONS - 1);
+
+   return( n*step );
+}
+
+@implementation LynkeosBufferPool
+
++ (void*) allocateBuffer:(size_t)size
+{
+   u_int index;
+   const size_t allocSize = sizeClass( size, &index );
+   void *buffer = NULL;
+
+   if ( index < K_POOL_CLASSES )
+   {
+      pthread_mutex_lock( &poolLock );
+      if ( poolClasses[index].count != 0 )
+         buffer = poolClasses[index].buffers[--poolClasses[index].count];
+      pthread_mutex_unlock( &poolLock );
+   }
+
+   if ( buffer == NULL )
+   {
+      if ( posix_memalign( &buffer, K_POOL_ALIGNMENT, allocSize ) != 0 )
+         buffer = NULL;
+      NSAssert1( buffer != NULL, @"Failed to allocate a buffer of %ld bytes",
+                 allocSize );
+      [LynkeosMemoryBudget allocatedMemory:allocSize];
+   }
+
+   return( buffer );
+}
+
++ (void) releaseBuffer:(void*)buffer size:(size_t)size
+{
+   u_int index;
+   const size_t allocSize = sizeClass( size, &index );
+   BOOL pooled = NO;
+
+   if ( buffer == NULL )
+      return;
+
+   // Keep the buffer, unless memory is short
+   if ( index < K_POOL_CLASSES && ![LynkeosMemoryBudget isOverBudget] )
+   {
+      pthread_mutex_lock( &poolLock );
+      if ( poolClassDepth == 0 )
+         poolClassDepth = 2*numberOfCpus + 2;
+      if ( poolClasses[index].buffers == NULL )
+         poolClasses[index].buffers =
+                               (void**)malloc( poolClassDepth*sizeof(void*) );
+      if ( poolClasses[index].count < poolClassDepth )
+      {
+         poolClasses[index].buffers[poolClasses[index].count++] = buffer;
+         pooled = YES;
+      }
+      pthread_mutex_unlock( &poolLock );
+   }
+
+   if ( !pooled )
+   {
+      free( buffer );
+      [LynkeosMemoryBudget freedMemory:allocSize];
+   }
+}
+
++ (void) drain
+{
+   u_long freed = 0;
+   u_int i;
+
+   pthread_mutex_lock( &poolLock );
+   for( i = 0; i < K_POOL_CLASSES; i++ )
+   {
+      // Size of the buffers in this class (the reverse of sizeClass)
+      const size_t allocSize =
+         (i == 0 ? ((size_t)1 << K_POOL_MIN_SHIFT) :
+          ((size_t)1 << (K_POOL_MIN_SHIFT + (i-1)/K_POOL_DIVISIONS))
+          /K_POOL_DIVISIONS*(K_POOL_DIVISIONS + 1 + (i-1)%K_POOL_DIVISIONS));
+
+      while ( poolClasses[i].count != 0 )
+      {
+         free( poolClasses[i].buffers[--poolClasses[i].count] );
+         freed += allocSize;
+      }
+   }
+   pthread_mutex_unlock( &poolLock );
+
+   [LynkeosMemoryBudget freedMemory:freed];
+}
+
+@end
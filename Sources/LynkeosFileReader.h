@@ -216,6 +216,15 @@
                     atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
               lineWidth:(u_short)lineW ;
 
+@optional
+/*!
+ * @abstract Start preparing the image in the background
+ * @discussion This is called, in the processing order, for the images which
+ *   will be processed soon. It shall return without waiting. When it is not
+ *   implemented, the image file is read ahead as a whole by the application.
+ */
+- (void) prefetchImage ;
+
 @end
 
 /*!
@@ -289,6 +298,24 @@
                     atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
               lineWidth:(u_short)lineW ;
 
+@optional
+/*!
+ * @abstract Start reading a frame in the background
+ * @discussion This is called for the frames which will be processed soon. The
+ *   implementation shall only hint the system to read the frame data (see
+ *   LynkeosReadAhead), and return without waiting. The image files are read
+ *   ahead as a whole by the application.
+ * @param index The index of the frame which will be read.
+ */
+- (void) prefetchFrameAtIndex:(u_long)index ;
+
+/*!
+ * @abstract Capture date of a frame, for the formats which record it
+ * @param index The index of the frame.
+ * @result The frame capture date, or nil if it is unknown
+ */
+- (NSDate*) dateOfFrameAtIndex:(u_long)index ;
+
 @end
 
 /*!
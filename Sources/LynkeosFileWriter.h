@@ -140,15 +140,39 @@
  * @ingroup FileAccess
  */
 @protocol LynkeosMovieFileWriterDelegate
+/*!
+ * @abstract Returns the number of frames to write
+ * @result The number of movie frames.
+ */
+- (u_long) numberOfFrames ;
+
 /*!
  * @abstract Retrieve image data for the given frame
+ * @discussion The frames are requested in sequence, the color planes are
+ *    allocated by the writer and filled by the delegate.
  * @param index The index of the frame to retrieve.
- * @param planes An array of color plane pointers filled by the delegate
+ * @param planes An array of color planes filled by the delegate
  * @param lineW The sample width of each color plane.
  */
 - (void) getFrameAtIndex:(u_long)index 
-                withData:(const void * const *)planes
+                withData:(REAL * const *)planes
                lineWidth:(u_short)lineW ;
+
+@optional
+/*!
+ * @abstract Capture date of a frame, for writers which can save it
+ * @param index The index of the frame.
+ * @result The frame capture date, or nil if it is unknown
+ */
+- (NSDate*) dateOfFrameAtIndex:(u_long)index ;
+
+/*!
+ * @abstract Whether the writing shall be abandoned
+ * @discussion The writers which can stop check it between the frames, and
+ *    remove the incomplete file.
+ * @result YES when the user cancelled the writing
+ */
+- (BOOL) isCancelled ;
 @end
 
 /*!
@@ -33,6 +33,8 @@
 #include "processing_core.h"
 #include "LynkeosFourierBuffer.h"
 #include "LynkeosImageBufferAdditions.h"
+#include "LynkeosBufferPool.h"
+#include "LynkeosThreadScheduler.h"
 
 #ifndef DOUBLE_PIXELS
 #define FFTW_COMPLEX fftwf_complex
@@ -105,8 +107,10 @@ void initializeProcessing(void)
    // Create a lock for FFTW non thread safe functions
    pthread_mutex_init( &fftwLock, NULL );
 
-   // Prepare FFTW to work with threads
+   // Prepare FFTW to work with threads, all the CPUs are given to it until a
+   // process splits them
    FFTW_INIT_THREADS();
+   [LynkeosThreadScheduler endProcess];
 
    // Reload FFTW wisdom
    NSFileManager *fileMgr = [NSFileManager defaultManager];
@@ -454,9 +458,13 @@ static void vect_spectrum_div_one_line(LynkeosFourierBuffer *a,
 
       pthread_mutex_lock( &fftwLock );
 
-      _data = FFT_MALLOC( _nPlanes*sizeof(LNKCOMPLEX)*_spadw*_h );
+      // The pool buffers are aligned for FFTW SIMD, and given back to the pool
+      // in LynkeosImageBuffer dealloc
+      _data = [LynkeosBufferPool allocateBuffer:
+                                      _nPlanes*sizeof(LNKCOMPLEX)*_spadw*_h];
       NSAssert( _data != NULL, @"FFT buffer allocation failed" );
       _freeWhenDone = YES;
+      _pooledData = YES;
 
       sizes[0] = _h;
       sizes[1] = _w;
@@ -71,6 +71,7 @@ typedef void(*ImageProcessOneLine_t)(LynkeosImageBuffer*,
 @protected
    REAL    *_planes[3];   ///< Shortcuts to the color planes
    BOOL     _freeWhenDone; ///< Whether to free the planes on dealloc
+   BOOL     _pooledData;   ///< Whether the planes come from the buffer pool
    double   _min[4];          ///< The image minimum value
    double   _max[4];          ///< The image maximum value
 
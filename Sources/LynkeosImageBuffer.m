@@ -36,6 +36,9 @@
 #include "LynkeosImageBufferAdditions.h"
 
 #include "LynkeosGammaCorrecter.h"
+#include "LynkeosMemoryBudget.h"
+#include "LynkeosBufferPool.h"
+#include "LynkeosThreadScheduler.h"
 
 /*!
  * @abstract Compatibility class for file opening
@@ -390,6 +393,7 @@ typedef enum
                          LynkeosImageBuffer*,
                          u_short);
    NSConditionLock *lock;           //!< Exclusive access to this object
+   u_short nThreads;               //!< Number of threads sharing the lines
    u_short startedThreads;         //!< Total number of started threads
    u_short livingThreads;         //!< Number of still living threads
 }
@@ -521,12 +525,12 @@ typedef enum
 
    // Count up on entry
    [args->lock lock];
-   if ( args->startedThreads < numberOfCpus )
+   if ( args->startedThreads < args->nThreads )
       args->startedThreads++;
    else
       NSLog( @"Too much thread start in one_thread_process_image" );
    args->livingThreads++;
-   if ( args->startedThreads == numberOfCpus )
+   if ( args->startedThreads == args->nThreads )
       [args->lock unlockWithCondition:OperationStarted];
    else
       [args->lock unlock];
@@ -589,11 +593,12 @@ typedef enum
    args->y = &y;
    args->lock = lock;
    args->processOneLine = processOneLine;
+   args->nThreads = [LynkeosThreadScheduler rowThreads];
    args->startedThreads = 0;
    args->livingThreads = 0;
 
-   // Start a thread for each "other processor"
-   for( i =  1; i < numberOfCpus; i++ )
+   // Start the other threads given by the scheduler
+   for( i =  1; i < args->nThreads; i++ )
       [NSThread detachNewThreadSelector:@selector(one_thread_process_image:)
                                toTarget:self
                              withObject:args];
@@ -624,6 +629,7 @@ typedef enum
       [self resetMinMax];
       _data = NULL;
       _freeWhenDone = NO;
+      _pooledData = NO;
 
       if ( hasSIMD )
       {
@@ -687,7 +693,7 @@ typedef enum
       if ( copy )
       {
          dataSize = _padw*_h*_nPlanes*sizeof(REAL);
-         _data = malloc( dataSize );
+         _data = [LynkeosBufferPool allocateBuffer:dataSize];
          NSAssert1(_data != NULL,
             @"Failed to allocate a LynkeosImageBuffer of %ld bytes",
             dataSize);
@@ -697,11 +703,17 @@ typedef enum
          else
             memset( _data, 0, dataSize );
          _freeWhenDone = YES;
+         _pooledData = YES;
       }
       else
       {
          _data = data;
          _freeWhenDone = freeWhenDone;
+
+         // The memory given to the buffer counts in the budget
+         if ( _freeWhenDone )
+            [LynkeosMemoryBudget allocatedMemory:
+                                          _padw*_h*_nPlanes*sizeof(REAL)];
       }
 
       // Vectorized instructions are only usable if aligned
@@ -731,8 +743,14 @@ typedef enum
 
 - (void) dealloc
 {
-   if ( _freeWhenDone )
+   if ( _pooledData )
+      [LynkeosBufferPool releaseBuffer:_data
+                                  size:_padw*_h*_nPlanes*sizeof(REAL)];
+   else if ( _freeWhenDone )
+   {
+      [LynkeosMemoryBudget freedMemory:_padw*_h*_nPlanes*sizeof(REAL)];
       free( _data );
+   }
    [super dealloc];
 }
 
@@ -1034,8 +1052,18 @@ typedef enum
                                                    height:_h];
 
          // Make this image become RGB (don't free the buffer, it was moved)
+         if ( _freeWhenDone )
+         {
+            // It was already counted, and the temporary image frees it the
+            // same way we would have done
+            [LynkeosMemoryBudget freedMemory:_padw*_h*_nPlanes*sizeof(REAL)];
+            monoImage->_pooledData = _pooledData;
+         }
          _nPlanes = destPlanes;
-         _data = malloc( _padw*_h*_nPlanes*sizeof(REAL) );
+         _data = [LynkeosBufferPool allocateBuffer:
+                                              _padw*_h*_nPlanes*sizeof(REAL)];
+         _freeWhenDone = YES;
+         _pooledData = YES;
          for( plane = 0; plane < _nPlanes; plane++ )
             _planes[plane] = &((REAL*)_data)[plane*_h*_padw];
 
@@ -0,0 +1,71 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+/*!
+ * @header
+ * @abstract Lock free queue of objects between threads
+ */
+#ifndef __LYNKEOSITEMQUEUE_H
+#define __LYNKEOSITEMQUEUE_H
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract Lock free queue with many producers and one consumer
+ * @discussion Any thread can push objects in the queue, without ever waiting.
+ *    The consumer takes all the queued objects at once, in the order they
+ *    were pushed (per producer).
+ *
+ *    The objects are retained while they are in the queue.
+ * @ingroup Support
+ */
+@interface LynkeosItemQueue : NSObject
+{
+@private
+   void * volatile _head;     //!< Last pushed node
+}
+
+/*!
+ * @abstract Push an object in the queue
+ * @discussion This method can be called from any thread.
+ * @param object The object to queue
+ */
+- (void) pushObject:(id)object ;
+
+/*!
+ * @abstract Take all the queued objects
+ * @discussion Only one thread at a time shall call this method.
+ * @result The objects, from the oldest to the newest, or nil if the queue
+ *    was empty
+ */
+- (NSArray*) drain ;
+
+/*!
+ * @abstract Check if objects are waiting in the queue
+ * @result YES if the queue is empty
+ */
+- (BOOL) isEmpty ;
+
+@end
+
+#endif
@@ -0,0 +1,103 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#include <stdlib.h>
+
+#include "LynkeosItemQueue.h"
+
+/*!
+ * @abstract Node of the queue
+ */
+typedef struct ItemQueueNode_s
+{
+   struct ItemQueueNode_s *next;    //!< Previously pushed node
+   id                     object;   //!< The queued object
+} ItemQueueNode_t;
+
+@implementation LynkeosItemQueue
+
+- (id) init
+{
+   if ( (self = [super init]) != nil )
+      _head = NULL;
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   // Release what was not consumed
+   [self drain];
+   [super dealloc];
+}
+
+- (void) pushObject:(id)object
+{
+   ItemQueueNode_t *node = (ItemQueueNode_t*)malloc( sizeof(ItemQueueNode_t) );
+
+   node->object = [object retain];
+   do
+   {
+      node->next = (ItemQueueNode_t*)_head;
+   } while ( !__sync_bool_compare_and_swap( &_head, node->next, node ) );
+}
+
+- (NSArray*) drain
+{
+   // The consumer takes the whole list at once, there is no ABA problem
+   ItemQueueNode_t *node =
+               (ItemQueueNode_t*)__sync_lock_test_and_set( &_head, NULL );
+   ItemQueueNode_t *reversed = NULL;
+   NSMutableArray *objects;
+
+   if ( node == NULL )
+      return( nil );
+
+   // The list is in the reverse order of the pushes
+   while ( node != NULL )
+   {
+      ItemQueueNode_t *next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+   }
+
+   objects = [NSMutableArray array];
+   while ( reversed != NULL )
+   {
+      ItemQueueNode_t *next = reversed->next;
+      [objects addObject:reversed->object];
+      [reversed->object release];
+      free( reversed );
+      reversed = next;
+   }
+
+   return( objects );
+}
+
+- (BOOL) isEmpty
+{
+   return( _head == NULL );
+}
+
+@end
@@ -0,0 +1,157 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+/*!
+ * @header
+ * @abstract Central budget of the memory used by images and workers
+ */
+#ifndef __LYNKEOSMEMORYBUDGET_H
+#define __LYNKEOSMEMORYBUDGET_H
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract Holder of memory which can give it back on demand
+ * @discussion The decode ahead rings and the decoded data caches of the
+ *    readers register with the budget as consumers.
+ * @ingroup Processing
+ */
+@protocol LynkeosMemoryConsumer <NSObject>
+/*!
+ * @abstract Free the memory which is not in use
+ * @discussion Called while the memory budget is exceeded, with no cache lock
+ *    held. The freed memory shall be registered with freedMemory:
+ */
+- (void) releaseMemory ;
+@end
+
+/*!
+ * @abstract Governor of the memory used by the image processing
+ * @discussion The image buffers register their memory here when they are
+ *    allocated and freed. When the budget is exceeded, the common caches are
+ *    shrunk first, then the registered consumers. If it is still exceeded,
+ *    the number of list processing
+ *    threads and the read ahead depth are reduced, down to one thread and no
+ *    read ahead at all.
+ *
+ *    A budget of zero means no limit.
+ * @ingroup Processing
+ */
+@interface LynkeosMemoryBudget : NSObject
+{
+}
+
+/*!
+ * @abstract Set the memory budget
+ * @param budget The maximum memory for the images, in bytes, 0 for no limit
+ */
++ (void) setBudget:(u_long)budget ;
+
+/*!
+ * @abstract Access to the memory budget
+ * @result The maximum memory for the images, in bytes
+ */
++ (u_long) budget ;
+
+/*!
+ * @abstract Memory currently registered
+ * @result The memory used by the images, in bytes
+ */
++ (u_long) usedMemory ;
+
+/*!
+ * @abstract Register a memory allocation
+ * @param size The allocated size, in bytes
+ */
++ (void) allocatedMemory:(u_long)size ;
+
+/*!
+ * @abstract Register a memory release
+ * @param size The freed size, in bytes
+ */
++ (void) freedMemory:(u_long)size ;
+
+/*!
+ * @abstract Whether the memory budget is exceeded
+ * @result YES if the registered memory exceeds the budget
+ */
++ (BOOL) isOverBudget ;
+
+/*!
+ * @abstract Register a memory consumer
+ * @discussion The consumer is not retained, it shall remove itself before
+ *    being deallocated.
+ * @param consumer The consumer to ask for memory when over budget
+ */
++ (void) addConsumer:(id <LynkeosMemoryConsumer>)consumer ;
+
+/*!
+ * @abstract Unregister a memory consumer
+ * @param consumer The consumer to remove
+ */
++ (void) removeConsumer:(id <LynkeosMemoryConsumer>)consumer ;
+
+/*!
+ * @abstract Shrink the common caches while the budget is exceeded
+ * @discussion The idle buffers of the buffer pool are freed first, then the
+ *    caches, then the consumers memory. This shall not be called with a cache
+ *    lock held, it is to be called between the processing of two items.
+ */
++ (void) relieveMemory ;
+
+/*!
+ * @abstract Number of workers the budget allows
+ * @discussion All the workers are allowed below three quarters of the budget,
+ *    then their number decreases down to one when the budget is reached.
+ * @param wanted The number of workers wanted
+ * @result The number of workers allowed, at least one
+ */
++ (u_long) allowedWorkers:(u_long)wanted ;
+
+/*!
+ * @abstract Number of images to read ahead of the processing
+ * @result The read ahead depth, 0 when the budget is exceeded
+ */
++ (u_long) readAheadDepth ;
+
+/*!
+ * @abstract Register the start of a list processing thread
+ */
++ (void) listThreadStarted ;
+
+/*!
+ * @abstract Ask if a list processing thread shall stop to spare memory
+ * @discussion When YES is returned, the thread is considered as ended and
+ *    shall stop processing the list, its items are left to the other threads.
+ * @result Whether the calling thread shall stop
+ */
++ (BOOL) listThreadShallStop ;
+
+/*!
+ * @abstract Register the end of a list processing thread
+ */
++ (void) listThreadEnded ;
+
+@end
+
+#endif
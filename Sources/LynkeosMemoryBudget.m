@@ -0,0 +1,157 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#include "LynkeosProcessing.h"
+#include "LynkeosObjectCache.h"
+#include "LynkeosBufferPool.h"
+#include "LynkeosMemoryBudget.h"
+
+//! Maximum memory for the images, 0 for no limit
+static u_long memoryBudget = 0;
+//! Memory registered by the images, updated atomically
+static volatile u_long usedMemory = 0;
+//! Number of running list processing threads, updated atomically
+static volatile u_long listThreads = 0;
+//! Registered memory consumers, not retained
+static NSMutableArray *consumers = nil;
+//! Protects the consumers list, a consumer may release others when called
+static NSRecursiveLock *consumersLock = nil;
+
+@implementation LynkeosMemoryBudget
+
++ (void) initialize
+{
+   if ( self == [LynkeosMemoryBudget class] )
+   {
+      consumers = (NSMutableArray*)CFArrayCreateMutable( NULL, 0, NULL );
+      consumersLock = [[NSRecursiveLock alloc] init];
+   }
+}
+
++ (void) setBudget:(u_long)budget
+{
+   memoryBudget = budget;
+}
+
++ (u_long) budget { return( memoryBudget ); }
+
++ (u_long) usedMemory { return( usedMemory ); }
+
++ (void) allocatedMemory:(u_long)size
+{
+   __sync_add_and_fetch( &usedMemory, size );
+}
+
++ (void) freedMemory:(u_long)size
+{
+   __sync_sub_and_fetch( &usedMemory, size );
+}
+
++ (BOOL) isOverBudget
+{
+   return( memoryBudget != 0 && usedMemory > memoryBudget );
+}
+
++ (void) addConsumer:(id <LynkeosMemoryConsumer>)consumer
+{
+   [consumersLock lock];
+   [consumers addObject:consumer];
+   [consumersLock unlock];
+}
+
++ (void) removeConsumer:(id <LynkeosMemoryConsumer>)consumer
+{
+   [consumersLock lock];
+   [consumers removeObjectIdenticalTo:consumer];
+   [consumersLock unlock];
+}
+
++ (void) relieveMemory
+{
+   u_long i;
+
+   if ( ![self isOverBudget] )
+      return;
+
+   // The idle pooled buffers are the first to give back memory, then the caches
+   [LynkeosBufferPool drain];
+   if ( ![self isOverBudget] )
+      return;
+
+   [[LynkeosObjectCache movieCache] releaseMemory];
+   [[LynkeosObjectCache frameCache] releaseMemory];
+   [[LynkeosObjectCache imageProcessingCache] releaseMemory];
+
+   // The consumers cannot be deallocated while they are called
+   [consumersLock lock];
+   for( i = 0; i < [consumers count] && [self isOverBudget]; i++ )
+      [[consumers objectAtIndex:i] releaseMemory];
+   [consumersLock unlock];
+}
+
++ (u_long) allowedWorkers:(u_long)wanted
+{
+   const u_long used = usedMemory;
+   const u_long threshold = memoryBudget - memoryBudget/4;
+
+   if ( memoryBudget == 0 || used <= threshold || wanted <= 1 )
+      return( wanted );
+   else if ( used >= memoryBudget )
+      return( 1 );
+   else
+      return( 1 + (wanted - 1)*(memoryBudget - used)/(memoryBudget/4) );
+}
+
++ (u_long) readAheadDepth
+{
+   if ( [self isOverBudget] )
+      return( 0 );
+   else
+      return( [self allowedWorkers:numberOfCpus] );
+}
+
++ (void) listThreadStarted
+{
+   __sync_add_and_fetch( &listThreads, 1 );
+}
+
++ (BOOL) listThreadShallStop
+{
+   u_long n;
+
+   // The last thread never stops
+   while ( (n = listThreads) > [self allowedWorkers:n] )
+   {
+      if ( __sync_bool_compare_and_swap( &listThreads, n, n-1 ) )
+         return( YES );
+   }
+
+   return( NO );
+}
+
++ (void) listThreadEnded
+{
+   __sync_sub_and_fetch( &listThreads, 1 );
+}
+
+@end
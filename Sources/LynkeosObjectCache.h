@@ -43,18 +43,37 @@ typedef enum
    CacheMemorySize
 } CacheCapacityStrategy_t;
 
+//! Part of the cache, with its own lock
+struct LynkeosCacheShard;
+
+@class LynkeosScratchFile;
+
 /*!
  * @abstract This class caches any kind of object
+ * @discussion The objects are spread in shards according to their key, each
+ *    one with its own lock, hash table and list in recency order. All
+ *    accesses are in constant time, and the cache can be used by several
+ *    threads at once.
+ *
+ *    When the cache is full, the least recently used object of all the shards
+ *    is removed. If the cache has a second level, the removed images are
+ *    written in it by a background thread, and read back when they are
+ *    needed again.
+ *
+ *    The least recently used images are also removed when the memory budget
+ *    is exceeded.
  */
 @interface LynkeosObjectCache : NSObject
 {
 @private
    CacheCapacityStrategy_t _capacityStrategy; //!< Cache capacity strategy
-   NSMutableDictionary *_cacheDict;    //!< Objects stored by keys
-   NSMutableArray      *_keyAge;       //!< Keys stored by age
+   struct LynkeosCacheShard *_shards;  //!< Objects spread by key hash
    u_long               _capacity;     //!< Maximum number or size
-   u_long               _size;         //!< Current size
+   volatile u_long      _size;         //!< Current size, updated atomically
+   volatile u_long      _clock;        //!< Age of the last used object
    u_short              _policy;       //!< Refresh policy
+   LynkeosScratchFile   *_secondLevel; //!< Disk storage of removed images
+   NSOperationQueue     *_spillQueue;  //!< Writes in the second level
 }
 
 /*!
@@ -71,6 +90,12 @@ typedef enum
  */
 + (void) setImageProcessingCache:(LynkeosObjectCache*)cache ;
 
+/*!
+ * @abstract Common cache for the decoded frames of the movie items
+ * @param cache The new frames cache
+ */
++ (void) setFrameCache:(LynkeosObjectCache*)cache ;
+
 /*!
  * @abstract Common cache for movie classes
  * @result The movie class common cache
@@ -83,6 +108,22 @@ typedef enum
  */
 + (LynkeosObjectCache*) imageProcessingCache ;
 
+/*!
+ * @abstract Common cache for the decoded frames of the movie items
+ * @discussion It exists only when a scratch file is available as its second
+ *    level, to spare the decoding of compressed movies on the later passes.
+ * @result The frames common cache
+ */
++ (LynkeosObjectCache*) frameCache ;
+
+/*!
+ * @abstract Remove the objects of an owner from all the common caches
+ * @discussion The caches do not retain the owners, which shall call this
+ *    method when they are deleted.
+ * @param owner The object which owns the cached ones
+ */
++ (void) forgetOwner:(id)owner ;
+
 /*!
  * @abstract Initializer
  * @discussion When first added to the cache, objects are always at the top,
@@ -106,22 +147,67 @@ typedef enum
 
 /*!
  * @abstract Retrieve an object from the cache
+ * @discussion The object is autoreleased by the calling thread, for it to
+ *    remain valid even if another thread removes it from the cache.
  * @param key the key for this object
  * @result The object it it was found in the cache, nil otherwise
  */
 - (NSObject*) getObjectForKey:(id)key ;
 
+/*!
+ * @abstract Put an object identified by its owner and an index in the cache
+ * @discussion This avoids building a key object for each access, for example
+ *    for the frames of a movie. The owner is not retained, it shall remove
+ *    its objects with removeObjectsForOwner: when it is deleted.
+ * @param obj The object to add to the cache
+ * @param owner The object which owns the cached one, compared by address
+ * @param index The index of the cached object for its owner
+ */
+- (void) setObject:(NSObject*)obj forOwner:(id)owner index:(u_long)index ;
+
+/*!
+ * @abstract Retrieve an object identified by its owner and an index
+ * @param owner The object which owns the cached one
+ * @param index The index of the cached object for its owner
+ * @result The object it it was found in the cache, nil otherwise
+ */
+- (NSObject*) getObjectForOwner:(id)owner index:(u_long)index ;
+
 /*!
  * @abstract Remove an object from the cache
  * @param key the key for this object
  */
 - (void) removeObjectForKey:(id)key ;
 
+/*!
+ * @abstract Remove all the objects of an owner, in both levels
+ * @param owner The object which owns the cached ones
+ */
+- (void) removeObjectsForOwner:(id)owner ;
+
 /*!
  * @abstract Adapt the cache to a new size
  * @param capacity The new size
  */
 - (void) setCapacity:(u_long)capacity ;
+
+/*!
+ * @abstract Remove the least recently used images while the memory budget is
+ *    exceeded
+ */
+- (void) releaseMemory ;
+
+/*!
+ * @abstract Add a disk storage behind the cache
+ * @discussion Only LynkeosImageBuffer objects are written in the second level.
+ * @param scratch The scratch file used as a second level, or nil
+ */
+- (void) setSecondLevel:(LynkeosScratchFile*)scratch ;
+
+/*!
+ * @abstract Wait for the removed images to be written in the second level
+ */
+- (void) waitForSecondLevel ;
 @end
 
 #endif
@@ -20,45 +20,432 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // 
 
+#include <pthread.h>
+
 #include <LynkeosCore/LynkeosImageBuffer.h>
+#include "LynkeosScratchFile.h"
+#include "LynkeosMemoryBudget.h"
 #include "LynkeosObjectCache.h"
 
+//! Number of independently locked parts of a cache
+#define K_CACHE_SHARDS 16
+//! Maximum number of images waiting to be written in the second level
+#define K_MAX_PENDING_SPILLS 8
+
 //! Movie cache singleton instance
 static LynkeosObjectCache *movieCache = nil;
 //! Image processing cache singleton instance
 static LynkeosObjectCache *imageProcessingCache = nil;
+//! Frames cache singleton instance
+static LynkeosObjectCache *frameCache = nil;
+
+/*!
+ * @abstract Key of a cached object
+ */
+typedef struct
+{
+   //! Key object, or owner of the cached object which is not retained
+   id       object;
+   u_long   index;     //!< Index of the cached object for its owner
+   BOOL     indexed;   //!< Whether the key is the owner and index
+} CacheKey_t;
+
+/*!
+ * @abstract Entry of a cached object, linked in recency order
+ */
+typedef struct CacheEntry
+{
+   CacheKey_t        key;     //!< The key is embedded in the entry
+   NSObject          *obj;    //!< The cached object
+   u_long            size;    //!< Size of the object for the capacity
+   u_long            age;     //!< Value of the cache clock at last use
+   BOOL              stored;  //!< Whether it is also in the second level
+   struct CacheEntry *older;  //!< Previous entry in recency order
+   struct CacheEntry *newer;  //!< Next entry in recency order
+} CacheEntry_t;
+
+/*!
+ * @abstract Part of the cache, with its own lock
+ */
+struct LynkeosCacheShard
+{
+   pthread_mutex_t         lock;     //!< Protects this shard
+   CFMutableDictionaryRef  entries;  //!< Entries by key
+   CacheEntry_t            *oldest;  //!< Least recently used entry
+   CacheEntry_t            *newest;  //!< Most recently used entry
+};
+
+//! Hash of a cache key
+static CFHashCode keyHash( const void *value )
+{
+   const CacheKey_t *key = (const CacheKey_t*)value;
+
+   if ( key->indexed )
+      return( (((CFHashCode)key->object >> 4) ^ (key->index*2654435761UL)) );
+   else
+      return( [key->object hash] );
+}
+
+//! Equality of cache keys
+static Boolean keyEqual( const void *value1, const void *value2 )
+{
+   const CacheKey_t *key1 = (const CacheKey_t*)value1,
+                    *key2 = (const CacheKey_t*)value2;
+
+   if ( key1->indexed != key2->indexed )
+      return( false );
+   else if ( key1->indexed )
+      return( key1->object == key2->object && key1->index == key2->index );
+   else
+      return( [key1->object isEqual:key2->object] );
+}
+
+//! Callbacks of the entries dictionaries, the keys belong to the entries
+static const CFDictionaryKeyCallBacks keyCallBacks =
+{ 0, NULL, NULL, NULL, keyEqual, keyHash };
+
+/*!
+ * @abstract Key object of an image in the second level
+ * @discussion It is built only when the second level is accessed.
+ */
+@interface LynkeosCacheKeyObject : NSObject <NSCopying>
+{
+@public
+   CacheKey_t  _key;       //!< The key of the cache entry
+}
+//! Initialize with a copy of the cache key
+- (id) initWithCacheKey:(const CacheKey_t*)key ;
+@end
+
+@implementation LynkeosCacheKeyObject
+- (id) initWithCacheKey:(const CacheKey_t*)key
+{
+   if ( (self = [self init]) != nil )
+   {
+      _key = *key;
+      // The owner is only compared by address
+      if ( !key->indexed )
+         _key.object = [key->object copy];
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   if ( !_key.indexed )
+      [_key.object release];
+   [super dealloc];
+}
+
+- (id) copyWithZone:(NSZone*)zone
+{
+   return( [self retain] );
+}
+
+- (NSUInteger) hash
+{
+   return( keyHash( &_key ) );
+}
+
+- (BOOL) isEqual:(id)anObject
+{
+   return( [anObject isKindOfClass:[LynkeosCacheKeyObject class]]
+           && keyEqual( &_key, &((LynkeosCacheKeyObject*)anObject)->_key ) );
+}
+@end
+
+/*!
+ * @abstract Delete an entry removed from the cache
+ * @discussion It is called out of the shard lock, as the release of the
+ *    objects may run any code.
+ * @param entry The entry to delete
+ */
+static void deleteEntry( CacheEntry_t *entry )
+{
+   if ( !entry->key.indexed )
+      [entry->key.object release];
+   [entry->obj release];
+   free( entry );
+}
 
 /*!
  * @abstract Private methods of LynkeosObjectCache
  */
 @interface LynkeosObjectCache(Private)
-//! Change the size of the memory strategy cache
+//! Shard in which an object is stored
+- (struct LynkeosCacheShard*) shardForKey:(const CacheKey_t*)key ;
+//! Put the entry at the most recent end of its shard list
+- (void) refreshEntry:(CacheEntry_t*)entry
+              inShard:(struct LynkeosCacheShard*)shard ;
+//! Remove the entry from its shard, it is deleted by the caller
+- (void) unlinkEntry:(CacheEntry_t*)entry
+             inShard:(struct LynkeosCacheShard*)shard ;
+//! Common implementation of the set methods
+- (void) setObject:(NSObject*)obj forCacheKey:(const CacheKey_t*)key
+            stored:(BOOL)stored ;
+//! Common implementation of the get methods
+- (NSObject*) getObjectForCacheKey:(const CacheKey_t*)key ;
+//! Delete the least recently used objects until the capacity and the memory
+//! budget are respected
 - (void) adjustCacheSize ;
+//! Write a removed image in the second level, in the spill thread
+- (void) spillImage:(LynkeosImageBuffer*)image
+        forCacheKey:(const CacheKey_t*)key stored:(BOOL)stored ;
+//! Remove an image from the second level, after the pending spills
+- (void) secondLevelRemoveImageForKey:(LynkeosCacheKeyObject*)keyObj ;
 @end
 
 @implementation LynkeosObjectCache(Private)
+- (struct LynkeosCacheShard*) shardForKey:(const CacheKey_t*)key
+{
+   CFHashCode h = keyHash( key );
+
+   // Mix the high bits in, as the hash table uses the low ones
+   h ^= (h >> 16) ^ (h >> 8);
+
+   return( &_shards[h % K_CACHE_SHARDS] );
+}
+
+- (void) refreshEntry:(CacheEntry_t*)entry
+              inShard:(struct LynkeosCacheShard*)shard
+{
+   entry->age = __sync_add_and_fetch( &_clock, 1 );
+
+   if ( entry == shard->newest )
+      return;
+
+   // Unlink
+   if ( entry->older != NULL )
+      entry->older->newer = entry->newer;
+   else
+      shard->oldest = entry->newer;
+   entry->newer->older = entry->older;
+
+   // And link at the newest end
+   entry->older = shard->newest;
+   entry->newer = NULL;
+   shard->newest->newer = entry;
+   shard->newest = entry;
+}
+
+- (void) unlinkEntry:(CacheEntry_t*)entry
+             inShard:(struct LynkeosCacheShard*)shard
+{
+   CFDictionaryRemoveValue( shard->entries, &entry->key );
+
+   if ( entry->older != NULL )
+      entry->older->newer = entry->newer;
+   else
+      shard->oldest = entry->newer;
+   if ( entry->newer != NULL )
+      entry->newer->older = entry->older;
+   else
+      shard->newest = entry->older;
+
+   __sync_sub_and_fetch( &_size, entry->size );
+}
+
+- (void) setObject:(NSObject*)obj forCacheKey:(const CacheKey_t*)key
+            stored:(BOOL)stored
+{
+   struct LynkeosCacheShard *shard = [self shardForKey:key];
+   CacheEntry_t *entry;
+   NSObject *replaced = nil;
+   u_long size = 1;
+
+   // Update cache size for memory strategy
+   if ( _capacityStrategy == CacheMemorySize )
+   {
+      NSAssert( [obj isKindOfClass:[LynkeosImageBuffer class]],
+                @"Inconsistent object for memory size cache strategy" );
+      size = [(LynkeosImageBuffer*)obj memorySize];
+   }
+
+   pthread_mutex_lock( &shard->lock );
+
+   entry = (CacheEntry_t*)CFDictionaryGetValue( shard->entries, key );
+   if ( entry == NULL )
+   {
+      // Add it at the newest end
+      entry = (CacheEntry_t*)malloc( sizeof(CacheEntry_t) );
+      entry->key = *key;
+      // Like a dictionary, the cache keeps a copy of the key objects, but
+      // the owners are not retained, they remove their objects when deleted
+      if ( !key->indexed )
+         entry->key.object = [key->object copy];
+      entry->obj = [obj retain];
+      entry->size = size;
+      entry->stored = stored;
+      entry->age = __sync_add_and_fetch( &_clock, 1 );
+      entry->older = shard->newest;
+      entry->newer = NULL;
+      if ( shard->newest != NULL )
+         shard->newest->newer = entry;
+      else
+         shard->oldest = entry;
+      shard->newest = entry;
+      CFDictionarySetValue( shard->entries, &entry->key, entry );
+
+      __sync_add_and_fetch( &_size, size );
+   }
+   else
+   {
+      // Replace the object
+      replaced = entry->obj;
+      entry->obj = [obj retain];
+      __sync_add_and_fetch( &_size, size );
+      __sync_sub_and_fetch( &_size, entry->size );
+      entry->size = size;
+      entry->stored = stored;
+
+      // Change keys order according to policy
+      if ( _policy & WriteRefresh )
+         [self refreshEntry:entry inShard:shard];
+   }
+
+   pthread_mutex_unlock( &shard->lock );
+
+   [replaced release];
+
+   // A new object makes obsolete the one in the second level
+   if ( _secondLevel != nil && !stored )
+   {
+      LynkeosCacheKeyObject *keyObj =
+                          [[LynkeosCacheKeyObject alloc] initWithCacheKey:key];
+      [self secondLevelRemoveImageForKey:keyObj];
+      [keyObj release];
+   }
+
+   // If the cache is full,
+   // delete the oldest objects to restore the cache capacity
+   [self adjustCacheSize];
+}
+
+- (NSObject*) getObjectForCacheKey:(const CacheKey_t*)key
+{
+   struct LynkeosCacheShard *shard = [self shardForKey:key];
+   CacheEntry_t *entry;
+   NSObject *obj = nil;
+
+   pthread_mutex_lock( &shard->lock );
+
+   // Find the object if still in the cache
+   entry = (CacheEntry_t*)CFDictionaryGetValue( shard->entries, key );
+   if ( entry != NULL )
+   {
+      obj = [[entry->obj retain] autorelease];
+
+      // Change keys order according to policy
+      if ( _policy & ReadRefresh )
+         [self refreshEntry:entry inShard:shard];
+   }
+
+   pthread_mutex_unlock( &shard->lock );
+
+   // Try to read it back from the second level
+   if ( obj == nil && _secondLevel != nil )
+   {
+      LynkeosCacheKeyObject *keyObj =
+                          [[LynkeosCacheKeyObject alloc] initWithCacheKey:key];
+      obj = [_secondLevel imageForKey:keyObj];
+      [keyObj release];
+
+      if ( obj != nil )
+         [self setObject:obj forCacheKey:key stored:YES];
+   }
+
+   return( obj );
+}
+
+- (void) spillImage:(LynkeosImageBuffer*)image
+        forCacheKey:(const CacheKey_t*)key stored:(BOOL)stored
+{
+   LynkeosScratchFile *scratch = _secondLevel;
+   LynkeosCacheKeyObject *keyObj;
+
+   // When the disk does not keep up, the image is lost rather than holding
+   // the memory
+   if ( [_spillQueue operationCount] >= K_MAX_PENDING_SPILLS )
+      return;
+
+   // The block retains the image and the key until the image is written
+   keyObj = [[[LynkeosCacheKeyObject alloc] initWithCacheKey:key] autorelease];
+   [_spillQueue addOperationWithBlock:^
+   {
+      if ( !stored || ![scratch hasImageForKey:keyObj] )
+         [scratch setImage:image forKey:keyObj];
+   }];
+}
+
+- (void) secondLevelRemoveImageForKey:(LynkeosCacheKeyObject*)keyObj
+{
+   LynkeosScratchFile *scratch = _secondLevel;
+
+   [_spillQueue addOperationWithBlock:^
+   {
+      [scratch removeImageForKey:keyObj];
+   }];
+}
+
 - (void) adjustCacheSize
 {
    // Delete now obsolete object
-   while ( (_capacityStrategy == CacheNumberOfObjects
-            && [_keyAge count] >= _capacity) ||
-          (_capacityStrategy == CacheMemorySize && _size >= _capacity) )
+   for( ;; )
    {
-      id cachedKey = [_keyAge objectAtIndex:0];
-      LynkeosImageBuffer *cachedObj = [_cacheDict objectForKey:cachedKey];
+      struct LynkeosCacheShard *victim = NULL;
+      CacheEntry_t *entry = NULL;
+      u_long oldestAge = 0;
+      int i;
+      // Only the images are removed for the memory budget, as only they
+      // register their memory
+      const BOOL forBudget = (_size < _capacity);
+
+      if ( forBudget && (_size == 0 || ![LynkeosMemoryBudget isOverBudget]) )
+         break;
 
-      if ( _capacityStrategy == CacheMemorySize )
+      // Look for the least recently used object in all the shards
+      for( i = 0; i < K_CACHE_SHARDS; i++ )
       {
-         u_long objSize = [cachedObj memorySize];
+         struct LynkeosCacheShard *shard = &_shards[i];
 
-         if ( objSize < _size )
-            _size -= objSize;
-         else
-            _size = 0;
+         pthread_mutex_lock( &shard->lock );
+         if ( shard->oldest != NULL
+              && (victim == NULL || shard->oldest->age < oldestAge) )
+         {
+            victim = shard;
+            oldestAge = shard->oldest->age;
+         }
+         pthread_mutex_unlock( &shard->lock );
       }
 
-      [_cacheDict removeObjectForKey:cachedKey];
-      [_keyAge removeObjectAtIndex:0];
+      if ( victim == NULL )
+         break;
+
+      // It may have been used in between, but it is still among the oldest
+      pthread_mutex_lock( &victim->lock );
+      entry = victim->oldest;
+      if ( entry != NULL && forBudget
+           && ![entry->obj isKindOfClass:[LynkeosImageBuffer class]] )
+         entry = NULL;
+      if ( entry != NULL )
+      {
+         [self unlinkEntry:entry inShard:victim];
+
+         // Spill the image to the second level, in the shard lock for a
+         // removal of the same object to be queued after the spill
+         if ( _secondLevel != nil
+              && [entry->obj isKindOfClass:[LynkeosImageBuffer class]] )
+            [self spillImage:(LynkeosImageBuffer*)entry->obj
+                 forCacheKey:&entry->key stored:entry->stored];
+      }
+      pthread_mutex_unlock( &victim->lock );
+
+      if ( entry == NULL && forBudget )
+         break;
+
+      if ( entry != NULL )
+         deleteEntry( entry );
    }
 }
 @end
@@ -67,6 +454,14 @@ static LynkeosObjectCache *imageProcessingCache = nil;
 
 + (LynkeosObjectCache*) movieCache { return( movieCache ); }
 + (LynkeosObjectCache*) imageProcessingCache { return( imageProcessingCache ); }
++ (LynkeosObjectCache*) frameCache { return( frameCache ); }
+
++ (void) forgetOwner:(id)owner
+{
+   [movieCache removeObjectsForOwner:owner];
+   [imageProcessingCache removeObjectsForOwner:owner];
+   [frameCache removeObjectsForOwner:owner];
+}
 
 + (void) setMovieCache:(LynkeosObjectCache*)cache
 {
@@ -90,24 +485,41 @@ static LynkeosObjectCache *imageProcessingCache = nil;
    imageProcessingCache = cache;
 }
 
++ (void) setFrameCache:(LynkeosObjectCache*)cache
+{
+   NSAssert( frameCache == nil || cache == nil,
+            @"Duplicate creation of the frames cache" );
+   if ( frameCache != nil )
+      [frameCache release];
+   if ( cache != nil )
+      [cache retain];
+   frameCache = cache;
+}
+
 - (id) initWithStrategy:(CacheCapacityStrategy_t)strategy
                capacity:(u_long)capacity policy:(u_short)policy
 {
    if ( (self = [self init]) != nil )
    {
-      u_long initialCapacity;
+      int i;
 
       _capacityStrategy = strategy;
-      if ( strategy == CacheNumberOfObjects )
-         initialCapacity = capacity+1;
-      else
-         initialCapacity = 1;
-      _cacheDict =
-          [[NSMutableDictionary dictionaryWithCapacity:initialCapacity] retain];
-      _keyAge = [[NSMutableArray arrayWithCapacity:initialCapacity] retain];
+      _shards = (struct LynkeosCacheShard*)malloc(
+                             K_CACHE_SHARDS*sizeof(struct LynkeosCacheShard) );
+      for( i = 0; i < K_CACHE_SHARDS; i++ )
+      {
+         pthread_mutex_init( &_shards[i].lock, NULL );
+         _shards[i].entries = CFDictionaryCreateMutable( NULL, 0,
+                                                         &keyCallBacks, NULL );
+         _shards[i].oldest = NULL;
+         _shards[i].newest = NULL;
+      }
       _capacity = capacity;
       _policy = policy;
       _size = 0;
+      _clock = 0;
+      _secondLevel = nil;
+      _spillQueue = nil;
    }
 
    return( self );
@@ -115,71 +527,131 @@ static LynkeosObjectCache *imageProcessingCache = nil;
 
 - (void) dealloc
 {
-   [_cacheDict release];
-   [_keyAge release];
+   int i;
+
+   for( i = 0; i < K_CACHE_SHARDS; i++ )
+   {
+      while ( _shards[i].oldest != NULL )
+      {
+         CacheEntry_t *entry = _shards[i].oldest;
+
+         [self unlinkEntry:entry inShard:&_shards[i]];
+         deleteEntry( entry );
+      }
+      CFRelease( _shards[i].entries );
+      pthread_mutex_destroy( &_shards[i].lock );
+   }
+   free( _shards );
+   [_spillQueue waitUntilAllOperationsAreFinished];
+   [_spillQueue release];
+   [_secondLevel release];
 
    [super dealloc];
 }
 
 - (void) setObject:(NSObject*)obj forKey:(id)key
 {
-   NSUInteger keyIdx;
+   CacheKey_t cacheKey = { key, 0, NO };
 
-   if ( _capacityStrategy == CacheMemorySize )
-      NSAssert( [obj isKindOfClass:[LynkeosImageBuffer class]],
-                @"Inconsistent object for memory size cache strategy" );
+   [self setObject:obj forCacheKey:&cacheKey stored:NO];
+}
 
-   // Put the object in the dictionary
-   [_cacheDict setObject:obj forKey:key];
+- (NSObject*) getObjectForKey:(id)key
+{
+   CacheKey_t cacheKey = { key, 0, NO };
 
-   // If the key is not already known
-   keyIdx = [_keyAge indexOfObject:key];
-   if ( keyIdx == NSNotFound )
-   {
-      // Add it to the keys array
-      [_keyAge addObject:key];
+   return( [self getObjectForCacheKey:&cacheKey] );
+}
 
-      // Update cache size for memory strategy
-      if ( _capacityStrategy == CacheMemorySize )
-         _size += [(LynkeosImageBuffer*)obj memorySize];
+- (void) setObject:(NSObject*)obj forOwner:(id)owner index:(u_long)index
+{
+   CacheKey_t cacheKey = { owner, index, YES };
 
-      // If the cache is full,
-      // delete the oldest objects to restore the cache capacity
-      [self adjustCacheSize];
-   }
-   else
+   [self setObject:obj forCacheKey:&cacheKey stored:NO];
+}
+
+- (NSObject*) getObjectForOwner:(id)owner index:(u_long)index
+{
+   CacheKey_t cacheKey = { owner, index, YES };
+
+   return( [self getObjectForCacheKey:&cacheKey] );
+}
+
+- (void) removeObjectForKey:(id)key
+{
+   CacheKey_t cacheKey = { key, 0, NO };
+   struct LynkeosCacheShard *shard = [self shardForKey:&cacheKey];
+   CacheEntry_t *entry;
+
+   pthread_mutex_lock( &shard->lock );
+   entry = (CacheEntry_t*)CFDictionaryGetValue( shard->entries, &cacheKey );
+   if ( entry != NULL )
+      [self unlinkEntry:entry inShard:shard];
+   pthread_mutex_unlock( &shard->lock );
+
+   if ( entry != NULL )
+      deleteEntry( entry );
+
+   if ( _secondLevel != nil )
    {
-      // Otherwise, change keys order according to policy
-      if ( _policy & WriteRefresh )
-      {
-         [_keyAge addObject:key];
-         [_keyAge removeObjectAtIndex:keyIdx];
-      }
+      LynkeosCacheKeyObject *keyObj =
+                     [[LynkeosCacheKeyObject alloc] initWithCacheKey:&cacheKey];
+      [self secondLevelRemoveImageForKey:keyObj];
+      [keyObj release];
    }
 }
 
-- (NSObject*) getObjectForKey:(id)key
+- (void) removeObjectsForOwner:(id)owner
 {
-   // Find the object if still in the cache
-   NSObject *obj = [_cacheDict objectForKey:key];
+   CacheEntry_t *removed = NULL;
+   int i;
+
+   for( i = 0; i < K_CACHE_SHARDS; i++ )
+   {
+      struct LynkeosCacheShard *shard = &_shards[i];
+      CacheEntry_t *entry, *next;
 
-   // Change keys order according to policy
-   if ( obj != nil && (_policy & ReadRefresh) )
+      pthread_mutex_lock( &shard->lock );
+      for( entry = shard->oldest; entry != NULL; entry = next )
+      {
+         next = entry->newer;
+         if ( entry->key.indexed && entry->key.object == owner )
+         {
+            [self unlinkEntry:entry inShard:shard];
+            // Chain the removed entries, to delete them out of the lock
+            entry->newer = removed;
+            removed = entry;
+         }
+      }
+      pthread_mutex_unlock( &shard->lock );
+   }
+
+   while ( removed != NULL )
    {
-      NSUInteger keyIdx = [_keyAge indexOfObject:key];
-      [_keyAge addObject:key];
-      [_keyAge removeObjectAtIndex:keyIdx];
+      CacheEntry_t *entry = removed;
+
+      removed = entry->newer;
+      deleteEntry( entry );
    }
 
-   return( obj );
-}
+   if ( _secondLevel != nil )
+   {
+      LynkeosScratchFile *scratch = _secondLevel;
+      // Not an object, for the block not to retain an owner being deleted
+      const void *ownerAddress = owner;
 
-- (void) removeObjectForKey:(id)key
-{
-   [_cacheDict removeObjectForKey:key];
-   NSUInteger keyIdx = [_keyAge indexOfObject:key];
-   if ( keyIdx != NSNotFound )
-      [_keyAge removeObjectAtIndex:keyIdx];
+      // After the pending spills of the owner's images
+      [_spillQueue addOperationWithBlock:^
+      {
+         [scratch removeImagesPassingTest:^BOOL(id key)
+         {
+            return( [key isKindOfClass:[LynkeosCacheKeyObject class]]
+                    && ((LynkeosCacheKeyObject*)key)->_key.indexed
+                    && (const void*)((LynkeosCacheKeyObject*)key)->_key.object
+                                                              == ownerAddress );
+         }];
+      }];
+   }
 }
 
 - (void) setCapacity:(u_long)capacity
@@ -189,4 +661,32 @@ static LynkeosObjectCache *imageProcessingCache = nil;
    // Delete now obsolete object
    [self adjustCacheSize];
 }
+
+- (void) releaseMemory
+{
+   [self adjustCacheSize];
+}
+
+- (void) setSecondLevel:(LynkeosScratchFile*)scratch
+{
+   if ( _spillQueue == nil )
+   {
+      // The spills are written by one thread, in the order of removal
+      _spillQueue = [[NSOperationQueue alloc] init];
+      [_spillQueue setMaxConcurrentOperationCount:1];
+      [_spillQueue setName:@"Lynkeos cache spill"];
+   }
+   else
+      // Let the pending accesses use the previous scratch file
+      [_spillQueue waitUntilAllOperationsAreFinished];
+
+   [scratch retain];
+   [_secondLevel release];
+   _secondLevel = scratch;
+}
+
+- (void) waitForSecondLevel
+{
+   [_spillQueue waitUntilAllOperationsAreFinished];
+}
 @end
@@ -0,0 +1,201 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+/*!
+ * @header
+ * @abstract Staged execution of a list processing
+ */
+#ifndef __LYNKEOSPIPELINE_H
+#define __LYNKEOSPIPELINE_H
+
+#include <pthread.h>
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract Bounded queue of objects between the stages of a pipeline
+ * @discussion A producer pushing in a full queue waits for a consumer to make
+ *    room, this is the pipeline backpressure. The objects are retained while
+ *    they are in the queue.
+ * @ingroup Support
+ */
+@interface LynkeosPipelineQueue : NSObject
+{
+@private
+   pthread_mutex_t _mutex;          //!< Protects the queue
+   pthread_cond_t  _notEmpty;       //!< Signaled when an object is pushed
+   pthread_cond_t  _notFull;        //!< Signaled when an object is taken
+   id              *_objects;       //!< Ring of queued objects
+   NSUInteger      _capacity;       //!< Size of the ring
+   NSUInteger      _head;           //!< Index of the oldest object
+   NSUInteger      _count;          //!< Number of queued objects
+   BOOL            _closed;         //!< No more object will be pushed
+}
+
+/*!
+ * @abstract Dedicated initializer
+ * @param capacity The maximum number of queued objects
+ * @result The initialized queue
+ */
+- (id) initWithCapacity:(NSUInteger)capacity ;
+
+/*!
+ * @abstract Push an object at the end of the queue
+ * @discussion The calling thread waits while the queue is full.
+ * @param object The object to queue
+ * @result NO if the queue was closed, the object is then not queued
+ */
+- (BOOL) pushObject:(id)object ;
+
+/*!
+ * @abstract Take the object at the head of the queue
+ * @discussion The calling thread waits while the queue is empty.
+ * @result The oldest object, nil when the queue is closed and empty
+ */
+- (id) popObject ;
+
+/*!
+ * @abstract Signal that no more objects will be pushed
+ * @discussion The consumers get the objects still queued, then nil.
+ */
+- (void) close ;
+
+/*!
+ * @abstract Number of queued objects
+ * @result The number of objects waiting in the queue
+ */
+- (NSUInteger) count ;
+
+@end
+
+/*!
+ * @abstract Executor of a process split in stages
+ * @discussion The objects read from the source go through the stages in
+ *    sequence. Each stage runs on its own workers, and is connected to the
+ *    previous one by a bounded LynkeosPipelineQueue. The stages can then
+ *    overlap, for example the reading and calibration of the next images
+ *    with the processing of the current one, while the queues bound the
+ *    number of images in flight.
+ *
+ *    A stage is a method of a target, taking the object from the previous
+ *    stage and returning the object for the next one (any returned object is
+ *    dropped by the last stage). A stage can return nil to drop the object.
+ *
+ *    NSNull objects are barriers (they mark the end of a pass in multipass
+ *    enumerators) : they reach the stages after all the objects read before
+ *    them have left the pipeline, and the source is not read anymore until
+ *    they also have left it. They always go through all the stages.
+ *
+ *    The time spent by the workers of each stage in processing is measured,
+ *    for the stages occupancy to show which one limits the throughput.
+ * @ingroup Processing
+ */
+@interface LynkeosPipeline : NSObject
+{
+@private
+   id               _source;        //!< Where the objects are read from
+   NSMutableArray   *_stages;       //!< The stages, in sequence
+   pthread_mutex_t  _flowMutex;     //!< Protects the flow control data
+   pthread_cond_t   _flowCond;      //!< Signaled when an object leaves
+   u_long           _inFlight;      //!< Number of objects in the pipeline
+   BOOL             _barrier;       //!< A barrier is in the pipeline
+   BOOL             _sourceEnded;   //!< The source has no more objects
+   volatile BOOL    _cancelled;     //!< The source shall not be read anymore
+   NSConditionLock  *_workersLock;  //!< Counts the living workers
+   NSTimeInterval   _duration;      //!< Duration of the last run
+}
+
+/*!
+ * @abstract Dedicated initializer
+ * @param source An object answering to nextObject, like an NSEnumerator. It
+ *    is never called by two threads at once.
+ * @result The initialized pipeline
+ */
+- (id) initWithSource:(id)source ;
+
+/*!
+ * @abstract Add a stage at the end of the pipeline
+ * @param target The object which processes the stage
+ * @param selector The stage method, it takes and returns an object
+ * @param workers The number of threads running the stage
+ * @param depth The capacity of the queue in front of the stage, the first
+ *    stage reads the source directly
+ * @param name The stage name, for the occupancy report
+ */
+- (void) addStageWithTarget:(id)target selector:(SEL)selector
+                    workers:(u_short)workers depth:(u_short)depth
+                       name:(NSString*)name ;
+
+/*!
+ * @abstract Run the pipeline until the source is exhausted
+ * @discussion The calling thread is one of the workers of the last stage,
+ *    this method returns when all the objects have left the pipeline.
+ */
+- (void) run ;
+
+/*!
+ * @abstract Stop reading the source
+ * @discussion The objects already read go on through the stages. This method
+ *    can be called from any thread.
+ */
+- (void) cancel ;
+
+/*!
+ * @abstract Number of stages
+ * @result The number of stages
+ */
+- (u_short) numberOfStages ;
+
+/*!
+ * @abstract Name of a stage
+ * @param stage The stage index
+ * @result The stage name
+ */
+- (NSString*) nameOfStage:(u_short)stage ;
+
+/*!
+ * @abstract Number of workers currently processing an object in a stage
+ * @param stage The stage index
+ * @result The number of busy workers
+ */
+- (u_short) busyWorkersOfStage:(u_short)stage ;
+
+/*!
+ * @abstract Number of objects waiting in front of a stage
+ * @param stage The stage index
+ * @result The number of queued objects, 0 for the first stage
+ */
+- (NSUInteger) queuedObjectsOfStage:(u_short)stage ;
+
+/*!
+ * @abstract Fraction of the last run the stage workers spent processing
+ * @discussion A stage close to 1 limits the pipeline throughput, the others
+ *    wait for it.
+ * @param stage The stage index
+ * @result The stage occupancy, between 0 and 1
+ */
+- (double) occupancyOfStage:(u_short)stage ;
+
+@end
+
+#endif
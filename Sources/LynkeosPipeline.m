@@ -0,0 +1,458 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#include <stdlib.h>
+
+#include "LynkeosPipeline.h"
+
+/*!
+ * @abstract One stage of the pipeline
+ */
+@interface LynkeosPipelineStage : NSObject
+{
+@public
+   NSString             *_name;        //!< Name for the occupancy report
+   id                   _target;       //!< Object processing the stage
+   SEL                  _selector;     //!< Stage method
+   id                   (*_method)(id,SEL,id); //!< Its implementation
+   u_short              _workers;      //!< Number of threads of the stage
+   u_short              _living;       //!< Workers still running
+   volatile u_short     _busy;         //!< Workers processing an object
+   LynkeosPipelineQueue *_input;       //!< Objects to process, nil if first
+   NSTimeInterval       _busyTime;     //!< Time spent in processing
+}
+@end
+
+@implementation LynkeosPipelineStage
+
+- (id) init
+{
+   if ( (self = [super init]) != nil )
+   {
+      _name = nil;
+      _target = nil;
+      _selector = NULL;
+      _method = NULL;
+      _workers = 0;
+      _living = 0;
+      _busy = 0;
+      _input = nil;
+      _busyTime = 0.0;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   [_name release];
+   [_target release];
+   [_input release];
+   [super dealloc];
+}
+@end
+
+/*!
+ * @abstract Internal methods
+ */
+@interface LynkeosPipeline(Private)
+
+/*!
+ * @abstract Read the next object from the source
+ * @discussion The barriers wait here for the previous objects to leave, and
+ *    the next objects wait for the barrier to leave.
+ * @result The object, nil when the source is exhausted or cancelled
+ */
+- (id) nextSourceObject ;
+
+/*!
+ * @abstract Account for an object leaving the pipeline
+ * @param isBarrier Whether it is a barrier
+ */
+- (void) objectLeft:(BOOL)isBarrier ;
+
+/*!
+ * @abstract Worker loop of a stage
+ * @param index The stage index, as an NSNumber
+ */
+- (void) runStage:(NSNumber*)index ;
+@end
+
+@implementation LynkeosPipelineQueue
+
+- (id) init
+{
+   return( [self initWithCapacity:1] );
+}
+
+- (id) initWithCapacity:(NSUInteger)capacity
+{
+   if ( (self = [super init]) != nil )
+   {
+      pthread_mutex_init( &_mutex, NULL );
+      pthread_cond_init( &_notEmpty, NULL );
+      pthread_cond_init( &_notFull, NULL );
+      _capacity = (capacity != 0 ? capacity : 1);
+      _objects = (id*)malloc( _capacity*sizeof(id) );
+      _head = 0;
+      _count = 0;
+      _closed = NO;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   // Release what was not consumed
+   while ( _count != 0 )
+   {
+      [_objects[_head] release];
+      _head = (_head + 1) % _capacity;
+      _count--;
+   }
+   free( _objects );
+   pthread_cond_destroy( &_notFull );
+   pthread_cond_destroy( &_notEmpty );
+   pthread_mutex_destroy( &_mutex );
+
+   [super dealloc];
+}
+
+- (BOOL) pushObject:(id)object
+{
+   BOOL queued = NO;
+
+   pthread_mutex_lock( &_mutex );
+   while ( _count == _capacity && !_closed )
+      pthread_cond_wait( &_notFull, &_mutex );
+
+   if ( !_closed )
+   {
+      _objects[(_head + _count) % _capacity] = [object retain];
+      _count++;
+      queued = YES;
+      pthread_cond_signal( &_notEmpty );
+   }
+   pthread_mutex_unlock( &_mutex );
+
+   return( queued );
+}
+
+- (id) popObject
+{
+   id object = nil;
+
+   pthread_mutex_lock( &_mutex );
+   while ( _count == 0 && !_closed )
+      pthread_cond_wait( &_notEmpty, &_mutex );
+
+   if ( _count != 0 )
+   {
+      object = _objects[_head];
+      _head = (_head + 1) % _capacity;
+      _count--;
+      pthread_cond_signal( &_notFull );
+   }
+   pthread_mutex_unlock( &_mutex );
+
+   return( [object autorelease] );
+}
+
+- (void) close
+{
+   pthread_mutex_lock( &_mutex );
+   _closed = YES;
+   pthread_cond_broadcast( &_notEmpty );
+   pthread_cond_broadcast( &_notFull );
+   pthread_mutex_unlock( &_mutex );
+}
+
+- (NSUInteger) count
+{
+   return( _count );
+}
+
+@end
+
+@implementation LynkeosPipeline(Private)
+
+- (id) nextSourceObject
+{
+   id object = nil;
+
+   pthread_mutex_lock( &_flowMutex );
+
+   while ( _barrier && !_cancelled )
+      pthread_cond_wait( &_flowCond, &_flowMutex );
+
+   if ( !_cancelled && !_sourceEnded )
+   {
+      @try
+      {
+         object = [_source nextObject];
+      }
+      @catch( NSException *e )
+      {
+         NSLog( @"*** Exception %@ raised in pipeline source: \"%@\"",
+                [e name], [e reason] );
+         object = nil;
+      }
+
+      if ( object == nil )
+         _sourceEnded = YES;
+      else
+      {
+         _inFlight++;
+
+         if ( [object isKindOfClass:[NSNull class]] )
+         {
+            // Let the objects read before go through the whole pipeline
+            _barrier = YES;
+            while ( _inFlight > 1 )
+               pthread_cond_wait( &_flowCond, &_flowMutex );
+         }
+      }
+   }
+
+   pthread_mutex_unlock( &_flowMutex );
+
+   return( object );
+}
+
+- (void) objectLeft:(BOOL)isBarrier
+{
+   pthread_mutex_lock( &_flowMutex );
+   _inFlight--;
+   if ( isBarrier )
+      _barrier = NO;
+   pthread_cond_broadcast( &_flowCond );
+   pthread_mutex_unlock( &_flowMutex );
+}
+
+- (void) runStage:(NSNumber*)index
+{
+   NSAutoreleasePool *threadPool = [[NSAutoreleasePool alloc] init];
+   const u_short i = [index unsignedShortValue];
+   LynkeosPipelineStage * const stage = [_stages objectAtIndex:i];
+   LynkeosPipelineStage * const next =
+      (i + 1 < [_stages count] ? [_stages objectAtIndex:i+1] : nil);
+   NSTimeInterval busyTime = 0.0;
+   BOOL ended = NO, lastWorker;
+
+   while ( !ended )
+   {
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      id object = (stage->_input == nil ? [self nextSourceObject]
+                                        : [stage->_input popObject]);
+
+      if ( object == nil )
+         ended = YES;
+
+      else
+      {
+         const BOOL isBarrier = [object isKindOfClass:[NSNull class]];
+         const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+         id result = nil;
+
+         __sync_add_and_fetch( &stage->_busy, 1 );
+         @try
+         {
+            result = stage->_method( stage->_target, stage->_selector, object );
+         }
+         @catch( NSException *e )
+         {
+            NSLog( @"*** Exception %@ raised in pipeline stage %@: \"%@\"",
+                   [e name], stage->_name, [e reason] );
+            result = nil;
+         }
+         __sync_sub_and_fetch( &stage->_busy, 1 );
+         busyTime += [NSDate timeIntervalSinceReferenceDate] - start;
+
+         // The barriers cannot be dropped
+         if ( isBarrier )
+            result = object;
+
+         if ( next == nil || result == nil || ![next->_input pushObject:result] )
+            [self objectLeft:isBarrier];
+      }
+
+      [pool release];
+   }
+
+   pthread_mutex_lock( &_flowMutex );
+   stage->_busyTime += busyTime;
+   stage->_living--;
+   lastWorker = (stage->_living == 0);
+   pthread_mutex_unlock( &_flowMutex );
+
+   // The last worker of a stage ends the next one
+   if ( lastWorker && next != nil )
+      [next->_input close];
+
+   [_workersLock lock];
+   [_workersLock unlockWithCondition:[_workersLock condition]-1];
+
+   [threadPool release];
+}
+@end
+
+@implementation LynkeosPipeline
+
+- (id) init
+{
+   return( [self initWithSource:nil] );
+}
+
+- (id) initWithSource:(id)source
+{
+   if ( (self = [super init]) != nil )
+   {
+      _source = [source retain];
+      _stages = [[NSMutableArray alloc] init];
+      pthread_mutex_init( &_flowMutex, NULL );
+      pthread_cond_init( &_flowCond, NULL );
+      _inFlight = 0;
+      _barrier = NO;
+      _sourceEnded = NO;
+      _cancelled = NO;
+      _workersLock = nil;
+      _duration = 0.0;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   [_source release];
+   [_stages release];
+   [_workersLock release];
+   pthread_cond_destroy( &_flowCond );
+   pthread_mutex_destroy( &_flowMutex );
+
+   [super dealloc];
+}
+
+- (void) addStageWithTarget:(id)target selector:(SEL)selector
+                    workers:(u_short)workers depth:(u_short)depth
+                       name:(NSString*)name
+{
+   LynkeosPipelineStage *stage = [[[LynkeosPipelineStage alloc] init]
+                                                                  autorelease];
+
+   stage->_name = [name retain];
+   stage->_target = [target retain];
+   stage->_selector = selector;
+   stage->_method = (id(*)(id,SEL,id))[target methodForSelector:selector];
+   stage->_workers = (workers != 0 ? workers : 1);
+   if ( [_stages count] != 0 )
+      stage->_input = [[LynkeosPipelineQueue alloc] initWithCapacity:depth];
+
+   [_stages addObject:stage];
+}
+
+- (void) run
+{
+   const u_short nStages = [_stages count];
+   const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+   NSNumber *lastIndex = [NSNumber numberWithUnsignedShort:nStages-1];
+   u_short i, w, nWorkers = 0;
+
+   NSAssert( nStages != 0, @"Pipeline without stages" );
+
+   for( i = 0; i < nStages; i++ )
+   {
+      LynkeosPipelineStage *stage = [_stages objectAtIndex:i];
+
+      stage->_living = stage->_workers;
+      stage->_busyTime = 0.0;
+      nWorkers += stage->_workers;
+   }
+
+   [_workersLock release];
+   _workersLock = [[NSConditionLock alloc] initWithCondition:nWorkers];
+
+   // Every worker gets its own thread, but one of the last stage
+   for( i = 0; i < nStages; i++ )
+   {
+      LynkeosPipelineStage *stage = [_stages objectAtIndex:i];
+
+      for( w = (i == nStages-1 ? 1 : 0); w < stage->_workers; w++ )
+         [NSThread detachNewThreadSelector:@selector(runStage:)
+                                  toTarget:self
+                                withObject:
+                                       [NSNumber numberWithUnsignedShort:i]];
+   }
+
+   // Which is the calling thread
+   [self runStage:lastIndex];
+
+   [_workersLock lockWhenCondition:0];
+   [_workersLock unlock];
+
+   _duration = [NSDate timeIntervalSinceReferenceDate] - start;
+}
+
+- (void) cancel
+{
+   _cancelled = YES;
+   pthread_mutex_lock( &_flowMutex );
+   pthread_cond_broadcast( &_flowCond );
+   pthread_mutex_unlock( &_flowMutex );
+}
+
+- (u_short) numberOfStages
+{
+   return( [_stages count] );
+}
+
+- (NSString*) nameOfStage:(u_short)stage
+{
+   return( ((LynkeosPipelineStage*)[_stages objectAtIndex:stage])->_name );
+}
+
+- (u_short) busyWorkersOfStage:(u_short)stage
+{
+   return( ((LynkeosPipelineStage*)[_stages objectAtIndex:stage])->_busy );
+}
+
+- (NSUInteger) queuedObjectsOfStage:(u_short)stage
+{
+   LynkeosPipelineStage *s = [_stages objectAtIndex:stage];
+
+   return( s->_input != nil ? [s->_input count] : 0 );
+}
+
+- (double) occupancyOfStage:(u_short)stage
+{
+   LynkeosPipelineStage *s = [_stages objectAtIndex:stage];
+   double occupancy = 0.0;
+
+   if ( _duration > 0.0 )
+      occupancy = s->_busyTime/((double)s->_workers*_duration);
+
+   return( occupancy );
+}
+
+@end
@@ -620,7 +620,7 @@ extern NSString * const LynkeosProcessStartedNotification;
 /*!
  * @abstract When a process ends.
  * @discussion The object is the document, the user info contains the processing
- *    class.
+ *    class, and the pipeline stages occupancy for a pipelined list processing.
  * @ingroup Notifications
  */
 extern NSString * const LynkeosProcessEndedNotification;
@@ -629,6 +629,13 @@ extern NSString * const LynkeosProcessEndedNotification;
  * @ingroup Notifications
  */
 extern NSString * const LynkeosUserInfoProcess;
+/*!
+ * @abstract The key for retrieving the pipeline stages occupancy.
+ * @discussion The value is a dictionary giving, for each stage name, the
+ *    fraction of the time its workers were busy, averaged on the threads.
+ * @ingroup Notifications
+ */
+extern NSString * const LynkeosUserInfoStagesOccupancy;
 
 /*!
  * @abstract When all the image processings attached to an item are applied
@@ -650,11 +657,18 @@ extern NSString * const LynkeosItemChangedNotification;
  * @ingroup Notifications
  */
 extern NSString * const LynkeosUserInfoItem;
+/*!
+ * @abstract The key to retrieve an array of items from the user info
+ * @ingroup Notifications
+ */
+extern NSString * const LynkeosUserInfoItems;
 
 /*!
- * @abstract When an item was used by a list process
- * @discussion  The object is the document, the user info is the same as 
- *    \ref LynkeosItemChangedNotification.
+ * @abstract When some items were used by a list process
+ * @discussion  The object is the document. The notifications are coalesced,
+ *    the user info contains all the items processed since the previous one,
+ *    accessible by the key \ref LynkeosUserInfoItems, and the last of them
+ *    accessible by the key \ref LynkeosUserInfoItem.
  * @ingroup Notifications
  */
 extern NSString * const LynkeosItemWasProcessedNotification;
@@ -750,7 +764,9 @@ typedef enum
  * @abstract Signals that an item was used in the process
  * @discussion This method shall not be called by processes which modify the
  *    items ; as it causes an "item changed" notification, this method is
- *    at least useless in this case, maybe even harmful.
+ *    at least useless in this case, maybe even harmful.<br>
+ *    The calls from the processing threads are not forwarded to the main
+ *    thread, the notifications are coalesced instead.
  * @param item The item which was processed
  */
 - (oneway void) itemWasProcessed:(id <LynkeosProcessableItem>)item;
@@ -801,6 +817,57 @@ typedef enum
  */
 - (void) finishProcessing ;
 
+@optional
+/*!
+ * @abstract Size of the images processed for each item
+ * @discussion It lets the thread scheduler decide whether the images are big
+ *    enough to share their rows and FFT between threads. When it is not
+ *    implemented, the size of the items images is taken.
+ * @param params The parameters given at process start
+ * @result The size of the images processed for each item
+ */
++ (LynkeosIntegerSize) processedSizeWithParameters:(id <NSObject>)params ;
+
+/*!
+ * @abstract Number of threads sharing the items of this process
+ * @discussion It is given after the initialization, to the processes which
+ *    synchronize their threads. When it is not called, the process runs in
+ *    one thread.
+ * @param nThreads The number of list threads started for this process
+ */
+- (void) setNumberOfListThreads:(u_short)nThreads ;
+
+@end
+
+/*!
+ * @abstract Protocol for the processing classes split in stages.
+ * @discussion The list processing threads of these classes run a
+ *    LynkeosPipeline : the data of the next items is loaded (read,
+ *    calibrated and transformed) by a loading thread, while the current item
+ *    is processed.<br>
+ *    The NSNull objects given by multipass enumerators are not loaded, they
+ *    are given directly to processItem:withData:.
+ * @ingroup Processing
+ */
+@protocol LynkeosPipelinedProcessing <LynkeosProcessing>
+
+/*!
+ * @abstract Load the data of an item
+ * @discussion This method is called in the loading thread, concurrently with
+ *    the processing of the previous items by the same instance. It shall
+ *    only read the item and the parameters, without modifying the instance.
+ * @param item The item to load
+ * @result The data to process, nil if there is none
+ */
+- (id) loadItem:(id <LynkeosProcessableItem>)item ;
+
+/*!
+ * @abstract Process an item with the data which was loaded for it
+ * @param item The item to process.
+ * @param data The data returned by loadItem:
+ */
+- (void) processItem:(id <LynkeosProcessableItem>)item withData:(id)data ;
+
 @end
 
 #endif
@@ -40,6 +40,7 @@ NSString * const LynkeosListChangeNotification =     @"LynkeosListChange";
 NSString * const LynkeosDataModeChangeNotification = @"LynkeosDataModeChange";
 
 NSString * const LynkeosUserInfoProcess = @"process";
+NSString * const LynkeosUserInfoStagesOccupancy = @"stagesOccupancy";
 
 NSString * const LynkeosDocumentDidLoadNotification = @"LynkeosDocumentDidLoad";
 
@@ -98,10 +98,19 @@
                   forProcessing:(NSString*)processing ;
 /*!
  * @abstract Propagate upward, a notification for object modification.
+ * @discussion When called from another thread than the main one, the
+ *    modifications are queued and notified at most 20 times per second, only
+ *    once for each item.
  * @param item The modified item
  */
 - (oneway void) notifyItemModification:(id)item ;
 
+/*!
+ * @abstract Notify at once the modifications queued by other threads
+ * @discussion This shall be called in the main thread.
+ */
++ (void) flushItemNotifications ;
+
 @end
 
 #endif
@@ -22,21 +22,82 @@
 #include <errno.h>
 
 #include <objc/objc-runtime.h>
-#include "LynkeosThreadConnection.h"
+#include "LynkeosItemQueue.h"
 #include "LynkeosProcessingParameterMgr.h"
 
+//! Period of the item modification notifications coming from other threads
+#define K_NOTIFICATION_PERIOD 0.05
+
 // These notification keys are defined here to avoid a dependency on MyDocument
 NSString * const LynkeosItemChangedNotification = @"LynkeosItemChanged";
 NSString * const LynkeosUserInfoItem = @"item";
+NSString * const LynkeosUserInfoItems = @"items";
 
 //! Global lock to protect dictionary and rw lock creation
 static NSLock *paramLock = nil;
+//! Modifications notified by other threads, as (manager, item) pairs
+static LynkeosItemQueue *modifiedItems = nil;
+//! Whether a notification of the queued modifications is scheduled
+static volatile int notificationScheduled = 0;
+
+/*!
+ * @abstract Private methods of LynkeosProcessingParameterMgr
+ */
+@interface LynkeosProcessingParameterMgr(Private)
+/*!
+ * @abstract Schedule the notification of the queued modifications
+ * @discussion Called in the main thread.
+ */
++ (void) scheduleItemsNotification ;
+@end
+
+@implementation LynkeosProcessingParameterMgr(Private)
+
++ (void) scheduleItemsNotification
+{
+   [self performSelector:@selector(flushItemNotifications) withObject:nil
+              afterDelay:K_NOTIFICATION_PERIOD];
+}
+
+@end
 
 @implementation LynkeosProcessingParameterMgr
 
 + (void) initialize
 {
    paramLock = [[NSLock alloc] init];
+   modifiedItems = [[LynkeosItemQueue alloc] init];
+}
+
++ (void) flushItemNotifications
+{
+   NSArray *pairs;
+   NSMutableSet *notified;
+   NSEnumerator *list;
+   NSArray *pair;
+
+   // New modifications will schedule another notification
+   notificationScheduled = 0;
+   __sync_synchronize();
+
+   pairs = [modifiedItems drain];
+   if ( pairs == nil )
+      return;
+
+   // Notify only once for each item, an item always notifies through the
+   // same manager
+   notified = [NSMutableSet setWithCapacity:[pairs count]];
+   list = [pairs objectEnumerator];
+   while ( (pair = [list nextObject]) != nil )
+   {
+      id item = [pair objectAtIndex:1];
+
+      if ( ![notified containsObject:item] )
+      {
+         [notified addObject:item];
+         [[pair objectAtIndex:0] notifyItemModification:item];
+      }
+   }
 }
 
 - (id) init
@@ -109,14 +170,16 @@ static NSLock *paramLock = nil;
 
 - (oneway void) notifyItemModification:(id)item
 {
-   // Always notify in the main thread
+   // Always notify in the main thread, coalesced at a fixed rate
    if ( [NSThread currentThread] != _mainThread )
    {
       NSObject* target = (_parent != nil ? _parent : self);
-      [LynkeosThreadConnection performSelectorOnMainThread:
-                                              @selector(notifyItemModification:)
-                                            forObject:target
-                                              withArg:item];
+      [modifiedItems pushObject:[NSArray arrayWithObjects:target, item, nil]];
+      if ( __sync_bool_compare_and_swap( &notificationScheduled, 0, 1 ) )
+         [LynkeosProcessingParameterMgr performSelectorOnMainThread:
+                                       @selector(scheduleItemsNotification)
+                                                          withObject:nil
+                                                       waitUntilDone:NO];
    }
    else
    {
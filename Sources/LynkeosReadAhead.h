@@ -0,0 +1,74 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+/*!
+ * @header
+ * @abstract Hints given to the system about the data to be read soon
+ */
+#ifndef __LYNKEOSREADAHEAD_H
+#define __LYNKEOSREADAHEAD_H
+
+#import <Foundation/Foundation.h>
+
+#include <sys/types.h>
+
+/*!
+ * @abstract Asynchronous read ahead of file data
+ * @discussion These methods only ask the system to bring the data in the page
+ *    cache, they return without waiting for it. The file readers use them for
+ *    the next frames to process, the read of these frames then finds its data
+ *    in memory instead of waiting for the disk.
+ *
+ *    Any error is ignored, the data is then read normally when needed.
+ * @ingroup FileAccess
+ */
+@interface LynkeosReadAhead : NSObject
+{
+}
+
+/*!
+ * @abstract Read ahead a part of an open file
+ * @param fd The file descriptor
+ * @param offset The start of the data in the file
+ * @param length The length of the data
+ */
++ (void) adviseFile:(int)fd offset:(off_t)offset length:(size_t)length ;
+
+/*!
+ * @abstract Read ahead a part of a file
+ * @param path The file path
+ * @param offset The start of the data in the file
+ * @param length The length of the data, 0 for up to the end of the file
+ */
++ (void) advisePath:(NSString*)path offset:(off_t)offset length:(size_t)length ;
+
+/*!
+ * @abstract Read ahead a part of a mapped file
+ * @param address The start of the data in the mapping
+ * @param length The length of the data
+ */
++ (void) adviseMemory:(const void*)address length:(size_t)length ;
+
+@end
+
+#endif
@@ -0,0 +1,91 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "LynkeosReadAhead.h"
+
+@implementation LynkeosReadAhead
+
++ (void) adviseFile:(int)fd offset:(off_t)offset length:(size_t)length
+{
+   if ( fd < 0 || length == 0 )
+      return;
+
+#if defined(F_RDADVISE)
+   // The advisory count is an int, bigger lengths are cut in parts
+   while ( length != 0 )
+   {
+      struct radvisory advice;
+      const size_t count = (length > INT_MAX ? INT_MAX : length);
+
+      advice.ra_offset = offset;
+      advice.ra_count = (int)count;
+      if ( fcntl( fd, F_RDADVISE, &advice ) == -1 )
+         break;
+
+      offset += count;
+      length -= count;
+   }
+#elif defined(POSIX_FADV_WILLNEED)
+   (void)posix_fadvise( fd, offset, (off_t)length, POSIX_FADV_WILLNEED );
+#endif
+}
+
++ (void) advisePath:(NSString*)path offset:(off_t)offset length:(size_t)length
+{
+   const int fd = open( [path fileSystemRepresentation], O_RDONLY );
+
+   if ( fd < 0 )
+      return;
+
+   if ( length == 0 )
+   {
+      struct stat st;
+
+      if ( fstat( fd, &st ) == 0 && st.st_size > offset )
+         length = (size_t)(st.st_size - offset);
+   }
+
+   // The read ahead goes on after the descriptor is closed
+   [self adviseFile:fd offset:offset length:length];
+   close( fd );
+}
+
++ (void) adviseMemory:(const void*)address length:(size_t)length
+{
+   const uintptr_t page = (uintptr_t)getpagesize();
+   const uintptr_t start = (uintptr_t)address & ~(page - 1);
+
+   if ( address == NULL || length == 0 )
+      return;
+
+   (void)madvise( (void*)start, (uintptr_t)address - start + length,
+                  MADV_WILLNEED );
+}
+
+@end
@@ -0,0 +1,117 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+/*!
+ * @header
+ * @abstract Disk storage of images in a memory mapped scratch file
+ */
+#ifndef __LYNKEOSSCRATCHFILE_H
+#define __LYNKEOSSCRATCHFILE_H
+
+#import <Foundation/Foundation.h>
+
+#include <pthread.h>
+
+#include <LynkeosCore/LynkeosImageBuffer.h>
+
+//! Format of the samples in the scratch file
+typedef enum
+{
+   ScratchFloatSamples = 0,   //!< Single precision floats, lossless
+   ScratchShortSamples        //!< 16 bits integers, scaled on the plane range
+} ScratchSampleFormat_t;
+
+/*!
+ * @abstract Second level storage for a LynkeosObjectCache
+ * @discussion The images are written one after the other in a file, used as a
+ *    ring : when the end of the file is reached, the writing restarts at its
+ *    beginning, and the images which are overwritten are forgotten.
+ *
+ *    The file is memory mapped, and removed from the directory as soon as it
+ *    is created, for it not to survive the application. The file is split
+ *    in regions with their own read/write lock, an image is copied with only
+ *    the regions it covers locked, and several images can be read or written
+ *    at once.
+ * @ingroup Processing
+ */
+@interface LynkeosScratchFile : NSObject
+{
+@private
+   NSLock                *_lock;        //!< Protects the records and the ring
+   pthread_rwlock_t      *_regionLocks; //!< Protect the file data, by region
+   u_long                _regionSize;   //!< Size of a locked region
+   int                   _fd;           //!< The scratch file descriptor
+   u_char                *_map;         //!< Mapping of the whole file
+   u_long                _capacity;     //!< Size of the file
+   u_long                _position;     //!< Where the next image is written
+   ScratchSampleFormat_t _format;       //!< Format of the stored samples
+   NSMutableDictionary   *_records;     //!< Images location, by key
+   NSMutableArray        *_order;       //!< Images in writing order
+}
+
+/*!
+ * @abstract Initializer
+ * @param directory The directory in which the scratch file is created
+ * @param capacity Size of the scratch file
+ * @param format Format of the stored samples
+ * @result The initialized scratch file, or nil if it could not be created
+ */
+- (id) initInDirectory:(NSString*)directory capacity:(u_long)capacity
+                format:(ScratchSampleFormat_t)format ;
+
+/*!
+ * @abstract Write an image in the scratch file
+ * @discussion An image bigger than the file is not stored.
+ * @param image The image to store
+ * @param key The key to identify the image, it shall conform to NSCopying
+ */
+- (void) setImage:(LynkeosImageBuffer*)image forKey:(id)key ;
+
+/*!
+ * @abstract Read an image from the scratch file
+ * @param key The key of the image
+ * @result A new autoreleased image, or nil if it is not in the file
+ */
+- (LynkeosImageBuffer*) imageForKey:(id)key ;
+
+/*!
+ * @abstract Whether an image is stored in the file
+ * @param key The key of the image
+ * @result YES if an image is stored for this key
+ */
+- (BOOL) hasImageForKey:(id)key ;
+
+/*!
+ * @abstract Forget an image
+ * @param key The key of the image
+ */
+- (void) removeImageForKey:(id)key ;
+
+/*!
+ * @abstract Forget all the images which keys match a predicate
+ * @param predicate Returns YES for the keys to remove
+ */
+- (void) removeImagesPassingTest:(BOOL (^)(id key))predicate ;
+
+@end
+
+#endif
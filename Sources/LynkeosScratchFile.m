@@ -0,0 +1,419 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <float.h>
+
+#include "LynkeosScratchFile.h"
+
+//! Number of independently locked regions of the file
+#define K_SCRATCH_REGIONS 64
+
+/*!
+ * @abstract Location and format of an image in the scratch file
+ */
+@interface LynkeosScratchRecord : NSObject
+{
+@public
+   id       _key;          //!< Key of the image
+   u_long   _offset;       //!< Start of the image in the file
+   u_long   _length;       //!< Size of the image in the file
+   u_short  _nPlanes;      //!< Number of planes
+   u_short  _width;        //!< Image width
+   u_short  _height;       //!< Image height
+   BOOL     _forgotten;    //!< The room was given to other images
+   double   _zero[4];      //!< Value of 0 for 16 bits samples, by plane
+   double   _step[4];      //!< Value of 1 for 16 bits samples, by plane
+}
+@end
+
+@implementation LynkeosScratchRecord
+- (void) dealloc
+{
+   [_key release];
+   [super dealloc];
+}
+@end
+
+/*!
+ * @abstract Private methods of LynkeosScratchFile
+ */
+@interface LynkeosScratchFile(Private)
+//! Forget an image, the lock shall be held
+- (void) forgetRecord:(LynkeosScratchRecord*)record ;
+//! Find room for an image, forgetting the ones it overwrites
+- (u_long) reserveLength:(u_long)length ;
+//! Lock the regions covered by a record, in increasing order
+- (void) lockRecord:(LynkeosScratchRecord*)record forWriting:(BOOL)write ;
+//! Unlock the regions covered by a record
+- (void) unlockRecord:(LynkeosScratchRecord*)record ;
+@end
+
+@implementation LynkeosScratchFile(Private)
+- (void) forgetRecord:(LynkeosScratchRecord*)record
+{
+   // The record may still be written, and not yet findable
+   if ( [_records objectForKey:record->_key] == record )
+      [_records removeObjectForKey:record->_key];
+   [_order removeObjectIdenticalTo:record];
+   record->_forgotten = YES;
+}
+
+- (u_long) reserveLength:(u_long)length
+{
+   u_long start;
+
+   // Wrap to the beginning when the end of the file is reached
+   if ( _position + length > _capacity )
+   {
+      // The images at the end of the file are the oldest
+      while ( [_order count] != 0
+              && ((LynkeosScratchRecord*)[_order objectAtIndex:0])->_offset
+                                                                  >= _position )
+         [self forgetRecord:[_order objectAtIndex:0]];
+      _position = 0;
+   }
+
+   start = _position;
+   _position += length;
+
+   // Forget the oldest images, which are overwritten
+   while ( [_order count] != 0 )
+   {
+      LynkeosScratchRecord *oldest = [_order objectAtIndex:0];
+
+      if ( oldest->_offset >= _position
+           || oldest->_offset + oldest->_length <= start )
+         break;
+      [self forgetRecord:oldest];
+   }
+
+   return( start );
+}
+
+- (void) lockRecord:(LynkeosScratchRecord*)record forWriting:(BOOL)write
+{
+   u_long r;
+
+   for( r = record->_offset/_regionSize;
+        r <= (record->_offset + record->_length - 1)/_regionSize;
+        r++ )
+   {
+      if ( write )
+         pthread_rwlock_wrlock( &_regionLocks[r] );
+      else
+         pthread_rwlock_rdlock( &_regionLocks[r] );
+   }
+}
+
+- (void) unlockRecord:(LynkeosScratchRecord*)record
+{
+   u_long r;
+
+   for( r = record->_offset/_regionSize;
+        r <= (record->_offset + record->_length - 1)/_regionSize;
+        r++ )
+      pthread_rwlock_unlock( &_regionLocks[r] );
+}
+@end
+
+@implementation LynkeosScratchFile
+
+- (id) init
+{
+   if ( (self = [super init]) != nil )
+   {
+      _lock = [[NSLock alloc] init];
+      _regionLocks = NULL;
+      _regionSize = 1;
+      _fd = -1;
+      _map = NULL;
+      _capacity = 0;
+      _position = 0;
+      _format = ScratchFloatSamples;
+      _records = [[NSMutableDictionary alloc] init];
+      _order = [[NSMutableArray alloc] init];
+   }
+
+   return( self );
+}
+
+- (id) initInDirectory:(NSString*)directory capacity:(u_long)capacity
+                format:(ScratchSampleFormat_t)format
+{
+   if ( (self = [self init]) != nil )
+   {
+      NSString *template =
+         [directory stringByAppendingPathComponent:@"LynkeosScratch.XXXXXX"];
+      char *path = strdup( [template fileSystemRepresentation] );
+      int r;
+
+      _capacity = capacity;
+      _format = format;
+
+      _regionSize = (_capacity + K_SCRATCH_REGIONS - 1)/K_SCRATCH_REGIONS;
+      if ( _regionSize == 0 )
+         _regionSize = 1;
+      _regionLocks = (pthread_rwlock_t*)malloc(
+                                   K_SCRATCH_REGIONS*sizeof(pthread_rwlock_t) );
+      for( r = 0; r < K_SCRATCH_REGIONS; r++ )
+         pthread_rwlock_init( &_regionLocks[r], NULL );
+
+      _fd = mkstemp( path );
+      if ( _fd >= 0 )
+      {
+         // The file disappears with its last descriptor
+         unlink( path );
+
+         if ( ftruncate( _fd, _capacity ) == 0 )
+            _map = (u_char*)mmap( NULL, _capacity, PROT_READ|PROT_WRITE,
+                                  MAP_SHARED, _fd, 0 );
+      }
+      free( path );
+
+      if ( _map == NULL || _map == MAP_FAILED )
+      {
+         NSLog( @"Unable to create a scratch file of %lu bytes in %@",
+                capacity, directory );
+         _map = NULL;
+         [self release];
+         self = nil;
+      }
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   int r;
+
+   if ( _map != NULL )
+      munmap( _map, _capacity );
+   if ( _fd >= 0 )
+      close( _fd );
+   if ( _regionLocks != NULL )
+   {
+      for( r = 0; r < K_SCRATCH_REGIONS; r++ )
+         pthread_rwlock_destroy( &_regionLocks[r] );
+      free( _regionLocks );
+   }
+   [_order release];
+   [_records release];
+   [_lock release];
+
+   [super dealloc];
+}
+
+- (void) setImage:(LynkeosImageBuffer*)image forKey:(id)key
+{
+   const u_long planeSize = (u_long)image->_w*image->_h;
+   const u_long length = planeSize*image->_nPlanes
+                         *(_format == ScratchShortSamples ?
+                           sizeof(u_short) : sizeof(float));
+   REAL * const * const planes = [image colorPlanes];
+   LynkeosScratchRecord *record;
+   u_short x, y, c;
+
+   if ( length > _capacity )
+      return;
+
+   record = [[[LynkeosScratchRecord alloc] init] autorelease];
+   record->_key = [key copy];
+   record->_length = length;
+   record->_nPlanes = image->_nPlanes;
+   record->_width = image->_w;
+   record->_height = image->_h;
+   record->_forgotten = NO;
+
+   [_lock lock];
+
+   // Replace any previous image for that key
+   if ( [_records objectForKey:key] != nil )
+      [self forgetRecord:[_records objectForKey:key]];
+
+   // The room is taken now, but the image is findable only when written
+   record->_offset = [self reserveLength:length];
+   [_order addObject:record];
+
+   [_lock unlock];
+
+   // Only the readers of the overwritten images are waited for
+   [self lockRecord:record forWriting:YES];
+
+   for( c = 0; c < image->_nPlanes; c++ )
+   {
+      if ( _format == ScratchShortSamples )
+      {
+         u_short *data = &((u_short*)&_map[record->_offset])[c*planeSize];
+         double vmin = DBL_MAX, vmax = -DBL_MAX;
+
+         // Scale the samples on the plane range
+         for( y = 0; y < image->_h; y++ )
+            for( x = 0; x < image->_w; x++ )
+            {
+               double v = planes[c][y*image->_padw+x];
+
+               if ( v < vmin )
+                  vmin = v;
+               if ( v > vmax )
+                  vmax = v;
+            }
+         record->_zero[c] = vmin;
+         record->_step[c] = (vmax > vmin ? (vmax - vmin)/65535.0 : 1.0);
+
+         for( y = 0; y < image->_h; y++ )
+            for( x = 0; x < image->_w; x++ )
+               data[y*image->_w+x] =
+                  (u_short)((planes[c][y*image->_padw+x] - record->_zero[c])
+                            /record->_step[c] + 0.5);
+      }
+      else
+      {
+         float *data = &((float*)&_map[record->_offset])[c*planeSize];
+
+         for( y = 0; y < image->_h; y++ )
+         {
+            if ( sizeof(REAL) == sizeof(float) )
+               memcpy( &data[y*image->_w], &planes[c][y*image->_padw],
+                       image->_w*sizeof(float) );
+            else
+               for( x = 0; x < image->_w; x++ )
+                  data[y*image->_w+x] = planes[c][y*image->_padw+x];
+         }
+      }
+   }
+
+   [self unlockRecord:record];
+
+   // Publish the image, unless it was overwritten in between
+   [_lock lock];
+   if ( !record->_forgotten )
+      [_records setObject:record forKey:key];
+   [_lock unlock];
+}
+
+- (LynkeosImageBuffer*) imageForKey:(id)key
+{
+   LynkeosImageBuffer *image = nil;
+   LynkeosScratchRecord *record;
+   BOOL valid;
+
+   [_lock lock];
+   record = [[[_records objectForKey:key] retain] autorelease];
+   [_lock unlock];
+
+   if ( record == nil )
+      return( nil );
+
+   // Once its regions are locked, the record cannot be overwritten. Check it
+   // was not forgotten before.
+   [self lockRecord:record forWriting:NO];
+   [_lock lock];
+   valid = !record->_forgotten;
+   [_lock unlock];
+
+   if ( valid )
+   {
+      const u_long planeSize = (u_long)record->_width*record->_height;
+      REAL * const * planes;
+      u_short x, y, c;
+
+      image = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:record->_nPlanes
+                                                          width:record->_width
+                                                         height:record->_height];
+      planes = [image colorPlanes];
+
+      for( c = 0; c < record->_nPlanes; c++ )
+      {
+         if ( _format == ScratchShortSamples )
+         {
+            const u_short *data =
+               &((u_short*)&_map[record->_offset])[c*planeSize];
+
+            for( y = 0; y < record->_height; y++ )
+               for( x = 0; x < record->_width; x++ )
+                  planes[c][y*image->_padw+x] =
+                     (REAL)(data[y*record->_width+x]*record->_step[c]
+                            + record->_zero[c]);
+         }
+         else
+         {
+            const float *data = &((float*)&_map[record->_offset])[c*planeSize];
+
+            for( y = 0; y < record->_height; y++ )
+            {
+               if ( sizeof(REAL) == sizeof(float) )
+                  memcpy( &planes[c][y*image->_padw], &data[y*record->_width],
+                          record->_width*sizeof(float) );
+               else
+                  for( x = 0; x < record->_width; x++ )
+                     planes[c][y*image->_padw+x] = data[y*record->_width+x];
+            }
+         }
+      }
+   }
+
+   [self unlockRecord:record];
+
+   return( image );
+}
+
+- (BOOL) hasImageForKey:(id)key
+{
+   BOOL found;
+
+   [_lock lock];
+   found = ([_records objectForKey:key] != nil);
+   [_lock unlock];
+
+   return( found );
+}
+
+- (void) removeImageForKey:(id)key
+{
+   LynkeosScratchRecord *record;
+
+   [_lock lock];
+   record = [_records objectForKey:key];
+   if ( record != nil )
+      [self forgetRecord:record];
+   [_lock unlock];
+}
+
+- (void) removeImagesPassingTest:(BOOL (^)(id key))predicate
+{
+   NSEnumerator *list;
+   LynkeosScratchRecord *record;
+
+   [_lock lock];
+   // Enumerate a copy, as the matching records are removed
+   list = [[[_order copy] autorelease] objectEnumerator];
+   while ( (record = [list nextObject]) != nil )
+      if ( predicate( record->_key ) )
+         [self forgetRecord:record];
+   [_lock unlock];
+}
+
+@end
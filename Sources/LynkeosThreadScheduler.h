@@ -0,0 +1,97 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+/*!
+ * @header
+ * @abstract Central split of the threads between the parallelism levels
+ */
+#ifndef __LYNKEOSTHREADSCHEDULER_H
+#define __LYNKEOSTHREADSCHEDULER_H
+
+#import <Foundation/Foundation.h>
+
+#include "LynkeosProcessing.h"
+
+/*!
+ * @abstract Scheduler of the processing threads
+ * @discussion A process can be parallelized at three levels : the list
+ *    threads which share the items, the threads which share the rows of an
+ *    image (ParallelizedStrategy) and the FFTW internal threads. Used all
+ *    together, each with one thread per CPU, they would run numberOfCpus
+ *    cubed threads.
+ *
+ *    The scheduler splits the CPUs between these levels, once per process.
+ *    The list threads come first, as they scale best, up to the number of
+ *    items and to what the memory budget allows. The CPUs left are given to
+ *    the rows and FFTW threads, unless the images are too small to gain
+ *    anything from them.
+ *
+ *    The number of list threads belongs to the process which asked for it,
+ *    as several documents can process at the same time. The rows and FFTW
+ *    threads are shared by all the processes, the last plan applies to them.
+ *    When no process is running anymore, all the CPUs are given back to the
+ *    rows and FFTW threads.
+ * @ingroup Processing
+ */
+@interface LynkeosThreadScheduler : NSObject
+{
+}
+
+/*!
+ * @abstract Split the threads for a process which is about to start
+ * @discussion The number of FFTW threads is applied to the next FFTW plans.
+ *    It shall be called in the main thread, and matched by a call to
+ *    endProcess when the process ends.
+ * @param optim The parallelization supported by the process
+ * @param nItems The number of items to process, 0 when all the threads share
+ *    a single item
+ * @param size The size of the images processed for each item
+ * @result The number of list threads to start for the process, at least one
+ */
++ (u_short) planProcessWithOptimization:(ParallelOptimization_t)optim
+                          numberOfItems:(u_long)nItems
+                              imageSize:(LynkeosIntegerSize)size ;
+
+/*!
+ * @abstract A process has ended
+ * @discussion The threads split used outside of a process is restored when
+ *    no other process is running. It shall be called in the main thread.
+ */
++ (void) endProcess ;
+
+/*!
+ * @abstract Number of threads sharing the rows of an image
+ * @discussion This number includes the calling thread.
+ * @result The number of rows threads, at least one
+ */
++ (u_short) rowThreads ;
+
+/*!
+ * @abstract Number of threads used internally by FFTW
+ * @result The number of FFTW threads, at least one
+ */
++ (u_short) fftwThreads ;
+
+@end
+
+#endif
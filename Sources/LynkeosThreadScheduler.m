@@ -0,0 +1,89 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#include "LynkeosImageBufferAdditions.h"
+#include "LynkeosMemoryBudget.h"
+#include "LynkeosThreadScheduler.h"
+
+//! Images smaller than this number of pixels are not worth more threads
+#define K_MIN_THREADED_PIXELS (256*256)
+
+//! Number of processes planned and not yet ended
+static u_short runningProcesses = 0;
+//! Number of threads sharing the rows of an image
+static u_short rowThreads = 1;
+//! Number of FFTW internal threads
+static u_short fftwThreads = 1;
+
+@implementation LynkeosThreadScheduler
+
++ (u_short) planProcessWithOptimization:(ParallelOptimization_t)optim
+                          numberOfItems:(u_long)nItems
+                              imageSize:(LynkeosIntegerSize)size
+{
+   u_long workers = 1, inner;
+
+   if ( (optim & ListThreadsOptimizations) != 0 )
+   {
+      workers = numberOfCpus;
+      // No more threads than items to share
+      if ( nItems != 0 && nItems < workers )
+         workers = nItems;
+      // And as far as the memory budget allows
+      workers = [LynkeosMemoryBudget allowedWorkers:workers];
+   }
+
+   // The CPUs left to each list thread go to the inner levels, when the
+   // images are big enough
+   inner = numberOfCpus/workers;
+   if ( inner == 0
+        || (u_long)size.width*(u_long)size.height < K_MIN_THREADED_PIXELS )
+      inner = 1;
+
+   runningProcesses++;
+   rowThreads = inner;
+   fftwThreads = ((optim & FFTW3ThreadsOptimization) != 0 ? inner : 1);
+   FFTW_PLAN_WITH_NTHREADS( fftwThreads );
+
+   return( (u_short)workers );
+}
+
++ (void) endProcess
+{
+   if ( runningProcesses > 0 )
+      runningProcesses--;
+
+   // Let the other processes run with their split
+   if ( runningProcesses == 0 )
+   {
+      rowThreads = numberOfCpus;
+      fftwThreads = numberOfCpus;
+      FFTW_PLAN_WITH_NTHREADS( fftwThreads );
+   }
+}
+
++ (u_short) rowThreads { return( rowThreads ); }
+
++ (u_short) fftwThreads { return( fftwThreads ); }
+
+@end
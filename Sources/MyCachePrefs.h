@@ -30,6 +30,16 @@
 #include "LynkeosObjectCache.h"
 
 extern NSString * const K_PREF_MOVIE_CACHE;
+//! Number of threads for movie decoding, 0 lets the codec decide
+extern NSString * const K_PREF_MOVIE_DECODE_THREADS;
+//! Memory budget in MB for the images and caches, 0 for no limit
+extern NSString * const K_PREF_MEMORY_BUDGET;
+//! Size in MB of the frames scratch file, 0 disables the frames cache
+extern NSString * const K_PREF_FRAME_SCRATCH_SIZE;
+//! Directory where the frames scratch file is created
+extern NSString * const K_PREF_FRAME_SCRATCH_DIR;
+//! Whether the frames are stored in 16 bits in the scratch file
+extern NSString * const K_PREF_FRAME_SCRATCH_16BITS;
 
 /*!
  * @abstract Private methods of MyCachePrefs
@@ -46,10 +56,36 @@ extern NSString * const K_PREF_MOVIE_CACHE;
    IBOutlet NSTextField*      _imageProcCacheSizeText;
    //! Stepper for changing the image processing memory cache size
    IBOutlet NSStepper*        _imageProcCacheSizeStep;
+   //! Text field for the number of movie decoding threads
+   IBOutlet NSTextField*      _movieDecodeThreadsText;
+   //! Stepper for changing the number of movie decoding threads
+   IBOutlet NSStepper*        _movieDecodeThreadsStep;
+   //! Text field for the memory budget
+   IBOutlet NSTextField*      _memoryBudgetText;
+   //! Stepper for changing the memory budget
+   IBOutlet NSStepper*        _memoryBudgetStep;
+   //! Text field for the frames scratch file size
+   IBOutlet NSTextField*      _scratchSizeText;
+   //! Stepper for changing the frames scratch file size
+   IBOutlet NSStepper*        _scratchSizeStep;
+   //! Text field for the frames scratch file directory
+   IBOutlet NSTextField*      _scratchDirectoryText;
+   //! Checkbox for 16 bits storage in the scratch file
+   IBOutlet NSButton*         _scratchShortButton;
 
    // Preferences
    u_long                     _movieCacheSize;     //!< Movie memory cache size
    u_long                     _imageProcCacheSize; //!< Image processing memory cache size
+   u_long                     _movieDecodeThreads; //!< Movie decoding threads
+   u_long                     _memoryBudget;       //!< Memory budget
+   u_long                     _scratchSize;        //!< Frames scratch size
+   NSString                   *_scratchDirectory;  //!< Frames scratch location
+   BOOL                       _scratchShortSamples; //!< 16 bits scratch
+
+   // Settings of the current frames cache
+   u_long                     _frameCacheSize;     //!< Its scratch size
+   NSString                   *_frameCacheDirectory; //!< Its scratch location
+   BOOL                       _frameCacheShortSamples; //!< Its scratch format
 }
 
 /*!
@@ -64,6 +100,42 @@ extern NSString * const K_PREF_MOVIE_CACHE;
  */
 - (IBAction)changeImageProcessingCacheSize:(id)sender;
 
+/*!
+ * @abstract Change the number of threads used for movie decoding
+ * @param sender Text or stepper which was modified
+ */
+- (IBAction)changeMovieDecodeThreads:(id)sender;
+
+/*!
+ * @abstract Change the memory budget
+ * @param sender Text or stepper which was modified
+ */
+- (IBAction)changeMemoryBudget:(id)sender;
+
+/*!
+ * @abstract Change the size of the frames scratch file
+ * @param sender Text or stepper which was modified
+ */
+- (IBAction)changeScratchSize:(id)sender;
+
+/*!
+ * @abstract Change the directory of the frames scratch file
+ * @param sender The directory text field
+ */
+- (IBAction)changeScratchDirectory:(id)sender;
+
+/*!
+ * @abstract Choose the directory of the frames scratch file in a panel
+ * @param sender The choose button
+ */
+- (IBAction)chooseScratchDirectory:(id)sender;
+
+/*!
+ * @abstract Change the format of the frames in the scratch file
+ * @param sender The 16 bits checkbox
+ */
+- (IBAction)changeScratchFormat:(id)sender;
+
 @end
 
 #endif
@@ -32,10 +32,17 @@
 #include "processing_core.h"
 #include <LynkeosCore/LynkeosProcessing.h>
 
+#include "LynkeosScratchFile.h"
+#include "LynkeosMemoryBudget.h"
 #include "MyCachePrefs.h"
 
 NSString * const K_PREF_MOVIE_CACHE = @"Movie cache size";
 NSString * const K_PREF_IMAGEPROC_CACHE = @"Image processing cache size";
+NSString * const K_PREF_MOVIE_DECODE_THREADS = @"Movie decoding threads";
+NSString * const K_PREF_MEMORY_BUDGET = @"Memory budget";
+NSString * const K_PREF_FRAME_SCRATCH_SIZE = @"Frame scratch size";
+NSString * const K_PREF_FRAME_SCRATCH_DIR = @"Frame scratch directory";
+NSString * const K_PREF_FRAME_SCRATCH_16BITS = @"Frame scratch 16 bits";
 
 //! MyCachePrefs singleton instance
 static MyCachePrefs *myCachePrefsInstance = nil;
@@ -69,6 +76,18 @@ static MyCachePrefs *myCachePrefsInstance = nil;
 #endif
 
    _imageProcCacheSize = memSize/4/1024/1024;
+
+   // And leave a quarter of it to the system and the other applications
+   _memoryBudget = memSize/4*3/1024/1024;
+
+   // Let the codec choose
+   _movieDecodeThreads = 0;
+
+   // No frames scratch file by default
+   _scratchSize = 0;
+   [_scratchDirectory release];
+   _scratchDirectory = [NSTemporaryDirectory() retain];
+   _scratchShortSamples = NO;
 }
 
 - (void) readPrefs
@@ -79,6 +98,19 @@ static MyCachePrefs *myCachePrefsInstance = nil;
       _movieCacheSize = [user integerForKey:K_PREF_MOVIE_CACHE];
    if ( [user objectForKey:K_PREF_IMAGEPROC_CACHE] != nil )
       _imageProcCacheSize = [user integerForKey:K_PREF_IMAGEPROC_CACHE];
+   if ( [user objectForKey:K_PREF_MOVIE_DECODE_THREADS] != nil )
+      _movieDecodeThreads = [user integerForKey:K_PREF_MOVIE_DECODE_THREADS];
+   if ( [user objectForKey:K_PREF_MEMORY_BUDGET] != nil )
+      _memoryBudget = [user integerForKey:K_PREF_MEMORY_BUDGET];
+   if ( [user objectForKey:K_PREF_FRAME_SCRATCH_SIZE] != nil )
+      _scratchSize = [user integerForKey:K_PREF_FRAME_SCRATCH_SIZE];
+   if ( [user stringForKey:K_PREF_FRAME_SCRATCH_DIR] != nil )
+   {
+      [_scratchDirectory release];
+      _scratchDirectory = [[user stringForKey:K_PREF_FRAME_SCRATCH_DIR] retain];
+   }
+   if ( [user objectForKey:K_PREF_FRAME_SCRATCH_16BITS] != nil )
+      _scratchShortSamples = [user boolForKey:K_PREF_FRAME_SCRATCH_16BITS];
 }
 
 - (void) updatePanel
@@ -87,6 +119,14 @@ static MyCachePrefs *myCachePrefsInstance = nil;
    [_movieCacheSizeStep setDoubleValue:(double)_movieCacheSize];
    [_imageProcCacheSizeText setDoubleValue:(double)_imageProcCacheSize];
    [_imageProcCacheSizeStep setDoubleValue:(double)_imageProcCacheSize];
+   [_movieDecodeThreadsText setDoubleValue:(double)_movieDecodeThreads];
+   [_movieDecodeThreadsStep setDoubleValue:(double)_movieDecodeThreads];
+   [_memoryBudgetText setDoubleValue:(double)_memoryBudget];
+   [_memoryBudgetStep setDoubleValue:(double)_memoryBudget];
+   [_scratchSizeText setDoubleValue:(double)_scratchSize];
+   [_scratchSizeStep setDoubleValue:(double)_scratchSize];
+   [_scratchDirectoryText setStringValue:_scratchDirectory];
+   [_scratchShortButton setState:(_scratchShortSamples ? NSOnState : NSOffState)];
 }
 @end
 
@@ -116,6 +156,10 @@ static MyCachePrefs *myCachePrefsInstance = nil;
 
    if ( (self = [super init]) != nil )
    {
+      _scratchDirectory = nil;
+      _frameCacheSize = 0;
+      _frameCacheDirectory = nil;
+      _frameCacheShortSamples = NO;
       [self initPrefs];
 
       myCachePrefsInstance = self;
@@ -156,6 +200,13 @@ static MyCachePrefs *myCachePrefsInstance = nil;
 {
    [prefs setInteger:_movieCacheSize forKey:K_PREF_MOVIE_CACHE];
    [prefs setInteger:_imageProcCacheSize forKey:K_PREF_IMAGEPROC_CACHE];
+   [prefs setInteger:_movieDecodeThreads forKey:K_PREF_MOVIE_DECODE_THREADS];
+   [prefs setInteger:_memoryBudget forKey:K_PREF_MEMORY_BUDGET];
+   [prefs setInteger:_scratchSize forKey:K_PREF_FRAME_SCRATCH_SIZE];
+   [prefs setObject:_scratchDirectory forKey:K_PREF_FRAME_SCRATCH_DIR];
+   [prefs setBool:_scratchShortSamples forKey:K_PREF_FRAME_SCRATCH_16BITS];
+
+   [LynkeosMemoryBudget setBudget:_memoryBudget*1024*1024];
 
    // Reconfigure the caches accordingly
    if ( [LynkeosObjectCache movieCache] != nil )
@@ -186,6 +237,44 @@ static MyCachePrefs *myCachePrefsInstance = nil;
                                                    capacity:byteCacheSize
                                                      policy:WriteRefresh]
                 autorelease]];
+
+   // The frames cache is rebuilt on its scratch file, only when the
+   // scratch file settings changed, as it looses all the frames
+   if ( _scratchSize == _frameCacheSize
+        && ( _scratchSize == 0
+             || ( _scratchShortSamples == _frameCacheShortSamples
+                  && [_scratchDirectory isEqualToString:_frameCacheDirectory] ) ) )
+      return;
+
+   _frameCacheSize = _scratchSize;
+   [_frameCacheDirectory release];
+   _frameCacheDirectory = [_scratchDirectory copy];
+   _frameCacheShortSamples = _scratchShortSamples;
+
+   [LynkeosObjectCache setFrameCache:nil];
+   if ( _scratchSize != 0 )
+   {
+      LynkeosScratchFile *scratch =
+         [[[LynkeosScratchFile alloc] initInDirectory:_scratchDirectory
+                                             capacity:_scratchSize*1024*1024
+                                               format:(_scratchShortSamples ?
+                                                       ScratchShortSamples :
+                                                       ScratchFloatSamples)]
+          autorelease];
+
+      if ( scratch != nil )
+      {
+         // The memory level holds only the frames in use
+         LynkeosObjectCache *cache =
+            [[[LynkeosObjectCache alloc] initWithStrategy:CacheNumberOfObjects
+                                                 capacity:2*numberOfCpus+1
+                                                   policy:ReadRefresh|WriteRefresh]
+             autorelease];
+
+         [cache setSecondLevel:scratch];
+         [LynkeosObjectCache setFrameCache:cache];
+      }
+   }
 }
 
 - (IBAction)changeMovieCacheSize:(id)sender
@@ -207,4 +296,62 @@ static MyCachePrefs *myCachePrefsInstance = nil;
    else if ( sender == _imageProcCacheSizeText )
       [_imageProcCacheSizeStep setDoubleValue:(double)_imageProcCacheSize];
 }
+
+- (IBAction)changeMovieDecodeThreads:(id)sender
+{
+   _movieDecodeThreads = [sender intValue];
+
+   if ( sender == _movieDecodeThreadsStep )
+      [_movieDecodeThreadsText setDoubleValue:(double)_movieDecodeThreads];
+   else if ( sender == _movieDecodeThreadsText )
+      [_movieDecodeThreadsStep setDoubleValue:(double)_movieDecodeThreads];
+}
+
+- (IBAction)changeMemoryBudget:(id)sender
+{
+   _memoryBudget = [sender intValue];
+
+   if ( sender == _memoryBudgetStep )
+      [_memoryBudgetText setDoubleValue:(double)_memoryBudget];
+   else if ( sender == _memoryBudgetText )
+      [_memoryBudgetStep setDoubleValue:(double)_memoryBudget];
+}
+
+- (IBAction)changeScratchSize:(id)sender
+{
+   _scratchSize = [sender intValue];
+
+   if ( sender == _scratchSizeStep )
+      [_scratchSizeText setDoubleValue:(double)_scratchSize];
+   else if ( sender == _scratchSizeText )
+      [_scratchSizeStep setDoubleValue:(double)_scratchSize];
+}
+
+- (IBAction)changeScratchDirectory:(id)sender
+{
+   [_scratchDirectory release];
+   _scratchDirectory = [[sender stringValue] retain];
+}
+
+- (IBAction)chooseScratchDirectory:(id)sender
+{
+   NSOpenPanel *panel = [NSOpenPanel openPanel];
+
+   [panel setCanChooseFiles:NO];
+   [panel setCanChooseDirectories:YES];
+   [panel setAllowsMultipleSelection:NO];
+   [panel setDirectoryURL:[NSURL fileURLWithPath:_scratchDirectory]];
+
+   if ( [panel runModal] == NSModalResponseOK )
+   {
+      [_scratchDirectory release];
+      _scratchDirectory = [[[panel URL] path] retain];
+      [_scratchDirectoryText setStringValue:_scratchDirectory];
+   }
+}
+
+- (IBAction)changeScratchFormat:(id)sender
+{
+   _scratchShortSamples = ([sender state] == NSOnState);
+}
 @end
@@ -84,7 +84,6 @@ typedef enum
    u_short                _bytesPerPixel;   //!< Total number of bytes for all planes
    NSLock                *_avLock;          //!< Multithreading protection
    LynkeosIntegerSize     _size;            //!< Movie frame size
-   NSString              *_url;             //!< Used for cache key
 }
 @end
 #endif
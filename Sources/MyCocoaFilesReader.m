@@ -321,14 +321,15 @@ static void getImageSample( REAL * const * const sample,
 @implementation MyQuickTimeReader(Private)
 - (CGImageRef) getCGImageAtIndex:(u_long)index
 {
-   NSString *key = [_url stringByAppendingFormat:@"&%06ld",index];
    LynkeosObjectCache *movieCache = [LynkeosObjectCache movieCache];
    MyCGImageContainer *pix;
    CGImageRef img;
    NSError *err;
 
    if ( movieCache != nil &&
-        (pix=(MyCGImageContainer*)[movieCache getObjectForKey:key]) != nil )
+        (pix=(MyCGImageContainer*)[movieCache getObjectForOwner:self
+                                                            index:index])
+          != nil )
    {
       return( CGImageRetain(pix->_img) );
    }
@@ -359,7 +360,7 @@ static void getImageSample( REAL * const * const sample,
       else if ( movieCache != nil )
          [movieCache setObject:
             [[[MyCGImageContainer alloc] initWithImage:img] autorelease]
-                        forKey:[_url stringByAppendingFormat:@"&%06ld",_currentImage]];
+                      forOwner:self index:_currentImage];
    } while ( index != _currentImage );
    [_avLock unlock];
 
@@ -422,8 +423,6 @@ static void getImageSample( REAL * const * const sample,
       return( nil );
    }
 
-   _url = [[url absoluteString] retain];
-
    // Extract the time of each frame
    const CMTime duration = [_movie duration];
    AVAssetTrack *track = [[_movie tracksWithMediaType:AVMediaTypeVideo] firstObject];
@@ -608,10 +607,12 @@ static void getImageSample( REAL * const * const sample,
 
 - (void) dealloc
 {
+   // The cache does not retain us
+   [LynkeosObjectCache forgetOwner:self];
+
    free( _times );
    [_avLock release];
    [_movie release];
-   [_url release];
 
    [super dealloc];
 }
@@ -37,6 +37,7 @@
 
 #include "LynkeosProcessing.h"
 #include "LynkeosProcessingView.h"
+#include "LynkeosItemQueue.h"
 #include "MyImageListItem.h"
 #include "MyImageList.h"
 #include "MyCalibrationLock.h"
@@ -95,7 +96,8 @@
  *   the Models classes for document contents change.
  * @ingroup Controlers
  */
-@interface MyDocument : NSDocument <LynkeosViewDocument>
+@interface MyDocument : NSDocument <LynkeosViewDocument,
+                                    LynkeosThreadSafeMethods>
 {
 @private
    // Document data
@@ -114,6 +116,9 @@
    NSPort              *_threadsPort;     //!< Input port of the main thread
    NSMutableArray      *_threads;         //!< Living threads
    Class               _currentProcessingClass; //!< What processing is running
+   //! Sum of the pipeline stages occupancy reported by the threads
+   NSMutableDictionary *_stagesOccupancy;
+   u_short              _occupancyReports; //!< Number of threads which reported
    //! Item being processed, nil if it is a list processing
    id <LynkeosProcessableItem> _processedItem;
    u_long               _imageListSequenceNumber; //!< To detect original change
@@ -137,6 +142,10 @@
    // Stuff to help notifying
    NSNotificationCenter* _notifCenter;    //!< Our notification center
    NSNotificationQueue* _notifQueue;      //!< For asynchronous notifications
+   //! Items processed by the threads, not yet notified
+   LynkeosItemQueue*    _processedItems;
+   //! Whether the notification of the processed items is scheduled
+   volatile int         _progressScheduled;
 }
 
 /// \name Accessors
@@ -181,6 +190,14 @@
  * @param obj The proxy for the thread that is ending.
  */
 - (void) processEnded: (id)obj ;
+
+/*!
+ * @abstract Receive the pipeline stages occupancy of a thread
+ * @discussion The pipelined list processing threads send it before their end.
+ *    The mean of all the threads goes in the process end notification.
+ * @param occupancy The busy time fraction of each stage, by stage name
+ */
+- (oneway void) processStagesOccupancy:(NSDictionary*)occupancy ;
 //@}
 @end
 
@@ -31,18 +31,23 @@
 #include "LynkeosFourierBuffer.h"
 #include "LynkeosImageBufferAdditions.h"
 #include "LynkeosBasicAlignResult.h"
+#include "LynkeosMemoryBudget.h"
+#include "LynkeosThreadScheduler.h"
 #include "MyCustomAlert.h"
 #include "MyImageListWindow.h" // Only for allocation purpose
 
 #include "MyDocument.h"
 
 #include "MyDocumentData.h"
+#include "MyImageListEnumerator.h"
 #include "MyGeneralPrefs.h"
 
 // Needed for setting calibration frames align offset (it's a bad hack)
 #include "MyImageAligner.h"
 
 #define K_DOCUMENT_TYPE		@"Lynkeos project"
+//! Period of the processing progress notifications
+#define K_PROGRESS_PERIOD	0.05
 
 // A bad hack for relative URL resolution (until I find a better solution)
 NSString *basePath = nil;
@@ -73,6 +78,8 @@ NSString *basePath = nil;
                orItem: (id <LynkeosProcessableItem>)item
            parameters: (id <NSObject>)params ;
 - (BOOL) continueProcessing ;
+- (void) scheduleProgressNotification ;
+- (void) notifyProcessedItems ;
 @end
 
 #if !defined GNUSTEP
@@ -157,6 +164,10 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
            parameters: (id <NSObject>)params
 {
    u_char i, nListThreads;
+   MyImageListEnumerator *list = nil;
+   id <LynkeosProcessableItem> firstItem = item;
+   u_long nItems = 0;
+   LynkeosIntegerSize size = {0, 0};
 
    NSAssert( enumerator == nil || item == nil,
              @"Cannot start a process for a list AND an item" );
@@ -166,15 +177,31 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
    NSAssert( [_threads count] == 0, 
              @"Trying to start a process while one is already running" );
 
-   // Start the process according to user preferences
-   nListThreads = 1;
+   // Give back the cached memory before counting the threads
+   [LynkeosMemoryBudget relieveMemory];
 
-   ParallelOptimization_t optim = [processingClass supportParallelization];
+   if ( [enumerator isKindOfClass:[MyImageListEnumerator class]] )
+   {
+      list = (MyImageListEnumerator*)enumerator;
+      nItems = [list countRemainingItems:&firstItem];
+   }
 
-   if ( (optim & ListThreadsOptimizations) != 0 )
-      // Parallel list processing
-      nListThreads = numberOfCpus;
-   FFTW_PLAN_WITH_NTHREADS( (optim & FFTW3ThreadsOptimization) != 0 ? numberOfCpus : 1 );
+   // Split the threads between the items, the rows and FFTW, according to
+   // user preferences
+   if ( [processingClass respondsToSelector:
+                                  @selector(processedSizeWithParameters:)] )
+      size = [processingClass processedSizeWithParameters:params];
+   else if ( firstItem != nil )
+      size = [firstItem imageSize];
+   nListThreads = [LynkeosThreadScheduler planProcessWithOptimization:
+                                      [processingClass supportParallelization]
+                                                        numberOfItems:nItems
+                                                            imageSize:size];
+
+   // Give contiguous frames to each thread, for sequential movie decoding,
+   // and read them ahead
+   if ( list != nil )
+      [list setChunkedSchedulingForThreads:nListThreads];
 
    // Notify that the processing is starting
    _currentProcessingClass = processingClass;
@@ -202,6 +229,8 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
          [attrib setObject:item forKey: K_PROCESS_ITEM_KEY];
       if ( params != nil )
          [attrib setObject:params forKey:K_PROCESS_PARAMETERS_KEY];
+      [attrib setObject:[NSNumber numberWithUnsignedShort:nListThreads]
+                 forKey:K_PROCESS_LIST_THREADS_KEY];
 
       [NSThread detachNewThreadSelector:@selector(threadWithAttributes:)
                                toTarget:[MyProcessingThread class]
@@ -209,6 +238,31 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
    }
 }
 
+- (void) scheduleProgressNotification
+{
+   [self performSelector:@selector(notifyProcessedItems) withObject:nil
+              afterDelay:K_PROGRESS_PERIOD];
+}
+
+- (void) notifyProcessedItems
+{
+   NSArray *items;
+
+   // The next processed item will schedule another notification
+   _progressScheduled = 0;
+   __sync_synchronize();
+
+   items = [_processedItems drain];
+   if ( items != nil )
+      [_notifCenter postNotificationName: LynkeosItemWasProcessedNotification
+                                  object: self
+                                userInfo:
+                   [NSDictionary dictionaryWithObjectsAndKeys:
+                                    items, LynkeosUserInfoItems,
+                                    [items lastObject], LynkeosUserInfoItem,
+                                    nil]];
+}
+
 - (BOOL) continueProcessing
 {
    _processedItem = nil;
@@ -280,6 +334,8 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
       _threadsPort = [[NSPort port] retain];
       _threads = [[NSMutableArray array] retain];
       _currentProcessingClass = nil;
+      _stagesOccupancy = [[NSMutableDictionary alloc] init];
+      _occupancyReports = 0;
       _processedItem = nil;
       _processStackMgr = [[ProcessStackManager alloc] init];
       _initialProcessEnum = nil;
@@ -288,6 +344,8 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
 
       _notifCenter = [NSNotificationCenter defaultCenter];
       _notifQueue = [NSNotificationQueue defaultQueue];
+      _processedItems = [[LynkeosItemQueue alloc] init];
+      _progressScheduled = 0;
 
 #if !defined GNUSTEP
       _rootPort = IORegisterForSystemPower(self, &_sysPowerNotifPort, MySleepCallBack, &_sysPowerNotifier);
@@ -335,8 +393,10 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
 
    [_threadsPort release];
    [_threads release];
+   [_stagesOccupancy release];
 
    [_parameters release];
+   [_processedItems release];
 
    [super dealloc];
 }
@@ -830,6 +890,19 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
       [thr->_threaded stopProcessing];
 }
 
+- (oneway void) processStagesOccupancy:(NSDictionary*)occupancy
+{
+   NSEnumerator *stages = [occupancy keyEnumerator];
+   NSString *stage;
+
+   while ( (stage = [stages nextObject]) != nil )
+      [_stagesOccupancy setObject:[NSNumber numberWithDouble:
+                           [[_stagesOccupancy objectForKey:stage] doubleValue]
+                           + [[occupancy objectForKey:stage] doubleValue]]
+                           forKey:stage];
+   _occupancyReports++;
+}
+
 - (oneway void) processEnded: (id)obj
 {
    NSEnumerator *threadList;
@@ -849,13 +922,36 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
    {
       BOOL listProcessing = YES;
 
-      // Notify of processing end
+      [LynkeosThreadScheduler endProcess];
+
+      // Deliver the pending progress before the end
+      [self notifyProcessedItems];
+      [LynkeosProcessingParameterMgr flushItemNotifications];
+
+      // Notify of processing end, with the mean occupancy of the stages
+      NSMutableDictionary *info =
+                    [NSMutableDictionary dictionaryWithObject:_currentProcessingClass
+                                                       forKey:LynkeosUserInfoProcess];
+      if ( _occupancyReports != 0 )
+      {
+         NSMutableDictionary *occupancy = [NSMutableDictionary dictionary];
+         NSEnumerator *stages = [_stagesOccupancy keyEnumerator];
+         NSString *stage;
+
+         while ( (stage = [stages nextObject]) != nil )
+            [occupancy setObject:[NSNumber numberWithDouble:
+                       [[_stagesOccupancy objectForKey:stage] doubleValue]
+                                                   / (double)_occupancyReports]
+                          forKey:stage];
+         [info setObject:occupancy forKey:LynkeosUserInfoStagesOccupancy];
+         [_stagesOccupancy removeAllObjects];
+         _occupancyReports = 0;
+      }
+
       [_myWindow document:self processHasEnded:_currentProcessingClass];
       [_notifCenter postNotificationName: LynkeosProcessEndedNotification
                                   object: self
-                                userInfo:
-                    [NSDictionary dictionaryWithObject:_currentProcessingClass
-                                                forKey:LynkeosUserInfoProcess]];
+                                userInfo: info];
       _currentProcessingClass = nil;
 
       // If it is an image processing, launch next process in the stack
@@ -928,11 +1024,17 @@ static void MySleepCallBack(void * x, io_service_t y, natural_t messageType,
 
 - (oneway void) itemWasProcessed:(id <LynkeosProcessableItem>) item
 {
-   // Notify of processing progress
-   [_notifCenter postNotificationName: LynkeosItemWasProcessedNotification
-                               object: self
-                             userInfo: [NSDictionary dictionaryWithObject:item
-                                                   forKey:LynkeosUserInfoItem]];
+   // Called directly in the processing threads, the progress is notified
+   // in the main thread for several items at once
+   [_processedItems pushObject:item];
+   if ( __sync_bool_compare_and_swap( &_progressScheduled, 0, 1 ) )
+      [self performSelectorOnMainThread:@selector(scheduleProgressNotification)
+                             withObject:nil waitUntilDone:NO];
+}
+
+- (BOOL) isThreadSafeSelector:(SEL)sel
+{
+   return( sel == @selector(itemWasProcessed:) );
 }
 
 - (void) setProcessingParameter:(id <LynkeosProcessingParameter>)parameter
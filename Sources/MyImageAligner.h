@@ -28,6 +28,7 @@
 #define __MYIMAGE_ALIGNER_H
 
 #include "LynkeosCore/LynkeosFourierBuffer.h"
+#include "LynkeosCore/LynkeosPipeline.h"
 #include "LynkeosCore/LynkeosProcessing.h"
 
 /*!
@@ -162,7 +163,7 @@ extern NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
  * @discussion This class is able to align images in parallel threads
  * @ingroup Processing
  */
-@interface MyImageAligner : NSObject <LynkeosProcessing>
+@interface MyImageAligner : NSObject <LynkeosPipelinedProcessing>
 {
 @private
    //! The document in which we are processing (weak reference)
@@ -171,8 +172,8 @@ extern NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
    //! The aligning parameters used when none other exists.
    MyImageAlignerListParametersV3 *_rootParams;
 
-   //! Array of per thread LynkeosFourierBuffer for Fourier transform
-   NSMutableArray                 *_spectrumBuffers;
+   //! Arrays of per square LynkeosFourierBuffer, waiting to be loaded
+   LynkeosPipelineQueue           *_freeBuffers;
 }
 @end
 
@@ -52,6 +52,9 @@ NSString * const myImageAlignerParametersRef = @"AlignParams";
 //! Key for saving the align precision threshold
 #define K_ALIGN_PRECISION_KEY @"precision"
 
+//! Number of items loaded ahead or being processed, in each thread
+#define K_LOADED_SAMPLES 3
+
 // V2 compatibility classes
 /*!
  * @abstract General entry parameters for alignment (V2 file compatibility)
@@ -112,6 +115,7 @@ static void cutoffSpectrum( LynkeosFourierBuffer *spectrum, u_short cutoff )
 static BOOL performAlignment( id <LynkeosProcessableItem> item,
                               LynkeosIntegerRect extractRect,
                               LynkeosFourierBuffer *buf,
+                              BOOL loaded,
                               LynkeosFourierBuffer *ref,
                               double cutoff,
                               double sigmaThreshold,
@@ -119,7 +123,11 @@ static BOOL performAlignment( id <LynkeosProcessableItem> item,
                               CORRELATION_PEAK *peak )
 {
    // Get the spectrum of that other image
-   [item getFourierTransform:&buf forRect:extractRect prepareInverse:NO];
+   if ( loaded )
+      // The sample was already extracted by the pipeline load stage
+      [buf directTransform];
+   else
+      [item getFourierTransform:&buf forRect:extractRect prepareInverse:NO];
    cutoffSpectrum( buf, cutoff );
 
    // correlate it against the reference
@@ -130,6 +138,40 @@ static BOOL performAlignment( id <LynkeosProcessableItem> item,
            peak->sigma_x < sigmaThreshold && peak->sigma_y < sigmaThreshold );
 }
 
+/*!
+ * @abstract Rectangle of an align square in an item, in Cocoa coordinates
+ * @discussion Any previous alignment of the item is taken into account.
+ */
+static LynkeosIntegerRect itemAlignRect( id <LynkeosProcessableItem> item,
+                                         MyImageAlignerSquareV3 *square )
+{
+   LynkeosIntegerRect r;
+
+   r.origin = square->_alignOrigin;
+   r.size = square->_alignSize;
+
+   // Take any previous alignment into account
+   LynkeosBasicAlignResult *align = (LynkeosBasicAlignResult*)
+   [item getProcessingParameterWithRef:LynkeosAlignResultRef
+                         forProcessing:LynkeosAlignRef];
+   if ( align != nil )
+   {
+      // Apply alignment to the align square center
+      NSPoint p = NSMakePoint((CGFloat)r.origin.x + (CGFloat)r.size.width/2.0,
+                              (CGFloat)r.origin.y + (CGFloat)r.size.height/2.0);
+      NSAffineTransform *t
+         = [[[NSAffineTransform alloc] initWithTransform: [align alignTransform]]
+            autorelease];
+
+      [t invert];
+      p = [t transformPoint:p];
+      r.origin.x = (short)floor(p.x - (CGFloat)r.size.width/2.0 + 0.5);
+      r.origin.y = (short)floor(p.y - (CGFloat)r.size.height/2.0 + 0.5);
+   }
+
+   return( r );
+}
+
 NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
                           MyImageAlignerListParametersV3* params)
 {
@@ -426,6 +468,15 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
 }
 @end
 
+/*!
+ * @abstract Internal methods
+ */
+@interface MyImageAligner(Private)
+//! Align an item with the samples extracted by loadItem:
+- (void) alignItem:(id <LynkeosProcessableItem>)item
+       withBuffers:(NSArray*)buffers;
+@end
+
 @implementation MyImageAligner
 
 + (ParallelOptimization_t) supportParallelization
@@ -435,6 +486,23 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
            & ListThreadsOptimizations);
 }
 
++ (LynkeosIntegerSize) processedSizeWithParameters:(id <NSObject>)params
+{
+   MyImageAlignerListParametersV3 *listParams =
+                                       (MyImageAlignerListParametersV3*)params;
+   NSEnumerator *squares = [listParams->_alignSquares objectEnumerator];
+   MyImageAlignerSquareV3 *square;
+   LynkeosIntegerSize size = {0, 0};
+
+   // The biggest alignment square
+   while ( (square = [squares nextObject]) != nil )
+      if ( (u_long)square->_alignSize.width*square->_alignSize.height
+           > (u_long)size.width*size.height )
+         size = square->_alignSize;
+
+   return( size );
+}
+
 - (id <LynkeosProcessing>) initWithDocument:(id <LynkeosDocument>)document
                                  parameters:(id <NSObject>)params
 {
@@ -535,19 +603,24 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
    // From now on, squares data is initialized
    NSAssert(_rootParams->_dataReady, @"Inconsistent alignment data initialization");
 
-   // Allocate a buffer per align point for each other images
-   _spectrumBuffers = [[NSMutableArray arrayWithCapacity:
-                                             [_rootParams->_alignSquares count]]
-                       retain];
-   NSEnumerator *squaresList = [_rootParams->_alignSquares objectEnumerator];
-   MyImageAlignerSquareV3 *square;
-   while ( (square = [squaresList nextObject]) != nil )
+   // Allocate a buffer per align point for each image loaded or processed
+   _freeBuffers =
+            [[LynkeosPipelineQueue alloc] initWithCapacity:K_LOADED_SAMPLES];
+   for( int i = 0; i < K_LOADED_SAMPLES; i++ )
    {
-      [_spectrumBuffers addObject:
-         [LynkeosFourierBuffer fourierBufferWithNumberOfPlanes:1
+      NSMutableArray *buffers = [NSMutableArray arrayWithCapacity:
+                                             [_rootParams->_alignSquares count]];
+      NSEnumerator *squaresList = [_rootParams->_alignSquares objectEnumerator];
+      MyImageAlignerSquareV3 *square;
+      while ( (square = [squaresList nextObject]) != nil )
+      {
+         [buffers addObject:
+            [LynkeosFourierBuffer fourierBufferWithNumberOfPlanes:1
                                                  width:square->_alignSize.width
                                                 height:square->_alignSize.height
                                               withGoal:FOR_DIRECT|FOR_INVERSE]];
+      }
+      [_freeBuffers pushObject:buffers];
    }
 
    return( self );
@@ -555,7 +628,7 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
 
 - (void) dealloc
 {
-   [_spectrumBuffers release];
+   [_freeBuffers release];
    // The view part takes care of emptying the squares data at processing end
    [_rootParams release];
 
@@ -563,6 +636,77 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
 }
 
 - (void) processItem:(id <LynkeosProcessableItem>)item
+{
+   [self processItem:item withData:[self loadItem:item]];
+}
+
+- (id) loadItem:(id <LynkeosProcessableItem>)item
+{
+   // The reference item needs no sample
+   if ( item == _rootParams->_referenceItem )
+      return( nil );
+
+   NSArray *buffers = [_freeBuffers popObject];
+   NSArray *squares = itemAlignSquares(item, _rootParams);
+   NSEnumerator *squaresList = [squares objectEnumerator];
+   NSEnumerator *bufferList = [buffers objectEnumerator];
+   const u_short height = [item imageSize].height;
+   MyImageAlignerSquareV3 *square;
+
+   @try
+   {
+      // Extract the sample of each align square
+      while ( (square = [squaresList nextObject]) != nil )
+      {
+         LynkeosFourierBuffer *buf = [bufferList nextObject];
+         LynkeosIntegerRect r = itemAlignRect( item, square );
+
+         NSAssert(buf != nil, @"No buffer for square");
+
+         // Convert the coordinate system from Cocoa to bitmap
+         r.origin.y = height - r.origin.y - r.size.height;
+         [item getImageSample:&buf inRect:r];
+         // The list threads transform it in their own thread, as
+         // getFourierTransform:forRect:prepareInverse: does for list items
+         [buf setOperatorsStrategy:StandardStrategy];
+      }
+   }
+   @catch( NSException *e )
+   {
+      [_freeBuffers pushObject:buffers];
+      @throw;
+   }
+   @finally
+   {
+      [squares release];
+   }
+
+   return( buffers );
+}
+
+- (void) processItem:(id <LynkeosProcessableItem>)item withData:(id)data
+{
+   @try
+   {
+      [self alignItem:item withBuffers:(NSArray*)data];
+   }
+   @finally
+   {
+      // The buffers can be loaded again
+      if ( data != nil )
+         [_freeBuffers pushObject:data];
+   }
+}
+
+- (void) finishProcessing
+{
+}
+@end
+
+@implementation MyImageAligner(Private)
+
+- (void) alignItem:(id <LynkeosProcessableItem>)item
+       withBuffers:(NSArray*)buffers
 {
    LynkeosBasicAlignResult *res = nil;
 
@@ -582,7 +726,7 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
       // Prepare for alignment on every point
       const int nPoints = (int)[squares count];
       NSEnumerator *squaresDataList = [_rootParams->_squaresData objectEnumerator];
-      NSEnumerator *bufferList = [_spectrumBuffers objectEnumerator];
+      NSEnumerator *bufferList = [buffers objectEnumerator];
       NSPoint refMatrix[nPoints], resultMatrix[nPoints];
       NSPoint refBarycenter= {0, 0}, resBarycenter = {0, 0};
       int nbResults = 0;
@@ -597,28 +741,8 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
          NSAssert(data != nil, @"No data for square");
 
          // Retrieve the alignment rectangle for the item
-         r.origin = square->_alignOrigin;
-         r.size = square->_alignSize;
-
-         // Take any previous alignment into account
-         LynkeosBasicAlignResult *align = (LynkeosBasicAlignResult*)
-         [item getProcessingParameterWithRef:LynkeosAlignResultRef
-                               forProcessing:LynkeosAlignRef];
-         if ( align != nil )
-         {
-            // Apply alignment to the align square center
-            NSPoint p = NSMakePoint((CGFloat)r.origin.x + (CGFloat)r.size.width/2.0,
-                                    (CGFloat)r.origin.y + (CGFloat)r.size.height/2.0);
-            NSAffineTransform *t
-               = [[[NSAffineTransform alloc] initWithTransform: [align alignTransform]]
-                  autorelease];
-
-            [t invert];
-            p = [t transformPoint:p];
-            r.origin.x = (short)floor(p.x - (CGFloat)r.size.width/2.0 + 0.5);
-            r.origin.y = (short)floor(p.y - (CGFloat)r.size.height/2.0 + 0.5);
-         }
-         
+         r = itemAlignRect( item, square );
+
          LynkeosIntegerRect extractRect;
          CORRELATION_PEAK peak;
          BOOL isAligned;
@@ -630,7 +754,7 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
          extractRect = r;
          extractRect.origin.y = [item imageSize].height - extractRect.origin.y
                                 - extractRect.size.height;
-         isAligned = performAlignment( item, extractRect, buf,
+         isAligned = performAlignment( item, extractRect, buf, YES,
                                       data->_referenceSpectrum, data->_cutoff,
                                       data->_precisionThreshold,
                                       data->_valueThreshold, &peak );
@@ -677,7 +801,8 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
                   checkRect.origin.x += shift.x;
                   checkRect.origin.y += shift.y;
                   alignChecked = performAlignment( item, checkRect,
-                                                   buf, data->_referenceSpectrum,
+                                                   buf, NO,
+                                                   data->_referenceSpectrum,
                                                    data->_cutoff,
                                                    data->_precisionThreshold,
                                                    data->_valueThreshold,
@@ -885,8 +1010,4 @@ NSArray* itemAlignSquares(id <LynkeosProcessableItem> item,
    [item setProcessingParameter:res withRef:LynkeosAlignResultRef
                   forProcessing:LynkeosAlignRef];
 }
-
-- (void) finishProcessing
-{
-}
 @end
@@ -28,6 +28,7 @@
 #define __MYIMAGE_ANALYZER_H
 
 #include "LynkeosFourierBuffer.h"
+#include "LynkeosPipeline.h"
 #include "LynkeosProcessing.h"
 
 /*!
@@ -114,15 +115,15 @@ typedef enum
  * @abstract Image analysis processing class
  * @ingroup Processing
  */
-@interface MyImageAnalyzer : NSObject <LynkeosProcessing>
+@interface MyImageAnalyzer : NSObject <LynkeosPipelinedProcessing>
 {
 @private
    id <LynkeosDocument> _document;  //!< The document in which we are processing
    MyImageAnalyzerParameters *_params;    //!< Parameters of analysis
    double               _lowerCutoff;     //!< Lower frequency cutoff
    double               _upperCutoff;     //!< Upper frequency cutoff
-   //! Per thread buffer for Fourier transform
-   LynkeosFourierBuffer      *_bufferSpectrum;
+   //! Per thread buffers for Fourier transform, waiting to be loaded
+   LynkeosPipelineQueue *_freeBuffers;
 }
 
 @end
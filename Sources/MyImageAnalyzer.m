@@ -37,6 +37,9 @@ static NSString * const K_QUALITY_KEY         = @"quality";
 static NSString * const K_UPPER_CUTOFF_FREQ_KEY = @"upCutFreq";
 static NSString * const K_LOWER_CUTOFF_FREQ_KEY = @"lowCutFreq";
 
+//! Number of samples loaded ahead or being processed, in each thread
+#define K_LOADED_SAMPLES 3
+
 void filterImageForAnalysis( LynkeosFourierBuffer *image,
                              double down,
                              double up )
@@ -230,6 +233,11 @@ static double entropy( LynkeosFourierBuffer *image, double down, double up )
            & ListThreadsOptimizations );
 }
 
++ (LynkeosIntegerSize) processedSizeWithParameters:(id <NSObject>)params
+{
+   return( ((MyImageAnalyzerParameters*)params)->_analysisRect.size );
+}
+
 - (id <LynkeosProcessing>) initWithDocument: (id <LynkeosDocument>)document
                                  parameters:(id <NSObject>)params
 {
@@ -246,18 +254,21 @@ static double entropy( LynkeosFourierBuffer *image, double down, double up )
    _lowerCutoff = _params->_lowerCutoff;
    _upperCutoff = _params->_upperCutoff;
 
-   // Allocate the buffer for each image
-   _bufferSpectrum = [[LynkeosFourierBuffer fourierBufferWithNumberOfPlanes:1
+   // Allocate the buffers for the images being loaded and processed
+   _freeBuffers =
+            [[LynkeosPipelineQueue alloc] initWithCapacity:K_LOADED_SAMPLES];
+   for( int i = 0; i < K_LOADED_SAMPLES; i++ )
+      [_freeBuffers pushObject:
+         [LynkeosFourierBuffer fourierBufferWithNumberOfPlanes:1
                                         width:_params->_analysisRect.size.width
-                                       height:_params->_analysisRect.size.height 
-                                     withGoal: FOR_DIRECT|FOR_INVERSE] retain];
+                                       height:_params->_analysisRect.size.height
+                                     withGoal: FOR_DIRECT|FOR_INVERSE]];
    return( self );
 }
 
 - (void) dealloc
 {
-   if ( _bufferSpectrum != nil )
-      [_bufferSpectrum release];
+   [_freeBuffers release];
    [_params release];
 
    [super dealloc];
@@ -265,6 +276,12 @@ static double entropy( LynkeosFourierBuffer *image, double down, double up )
 
 - (void) processItem:(id <LynkeosProcessableItem>)item
 {
+   [self processItem:item withData:[self loadItem:item]];
+}
+
+- (id) loadItem:(id <LynkeosProcessableItem>)item
+{
+   LynkeosFourierBuffer *buffer = [_freeBuffers popObject];
    LynkeosIntegerRect r = _params->_analysisRect;
    id <LynkeosAlignResult> aligned =
       (id <LynkeosAlignResult>)[item getProcessingParameterWithRef:
@@ -272,7 +289,6 @@ static double entropy( LynkeosFourierBuffer *image, double down, double up )
                                                          forProcessing:
                                                                LynkeosAlignRef];
    LynkeosIntegerSize imageSize = [item imageSize];
-   MyImageAnalyzerResult *res;
 
    // Take alignment into account
    if ( aligned != nil )
@@ -296,28 +312,52 @@ static double entropy( LynkeosFourierBuffer *image, double down, double up )
    r.origin.y = imageSize.height - r.origin.y - r.size.height;
 
    // Get the sample in that image
-   [item getImageSample:&_bufferSpectrum inRect:r];
+   @try
+   {
+      [item getImageSample:&buffer inRect:r];
+   }
+   @catch( NSException *e )
+   {
+      [_freeBuffers pushObject:buffer];
+      @throw;
+   }
 
-   if ( _params->_method == SpectrumAnalysis )
-      [_bufferSpectrum directTransform];
+   return( buffer );
+}
+
+- (void) processItem:(id <LynkeosProcessableItem>)item withData:(id)data
+{
+   LynkeosFourierBuffer *buffer = (LynkeosFourierBuffer*)data;
+   MyImageAnalyzerResult *res;
 
-   // Analyze its quality
-   res = [[[MyImageAnalyzerResult alloc] init] autorelease];
-   switch ( _params->_method )
+   @try
    {
-      case SpectrumAnalysis:
-         res->_quality = quality( _bufferSpectrum, _lowerCutoff, _upperCutoff );
-         break;
-      case EntropyAnalysis:
-         res->_quality = entropy(_bufferSpectrum,  _lowerCutoff, _upperCutoff);
-         break;
-      default:
-         NSAssert(NO, @"Invalid analysis method");
-   }
+      if ( _params->_method == SpectrumAnalysis )
+         [buffer directTransform];
 
-   // Save the result
-   [item setProcessingParameter:res withRef:myImageAnalyzerResultRef 
-                  forProcessing:myImageAnalyzerRef];
+      // Analyze its quality
+      res = [[[MyImageAnalyzerResult alloc] init] autorelease];
+      switch ( _params->_method )
+      {
+         case SpectrumAnalysis:
+            res->_quality = quality( buffer, _lowerCutoff, _upperCutoff );
+            break;
+         case EntropyAnalysis:
+            res->_quality = entropy( buffer,  _lowerCutoff, _upperCutoff );
+            break;
+         default:
+            NSAssert(NO, @"Invalid analysis method");
+      }
+
+      // Save the result
+      [item setProcessingParameter:res withRef:myImageAnalyzerResultRef 
+                     forProcessing:myImageAnalyzerRef];
+   }
+   @finally
+   {
+      // The buffer can be loaded again
+      [_freeBuffers pushObject:buffer];
+   }
 }
 
 - (void) finishProcessing
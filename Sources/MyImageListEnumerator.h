@@ -31,6 +31,8 @@
 
 #import <Foundation/Foundation.h>
 
+#include <pthread.h>
+
 #include "MyImageListItem.h"
 
 /*!
@@ -39,6 +41,13 @@
  * @discussion This enumerator scans all the MyImageListItem images in a 
  *    MyImageList. When the list contains a container, it scans each items 
  *    inside it.
+ *
+ *    In chunked mode, each thread claims a contiguous range of items, of a
+ *    size decreasing with the remaining items. A thread which has no more item
+ *    to claim steals the second half of the biggest remaining range. Each
+ *    thread thus reads mostly consecutive frames, and the enumerator lock is
+ *    only taken once per range. The next items of each range are read ahead
+ *    in the background.
  * @ingroup Models
  */
 @interface MyImageListEnumerator : NSEnumerator
@@ -53,6 +62,11 @@
    int              _step;               //!< Sense of enumeration (1 or -1)
    BOOL             _skipUnselected;     //!< Do not enumerate unselected items
    NSRecursiveLock  *_lock;              //!< Lock for multithreads access
+   u_short          _nThreads;           //!< Threads sharing chunks, 0 if not chunked
+   NSMutableArray   *_chunkItems;        //!< All the items, in chunked mode
+   NSUInteger       _nextChunk;          //!< Index of the first unclaimed item
+   NSMutableArray   *_ranges;            //!< Ranges claimed by the threads
+   pthread_key_t    _rangeKey;           //!< Key of the calling thread range
 }
 
 /*!
@@ -82,6 +96,23 @@
  * @abstract Reset the enumerator to its starting point
  */
 - (void) reset;
+
+/*!
+ * @abstract Switch to the chunked scheduling
+ * @discussion It shall be called before the threads start to enumerate. The
+ *    items not yet enumerated are then given by contiguous ranges. It can be
+ *    called again to change the number of threads, until they start.
+ * @param nThreads The number of threads which will share the items
+ */
+- (void) setChunkedSchedulingForThreads:(u_short)nThreads ;
+
+/*!
+ * @abstract Count the items not yet enumerated, without enumerating them
+ * @param first Where to return the first of these items, if not NULL. It is
+ *    set to nil if there is no more item.
+ * @result The number of items
+ */
+- (NSUInteger) countRemainingItems:(MyImageListItem**)first ;
 @end
 
 #endif
@@ -20,8 +20,258 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //
 
+#include "LynkeosMemoryBudget.h"
+
 #include "MyImageListEnumerator.h"
 
+/*!
+ * @abstract Range of items claimed by a thread in chunked mode
+ * @discussion The owner thread takes the items at the start of the range, a
+ *    thread stealing work takes the end of the range.
+ */
+@interface MyImageListRange : NSObject
+{
+@public
+   pthread_mutex_t _mutex;       //!< Protects the range bounds
+   NSUInteger      _next;        //!< Next item to process
+   NSUInteger      _end;         //!< Index after the last item of the range
+   NSUInteger      _prefetched;  //!< Index after the last item read ahead
+}
+@end
+
+@implementation MyImageListRange
+
+- (id) init
+{
+   if ( (self = [super init]) != nil )
+   {
+      pthread_mutex_init( &_mutex, NULL );
+      _next = 0;
+      _end = 0;
+      _prefetched = 0;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   pthread_mutex_destroy( &_mutex );
+   [super dealloc];
+}
+
+@end
+
+/*!
+ * @abstract Private methods of MyImageListEnumerator
+ */
+@interface MyImageListEnumerator(Private)
+/*!
+ * @abstract Walk the list hierarchy up to the next item
+ * @result The next item, or nil at the end of the list
+ */
+- (id) nextItemInList ;
+
+/*!
+ * @abstract Collect the items which are not yet enumerated, for the chunks
+ */
+- (void) collectChunkItems ;
+
+/*!
+ * @abstract Give a new range of items to a thread
+ * @discussion A range is taken from the unclaimed items, or else stolen from
+ *    the thread which has the most remaining items.
+ * @param range The range of the calling thread
+ * @result The first item of the new range, or nil if there is no more item
+ */
+- (id) claimChunkFor:(MyImageListRange*)range ;
+
+/*!
+ * @abstract Read ahead the next items of a thread range
+ * @discussion The depth of the read ahead is given by the memory budget.
+ * @param range The range of the calling thread
+ */
+- (void) prefetchInRange:(MyImageListRange*)range ;
+@end
+
+@implementation MyImageListEnumerator(Private)
+
+- (id) nextItemInList
+{
+   id item = nil;
+
+   while ( item == nil &&  _itemIndex != NSNotFound )
+   {
+      // Look for the next image item (inside a movie or self contained)
+      if ( _currentContainer == nil || _itemIndexInContainer == NSNotFound )
+      {
+         // At first level
+         item = [_itemList objectAtIndex:_itemIndex];
+         if ( (_containerSize = [item numberOfChildren]) != 0 )
+         {
+            // First level item is a container, go down
+            _currentContainer = item;
+            item = nil;
+            _itemIndexInContainer = (_step > 0 ? 0 : _containerSize-1);
+         }
+
+         else if ( (_step > 0 && _itemIndex < _listSize-1) ||
+                   (_step < 0 && _itemIndex > 0) )
+            _itemIndex += _step;
+
+         else
+            _itemIndex = NSNotFound;
+      }
+
+      if ( _currentContainer != nil )
+      {
+         // Inside a container
+         if ( _itemIndexInContainer != NSNotFound )
+         {
+            item = [_currentContainer getChildAtIndex:_itemIndexInContainer];
+            if ( (_step > 0 && _itemIndexInContainer < _containerSize-1) ||
+                 (_step < 0 && _itemIndexInContainer > 0))
+               _itemIndexInContainer += _step;
+            else
+               _itemIndexInContainer = NSNotFound;
+         }
+         if ( _itemIndexInContainer == NSNotFound )
+         {
+            if ( (_step > 0 && _itemIndex < _listSize-1) ||
+                 (_step < 0 && _itemIndex > 0) )
+               _itemIndex += _step;
+            else
+               _itemIndex = NSNotFound;
+         }
+      }
+
+      // Do not iterate over unselected items if told so
+      if ( _skipUnselected && item != nil &&
+          [item getSelectionState] != NSOnState )
+         item = nil;
+   }
+
+   return( item );
+}
+
+- (void) collectChunkItems
+{
+   NSEnumerator *list = [_ranges objectEnumerator];
+   MyImageListRange *range;
+   id item;
+
+   [_chunkItems removeAllObjects];
+   while ( (item = [self nextItemInList]) != nil )
+      [_chunkItems addObject:item];
+   _nextChunk = 0;
+
+   // Forget the previous ranges
+   while ( (range = [list nextObject]) != nil )
+   {
+      pthread_mutex_lock( &range->_mutex );
+      range->_next = 0;
+      range->_end = 0;
+      range->_prefetched = 0;
+      pthread_mutex_unlock( &range->_mutex );
+   }
+}
+
+- (id) claimChunkFor:(MyImageListRange*)range
+{
+   const NSUInteger nItems = [_chunkItems count];
+   id item = nil;
+
+   [_lock lock];
+
+   if ( _nextChunk < nItems )
+   {
+      // Guided scheduling : big chunks first, smaller ones near the end
+      NSUInteger size = (nItems - _nextChunk)/(2*_nThreads);
+
+      if ( size == 0 )
+         size = 1;
+
+      pthread_mutex_lock( &range->_mutex );
+      range->_next = _nextChunk;
+      range->_end = _nextChunk + size;
+      item = [_chunkItems objectAtIndex:range->_next++];
+      range->_prefetched = range->_next;
+      pthread_mutex_unlock( &range->_mutex );
+
+      _nextChunk += size;
+   }
+   else
+   {
+      // Steal the end of the biggest range
+      NSEnumerator *list = [_ranges objectEnumerator];
+      MyImageListRange *other, *victim = nil;
+      NSUInteger remaining, biggest = 0;
+
+      while ( (other = [list nextObject]) != nil )
+      {
+         pthread_mutex_lock( &other->_mutex );
+         remaining = other->_end - other->_next;
+         pthread_mutex_unlock( &other->_mutex );
+         if ( other != range && remaining > biggest )
+         {
+            victim = other;
+            biggest = remaining;
+         }
+      }
+
+      if ( victim != nil )
+      {
+         NSUInteger start = 0, end = 0;
+
+         pthread_mutex_lock( &victim->_mutex );
+         // The victim may have progressed meanwhile
+         if ( victim->_next < victim->_end )
+         {
+            end = victim->_end;
+            start = end - (end - victim->_next + 1)/2;
+            victim->_end = start;
+         }
+         pthread_mutex_unlock( &victim->_mutex );
+
+         if ( start < end )
+         {
+            pthread_mutex_lock( &range->_mutex );
+            range->_next = start;
+            range->_end = end;
+            item = [_chunkItems objectAtIndex:range->_next++];
+            range->_prefetched = range->_next;
+            pthread_mutex_unlock( &range->_mutex );
+         }
+      }
+   }
+
+   [_lock unlock];
+
+   return( item );
+}
+
+- (void) prefetchInRange:(MyImageListRange*)range
+{
+   const NSUInteger depth = [LynkeosMemoryBudget readAheadDepth];
+   NSUInteger first, last;
+
+   pthread_mutex_lock( &range->_mutex );
+   first = range->_prefetched;
+   if ( first < range->_next )
+      first = range->_next;
+   last = range->_next + depth;
+   if ( last > range->_end )
+      last = range->_end;
+   if ( last > range->_prefetched )
+      range->_prefetched = last;
+   pthread_mutex_unlock( &range->_mutex );
+
+   for( ; first < last; first++ )
+      [(MyImageListItem*)[_chunkItems objectAtIndex:first] prefetch];
+}
+
+@end
+
 @implementation MyImageListEnumerator
 
 - (id) init
@@ -36,6 +286,10 @@
       _step = 0;
       _skipUnselected = FALSE;
       _firstItem = nil;
+      _nThreads = 0;
+      _chunkItems = nil;
+      _nextChunk = 0;
+      _ranges = nil;
    }
 
    return( self );
@@ -87,6 +341,12 @@
 
 - (void) dealloc
 {
+   if ( _nThreads != 0 )
+   {
+      pthread_key_delete( _rangeKey );
+      [_chunkItems release];
+      [_ranges release];
+   }
    [_lock release];
    [_itemList release];
    [super dealloc];
@@ -145,9 +405,73 @@
       _itemIndexInContainer = NSNotFound;
    }
 
+   if ( _nThreads != 0 )
+      [self collectChunkItems];
+
    [_lock unlock];
 }
 
+- (void) setChunkedSchedulingForThreads:(u_short)nThreads
+{
+   [_lock lock];
+
+   if ( _nThreads == 0 && pthread_key_create( &_rangeKey, NULL ) == 0 )
+   {
+      _nThreads = (nThreads != 0 ? nThreads : 1);
+      _chunkItems = [[NSMutableArray alloc] init];
+      _ranges = [[NSMutableArray alloc] initWithCapacity:_nThreads];
+
+      [self collectChunkItems];
+   }
+   else if ( _nThreads != 0 && nThreads != 0 )
+      _nThreads = nThreads;
+
+   [_lock unlock];
+}
+
+- (NSUInteger) countRemainingItems:(MyImageListItem**)first
+{
+   NSUInteger n = 0;
+   MyImageListItem *item = nil;
+
+   [_lock lock];
+
+   if ( _nThreads != 0 )
+   {
+      n = [_chunkItems count] - _nextChunk;
+      if ( n != 0 )
+         item = [[[_chunkItems objectAtIndex:_nextChunk] retain] autorelease];
+   }
+   else
+   {
+      // Walk the list, and come back where we were
+      const NSUInteger itemIndex = _itemIndex;
+      MyImageListItem * const container = _currentContainer;
+      const NSUInteger containerSize = _containerSize;
+      const NSUInteger indexInContainer = _itemIndexInContainer;
+      id next;
+
+      while ( (next = [self nextItemInList]) != nil )
+      {
+         if ( n == 0 )
+            item = next;
+         n++;
+      }
+
+      _itemIndex = itemIndex;
+      _currentContainer = container;
+      _containerSize = containerSize;
+      _itemIndexInContainer = indexInContainer;
+   }
+
+   [_lock unlock];
+
+   if ( first != NULL )
+      *first = item;
+
+   return( n );
+}
+
 - (NSArray *) allObjects
 {
    NSMutableArray *array = [NSMutableArray array];
@@ -165,62 +489,40 @@
 
 - (id) nextObject
 {
+   MyImageListRange *range;
    id item = nil;
 
-   [_lock lock];
-
-   while ( item == nil &&  _itemIndex != NSNotFound )
+   if ( _nThreads == 0 )
    {
-      // Look for the next image item (inside a movie or self contained)
-      if ( _currentContainer == nil || _itemIndexInContainer == NSNotFound )
+      [_lock lock];
+      item = [self nextItemInList];
+      [_lock unlock];
+   }
+   else
+   {
+      // Chunked mode, take the next item in the thread range
+      range = (MyImageListRange*)pthread_getspecific( _rangeKey );
+      if ( range == nil )
       {
-         // At first level
-         item = [_itemList objectAtIndex:_itemIndex];
-         if ( (_containerSize = [item numberOfChildren]) != 0 )
-         {
-            // First level item is a container, go down
-            _currentContainer = item;
-            item = nil;
-            _itemIndexInContainer = (_step > 0 ? 0 : _containerSize-1);
-         }
-
-         else if ( (_step > 0 && _itemIndex < _listSize-1) ||
-                   (_step < 0 && _itemIndex > 0) )
-            _itemIndex += _step;
-
-         else
-            _itemIndex = NSNotFound;
+         range = [[[MyImageListRange alloc] init] autorelease];
+         [_lock lock];
+         [_ranges addObject:range];
+         [_lock unlock];
+         pthread_setspecific( _rangeKey, range );
       }
 
-      if ( _currentContainer != nil )
-      {
-         // Inside a container
-         if ( _itemIndexInContainer != NSNotFound )
-         {
-            item = [_currentContainer getChildAtIndex:_itemIndexInContainer];
-            if ( (_step > 0 && _itemIndexInContainer < _containerSize-1) ||
-                 (_step < 0 && _itemIndexInContainer > 0))
-               _itemIndexInContainer += _step;
-            else
-               _itemIndexInContainer = NSNotFound;
-         }
-         if ( _itemIndexInContainer == NSNotFound )
-         {
-            if ( (_step > 0 && _itemIndex < _listSize-1) ||
-                 (_step < 0 && _itemIndex > 0) )
-               _itemIndex += _step;
-            else
-               _itemIndex = NSNotFound;
-         }
-      }
+      pthread_mutex_lock( &range->_mutex );
+      if ( range->_next < range->_end )
+         item = [_chunkItems objectAtIndex:range->_next++];
+      pthread_mutex_unlock( &range->_mutex );
 
-      // Do not iterate over unselected items if told so
-      if ( _skipUnselected && item != nil &&
-          [item getSelectionState] != NSOnState )
-         item = nil;
-   }
+      if ( item == nil )
+         item = [self claimChunkFor:range];
 
-   [_lock unlock];
+      // Keep the next items of the range read ahead
+      if ( item != nil )
+         [self prefetchInRange:range];
+   }
 
    return( item );
 }
@@ -199,6 +199,22 @@ extern NSString * const myImageListItemFlatField;   ///< Flat field param key
  */
 - (void) setMode:(ListMode_t)mode ;
 
+/*!
+ * @abstract Start reading the item data in the background
+ * @discussion A movie frame is read ahead by its reader, if it is able to.
+ *    An image is prepared by its reader if it is able to, otherwise the
+ *    image file is read ahead as a whole.
+ */
+- (void) prefetch ;
+
+/*!
+ * @abstract Capture date of the item
+ * @discussion A movie frame gets its own date from its reader, if the movie
+ *    records it. An image gets the date of its metadata.
+ * @result The capture date, or nil if it is unknown
+ */
+- (NSDate*) captureDate ;
+
 /*!
  * @method imageListItemWithURL:
  * @abstract Creator
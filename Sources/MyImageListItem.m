@@ -28,6 +28,10 @@
 #include "MyImageListItem.h"
 #include "LynkeosFourierBuffer.h"
 #include "LynkeosInterpolator.h"
+#include "LynkeosObjectCache.h"
+#include "LynkeosReadAhead.h"
+#include "LynkeosMetadata.h"
+#include "LynkeosThreadScheduler.h"
 
 // V1 Compatibility includes
 #ifndef NO_FILE_FORMAT_COMPATIBILITY_CODE
@@ -82,6 +86,7 @@ typedef enum
    NSPoint                    *offsets;
    u_short                     y;              //!< Current line
    NSConditionLock            *lock;           //!< Exclusive access to this object
+   u_short                     nThreads;       //!< Number of threads sharing the lines
    u_short                     startedThreads; //!< Total number of started threads
    u_short                     livingThreads;  //!< Number of still living threads
 }
@@ -116,6 +121,16 @@ typedef enum
  * @result The flat field for this item
  */
 - (LynkeosImageBuffer*) getFlatField ;
+
+/*!
+ * @abstract Read a sample of this movie frame
+ * @discussion When the frames cache exists, the whole frame is decoded and
+ *    kept in it, for the next passes not to decode it again.
+ */
+- (void) getMovieSample:(REAL * const * const)sample
+             withPlanes:(u_short)nPlanes
+                    atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+              lineWidth:(u_short)lineW ;
 @end
 
 /** Comparison function for sorting readers (highest priority first) */
@@ -284,12 +299,12 @@ static NSComparisonResult compareReaders( id obj1, id obj2, void *ctx )
    if ( _processStrategy == ParallelizedStrategy )
    {
       [args->lock lock];
-      if ( args->startedThreads < numberOfCpus )
+      if ( args->startedThreads < args->nThreads )
          args->startedThreads++;
       else
          NSLog( @"Too much thread start in one_thread_process_image" );
       args->livingThreads++;
-      if ( args->startedThreads == numberOfCpus )
+      if ( args->startedThreads == args->nThreads )
          [args->lock unlockWithCondition: ProcessStarted];
       else
          [args->lock unlock];
@@ -361,6 +376,52 @@ static NSComparisonResult compareReaders( id obj1, id obj2, void *ctx )
 
    return( _flat );
 }
+
+- (void) getMovieSample:(REAL * const * const)sample
+             withPlanes:(u_short)nPlanes
+                    atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+              lineWidth:(u_short)lineW
+{
+   // The cache may be replaced by the preferences meanwhile
+   LynkeosObjectCache *frameCache
+      = [[[LynkeosObjectCache frameCache] retain] autorelease];
+   LynkeosImageBuffer *frame;
+   u_short width, height, c, l;
+
+   if ( frameCache == nil )
+   {
+      // No room to keep the frames, read only the sample
+      [_reader getImageSample:sample atIndex:_index withPlanes:nPlanes
+                          atX:x Y:y W:w H:h lineWidth:lineW];
+      return;
+   }
+
+   // The readers remove their frames from the cache when they are deleted
+   frame = (LynkeosImageBuffer*)[frameCache getObjectForOwner:_reader
+                                                        index:_index];
+   if ( frame == nil || frame->_nPlanes != nPlanes )
+   {
+      // Decode the whole frame, for the next passes
+      [_reader imageWidth:&width height:&height];
+      frame = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:nPlanes
+                                                          width:width
+                                                         height:height];
+      [_reader getImageSample:[frame colorPlanes] atIndex:_index
+                   withPlanes:nPlanes
+                          atX:0 Y:0 W:width H:height
+                    lineWidth:frame->_padw];
+      [frameCache setObject:frame forOwner:_reader index:_index];
+   }
+
+   NSAssert( x + w <= frame->_w && y + h <= frame->_h,
+             @"Movie sample outside of the frame" );
+
+   // And copy the sample
+   for( c = 0; c < nPlanes; c++ )
+      for( l = 0; l < h; l++ )
+         memcpy( &sample[c][l*lineW], &colorValue(frame,x,y+l,c),
+                 w*sizeof(REAL) );
+}
 @end
 
 @implementation MyImageListItem
@@ -632,6 +693,22 @@ static NSComparisonResult compareReaders( id obj1, id obj2, void *ctx )
 }
 
 // Accessors
+- (void) prefetch
+{
+   if ( _reader == nil || [self numberOfChildren] != 0 )
+      return;
+
+   if ( _index != NSNotFound )
+   {
+      if ( [_reader respondsToSelector:@selector(prefetchFrameAtIndex:)] )
+         [_reader prefetchFrameAtIndex:_index];
+   }
+   else if ( [_reader respondsToSelector:@selector(prefetchImage)] )
+      [(id <LynkeosImageFileReader>)_reader prefetchImage];
+   else if ( [_itemURL isFileURL] )
+      [LynkeosReadAhead advisePath:[_itemURL path] offset:0 length:0];
+}
+
 - (NSURL*) getURL { return( _itemURL ); }
 
 - (u_long) numberOfChildren
@@ -965,12 +1042,11 @@ static NSComparisonResult compareReaders( id obj1, id obj2, void *ctx )
                           lineWidth:((LynkeosImageBuffer*)data)->_padw];
          else
             // Movie image
-            [_reader getImageSample:(REAL*const*const)readPlanes
-                            atIndex:_index
-                         withPlanes:((LynkeosImageBuffer*)data)->_nPlanes
-                                atX:wRect.origin.x Y:wRect.origin.y
-                                  W:wRect.size.width H:wRect.size.height
-                          lineWidth:((LynkeosImageBuffer*)data)->_padw];
+            [self getMovieSample:(REAL*const*const)readPlanes
+                      withPlanes:((LynkeosImageBuffer*)data)->_nPlanes
+                             atX:wRect.origin.x Y:wRect.origin.y
+                               W:wRect.size.width H:wRect.size.height
+                       lineWidth:((LynkeosImageBuffer*)data)->_padw];
       }
 
       NSAssert( data != nil, @"Failed to read a sample" );
@@ -1024,6 +1100,7 @@ static NSComparisonResult compareReaders( id obj1, id obj2, void *ctx )
       }
    args->y = 0;
    args->lock = nil;
+   args->nThreads = [LynkeosThreadScheduler rowThreads];
    args->startedThreads = 0;
    args->livingThreads = 0;
 
@@ -1032,8 +1109,8 @@ static NSComparisonResult compareReaders( id obj1, id obj2, void *ctx )
    {
       args->lock = [[NSConditionLock alloc] initWithCondition:ProcessInited];
 
-      // Start a thread for each "other processor"
-      for( i =  1; i < numberOfCpus; i++ )
+      // Start the other threads given by the scheduler
+      for( i =  1; i < args->nThreads; i++ )
          [NSThread detachNewThreadSelector:@selector(one_thread_interpolate:)
                                   toTarget:self
                                 withObject:args];
@@ -1247,6 +1324,21 @@ static NSComparisonResult compareReaders( id obj1, id obj2, void *ctx )
    return([_reader getMetaData]);
 }
 
+- (NSDate*) captureDate
+{
+   if ( _reader == nil || [self numberOfChildren] != 0 )
+      return( nil );
+
+   if ( _index != NSNotFound )
+   {
+      if ( [_reader respondsToSelector:@selector(dateOfFrameAtIndex:)] )
+         return( [_reader dateOfFrameAtIndex:_index] );
+      return( nil );
+   }
+
+   return( [[_reader getMetaData] objectForKey:LynkeosMD_CaptureDate()] );
+}
+
 + (id) imageListItemWithURL :(NSURL*)url
 {
    return( [[[self alloc] initWithURL:url] autorelease] );
@@ -50,6 +50,7 @@ extern NSString * const toolbarProcPrefix;
 #define ProcessingViewAuthorized 8
 
 @class MyProcessViewDefinition;
+@class MyMovieExporter;
 
 /*!
  * @abstract The document window controler
@@ -158,6 +159,11 @@ extern NSString * const toolbarProcPrefix;
    NSSavePanel                *_savePanel;      //!< The save file dialog
    NSMutableArray             *_currentWriters; //!< List of avilable writers
 
+   // The movie export
+   IBOutlet NSPanel           *_exportSheet;    //!< Export progress sheet
+   IBOutlet NSProgressIndicator *_exportProgress; //!< Exported frames
+   MyMovieExporter            *_movieExporter;  //!< Ongoing export, if any
+
    //! @abstract document contents
    //! @discussion optimisation to jump over a redirection for reads, document
    //!    is still called for writing
@@ -201,6 +207,7 @@ extern NSString * const toolbarProcPrefix;
 // Input output
 - (IBAction) saveStackedImage :(id)sender ;
 - (IBAction) exportMovie :(id)sender ;
+- (IBAction) cancelExport :(id)sender ;
 //@}
 @end
 
@@ -30,6 +30,8 @@
 #include "LynkeosImageBufferAdditions.h"
 #include "LynkeosGammaCorrecter.h"
 #include "MyUserPrefsController.h"
+#include "MyImageListEnumerator.h"
+#include "MyImageStacker.h"
 
 #ifdef DOUBLE_PIXELS
 #define powerof(x,y) pow(x,y)
@@ -70,6 +72,153 @@ typedef enum { K_UP, K_DOWN } enumeration_direction_t;
 }
 @end
 
+/*!
+ * @abstract Movie writer delegate, which provides the aligned and cropped
+ *    frames of a list
+ * @discussion The movie is written in its own thread, the progress and the
+ *    end of the export are sent to the window controller in the main thread.
+ */
+@interface MyMovieExporter : NSObject <LynkeosMovieFileWriterDelegate>
+{
+@private
+   MyImageListWindow    *_controller; //!< Window which displays the progress
+   id <LynkeosMovieFileWriter> _writer; //!< The configured writer
+   NSURL                *_url;       //!< The movie file
+   NSDictionary         *_metaData;  //!< The movie metadata
+   NSArray              *_items;     //!< The items to export
+   LynkeosIntegerRect    _rect;      //!< The crop rectangle
+   NSAffineTransform    *_transform; //!< Additional transform, as in stacking
+   u_short               _nPlanes;   //!< Number of planes to export
+   double                _black;     //!< Level exported as 0.0
+   double                _white;     //!< Level exported as 1.0
+   volatile BOOL         _cancelled; //!< The user cancelled the export
+}
+
+- (id) initWithItems:(NSArray*)items rect:(LynkeosIntegerRect)rect
+           transform:(NSAffineTransform*)transform
+      numberOfPlanes:(u_short)nPlanes
+          blackLevel:(double)black whiteLevel:(double)white
+              writer:(id <LynkeosMovieFileWriter>)writer url:(NSURL*)url
+            metaData:(NSDictionary*)metaData
+          controller:(MyImageListWindow*)controller ;
+
+/*!
+ * @abstract Write the movie, in a dedicated thread
+ * @param arg Unused
+ */
+- (void) exportThread:(id)arg ;
+
+/*!
+ * @abstract Stop the export before the next frame
+ */
+- (void) cancel ;
+@end
+
+@implementation MyMovieExporter
+
+- (id) initWithItems:(NSArray*)items rect:(LynkeosIntegerRect)rect
+           transform:(NSAffineTransform*)transform
+      numberOfPlanes:(u_short)nPlanes
+          blackLevel:(double)black whiteLevel:(double)white
+              writer:(id <LynkeosMovieFileWriter>)writer url:(NSURL*)url
+            metaData:(NSDictionary*)metaData
+          controller:(MyImageListWindow*)controller
+{
+   if ( (self = [super init]) != nil )
+   {
+      _controller = [controller retain];
+      _writer = [writer retain];
+      _url = [url retain];
+      _metaData = [metaData retain];
+      _items = [items retain];
+      _rect = rect;
+      _transform = [transform retain];
+      _nPlanes = nPlanes;
+      _black = black;
+      _white = white;
+      _cancelled = NO;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   [_controller release];
+   [_writer release];
+   [_url release];
+   [_metaData release];
+   [_items release];
+   [_transform release];
+   [super dealloc];
+}
+
+- (u_long) numberOfFrames
+{
+   return( [_items count] );
+}
+
+- (void) getFrameAtIndex:(u_long)index
+                withData:(REAL * const *)planes
+               lineWidth:(u_short)lineW
+{
+   LynkeosImageBuffer *image
+      = [MyImageStacker alignedSampleOfItem:[_items objectAtIndex:index]
+                                     inRect:_rect
+                              withTransform:_transform];
+   u_short x, y, c;
+
+   [_controller performSelectorOnMainThread:@selector(exportProgress:)
+                                 withObject:[NSNumber numberWithDouble:
+                                               index*100.0/[_items count]]
+                              waitUntilDone:NO];
+
+   if ( image == nil )
+   {
+      for( c = 0; c < _nPlanes; c++ )
+         memset( planes[c], 0, lineW*_rect.size.height*sizeof(REAL) );
+      return;
+   }
+
+   // Extract and scale the levels to 0..1
+   [image convertToPlanar:planes withPlanes:_nPlanes lineWidth:lineW];
+   for( c = 0; c < _nPlanes; c++ )
+      for( y = 0; y < _rect.size.height; y++ )
+         for( x = 0; x < _rect.size.width; x++ )
+            planes[c][x+y*lineW]
+               = (planes[c][x+y*lineW] - _black)/(_white - _black);
+}
+
+- (NSDate*) dateOfFrameAtIndex:(u_long)index
+{
+   return( [[_items objectAtIndex:index] captureDate] );
+}
+
+- (BOOL) isCancelled { return( _cancelled ); }
+
+- (void) cancel { _cancelled = YES; }
+
+- (void) exportThread:(id)arg
+{
+   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+   [_writer saveMovieAtURL:_url
+              withDelegate:self
+                blackLevel:_black whiteLevel:_white
+                withPlanes:_nPlanes
+                     width:_rect.size.width
+                    height:_rect.size.height
+                  metaData:_metaData];
+
+   [_controller performSelectorOnMainThread:@selector(exportEnded:)
+                                 withObject:self
+                              waitUntilDone:NO];
+
+   [pool release];
+}
+
+@end
+
 @implementation MyProcessViewDefinition
 - (id) init
 {
@@ -99,6 +248,8 @@ typedef enum { K_UP, K_DOWN } enumeration_direction_t;
 - (void) highlightOther:(enumeration_direction_t)sense skipUnselected:(BOOL)skip;
 - (void) itemChanged:(NSNotification*)notif ;
 - (void) zoomChanged:(NSNotification*)notif ;
+- (void) exportProgress:(NSNumber*)percent ;
+- (void) exportEnded:(MyMovieExporter*)exporter ;
 @end
 
 @interface MyImageListWindow(SplitView)
@@ -161,6 +312,22 @@ typedef enum { K_UP, K_DOWN } enumeration_direction_t;
       default : NSAssert( NO, @"Inconsistent data mode" );
    }
 }
+
+- (void) exportProgress:(NSNumber*)percent
+{
+   [_exportProgress setDoubleValue:[percent doubleValue]];
+}
+
+- (void) exportEnded:(MyMovieExporter*)exporter
+{
+   NSAssert( exporter == _movieExporter, @"Unknown movie export end" );
+
+   [[self window] endSheet:_exportSheet];
+   [_exportSheet orderOut:self];
+
+   [_movieExporter release];
+   _movieExporter = nil;
+}
 @end
 
 @implementation MyImageListWindow
@@ -170,6 +337,7 @@ typedef enum { K_UP, K_DOWN } enumeration_direction_t;
       return( self );
 
    _highlightedItem = nil;
+   _movieExporter = nil;
    _processingViewDict = [[NSMutableDictionary dictionary] retain];
    _processingAuthorization = NULL;
    _isProcessing = NO;
@@ -438,6 +606,11 @@ typedef enum { K_UP, K_DOWN } enumeration_direction_t;
 - (BOOL)validateMenuItem:(NSMenuItem*)menuItem
 {
    NSInteger tag = [menuItem tag];
+
+   // The list is read by the movie export, leave it alone meanwhile
+   if ( _movieExporter != nil )
+      return( NO );
+
    switch ( tag )
    {
       case K_SAVE_TAG:
@@ -1350,6 +1523,151 @@ typedef enum { K_UP, K_DOWN } enumeration_direction_t;
 
 - (void) exportMovie :(id)sender
 {
+   NSMutableArray *items = [NSMutableArray array];
+   NSEnumerator *list;
+   MyImageListItem *item;
+   Class writerClass;
+   id <LynkeosMovieFileWriter> writer;
+   NSInteger selectedIndex = -1;
+
+   // One export at a time
+   if ( _movieExporter != nil )
+   {
+      NSBeep();
+      return;
+   }
+
+   // Export the selected and aligned images
+   list = [[[MyImageListEnumerator alloc] initWithImageList:[_currentList imageArray]
+                                                    startAt:nil
+                                                directSense:YES
+                                             skipUnselected:YES] autorelease];
+   while ( (item = [list nextObject]) != nil )
+   {
+      if ( [item getProcessingParameterWithRef:LynkeosAlignResultRef
+                                 forProcessing:LynkeosAlignRef] != nil )
+         [items addObject:item];
+   }
+   if ( [items count] == 0 )
+   {
+      NSBeep();
+      return;
+   }
+
+   // Crop as for stacking, or the whole image
+   item = [items objectAtIndex:0];
+   const u_short nPlanes = [item numberOfPlanes];
+   MyImageStackerParameters *stackParams
+      = [_currentList getProcessingParameterWithRef:myImageStackerParametersRef
+                                      forProcessing:myImageStackerRef];
+   LynkeosIntegerRect rect;
+   NSAffineTransform *transform;
+   double black, white, gamma;
+
+   if ( stackParams != nil && stackParams->_cropRectangle.size.width != 0 )
+   {
+      rect = stackParams->_cropRectangle;
+      transform = stackParams->_transform;
+   }
+   else
+   {
+      rect.origin = LynkeosMakeIntegerPoint(0, 0);
+      rect.size = [item imageSize];
+      transform = nil;
+   }
+   if ( transform == nil )
+      transform = [NSAffineTransform transform];
+
+   if ( ![item getBlackLevel:&black whiteLevel:&white gamma:&gamma]
+        && ![item getMinLevel:&black maxLevel:&white] )
+   {
+      black = 0.0;
+      white = 255.0;
+   }
+
+   // Construct the writers list
+   _currentWriters = [NSMutableArray array];
+   if ( [_fileWritersMenu numberOfItems] != 0 )
+      [_fileWritersMenu removeAllItems];
+   for( list = [[[MyPluginsController defaultPluginController]
+                 getMovieWriters] objectEnumerator];
+       (writerClass = [list nextObject]) != nil; )
+   {
+      if ( [writerClass canSaveDataWithPlanes:nPlanes
+                                        width:rect.size.width
+                                       height:rect.size.height
+                                     metaData:nil] )
+      {
+         [_currentWriters addObject:writerClass];
+         [_fileWritersMenu addItemWithTitle:[writerClass writerName]];
+      }
+   }
+   if ( [_currentWriters count] == 0 )
+   {
+      NSBeep();
+      return;
+   }
+
+   // Select the last used, if any ; otherwise, select the first
+   NSString *prefWriter = [[NSUserDefaults standardUserDefaults]
+                           stringForKey:K_PREFERED_MOVIE_WRITER];
+   if ( prefWriter != nil )
+      selectedIndex = [_fileWritersMenu indexOfItemWithTitle:prefWriter];
+   if ( selectedIndex == -1 )
+      selectedIndex = 0;
+   [_fileWritersMenu selectItemAtIndex:selectedIndex];
+
+   _savePanel = [NSSavePanel savePanel];
+   [_savePanel setTitle:NSLocalizedString(@"Export movie",
+                                          @"Export movie window title")];
+   [_savePanel setCanSelectHiddenExtension:YES];
+   [_savePanel setAccessoryView:_fileWritersView];
+   writerClass = [_currentWriters objectAtIndex:selectedIndex];
+   [_savePanel setAllowedFileTypes:[NSArray arrayWithObject:[writerClass fileExtension]]];
+
+   if ( [_savePanel runModal] == NSModalResponseOK )
+   {
+      NSURL *url = [_savePanel URL];
+
+      selectedIndex = [_fileWritersMenu indexOfSelectedItem];
+      writerClass = [_currentWriters objectAtIndex: selectedIndex];
+
+      writer = (id <LynkeosMovieFileWriter>)[writerClass
+                                             writerForURL:url
+                                             planes:nPlanes
+                                             width:rect.size.width
+                                             height:rect.size.height
+                                             metaData:[item getMetaData]];
+
+      if ( [NSApp runModalForWindow:[writer configurationPanel]] == NSModalResponseOK )
+      {
+         _movieExporter
+            = [[MyMovieExporter alloc] initWithItems:items rect:rect
+                                           transform:transform
+                                      numberOfPlanes:nPlanes
+                                          blackLevel:black whiteLevel:white
+                                              writer:writer url:url
+                                            metaData:[item getMetaData]
+                                          controller:self];
+
+         // The movie is written in background, under a progress sheet
+         [_exportProgress setDoubleValue:0.0];
+         [[self window] beginSheet:_exportSheet completionHandler:nil];
+         [NSThread detachNewThreadSelector:@selector(exportThread:)
+                                  toTarget:_movieExporter
+                                withObject:nil];
+
+         // Remember the writer's name
+         [[NSUserDefaults standardUserDefaults]
+          setObject:[writerClass writerName]
+          forKey:K_PREFERED_MOVIE_WRITER];
+      }
+   }
+}
+
+- (void) cancelExport :(id)sender
+{
+   [_movieExporter cancel];
 }
 
 @end
@@ -97,6 +97,7 @@ typedef enum
                         _enumerator;      //!< Enumerator of the images to stack
    NSConditionLock*     _stackLock;       //!< Lock for orderly recombination
    unsigned             _livingThreads;   //!< How many stacking threads
+   u_short              _listThreads;     //!< Threads started for the stacking
    unsigned long        _imagesStacked;   //!< Total number of images stacked
 }
 @end
@@ -154,7 +155,7 @@ typedef enum
  *    (ie: one mono and one RGB per thread) are all recombined at the end.
  * @ingroup Processing
  */
-@interface MyImageStacker : NSObject <LynkeosProcessing>
+@interface MyImageStacker : NSObject <LynkeosPipelinedProcessing>
 {
 @private
    id <LynkeosDocument> _document;  //!< The document in which we are processing
@@ -164,6 +165,19 @@ typedef enum
    MyImageStackerParameters   *_params;     //!< Stacking parameters
    unsigned long               _imagesStacked; //!< Nb stacked in this thread
 }
+
+/*!
+ * @abstract Read an item sample with the stacking geometry
+ * @discussion The sample is aligned, corrected for the chromatic dispersion,
+ *    expanded by the stacking transform, and calibrated.
+ * @param item The item to read
+ * @param rect The crop rectangle, in the expanded coordinates
+ * @param transform The stacking transform, applied after the alignment
+ * @result The sample, or nil if the item is not aligned or not readable
+ */
++ (LynkeosImageBuffer*) alignedSampleOfItem:(id <LynkeosProcessableItem>)item
+                                     inRect:(LynkeosIntegerRect)rect
+                              withTransform:(NSAffineTransform*)transform ;
 @end
 
 #endif
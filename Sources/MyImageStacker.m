@@ -56,6 +56,7 @@ NSString * const myImageStackerListRef = @"ListToStack";
       _postStack = NoPostStack;
       _monochromeStack = NO;
       _livingThreads = 0;
+      _listThreads = 1;
       _imagesStacked = 0;
       _stackLock = nil;
    }
@@ -153,6 +154,64 @@ NSString * const myImageStackerListRef = @"ListToStack";
 
 @implementation MyImageStacker
 
++ (LynkeosImageBuffer*) alignedSampleOfItem:(id <LynkeosProcessableItem>)item
+                                     inRect:(LynkeosIntegerRect)rect
+                              withTransform:(NSAffineTransform*)transform
+{
+   LynkeosImageBuffer* image = nil;
+   NSPoint offsets[3] = {{0.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}};
+   LynkeosIntegerRect r = rect;
+
+   id <LynkeosAlignResult> alignRes
+      = (id <LynkeosAlignResult>)[item getProcessingParameterWithRef: LynkeosAlignResultRef
+                                                       forProcessing: LynkeosAlignRef];
+
+   if ( alignRes != nil )
+   {
+      NSAffineTransform *itemTransform
+         = [[[NSAffineTransform alloc] initWithTransform:[alignRes alignTransform]] autorelease];
+      NSAffineTransformStruct t;
+      u_short c;
+
+      // Take expansion into account, and convert to bitmap coordinate system
+      [itemTransform appendTransform:transform];
+      t = [itemTransform transformStruct];
+      const CGFloat factor = sqrt( t.m11*t.m22 - t.m12*t.m21 );
+      const CGFloat imgHeight = [item imageSize].height;
+      t.tX += t.m21*imgHeight;
+      t.tY = (factor - t.m22)*imgHeight - t.tY;
+      t.m12 *= -1.0;
+      t.m21 *= -1.0;
+
+      r.origin.y =  imgHeight*factor - r.origin.y - r.size.height;
+
+      // Take the chromatic dispersion correction into account
+      MyChromaticAlignParameter *chroma
+         = [item getProcessingParameterWithRef:myChromaticAlignerOffsetsRef
+                                 forProcessing:myChromaticAlignerRef];
+
+      // Prepare the offsets, with conversion to the bitmap coordinate system
+      for( c = 0; c < [item numberOfPlanes] && c < 3; c++ )
+      {
+         if ( chroma != nil )
+         {
+            offsets[c].x += chroma->_offsets[c].x * factor;
+            offsets[c].y -= chroma->_offsets[c].y * factor;
+         }
+      }
+
+      // Try first to get a custom calibrated image
+      image = [item getCustomImageSampleinRect:r withTransform:t withOffsets:offsets];
+      // Otherwise, get a standard one
+      if (image == nil)
+         [item getImageSample:&image inRect:r withTransform:t withOffsets:offsets];
+      if (image == nil)
+         NSLog(@"Could not get sample from image");
+   }
+
+   return( image );
+}
+
 + (ParallelOptimization_t) supportParallelization
 {
    return( [[NSUserDefaults standardUserDefaults] integerForKey:
@@ -218,82 +277,50 @@ NSString * const myImageStackerListRef = @"ListToStack";
    [super dealloc];
 }
 
+- (void) setNumberOfListThreads:(u_short)nThreads
+{
+   // All the threads of the stacking give the same number
+   _params->_listThreads = nThreads;
+}
+
 - (void) processItem :(id <LynkeosProcessableItem>)item
+{
+   id image = nil;
+
+   if ( ![item isKindOfClass:[NSNull class]] )
+      image = [self loadItem:item];
+
+   [self processItem:item withData:image];
+}
+
+- (id) loadItem:(id <LynkeosProcessableItem>)item
+{
+   return( [MyImageStacker alignedSampleOfItem:item
+                                        inRect:_params->_cropRectangle
+                                 withTransform:_params->_transform] );
+}
+
+- (void) processItem:(id <LynkeosProcessableItem>)item withData:(id)data
 {
    // When in multipass, the enumerator returns a NSNull at end of one pass
    if ([item isKindOfClass:[NSNull class]])
    {
       [_stackingStrategy processImage:(LynkeosImageBuffer*)item];
    }
-   else
+   else if ( data != nil )
    {
-      LynkeosImageBuffer* image = nil;
-      NSPoint offsets[3] = {0.0, 0.0, 0.0};
-      LynkeosIntegerRect r = _params->_cropRectangle;
+      // Accumulate
+      [_stackingStrategy processImage:(LynkeosImageBuffer*)data];
+      _imagesStacked++;
 
-      id <LynkeosAlignResult> alignRes
-         = (id <LynkeosAlignResult>)[item getProcessingParameterWithRef: LynkeosAlignResultRef
-                                                          forProcessing: LynkeosAlignRef];
-
-      if ( alignRes != nil )
-      {
-         NSAffineTransform *transform
-            = [[[NSAffineTransform alloc] initWithTransform:[alignRes alignTransform]] autorelease];
-         NSAffineTransformStruct t;
-         u_short c;
-
-         // Take expansion into account, and convert to bitmap coordinate system
-         [transform appendTransform:_params->_transform];
-         t = [transform transformStruct];
-         const CGFloat factor = sqrt( t.m11*t.m22 - t.m12*t.m21 );
-         const CGFloat imgHeight = [item imageSize].height;
-         t.tX += t.m21*imgHeight;
-         t.tY = (factor - t.m22)*imgHeight - t.tY;
-         t.m12 *= -1.0;
-         t.m21 *= -1.0;
-
-         r.origin.y =  imgHeight*factor - r.origin.y - r.size.height;
-
-         // Take the chromatic dispersion correction into account
-         MyChromaticAlignParameter *chroma
-            = [item getProcessingParameterWithRef:myChromaticAlignerOffsetsRef
-                                    forProcessing:myChromaticAlignerRef];
-
-         // Prepare the offsets, with conversion to the bitmap coordinate system
-         for( c = 0; c < [item numberOfPlanes]; c++ )
-         {
-            if ( chroma != nil )
-            {
-               offsets[c].x += chroma->_offsets[c].x * factor;
-               offsets[c].y -= chroma->_offsets[c].y * factor;
-            }
-         }
-
-         // Try first to get a custom calibrated image
-         image = [item getCustomImageSampleinRect:r withTransform:t withOffsets:offsets];
-         // Otherwise, get a standard one
-         if (image == nil)
-            [item getImageSample:&image inRect:r withTransform:t withOffsets:offsets];
-         if (image == nil)
-            NSLog(@"Could not get sample from image");
-      }
-
-      if ( image != nil )
-      {
-         // Accumulate
-         [_stackingStrategy processImage:image];
-         _imagesStacked++;
-
-         // As the item is not modified, force a notification
-         [_document itemWasProcessed:item];
-      }
+      // As the item is not modified, force a notification
+      [_document itemWasProcessed:item];
    }
 }
 
 - (void) finishProcessing
 {
-   const NSInteger maxThreads
-      = ([[self class] supportParallelization] ? numberOfCpus : 1);
+   const NSInteger maxThreads = _params->_listThreads;
 
    // Take control of the list (but only when all threads have started)
    [_params->_stackLock lockWhenCondition:maxThreads];
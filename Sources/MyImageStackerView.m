@@ -402,12 +402,14 @@ static NSString * const K_STACK_NAME = @"name";
 - (void) itemUsedInStack:(NSNotification*)notif
 {
    NSAssert( _isStacking, @"Stacking notification outside stacking" );
+   // The notifications are coalesced, highlight only the last item
+   NSArray *items = [[notif userInfo] objectForKey:LynkeosUserInfoItems];
    MyImageListItem *item = [[notif userInfo] objectForKey:LynkeosUserInfoItem];
 
    if ( item != nil )
    {
       [_window highlightItem:item];
-      _stackedImagesNb++;
+      _stackedImagesNb += (items != nil ? [items count] : 1);
    }
 }
 
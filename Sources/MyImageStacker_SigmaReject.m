@@ -105,7 +105,7 @@ static NSString * const mySigmaRejectImageStackerResult
 
 - (void) startNewPass
 {
-   const u_short maxThread = ([MyImageStacker supportParallelization] ? numberOfCpus : 1);
+   const u_short maxThread = _params->_listThreads;
    SigmaRejectImageStackerResult *res = (SigmaRejectImageStackerResult*)
       [_list getProcessingParameterWithRef:mySigmaRejectImageStackerResult
                              forProcessing:myImageStackerRef];
@@ -267,12 +267,19 @@ static NSString * const mySigmaRejectImageStackerResult
       NSAssert( _sum == nil || _sum->_nPlanes == [image numberOfPlanes],
                @"heterogeneous planes numbers in sigma reject stacking" );
 
-      // Extract the data in a local image buffer
-      LynkeosImageBuffer *buf
-         = [LynkeosImageBuffer imageBufferWithNumberOfPlanes: [image numberOfPlanes]
-                                                               width: [image width]
-                                                              height: [image height]];
-      [image convertToPlanar:[buf colorPlanes] withPlanes:buf->_nPlanes lineWidth:buf->_padw];
+      LynkeosImageBuffer *buf;
+
+      // Extract the data in a local image buffer, which is modified in pass 1.
+      // Pass 2 only reads it, a planar image is then used as is
+      if ( [_params->_enumerator pass] != 1 && ![image hasCustomFormat] )
+         buf = image;
+      else
+      {
+         buf = [LynkeosImageBuffer imageBufferWithNumberOfPlanes: [image numberOfPlanes]
+                                                           width: [image width]
+                                                          height: [image height]];
+         [image convertToPlanar:[buf colorPlanes] withPlanes:buf->_nPlanes lineWidth:buf->_padw];
+      }
 
       // If this is the first image, create the empty stack buffer with the same
       // number of planes (taking into account the expansion factor)
@@ -60,17 +60,19 @@
 {
    id next;
 
-   [_lock lock];
-
    next = [super nextObject];
 
-   if ( next == nil && _delegate != nil && [_delegate shouldPerformOneMorePass:self] )
+   // The lock is only needed at the end of a pass
+   if ( next == nil )
    {
-      next = [NSNull null];
+      [_lock lock];
+      if ( _delegate != nil && [_delegate shouldPerformOneMorePass:self] )
+      {
+         next = [NSNull null];
+      }
+      [_lock unlock];
    }
 
-   [_lock unlock];
-
    return( next );
 }
 @end
@@ -0,0 +1,63 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+/**
+ * \page libraries Libraries needed to compile Lynkeos
+ * The PNG and JPEG reader class needs the libpng library which can be found
+ * at http://www.libpng.org/pub/png/libpng.html and the libjpeg library, or
+ * preferably libjpeg-turbo found at https://libjpeg-turbo.org/
+ */
+
+/*!
+ * @header
+ * @abstract Reader for PNG and JPEG images
+ * @discussion These formats are also read by Cocoa, but through an offscreen
+ *   drawing of the whole image for each sample. This class is declared with a
+ *   higher priority.
+ */
+#ifndef __MYPNGJPEGREADER_H
+#define __MYPNGJPEGREADER_H
+
+#include <LynkeosCore/LynkeosFileReader.h>
+
+/*!
+ * @abstract Class for reading PNG and JPEG images with their own libraries.
+ * @discussion The lines are decoded directly in memory. When the movie cache
+ *   is enabled, the whole image is decoded and kept in the cache, for the next
+ *   samples of the same image. Otherwise, only the lines up to the sample end
+ *   are decoded.
+ * @ingroup FileAccess
+ */
+@interface MyPngJpegReader : NSObject <LynkeosImageFileReader>
+{
+@private
+   NSString *_path;           //!< Path of the image file
+   BOOL     _isPng;           //!< PNG or JPEG file
+   u_short  _width;           //!< Cached width
+   u_short  _height;          //!< Cached height
+   u_short  _channels;        //!< Number of decoded samples per pixel
+   u_short  _bytesPerSample;  //!< 1 or 2 bytes per decoded sample
+}
+
+@end
+
+#endif
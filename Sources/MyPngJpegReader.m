@@ -0,0 +1,501 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <png.h>
+#include <jpeglib.h>
+
+#include <AppKit/NSImage.h>
+
+#include <LynkeosCore/LynkeosObjectCache.h>
+
+#include "processing_core.h"
+#include "MyPngJpegReader.h"
+
+/*!
+ * @abstract Format of the decoded lines
+ */
+typedef struct
+{
+   u_short  width;          //!< Image width
+   u_short  height;         //!< Image height
+   u_short  channels;       //!< 1 for monochrome, 3 for RGB
+   u_short  bytesPerSample; //!< 1 or 2
+} DecodedFormat_t;
+
+/*!
+ * @abstract Decode some lines of a PNG image
+ * @discussion The palette and the lower bit depths are expanded to 8 bits,
+ *    and the alpha channel, or the transparency chunk, is stripped. 16 bits
+ *    samples are in host order.
+ * @param path The image file
+ * @param format The format of the decoded lines
+ * @param first The first line to decode
+ * @param count The number of lines to decode
+ * @param buf The buffer for the lines, or NULL for only reading the format
+ * @result 0 when successful
+ */
+static int decodePng( const char *path, DecodedFormat_t *format,
+                      u_short first, u_short count, u_char *buf )
+{
+   FILE *file = fopen( path, "rb" );
+   png_structp png = NULL;
+   png_infop info = NULL;
+   u_char * volatile lines = NULL;
+   png_bytep * volatile rows = NULL;
+   volatile int result = -1;
+   png_byte sig[8];
+
+   if ( file == NULL )
+      return( -1 );
+
+   if ( fread( sig, 1, sizeof(sig), file ) == sizeof(sig)
+        && png_sig_cmp( sig, 0, sizeof(sig) ) == 0 )
+      png = png_create_read_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+   if ( png != NULL )
+      info = png_create_info_struct( png );
+
+   // libpng errors jump back here
+   if ( info != NULL && setjmp( png_jmpbuf(png) ) == 0 )
+   {
+      int colorType, depth, passes;
+      size_t rowBytes;
+      u_long y;
+
+      png_init_io( png, file );
+      png_set_sig_bytes( png, sizeof(sig) );
+      png_read_info( png, info );
+
+      colorType = png_get_color_type( png, info );
+      depth = png_get_bit_depth( png, info );
+      if ( colorType == PNG_COLOR_TYPE_PALETTE )
+         png_set_palette_to_rgb( png );
+      if ( colorType == PNG_COLOR_TYPE_GRAY && depth < 8 )
+         png_set_expand_gray_1_2_4_to_8( png );
+      // The palette expansion turns the transparency into alpha, strip it
+      if ( png_get_valid( png, info, PNG_INFO_tRNS ) != 0 )
+      {
+         png_set_tRNS_to_alpha( png );
+         png_set_strip_alpha( png );
+      }
+      else if ( (colorType & PNG_COLOR_MASK_ALPHA) != 0 )
+         png_set_strip_alpha( png );
+#if BYTE_ORDER == LITTLE_ENDIAN
+      if ( depth == 16 )
+         png_set_swap( png );
+#endif
+      passes = png_set_interlace_handling( png );
+      png_read_update_info( png, info );
+
+      if ( png_get_image_width( png, info ) > 65535
+           || png_get_image_height( png, info ) > 65535 )
+         png_error( png, "Image too large" );
+      format->width = png_get_image_width( png, info );
+      format->height = png_get_image_height( png, info );
+      format->channels = png_get_channels( png, info );
+      format->bytesPerSample = (png_get_bit_depth( png, info ) == 16 ? 2 : 1);
+      rowBytes = png_get_rowbytes( png, info );
+
+      if ( buf != NULL )
+      {
+         if ( passes == 1 )
+         {
+            // Decode until the last needed line, in place for the needed ones
+            lines = (u_char*)malloc( rowBytes );
+            for( y = 0; y < (u_long)first+count; y++ )
+               png_read_row( png,
+                             (y < first ? lines : &buf[(y-first)*rowBytes]),
+                             NULL );
+         }
+         else
+         {
+            // Each pass of an interlaced image fills all the lines
+            lines = (u_char*)malloc( rowBytes*format->height );
+            rows = (png_bytep*)malloc( format->height*sizeof(png_bytep) );
+            for( y = 0; y < format->height; y++ )
+               rows[y] = &lines[y*rowBytes];
+            png_read_image( png, rows );
+            memcpy( buf, &lines[first*rowBytes], count*rowBytes );
+         }
+      }
+
+      result = 0;
+   }
+
+   png_destroy_read_struct( &png, &info, NULL );
+   if ( lines != NULL )
+      free( lines );
+   if ( rows != NULL )
+      free( rows );
+   fclose( file );
+
+   return( result );
+}
+
+/*!
+ * @abstract Error manager for libjpeg, which returns to the decoding function
+ */
+typedef struct
+{
+   struct jpeg_error_mgr pub;  //!< Standard libjpeg error manager
+   jmp_buf               jump; //!< Where to go back on error
+} JpegError_t;
+
+/*!
+ * @abstract Report a libjpeg error and leave the decoding
+ * @param cinfo The decompression object
+ */
+static void jpegError( j_common_ptr cinfo )
+{
+   (*cinfo->err->output_message)( cinfo );
+   longjmp( ((JpegError_t*)cinfo->err)->jump, 1 );
+}
+
+/*!
+ * @abstract Decode some lines of a JPEG image
+ * @discussion Only grayscale and RGB images are read, with 8 bits samples.
+ * @param path The image file
+ * @param format The format of the decoded lines
+ * @param first The first line to decode
+ * @param count The number of lines to decode
+ * @param buf The buffer for the lines, or NULL for only reading the format
+ * @result 0 when successful
+ */
+static int decodeJpeg( const char *path, DecodedFormat_t *format,
+                       u_short first, u_short count, u_char *buf )
+{
+   FILE *file = fopen( path, "rb" );
+   struct jpeg_decompress_struct cinfo;
+   JpegError_t err;
+   JSAMPROW volatile skipped = NULL;
+   volatile int result = -1;
+
+   if ( file == NULL )
+      return( -1 );
+
+   cinfo.err = jpeg_std_error( &err.pub );
+   err.pub.error_exit = jpegError;
+
+   // libjpeg errors jump back here
+   if ( setjmp( err.jump ) == 0 )
+   {
+      jpeg_create_decompress( &cinfo );
+      jpeg_stdio_src( &cinfo, file );
+      jpeg_read_header( &cinfo, TRUE );
+
+      if ( cinfo.jpeg_color_space != JCS_CMYK
+           && cinfo.jpeg_color_space != JCS_YCCK
+           && cinfo.image_width <= 65535 && cinfo.image_height <= 65535 )
+      {
+         cinfo.out_color_space = (cinfo.num_components == 1 ? JCS_GRAYSCALE :
+                                                               JCS_RGB);
+         format->width = cinfo.image_width;
+         format->height = cinfo.image_height;
+         format->channels = (cinfo.num_components == 1 ? 1 : 3);
+         format->bytesPerSample = 1;
+
+         if ( buf != NULL )
+         {
+            const u_long rowBytes = (u_long)format->width*format->channels;
+
+            jpeg_start_decompress( &cinfo );
+
+            // Go to the first needed line, libjpeg-turbo can skip them since
+            // its version 1.5
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) \
+    && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+            if ( first > 0 )
+               jpeg_skip_scanlines( &cinfo, first );
+#else
+            skipped = (JSAMPROW)malloc( rowBytes );
+            while ( cinfo.output_scanline < first )
+               jpeg_read_scanlines( &cinfo, (JSAMPARRAY)&skipped, 1 );
+#endif
+
+            while ( cinfo.output_scanline < (u_long)first+count )
+            {
+               JSAMPROW row = &buf[(cinfo.output_scanline-first)*rowBytes];
+
+               jpeg_read_scanlines( &cinfo, &row, 1 );
+            }
+
+            // The next lines are not needed
+            jpeg_abort_decompress( &cinfo );
+         }
+
+         result = 0;
+      }
+   }
+
+   jpeg_destroy_decompress( &cinfo );
+   if ( skipped != NULL )
+      free( skipped );
+   fclose( file );
+
+   return( result );
+}
+
+/*!
+ * @abstract Decoded lines of an image
+ */
+@interface MyDecodedLines : NSObject
+{
+@public
+   u_char   *_samples;    //!< Interleaved samples of the lines
+   u_short  _firstLine;   //!< Image line of the first decoded line
+   u_short  _lines;       //!< Number of decoded lines
+}
+@end
+
+@implementation MyDecodedLines
+- (void) dealloc
+{
+   if ( _samples != NULL )
+      free( _samples );
+   [super dealloc];
+}
+@end
+
+/*!
+ * @abstract Private methods of MyPngJpegReader
+ */
+@interface MyPngJpegReader(Private)
+/*!
+ * @abstract Decode some lines of the image
+ * @param first The first line
+ * @param count The number of lines
+ * @result The decoded lines, owned by the caller, or nil on error
+ */
+- (MyDecodedLines*) decodeLinesFrom:(u_short)first count:(u_short)count ;
+@end
+
+@implementation MyPngJpegReader(Private)
+
+- (MyDecodedLines*) decodeLinesFrom:(u_short)first count:(u_short)count
+{
+   MyDecodedLines *lines = [[MyDecodedLines alloc] init];
+   DecodedFormat_t format;
+   int err;
+
+   lines->_firstLine = first;
+   lines->_lines = count;
+   lines->_samples = (u_char*)malloc( (u_long)_width*count*_channels
+                                      *_bytesPerSample );
+   NSAssert( lines->_samples != NULL, @"Unable to allocate decoded lines" );
+
+   if ( _isPng )
+      err = decodePng( [_path fileSystemRepresentation], &format,
+                       first, count, lines->_samples );
+   else
+      err = decodeJpeg( [_path fileSystemRepresentation], &format,
+                        first, count, lines->_samples );
+
+   if ( err != 0 || format.width != _width || format.height != _height
+        || format.channels != _channels
+        || format.bytesPerSample != _bytesPerSample )
+   {
+      [lines release];
+      lines = nil;
+   }
+
+   return( lines );
+}
+
+@end
+
+@implementation MyPngJpegReader
+
++ (void) load
+{
+   // Nothing to do, this is just to force the runtime to load this class
+}
+
++ (void) lynkeosFileTypes:(NSArray**)fileTypes
+{
+   // Tried before the Cocoa reader
+   NSNumber *pri = [NSNumber numberWithInt:1];
+
+   *fileTypes = [NSArray arrayWithObjects:pri,@"png",
+                                          pri,@"jpg",pri,@"jpeg",
+                                          nil];
+}
+
+- (id) init
+{
+   self = [super init];
+   if ( self != nil )
+   {
+      _path = nil;
+      _isPng = NO;
+      _width = 0;
+      _height = 0;
+      _channels = 0;
+      _bytesPerSample = 0;
+   }
+
+   return( self );
+}
+
+- (id) initWithURL:(NSURL*)url
+{
+   DecodedFormat_t format;
+   const char *path;
+
+   self = [self init];
+
+   if ( self == nil )
+      return( self );
+
+   _path = [[url path] retain];
+   path = [_path fileSystemRepresentation];
+
+   // Try both, as the extension may be wrong
+   if ( decodePng( path, &format, 0, 0, NULL ) == 0 )
+      _isPng = YES;
+   else if ( decodeJpeg( path, &format, 0, 0, NULL ) != 0 )
+   {
+      [self release];
+      return( nil );
+   }
+
+   _width = format.width;
+   _height = format.height;
+   _channels = format.channels;
+   _bytesPerSample = format.bytesPerSample;
+
+   if ( _channels != 1 && _channels != 3 )
+   {
+      [self release];
+      self = nil;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   // The cache does not retain us
+   [LynkeosObjectCache forgetOwner:self];
+
+   [_path release];
+   [super dealloc];
+}
+
+- (void) imageWidth:(u_short*)w height:(u_short*)h
+{
+   *w = _width;
+   *h = _height;
+}
+
+- (u_short) numberOfPlanes
+{
+   return( _channels );
+}
+
+- (void) getMinLevel:(double*)vmin maxLevel:(double*)vmax
+{
+   *vmin = 0.0;
+   *vmax = 255.0;
+}
+
+- (NSImage*) getNSImage
+{
+   return( [[[NSImage alloc] initWithContentsOfFile:_path] autorelease] );
+}
+
+/*! 16 bits samples are scaled to remain with a 256 maximum, as for TIFF.
+ * A decoding failure raises an exception, the processing then skips the image.
+ */
+- (void) getImageSample:(REAL * const * const)sample
+             withPlanes:(u_short)nPlanes
+                    atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+              lineWidth:(u_short)lineW
+{
+   LynkeosObjectCache *movieCache = [LynkeosObjectCache movieCache];
+   MyDecodedLines *lines = nil;
+   u_short xs, ys, c;
+
+   NSAssert2( nPlanes == _channels || nPlanes == 1,
+              @"Illegal transfer from %d planes to %d planes",
+              _channels, nPlanes );
+   NSAssert( x+w <= _width && y+h <= _height,
+             @"Sample at least partly outside the image" );
+
+   if ( movieCache != nil )
+      lines = (MyDecodedLines*)[[movieCache getObjectForOwner:self index:0]
+                                                                       retain];
+
+   if ( lines == nil )
+   {
+      if ( movieCache != nil )
+      {
+         // The whole image is decoded once for all the samples
+         lines = [self decodeLinesFrom:0 count:_height];
+         if ( lines != nil )
+            [movieCache setObject:lines forOwner:self index:0];
+      }
+      else
+         lines = [self decodeLinesFrom:y count:h];
+   }
+
+   // Do not let a corrupted file go unnoticed as a black image
+   if ( lines == nil )
+      [NSException raise:NSGenericException
+                  format:@"Unable to decode %@", _path];
+
+   for( ys = 0; ys < h; ys++ )
+   {
+      const u_long first = ((u_long)(y+ys-lines->_firstLine)*_width + x)
+                           *_channels;
+
+      for( xs = 0; xs < w; xs++ )
+      {
+         REAL v[3];
+
+         for( c = 0; c < _channels; c++ )
+         {
+            const u_long i = first + xs*_channels + c;
+
+            if ( _bytesPerSample == 2 )
+               v[c] = (REAL)((u_short*)lines->_samples)[i] / 256.0;
+            else
+               v[c] = (REAL)lines->_samples[i];
+         }
+
+         if ( nPlanes == 1 && _channels != 1 )
+            SET_SAMPLE( sample[0], xs, ys, lineW, (v[0]+v[1]+v[2])/3.0 );
+         else
+            for( c = 0; c < nPlanes; c++ )
+               SET_SAMPLE( sample[c], xs, ys, lineW, v[c] );
+      }
+   }
+
+   [lines release];
+}
+
+- (NSDictionary*) getMetaData
+{
+   return( nil );
+}
+
+@end
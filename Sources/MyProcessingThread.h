@@ -40,6 +40,7 @@ extern NSString * const K_PROCESS_CLASS_KEY;      ///< Class of the "processor"
 extern NSString * const K_PROCESS_ENUMERATOR_KEY; ///< Process items enumerator
 extern NSString * const K_PROCESS_ITEM_KEY;       ///< Alternate form: only item
 extern NSString * const K_PROCESS_PARAMETERS_KEY; ///< Direct parameter
+extern NSString * const K_PROCESS_LIST_THREADS_KEY; ///< Threads of the process
 
 /*!
  * @class MyProcessingThread
@@ -48,20 +49,22 @@ extern NSString * const K_PROCESS_PARAMETERS_KEY; ///< Direct parameter
  *    <ul>
  *      <li>creates and initializes a processing instance.
  *      <li>iterates over the item list and calls the processing instance for 
- *      each item. 
+ *      each item. When the processing is split in stages, the items are
+ *      loaded in a LynkeosPipeline ahead of their processing.
  *      <li>Calls the "end of processing" method of processing instance when
  *      all items have been processed.
  *      <li>Free all the resources and terminates the thread.
  *   </ul> 
  */
-@interface MyProcessingThread : NSObject
+@interface MyProcessingThread : NSObject <LynkeosThreadSafeMethods>
 {
 @protected
    id <LynkeosProcessing>  _processingInstance;    //!< The processing object !
    MyDocument*             _document;              //!< The document controller
    NSEnumerator*           _itemList;  //!< Enumerator given at thread creation
    id <LynkeosProcessableItem> _item;        //!< Alternate form: only one item
-   BOOL                    _processEnded;          //!< Controls the run loop
+   volatile BOOL           _processEnded;          //!< Cancel flag, set by any thread
+   BOOL                    _registered;  //!< Counted by the memory budget
    NSProxy*                _proxy;             //!< Our proxy in the main thread
 }
 
@@ -77,6 +80,8 @@ extern NSString * const K_PROCESS_PARAMETERS_KEY; ///< Direct parameter
 /*!
  * @method stopProcessing
  * @abstract Force the thread to exit when next item is processed
+ * @discussion This method is called directly by the main thread, through the
+ *    proxy, it only raises the cancel flag.
  * @result None
  */
 - (oneway void) stopProcessing ;
@@ -20,14 +20,20 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //
 
+#include "LynkeosMemoryBudget.h"
+#include "LynkeosPipeline.h"
 #include "MyDocument.h"
 #include "MyProcessingThread.h"
 
+//! Number of loaded items waiting for their processing, in pipelined processes
+#define K_PIPELINE_DEPTH 2
+
 NSString * const K_PROCESS_CONNECTION =     @"prCnx";
 NSString * const K_PROCESS_CLASS_KEY =      @"prClass";
 NSString * const K_PROCESS_ENUMERATOR_KEY = @"prEnum";
 NSString * const K_PROCESS_ITEM_KEY =       @"prItem";
 NSString * const K_PROCESS_PARAMETERS_KEY = @"param";
+NSString * const K_PROCESS_LIST_THREADS_KEY = @"prThreads";
 
 /*!
  * @abstract Private methods of MyProcessingThread class
@@ -49,11 +55,38 @@ NSString * const K_PROCESS_PARAMETERS_KEY = @"param";
  * @discussion The loop exits when the last item is processed or if the main 
  *   thread stopped the processing.
  *
- *   The run loop is run at each iteration to allow inter-threads method call.
- *   The run loop is just queried for a pending inter-thread message.
+ *   The cancel flag is checked before each item, the run loop is not polled.
  */
 - (void) processList ;
 
+/*!
+ * @abstract Next item to process
+ * @discussion It is also the source of the pipeline, in the loading thread.
+ * @result The next item, nil when the processing shall end
+ */
+- (id) nextObject ;
+
+/*!
+ * @abstract Process the list in a pipeline, for the pipelined processes
+ * @discussion The items are loaded in a dedicated thread, while this thread
+ *    processes them.
+ */
+- (void) processPipeline ;
+
+/*!
+ * @abstract Loading stage of the pipeline
+ * @param item The item to load
+ * @result An array holding the item and its loaded data
+ */
+- (id) loadStage:(id)item ;
+
+/*!
+ * @abstract Processing stage of the pipeline
+ * @param object The item and its data, or a multipass enumerator pass end
+ * @result nil, as this is the last stage
+ */
+- (id) processStage:(id)object ;
+
 @end
 
 @implementation MyProcessingThread(Private)
@@ -66,6 +99,7 @@ NSString * const K_PROCESS_PARAMETERS_KEY = @"param";
    {
       _document = document;
       _processEnded = NO;
+      _registered = NO;
       _itemList = [[attributes objectForKey:K_PROCESS_ENUMERATOR_KEY] retain];
       _item = [[attributes objectForKey:K_PROCESS_ITEM_KEY] retain];
       NSAssert( _itemList == nil || _item == nil,
@@ -75,6 +109,11 @@ NSString * const K_PROCESS_PARAMETERS_KEY = @"param";
          [[[attributes objectForKey: K_PROCESS_CLASS_KEY] alloc]
                   initWithDocument: document
                         parameters: [attributes objectForKey:K_PROCESS_PARAMETERS_KEY]];
+      if ( [_processingInstance respondsToSelector:
+                                        @selector(setNumberOfListThreads:)] )
+         [_processingInstance setNumberOfListThreads:
+              [[attributes objectForKey:K_PROCESS_LIST_THREADS_KEY]
+                                                            unsignedShortValue]];
       _proxy = [[cnx proxyForObject:self inThread:YES] retain];
    }
 
@@ -83,9 +122,6 @@ NSString * const K_PROCESS_PARAMETERS_KEY = @"param";
 
 - (void) processList
 {
-   // Create a run loop for this thread
-   NSRunLoop* runLoop = [NSRunLoop currentRunLoop];
-
    if ( _item != nil )
    {
       @try
@@ -101,41 +137,123 @@ NSString * const K_PROCESS_PARAMETERS_KEY = @"param";
 
    else
    {
-      while ( ! _processEnded )
-      {
-         NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+      _registered = YES;
+      [LynkeosMemoryBudget listThreadStarted];
 
-         @try
+      if ( [_processingInstance conformsToProtocol:
+                                       @protocol(LynkeosPipelinedProcessing)] )
+         [self processPipeline];
+
+      else
+      {
+         while ( ! _processEnded )
          {
-            // Null timeout and process next item immediately after
-            [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate date]];
-            if ( ! _processEnded  )
+            NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+            @try
             {
-               id <LynkeosProcessableItem> item = [_itemList nextObject];
+               id <LynkeosProcessableItem> item = [self nextObject];
 
-               if ( item == nil )
-                  // Process is finished
-                  [self stopProcessing];
-               else
-                  [_processingInstance processItem:item];         
+               if ( item != nil )
+                  [_processingInstance processItem:item];
+            }
+            @catch( NSException *e )
+            {
+               NSLog( @"*** Exception %@ raised in list processing thread: \"%@\"",
+                      [e name], [e reason] );
+            }
+            @finally
+            {
+               [pool release];
             }
-         }
-         @catch( NSException *e )
-         {
-            NSLog( @"*** Exception %@ raised in list processing thread: \"%@\"",
-                   [e name], [e reason] );
-         }
-         @finally
-         {
-            [pool release];
          }
       }
+
+      if ( _registered )
+         [LynkeosMemoryBudget listThreadEnded];
    }
 
    [_processingInstance finishProcessing];
    [_document processEnded:_proxy];
 }
 
+- (id) nextObject
+{
+   id item = nil;
+
+   // When short of memory, shrink the caches, then the threads. But a
+   // multipass processing waits for all its threads at the end of each pass,
+   // none of them can leave before the last one.
+   [LynkeosMemoryBudget relieveMemory];
+   if ( ! [_itemList conformsToProtocol:@protocol(LynkeosMultiPassEnumerator)]
+        && [LynkeosMemoryBudget listThreadShallStop] )
+   {
+      _registered = NO;
+      [self stopProcessing];
+   }
+
+   if ( ! _processEnded  )
+   {
+      item = [_itemList nextObject];
+
+      if ( item == nil )
+         // Process is finished
+         [self stopProcessing];
+   }
+
+   return( item );
+}
+
+- (void) processPipeline
+{
+   LynkeosPipeline *pipeline = [[LynkeosPipeline alloc] initWithSource:self];
+   NSMutableDictionary *occupancy = [NSMutableDictionary dictionary];
+   u_short i;
+
+   [pipeline addStageWithTarget:self selector:@selector(loadStage:)
+                        workers:1 depth:0 name:@"load"];
+   [pipeline addStageWithTarget:self selector:@selector(processStage:)
+                        workers:1 depth:K_PIPELINE_DEPTH name:@"process"];
+   [pipeline run];
+
+   // Let the document publish the stages occupancy
+   for( i = 0; i < [pipeline numberOfStages]; i++ )
+      [occupancy setObject:
+                   [NSNumber numberWithDouble:[pipeline occupancyOfStage:i]]
+                    forKey:[pipeline nameOfStage:i]];
+   [_document processStagesOccupancy:occupancy];
+
+   [pipeline release];
+}
+
+- (id) loadStage:(id)item
+{
+   id data;
+
+   // The multipass enumerators pass ends have nothing to load
+   if ( [item isKindOfClass:[NSNull class]] )
+      return( item );
+
+   data = [(id <LynkeosPipelinedProcessing>)_processingInstance loadItem:item];
+
+   return( [NSArray arrayWithObjects:item, data, nil] );
+}
+
+- (id) processStage:(id)object
+{
+   id <LynkeosPipelinedProcessing> instance =
+                          (id <LynkeosPipelinedProcessing>)_processingInstance;
+
+   if ( [object isKindOfClass:[NSNull class]] )
+      [instance processItem:object withData:nil];
+   else
+      [instance processItem:[object objectAtIndex:0]
+                   withData:([object count] > 1 ? [object objectAtIndex:1]
+                                                : nil)];
+
+   return( nil );
+}
+
 @end
 
 @implementation MyProcessingThread
@@ -206,6 +324,12 @@ NSString * const K_PROCESS_PARAMETERS_KEY = @"param";
 - (oneway void) stopProcessing 
 {
    _processEnded = YES;
+   __sync_synchronize();
+}
+
+- (BOOL) isThreadSafeSelector:(SEL)sel
+{
+   return( sel == @selector(stopProcessing) );
 }
 
 - (void) dealloc
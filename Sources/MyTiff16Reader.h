@@ -42,8 +42,14 @@
 
 /*!
  * @abstract Class for reading 16 bits or monochrome TIFF image file format.
- * @discussion The TIFF file is opened and closed each time we need to read its
- *   contents. Otherwise, all the TIFF files would be loaded in memory.
+ * @discussion Each reading thread uses its own libtiff handle, taken from a
+ *   pool. The idle handles of all the readers are bounded in number, the
+ *   least recently used being closed. Otherwise, all the TIFF files would be
+ *   opened at once.
+ *
+ *   The decoded strips or tiles are kept in a cache shared by all the readers,
+ *   of bounded size, for the next samples read in the same image not to decode
+ *   them again. Only the strips or tiles covering the sample are decoded.
  * @ingroup FileAccess
  */
 @interface MyTiff16Reader : NSObject <LynkeosImageFileReader>
@@ -54,11 +60,18 @@
    uint32   _height;     //!< Cached height
    u_short  _planar;     //!< Is the image planar
    u_short  _nPlanes;    //!< Number of color planes
-   uint32   _stripH;     //!< Tiff strip height
+   uint32   _chunkW;     //!< Width of the strips or tiles
+   uint32   _chunkH;     //!< Height of the strips or tiles
+   uint32   _chunksAcross; //!< Number of tiles in a row (1 for strips)
+   uint32   _chunksDown; //!< Number of strips or tiles in a column
+   tsize_t  _chunkSize;  //!< Size in bytes of a decoded strip or tile
+   BOOL     _tiled;      //!< Whether the image is organized in tiles
    u_short  _nBits;      //!< Number of bits per pixels
    u_short  _sampleType; //!< Integer or float pixels
    double   _min;        //!< Minimum pixel value
    double   _max;        //!< Maximum pixel value
+   NSMutableArray *_freeHandles; //!< Idle libtiff handles
+   NSMutableDictionary *_chunks; //!< Our decoded strips or tiles in the cache
 }
 
 @end
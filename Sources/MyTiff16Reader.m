@@ -23,16 +23,325 @@
 #import <AppKit/NSGraphics.h>
 
 #include <LynkeosCore/LynkeosImageBuffer.h>
+#include <LynkeosCore/LynkeosMemoryBudget.h>
 
 #include "processing_core.h"
 #include "MyTiff16Reader.h"
 
+//! Maximum memory used by the cache of decoded strips and tiles, it is also
+//! reduced when the memory budget is exceeded
+#define K_TIFF_CACHE_MEMORY (256*1024*1024UL)
+
+//! Maximum number of idle libtiff handles, for all the readers
+#define K_MAX_IDLE_HANDLES (4*numberOfCpus)
+
+static NSLock *tiffCacheLock = nil;           //!< Protects the pool and cache
+static NSMutableArray *idleHandleReaders = nil; //!< Least recently used first
+static u_long idleHandles = 0;               //!< Number of idle handles
+static u_long chunksMemory = 0;              //!< Memory used by the cache
+
+/*!
+ * @abstract A decoded strip or tile in the cache
+ */
+@interface MyTiffChunk : NSObject
+{
+@public
+   u_long   index;     //!< Strip or tile number in the TIFF file
+   tdata_t  data;      //!< Decoded samples
+   tsize_t  size;      //!< Size of the decoded samples
+   u_int    users;     //!< Number of ongoing reads of the samples
+   NSMutableDictionary *owner; //!< Chunks dictionary of the reader (weak ref)
+   MyTiffChunk *older;  //!< Previous chunk in the LRU list (weak ref)
+   MyTiffChunk *newer;  //!< Next chunk in the LRU list (weak ref)
+}
+@end
+
+//! Least recently used chunk, the chunks are retained by their owner only
+static MyTiffChunk *oldestChunk = nil;
+//! Most recently used chunk
+static MyTiffChunk *newestChunk = nil;
+
+@implementation MyTiffChunk
+- (void) dealloc
+{
+   if ( data != NULL )
+      _TIFFfree( data );
+   [super dealloc];
+}
+@end
+
+/*!
+ * @abstract Remove a chunk from the LRU list
+ * @discussion Called with the cache lock held.
+ * @param chunk The chunk to remove
+ */
+static void unlinkChunk( MyTiffChunk *chunk )
+{
+   if ( chunk->older != nil )
+      chunk->older->newer = chunk->newer;
+   else
+      oldestChunk = chunk->newer;
+   if ( chunk->newer != nil )
+      chunk->newer->older = chunk->older;
+   else
+      newestChunk = chunk->older;
+   chunk->older = nil;
+   chunk->newer = nil;
+}
+
+/*!
+ * @abstract Make a chunk the most recently used
+ * @discussion Called with the cache lock held, the chunk is not in the list.
+ * @param chunk The chunk to add
+ */
+static void linkNewestChunk( MyTiffChunk *chunk )
+{
+   chunk->older = newestChunk;
+   chunk->newer = nil;
+   if ( newestChunk != nil )
+      newestChunk->newer = chunk;
+   else
+      oldestChunk = chunk;
+   newestChunk = chunk;
+}
+
+/*!
+ * @abstract Evict the least recently used chunks which are not being read
+ * @discussion Called with the cache lock held.
+ * @param forBudget Whether to evict until the memory budget is respected,
+ *    instead of the cache maximum size
+ */
+static void evictChunks( BOOL forBudget )
+{
+   MyTiffChunk *old = oldestChunk;
+
+   while ( old != nil )
+   {
+      MyTiffChunk *next = old->newer;
+
+      if ( forBudget ? ![LynkeosMemoryBudget isOverBudget]
+                     : chunksMemory <= K_TIFF_CACHE_MEMORY )
+         break;
+
+      if ( old->users == 0 )
+      {
+         chunksMemory -= old->size;
+         [LynkeosMemoryBudget freedMemory:old->size];
+         unlinkChunk( old );
+         // This releases the chunk
+         [old->owner removeObjectForKey:
+                         [NSNumber numberWithUnsignedLong:old->index]];
+      }
+      old = next;
+   }
+}
+
+/*!
+ * @abstract Read a sample out of a decoded strip or tile
+ * @param buf The decoded samples
+ * @param i The index of the sample
+ * @param nBits The sample size
+ * @result The sample value, scaled to 8 bits for integer samples
+ */
+static inline float chunkSample( tdata_t buf, u_long i, u_short nBits )
+{
+   switch ( nBits )
+   {
+      case 8 :
+         return( (float)((u_char*)buf)[i] );
+      case 16 :
+         return( (float)((u_short*)buf)[i] / 256.0 );
+      case 32 :
+         return( ((float*)buf)[i] );
+      default:
+         NSCAssert( NO, @"Inconsistent sample size" );
+         return( 0.0 );
+   }
+}
+
+/*!
+ * @abstract Private methods of MyTiff16Reader
+ */
+@interface MyTiff16Reader(Private)
+/*!
+ * @abstract Get a libtiff handle for the calling thread
+ * @result The handle, or NULL if the file could not be opened
+ */
+- (TIFF*) acquireHandle ;
+
+/*!
+ * @abstract Give back a handle to the pool
+ * @discussion The idle handles of the least recently used readers are closed
+ *    when there are too much of them.
+ * @param tiff The handle
+ */
+- (void) releaseHandle:(TIFF*)tiff ;
+
+/*!
+ * @abstract Get a decoded strip or tile, from the cache or from the file
+ * @discussion The chunk cannot be evicted until unlockChunk: is called.
+ * @param index The strip or tile number
+ * @result The chunk, or nil if it could not be decoded
+ */
+- (MyTiffChunk*) lockChunk:(u_long)index ;
+
+/*!
+ * @abstract Tell that the chunk samples are no longer read
+ * @param chunk The chunk
+ */
+- (void) unlockChunk:(MyTiffChunk*)chunk ;
+@end
+
+@implementation MyTiff16Reader(Private)
+
+- (TIFF*) acquireHandle
+{
+   TIFF *tiff = NULL;
+
+   [tiffCacheLock lock];
+   if ( [_freeHandles count] != 0 )
+   {
+      tiff = [[_freeHandles lastObject] pointerValue];
+      [_freeHandles removeLastObject];
+      idleHandles--;
+      if ( [_freeHandles count] == 0 )
+         [idleHandleReaders removeObjectIdenticalTo:self];
+   }
+   [tiffCacheLock unlock];
+
+   // No free handle, this thread will get its own
+   if ( tiff == NULL )
+      tiff = TIFFOpen( _tiffFile, "r" );
+
+   return( tiff );
+}
+
+- (void) releaseHandle:(TIFF*)tiff
+{
+   [tiffCacheLock lock];
+   [_freeHandles addObject:[NSValue valueWithPointer:tiff]];
+   idleHandles++;
+   [idleHandleReaders removeObjectIdenticalTo:self];
+   [idleHandleReaders addObject:self];
+
+   while ( idleHandles > K_MAX_IDLE_HANDLES )
+   {
+      MyTiff16Reader *reader = [idleHandleReaders objectAtIndex:0];
+      NSMutableArray *handles = reader->_freeHandles;
+
+      TIFFClose( (TIFF*)[[handles lastObject] pointerValue] );
+      [handles removeLastObject];
+      idleHandles--;
+      if ( [handles count] == 0 )
+         [idleHandleReaders removeObjectAtIndex:0];
+   }
+   [tiffCacheLock unlock];
+}
+
+- (MyTiffChunk*) lockChunk:(u_long)index
+{
+   NSNumber *key = [NSNumber numberWithUnsignedLong:index];
+   MyTiffChunk *chunk, *decoded;
+   TIFF *tiff;
+   tsize_t decodedSize;
+
+   [tiffCacheLock lock];
+   chunk = [_chunks objectForKey:key];
+   if ( chunk != nil )
+   {
+      chunk->users++;
+      unlinkChunk( chunk );
+      linkNewestChunk( chunk );
+   }
+   [tiffCacheLock unlock];
+
+   if ( chunk != nil )
+      return( chunk );
+
+   // Decode it without holding the lock
+   decoded = [[MyTiffChunk alloc] init];
+   decoded->index = index;
+   decoded->size = _chunkSize;
+   decoded->data = _TIFFmalloc( _chunkSize );
+   decoded->users = 1;
+   decoded->owner = _chunks;
+   NSAssert( decoded->data != NULL, @"Unable to allocate a strip buffer" );
+
+   tiff = [self acquireHandle];
+   NSAssert( tiff != NULL, @"Unable to open the TIFF file" );
+   if ( _tiled )
+      decodedSize = TIFFReadEncodedTile( tiff, (uint32)index, decoded->data,
+                                         (tsize_t)-1 );
+   else
+      decodedSize = TIFFReadEncodedStrip( tiff, (uint32)index, decoded->data,
+                                          (tsize_t)-1 );
+   [self releaseHandle:tiff];
+
+   // A corrupt chunk is not cached
+   if ( decodedSize == (tsize_t)-1 )
+   {
+      NSLog( @"Unable to decode %s %lu of %s",
+             (_tiled ? "tile" : "strip"), index, _tiffFile );
+      [decoded release];
+      return( nil );
+   }
+
+   [tiffCacheLock lock];
+   chunk = [_chunks objectForKey:key];
+   if ( chunk != nil )
+   {
+      // Another thread was faster
+      chunk->users++;
+      [decoded release];
+   }
+   else
+   {
+      chunk = decoded;
+      [_chunks setObject:chunk forKey:key];
+      linkNewestChunk( chunk );
+      chunksMemory += chunk->size;
+      [LynkeosMemoryBudget allocatedMemory:chunk->size];
+      [chunk release];
+
+      evictChunks( NO );
+   }
+   [tiffCacheLock unlock];
+
+   return( chunk );
+}
+
+- (void) unlockChunk:(MyTiffChunk*)chunk
+{
+   [tiffCacheLock lock];
+   NSAssert( chunk->users > 0, @"Unbalanced unlock of TIFF chunk" );
+   chunk->users--;
+   [tiffCacheLock unlock];
+}
+
+@end
+
 @implementation MyTiff16Reader
 + (void) load
 {
    // Nothing to do, this is just to force the runtime to load this class
 }
 
++ (void) initialize
+{
+   tiffCacheLock = [[NSLock alloc] init];
+   // The readers leave the pool when deallocated
+   idleHandleReaders = (NSMutableArray*)CFArrayCreateMutable( NULL, 0, NULL );
+   // The chunks cache is shared by all the readers, the class shrinks it
+   [LynkeosMemoryBudget addConsumer:(id <LynkeosMemoryConsumer>)self];
+}
+
++ (void) releaseMemory
+{
+   [tiffCacheLock lock];
+   evictChunks( YES );
+   [tiffCacheLock unlock];
+}
+
 + (void) lynkeosFileTypes:(NSArray**)fileTypes
 {
    *fileTypes = [NSArray arrayWithObjects:[NSNumber numberWithInt:1],@"tif",
@@ -46,6 +355,8 @@
    if ( self != nil )
    {
       _tiffFile = NULL;
+      _freeHandles = [[NSMutableArray alloc] init];
+      _chunks = [[NSMutableDictionary alloc] init];
       _min = HUGE;
       _max = -HUGE;
    }
@@ -70,24 +381,42 @@
       }
       else
       {
+         uint32 rowsPerStrip = 0;
+
          TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &_width);
          TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &_height);
-         TIFFGetField(tiff, TIFFTAG_ROWSPERSTRIP, &_stripH);
          TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &_nBits);
          TIFFGetField(tiff, TIFFTAG_SAMPLEFORMAT, &_sampleType);
          TIFFGetField(tiff, TIFFTAG_PLANARCONFIG, &_planar);
          TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &_nPlanes );
 
+         _tiled = TIFFIsTiled( tiff );
+         if ( _tiled )
+         {
+            TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &_chunkW);
+            TIFFGetField(tiff, TIFFTAG_TILELENGTH, &_chunkH);
+            _chunkSize = TIFFTileSize( tiff );
+         }
+         else
+         {
+            TIFFGetField(tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+            _chunkW = _width;
+            _chunkH = (rowsPerStrip > _height ? _height : rowsPerStrip);
+            _chunkSize = TIFFStripSize( tiff );
+         }
+
          if ( (_nPlanes == 1                       /* Monochrome */
                || (_nPlanes == 3 || _nBits > 8) )  /* or 16/32 bits RGB image */
               && ( ( (_sampleType == 0 || _sampleType == SAMPLEFORMAT_UINT)
                      && (_nBits == 16 || _nBits == 8)) /* Only 8, 16 uint */
                    || ( _sampleType == SAMPLEFORMAT_IEEEFP
                         && _nBits == 32) )              /* Or 32 float */
-              && _stripH != 0 )                       /* Organized as strips */
+              && _chunkW != 0 && _chunkH != 0 )      /* Strips or tiles */
          {
             _tiffFile = (char*)malloc( strlen(filePath) + 1 );
             strcpy( _tiffFile, filePath );
+            _chunksAcross = (_width + _chunkW - 1)/_chunkW;
+            _chunksDown = (_height + _chunkH - 1)/_chunkH;
          }
          else
          {
@@ -96,7 +425,11 @@
             self = nil;
          }
 
-         TIFFClose( tiff );
+         // Keep the handle for the first read
+         if ( self != nil )
+            [self releaseHandle:tiff];
+         else
+            TIFFClose( tiff );
       }
    }
 
@@ -105,6 +438,31 @@
 
 - (void) dealloc
 {
+   NSEnumerator *list;
+   NSValue *handle;
+   MyTiffChunk *chunk;
+
+   // No read can be ongoing here, all the handles and chunks are free
+   [tiffCacheLock lock];
+   list = [_freeHandles objectEnumerator];
+   while ( (handle = [list nextObject]) != nil )
+   {
+      TIFFClose( (TIFF*)[handle pointerValue] );
+      idleHandles--;
+   }
+   [idleHandleReaders removeObjectIdenticalTo:self];
+
+   list = [_chunks objectEnumerator];
+   while ( (chunk = [list nextObject]) != nil )
+   {
+      chunksMemory -= chunk->size;
+      [LynkeosMemoryBudget freedMemory:chunk->size];
+      unlinkChunk( chunk );
+   }
+   [tiffCacheLock unlock];
+
+   [_freeHandles release];
+   [_chunks release];
    if ( _tiffFile != NULL )
       free( _tiffFile );
    [super dealloc];
@@ -152,13 +510,14 @@
 {
    NSImage *image = nil;
    NSBitmapImageRep* bitmap;
-   TIFF *tiff = TIFFOpen( _tiffFile, "r" );
    u_long i;
 
-   NSAssert( tiff != NULL, @"Unable to open the TIFF file" );
-
    if ( _sampleType != SAMPLEFORMAT_IEEEFP )
    {
+      TIFF *tiff = [self acquireHandle];
+
+      NSAssert( tiff != NULL, @"Unable to open the TIFF file" );
+
       // Create a RGBA bitmap
       bitmap = [[[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
                                             pixelsWide:_width
@@ -179,6 +538,8 @@
       // Unfortunately libtiff put it in little endian order
       for( i = 0; i < _width*_height; i++ )
          pixels[i] = NSSwapLittleIntToHost(pixels[i]);
+
+      [self releaseHandle:tiff];
    }
 
    // TIFFReadRGBAImageOriented is unable to read IEEE fp images
@@ -207,8 +568,6 @@
       CGImageRelease(img);
    }
 
-   TIFFClose( tiff );
-
    image = [[[NSImage alloc] initWithSize:NSMakeSize(_width,_height)] autorelease];
 
    if ( image != nil )
@@ -217,18 +576,6 @@
    return( image );
 }
 
-/* Macro to insert the monochromatic conversion with the required precision */
-#define PLANAR_MONOCHROMATIC_CONVERSION(floating_type)                   \
-{                                                                        \
-   floating_type *s = &((floating_type*)sample[0])[(ys-y)*lineW+xs-x]; \
-   if ( cs == 0 )                                                        \
-      *s = v;                                                            \
-   else                                                                  \
-      *s += v;                                                           \
-   if ( cs == _nPlanes-1 )                                               \
-      *s /= (float)_nPlanes;                                             \
-}
-
 /*! Pixels values are scaled to remain with a 256 maximum while retaining
  * 16 bits precision (because they are floating precision numbers) when 
  * applicable
@@ -238,12 +585,12 @@
                     atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
               lineWidth:(u_short)lineW
 {
-   TIFF *tiff = TIFFOpen( _tiffFile, "r" );
    BOOL monoConversion = (nPlanes == 1 && _nPlanes != 1 );
-   tdata_t buf;
-   u_short xs, ys, cs, ystr;
+   const u_short chunkPlanes = (_planar == PLANARCONFIG_SEPARATE ? 1 : _nPlanes);
+   const u_short nSeparate = (_planar == PLANARCONFIG_SEPARATE ? _nPlanes : 1);
+   uint32 cx, cy, sep;
+   u_short xs, ys, cs;
 
-   NSAssert( tiff != NULL, @"Unable to open the TIFF file" );
    NSAssert2( nPlanes == _nPlanes || nPlanes == 1,
               @"Illegal transfer from %d planes to %d planes", 
               _nPlanes, nPlanes );
@@ -251,127 +598,73 @@
    NSAssert( x+w <= _width && y+h <= _height, 
              @"Sample at least partly outside the image" );
 
-   buf = _TIFFmalloc(TIFFStripSize(tiff));
-   NSAssert( buf != NULL, @"Unable to allocate a strip buffer" );
-
-   if (_planar == PLANARCONFIG_SEPARATE)
+   /* Go through the strips or tiles covering the sample only. For separate
+    * planes, if the caller wants monochrome data, we will accumulate our
+    * planes in the output buffer */
+   for( sep = 0; sep < nSeparate; sep++ )
    {
-      /* We go through all our planes, if the caller wants monochrome data, 
-       * we will accumulate our planes in the output buffer */
-      for( cs = 0; cs < _nPlanes; cs++ )
+      for( cy = y/_chunkH; cy <= (y+h-1)/_chunkH; cy++ )
       {
-         for (ys = y, ystr = -1; ys < y+h; ys++)
-         {
-            uint32 strip = (ys+cs*_height)/_stripH, 
-                   yoffset = (ys+cs*_height)%_stripH;
-
-            if ( strip != ystr )
-            {
-               /* Start of a new strip */
-               ystr = strip;
-               TIFFReadEncodedStrip(tiff, strip, buf, (tsize_t) -1);
-            }
+         const u_short y0 = (cy*_chunkH > y ? cy*_chunkH : y);
+         const u_short y1 = ((cy+1)*_chunkH < y+h ? (cy+1)*_chunkH : y+h);
 
-            for( xs = x; xs < x+w; xs++ )
-            {
-               float v;
-
-               switch ( _nBits )
-               {
-                  case 8 :
-                     v = (float)((u_char*)buf)[xs+yoffset*_width];
-                     break;
-                  case 16 :
-                     v = (float)((u_short*)buf)[xs+yoffset*_width] / 256.0;
-                     break;
-                  case 32 :
-                     v = ((float*)buf)[xs+yoffset*_width];
-                     break;
-                  default:
-                     NSAssert( NO, @"Inconsistent sample size" );
-               }
-
-               if ( monoConversion )
-               {
-#if PROCESSING_PRECISION == SINGLE_PRECISION
-                     PLANAR_MONOCHROMATIC_CONVERSION(float)
-#else
-                     PLANAR_MONOCHROMATIC_CONVERSION(double)
-#endif
-               }
-               else
-                  SET_SAMPLE(sample[cs], xs-x, ys-y, lineW, v);
-            }
-         }
-      }
-   }
-   else
-   {
-      for (ys = y, ystr = -1; ys < y+h; ys++)
-      {
-         uint32 strip = ys/_stripH, 
-                yoffset = ys%_stripH;
-
-         if ( strip != ystr )
+         for( cx = x/_chunkW; cx <= (x+w-1)/_chunkW; cx++ )
          {
-            /* Start of a new strip */
-            ystr = strip;
-            TIFFReadEncodedStrip(tiff, strip, buf, (tsize_t) -1);
-         }
+            const u_short x0 = (cx*_chunkW > x ? cx*_chunkW : x);
+            const u_short x1 = ((cx+1)*_chunkW < x+w ? (cx+1)*_chunkW : x+w);
+            MyTiffChunk *chunk =
+               [self lockChunk:(sep*_chunksDown + cy)*_chunksAcross + cx];
 
-         for( xs = x; xs < x+w; xs++ )
-         {
-            u_long i = yoffset*_width*_nPlanes+xs*_nPlanes;
+            if ( chunk == nil )
+               [NSException raise:NSGenericException
+                           format:@"Unable to decode %s", _tiffFile];
 
-            if ( monoConversion )
+            for( ys = y0; ys < y1; ys++ )
             {
-               float v = 0;
-
-               for( cs = 0; cs < _nPlanes; cs++ )
+               for( xs = x0; xs < x1; xs++ )
                {
-                  switch ( _nBits )
+                  const u_long i = ((u_long)(ys - cy*_chunkH)*_chunkW
+                                    + xs - cx*_chunkW)*chunkPlanes;
+
+                  if ( _planar == PLANARCONFIG_SEPARATE )
                   {
-                     case 8 :
-                        v += (float)((u_char*)buf)[i+cs];
-                        break;
-                     case 16 :
-                        v += (float)((u_short*)buf)[i+cs] / 256.0;
-                        break;
-                     case 32 :
-                        v += ((float*)buf)[i+cs];
-                        break;
-                     default:
-                        NSAssert( NO, @"Inconsistent sample size" );
-                  }                        
-               }
-               SET_SAMPLE(sample[0], xs-x, ys-y, lineW, v/(float)_nPlanes);
-            }
-            else
-            {
-               for( cs = 0; cs < _nPlanes; cs++ )
-               {
-                  switch ( _nBits )
+                     float v = chunkSample( chunk->data, i, _nBits );
+
+                     if ( monoConversion )
+                     {
+                        REAL *s = &sample[0][(ys-y)*lineW+xs-x];
+
+                        if ( sep == 0 )
+                           *s = v;
+                        else
+                           *s += v;
+                        if ( sep == _nPlanes-1 )
+                           *s /= (float)_nPlanes;
+                     }
+                     else
+                        SET_SAMPLE(sample[sep], xs-x, ys-y, lineW, v);
+                  }
+                  else if ( monoConversion )
                   {
-                     case 8 :
-                        SET_SAMPLE(sample[cs], xs-x, ys-y, lineW, ((u_char*)buf)[i+cs]);
-                        break;
-                     case 16 :
-                        SET_SAMPLE(sample[cs], xs-x, ys-y, lineW, ((u_short*)buf)[i+cs]/256.0);
-                        break;
-                     case 32 :
-                        SET_SAMPLE(sample[cs], xs-x, ys-y, lineW, ((float*)buf)[i+cs]);
-                        break;
-                     default:
-                        NSAssert( NO, @"Inconsistent sample size" );
+                     float v = 0;
+
+                     for( cs = 0; cs < _nPlanes; cs++ )
+                        v += chunkSample( chunk->data, i+cs, _nBits );
+                     SET_SAMPLE(sample[0], xs-x, ys-y, lineW, v/(float)_nPlanes);
+                  }
+                  else
+                  {
+                     for( cs = 0; cs < _nPlanes; cs++ )
+                        SET_SAMPLE(sample[cs], xs-x, ys-y, lineW,
+                                   chunkSample( chunk->data, i+cs, _nBits ));
                   }
                }
             }
+
+            [self unlockChunk:chunk];
          }
       }
    }
-
-   _TIFFfree(buf);
-   TIFFClose( tiff );
 }
 
 - (NSDictionary*) getMetaData 
@@ -79,8 +79,8 @@ typedef struct
 @interface MyWavelet : NSObject <LynkeosProcessing>
 {
    MyWaveletParameters  *_params; //!< Wavelet parameters
-   id <LynkeosDocument> _doc; //!< The owning document, only there for a bad hack
    id <LynkeosProcessableItem> _item; //!< The item being processed
+   u_short              _listThreads; //!< Threads sharing the process
    //! Strategy (vector or not) method for processing one line
    void(*_process_One_Line)(MyWaveletParameters*,u_short);
 }
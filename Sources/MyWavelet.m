@@ -380,7 +380,8 @@ static void std_ESO_process_line( const MyWaveletParameters *params, u_short y )
                  @"Wrong parameter class %s for wavelet processing",
                  class_getName([params class]) );
       _params = (MyWaveletParameters*)[params retain];
-      _doc = document;
+      // The view calls processing without the document, in one thread only
+      _listThreads = 1;
       switch( _params->_waveletKind )
       {
          case FrequencySawtooth_Wavelet:
@@ -408,6 +409,11 @@ static void std_ESO_process_line( const MyWaveletParameters *params, u_short y )
    [super dealloc];
 }
 
+- (void) setNumberOfListThreads:(u_short)nThreads
+{
+   _listThreads = nThreads;
+}
+
 - (void) processItem:(id <LynkeosProcessableItem>)item
 {
    const LynkeosIntegerRect r = {{0,0},[item imageSize]};
@@ -445,8 +451,7 @@ static void std_ESO_process_line( const MyWaveletParameters *params, u_short y )
 
 - (void) finishProcessing
 {
-   // The view calls processing with a nil document, in one thread only
-   const NSInteger maxThreads = ([[self class] supportParallelization] && _doc != nil ? numberOfCpus : 1);
+   const NSInteger maxThreads = _listThreads;
 
    [_params->_loopLock lockWhenCondition:maxThreads];
    _params->_livingThreadsNb--;
@@ -89,3 +89,52 @@ int SER_read_header(FILE *ser, SER_Header_t *hdr)
 
    return(0);
 }
+
+int SER_write_header(FILE *ser, const SER_Header_t *hdr)
+{
+   // Write field by field, for the same reason
+   int32_t value;
+
+   if (fwrite(&hdr->FileID, sizeof(char), SER_ID_LENGTH, ser) != SER_ID_LENGTH)
+      return(-1);
+
+   if (fwrite(&hdr->LuID, sizeof(int32_t), 1, ser) != 1)
+      return(-1);
+
+   value = hdr->ColorID;
+   if (fwrite(&value, sizeof(int32_t), 1, ser) != 1)
+      return(-1);
+
+   value = hdr->LittleEndian;
+   if (fwrite(&value, sizeof(int32_t), 1, ser) != 1)
+      return(-1);
+
+   if (fwrite(&hdr->ImageWidth, sizeof(int32_t), 1, ser) != 1)
+      return(-1);
+
+   if (fwrite(&hdr->ImageHeight, sizeof(int32_t), 1, ser) != 1)
+      return(-1);
+
+   if (fwrite(&hdr->PixelDepthPerPlane, sizeof(int32_t), 1, ser) != 1)
+      return(-1);
+
+   if (fwrite(&hdr->FrameCount, sizeof(int32_t), 1, ser) != 1)
+      return(-1);
+
+   if (fwrite(&hdr->Observer, sizeof(char), SER_STRING_LENGTH, ser) != SER_STRING_LENGTH)
+      return(-1);
+
+   if (fwrite(&hdr->Instrument, sizeof(char), SER_STRING_LENGTH, ser) != SER_STRING_LENGTH)
+      return(-1);
+
+   if (fwrite(&hdr->Telescope, sizeof(char), SER_STRING_LENGTH, ser) != SER_STRING_LENGTH)
+      return(-1);
+
+   if (fwrite(&hdr->DateTime, sizeof(int64_t), 1, ser) != 1)
+      return(-1);
+
+   if (fwrite(&hdr->DateTime_UTC, sizeof(int64_t), 1, ser) != 1)
+      return(-1);
+
+   return(0);
+}
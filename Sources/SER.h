@@ -80,4 +80,13 @@ typedef struct
  */
 extern int SER_read_header(FILE *ser,  SER_Header_t *hdr);
 
+/*!
+ * @abstract Write the header of a SER file
+ * @param ser The FILE descriptor of the ser file, positioned at its start.
+ * @param hdr The SER header to write
+ * @result 0 upon succes
+ * @ingroup FileAccess
+ */
+extern int SER_write_header(FILE *ser, const SER_Header_t *hdr);
+
 #endif
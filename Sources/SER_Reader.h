@@ -34,6 +34,20 @@
 #include "SER.h"
 #include "SER_ImageBuffer.h"
 
+/*!
+ * @abstract Conversion of a part of a SER row into planar REAL
+ * @param src The SER row data
+ * @param x First column to convert
+ * @param w Number of columns to convert
+ * @param dst The output rows, one per plane
+ * @param weights White balance, per plane for RGB, per lane for mono/bayer
+ * @param vmax Clamping value
+ * @ingroup FileAccess
+ */
+typedef void (*SER_RowConverter_t)(const void *src, u_short x, u_short w,
+                                   REAL * const *dst, const REAL *weights,
+                                   REAL vmax);
+
 /*!
  * @class SER_Reader
  * @abstract Class for reading SER movie file format.
@@ -53,12 +67,16 @@
    ByteOrder_t          _byteOrder;      //!< Endianness for 16 bits data
    u_short              _bayerPlanes[2][2]; //!< Bayer mosaic pattern (Y first)
    double               _whiteBalance[3]; //!< Color weights
+   SER_RowConverter_t   _convertRow;     //!< Conversion kernel for this file format
+   REALVECT             _cfaWeights[2][2]; //!< White balance lanes, per row and column parity
+   REAL                 _planeWeights[3]; //!< White balance per plane, for RGB
+   REAL                 _maxValue;       //!< Clamping value
    BOOL                 _isBayer;
-   off_t                _filePos;        //!< Current position in file, used to avoid seeking
+   void                *_map;            //!< Read only mapping of the whole file, if any
+   off_t                _fileSize;       //!< Size of the SER file
    ListMode_t           _mode;           //!< Current mode, taken into account in conversion
    SER_ImageBuffer     *_darkFrame;      //!< Dark frame in same bayer format
    LynkeosImageBuffer  *_flatField;      //!< Flat field (actually, in planar format)
-   NSLock              *_mutex;          //!< To allow multithreading of movie reading
    NSMutableDictionary *_metadata;       //!< Movie metadata
 }
 
@@ -20,21 +20,279 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // 
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <LynkeosCore/LynkeosProcessing.h>
+#include <LynkeosCore/LynkeosBufferPool.h>
+#include <LynkeosCore/LynkeosReadAhead.h>
 #include <LynkeosCore/LynkeosMetadata.h>
+#include <LynkeosCore/LynkeosObjectCache.h>
+#include <LynkeosCore/LynkeosInterpolator.h>
 
 #include "SER_ReaderPrefs.h"
 #include "SER_Reader.h"
 
+#define SER_NLANES (sizeof(REALVECT)/sizeof(REAL))
+
+typedef uint8_t SER_u8vect __attribute__ ((vector_size (SER_NLANES)));
+typedef uint16_t SER_u16vect __attribute__ ((vector_size (SER_NLANES*sizeof(uint16_t))));
+#ifdef DOUBLE_PIXELS
+typedef int64_t SER_maskvect __attribute__ ((vector_size (sizeof(REALVECT))));
+#else
+typedef int32_t SER_maskvect __attribute__ ((vector_size (sizeof(REALVECT))));
+#endif
+
+/* Branch free clamping of a vector */
+static inline REALVECT clampVect( REALVECT v, REALVECT vmax )
+{
+   const SER_maskvect m = (SER_maskvect)(v < vmax);
+
+   return( (REALVECT)((m & (SER_maskvect)v) | (~m & (SER_maskvect)vmax)) );
+}
+
+static inline uint16_t readU16( const uint16_t *p, BOOL swap )
+{
+   return( swap ? (uint16_t)((*p << 8) | (*p >> 8)) : *p );
+}
+
+/* Mono and bayer conversion, the weights lanes follow the CFA phase */
+static inline __attribute__((always_inline))
+void convertPlaneRow( const void *src, u_short x, u_short w,
+                      REAL * const *dst, const REAL *weights, REAL vmax,
+                      u_short bytesPerPixel, BOOL swap )
+{
+   const REALVECT vmaxv = {vmax, vmax, vmax, vmax};
+   const REALVECT scale = {1.0/256.0, 1.0/256.0, 1.0/256.0, 1.0/256.0};
+   const uint8_t *in8 = (const uint8_t*)src + x;
+   const uint16_t *in16 = (const uint16_t*)src + x;
+   REAL *out = dst[0];
+   REALVECT wv, v;
+   u_short i = 0;
+
+   memcpy( &wv, weights, sizeof(REALVECT) );
+
+   if ( bytesPerPixel == 1 )
+   {
+      for ( ; i + SER_NLANES <= w; i += SER_NLANES )
+      {
+         SER_u8vect iv;
+
+         memcpy( &iv, &in8[i], sizeof(iv) );
+         v = clampVect( __builtin_convertvector(iv, REALVECT)*wv, vmaxv );
+         memcpy( &out[i], &v, sizeof(REALVECT) );
+      }
+   }
+   else
+   {
+      for ( ; i + SER_NLANES <= w; i += SER_NLANES )
+      {
+         SER_u16vect iv;
+
+         memcpy( &iv, &in16[i], sizeof(iv) );
+         if ( swap )
+            iv = (iv << 8) | (iv >> 8);
+         v = clampVect( __builtin_convertvector(iv, REALVECT)*scale*wv, vmaxv );
+         memcpy( &out[i], &v, sizeof(REALVECT) );
+      }
+   }
+
+   // Remaining pixels, the CFA period divides the number of lanes
+   for ( ; i < w; i++ )
+   {
+      REAL vs = (bytesPerPixel == 1 ? (REAL)in8[i]
+                                    : (REAL)readU16(&in16[i], swap)/(REAL)256.0)
+                * weights[i % SER_NLANES];
+      out[i] = (vs < vmax ? vs : vmax);
+   }
+}
+
+/* Interleaved RGB or BGR conversion */
+static inline __attribute__((always_inline))
+void convertRGBRow( const void *src, u_short x, u_short w,
+                    REAL * const *dst, const REAL *weights, REAL vmax,
+                    u_short bytesPerPixel, BOOL swap, BOOL bgr )
+{
+   const REALVECT vmaxv = {vmax, vmax, vmax, vmax};
+   const REAL scale = (bytesPerPixel == 1 ? 1.0 : 1.0/256.0);
+   const uint8_t *in8 = (const uint8_t*)src + 3*x;
+   const uint16_t *in16 = (const uint16_t*)src + 3*x;
+   u_short i, k, p;
+
+   for ( p = 0; p < 3; p++ )
+   {
+      const u_short chan = (bgr ? 2 - p : p);
+      const REAL wp = weights[p]*scale;
+      const REALVECT wv = {wp, wp, wp, wp};
+      REAL *out = dst[p];
+
+      for ( i = 0; i + SER_NLANES <= w; i += SER_NLANES )
+      {
+         REALVECT v;
+
+         for ( k = 0; k < SER_NLANES; k++ )
+            v[k] = (bytesPerPixel == 1 ? (REAL)in8[3*(i+k)+chan]
+                                       : (REAL)readU16(&in16[3*(i+k)+chan], swap));
+         v = clampVect( v*wv, vmaxv );
+         memcpy( &out[i], &v, sizeof(REALVECT) );
+      }
+
+      for ( ; i < w; i++ )
+      {
+         REAL vs = (bytesPerPixel == 1 ? (REAL)in8[3*i+chan]
+                                       : (REAL)readU16(&in16[3*i+chan], swap)) * wp;
+         out[i] = (vs < vmax ? vs : vmax);
+      }
+   }
+}
+
+// Specialized kernels, one per format combination
+#define SER_PLANE_KERNEL(name, bpp, swap) \
+static void name( const void *src, u_short x, u_short w, REAL * const *dst, \
+                  const REAL *weights, REAL vmax ) \
+{ convertPlaneRow( src, x, w, dst, weights, vmax, bpp, swap ); }
+
+#define SER_RGB_KERNEL(name, bpp, swap, bgr) \
+static void name( const void *src, u_short x, u_short w, REAL * const *dst, \
+                  const REAL *weights, REAL vmax ) \
+{ convertRGBRow( src, x, w, dst, weights, vmax, bpp, swap, bgr ); }
+
+SER_PLANE_KERNEL(convertPlane8, 1, NO)
+SER_PLANE_KERNEL(convertPlane16, 2, NO)
+SER_PLANE_KERNEL(convertPlane16Swapped, 2, YES)
+SER_RGB_KERNEL(convertRGB8, 1, NO, NO)
+SER_RGB_KERNEL(convertRGB16, 2, NO, NO)
+SER_RGB_KERNEL(convertRGB16Swapped, 2, YES, NO)
+SER_RGB_KERNEL(convertBGR8, 1, NO, YES)
+SER_RGB_KERNEL(convertBGR16, 2, NO, YES)
+SER_RGB_KERNEL(convertBGR16Swapped, 2, YES, YES)
+
 /*!
  * @abstract Internals of the SER reader
  * @discussion
  * @ingroup FileAccess
  */
 @interface SER_Reader(Private)
+/*!
+ * @abstract Access to the raw data of a range of rows in a frame
+ * @discussion The rows are addressed directly in the file mapping, or read
+ *    with pread when the file could not be mapped. Neither way needs a lock.
+ * @param index The frame index
+ * @param y The first row
+ * @param h The number of rows
+ * @param[out] buffer Set to a buffer of h rows, to give back to the buffer
+ *    pool by the caller, or NULL when the data comes from the mapping
+ * @result The data of the first row, or NULL on error
+ */
+- (const void*) rowsAtIndex:(u_long)index fromRow:(u_short)y count:(u_short)h
+                     buffer:(void**)buffer ;
+
+/*!
+ * @abstract Convert a rectangle of a frame in planar format
+ * @discussion Only the rows of the rectangle are read. The planes are in the
+ *    file number of planes, for bayer files it is the raw single plane.
+ * @result Wether the data could be read
+ */
+- (BOOL) convertFrame:(u_long)index toPlanes:(REAL * const *)planes
+                  atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+            lineWidth:(u_short)lineW ;
+
+/*!
+ * @abstract Select the conversion kernel and weights for this file format
+ */
+- (void) selectConverter ;
 @end
 
 @implementation SER_Reader(Private)
+- (const void*) rowsAtIndex:(u_long)index fromRow:(u_short)y count:(u_short)h
+                     buffer:(void**)buffer
+{
+   const size_t imageSize = _height*_bytesPerRow;
+   const size_t size = h*_bytesPerRow;
+   const off_t offset = SER_START_OF_IMAGES + index*imageSize + y*_bytesPerRow;
+
+   *buffer = NULL;
+
+   if (offset + (off_t)size > _fileSize)
+   {
+      NSLog( @"SER frame %ld is beyond the end of file", index );
+      return( NULL );
+   }
+
+   if (_map != NULL)
+      return( _map + offset );
+
+   // Fallback on positional reads, which do not share any file position
+   *buffer = [LynkeosBufferPool allocateBuffer:size];
+   if (pread(fileno(_file), *buffer, size, offset) != (ssize_t)size)
+   {
+      NSLog( @"Failed to read SER frame %ld", index );
+      [LynkeosBufferPool releaseBuffer:*buffer size:size];
+      *buffer = NULL;
+      return( NULL );
+   }
+
+   return( *buffer );
+}
+
+- (BOOL) convertFrame:(u_long)index toPlanes:(REAL * const *)planes
+                  atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
+            lineWidth:(u_short)lineW
+{
+   const u_short nPlanes = (_isBayer ? 1 : _numberOfPlanes);
+   const BOOL isRGB = (_format == SER_RGB || _format == SER_BGR);
+   void *readBuffer;
+   const void *buffer = [self rowsAtIndex:index fromRow:y count:h buffer:&readBuffer];
+   u_short yl, p;
+
+   if (buffer == NULL)
+      return( NO );
+
+   for( yl = 0; yl < h; yl++ )
+   {
+      REAL *rows[3];
+
+      for ( p = 0; p < nPlanes; p++ )
+         rows[p] = &planes[p][yl*lineW];
+      _convertRow(buffer + yl*_bytesPerRow, x, w, rows,
+                  (isRGB ? _planeWeights : (const REAL*)&_cfaWeights[(y+yl)%2][x%2]),
+                  _maxValue);
+   }
+
+   if (readBuffer != NULL)
+      [LynkeosBufferPool releaseBuffer:readBuffer size:h*_bytesPerRow];
+
+   return( YES );
+}
+
+- (void) selectConverter
+{
+   const BOOL swap = ((_byteOrder == SER_BIG_ENDIAN) != (NSHostByteOrder() == NS_BigEndian));
+   u_short r, c, k, p;
+
+   _maxValue = (_bytesPerPixel == 2 ? 65535.0/256.0 : 255.0);
+
+   for ( p = 0; p < 3; p++ )
+      _planeWeights[p] = _whiteBalance[p];
+
+   // Lanes weights, for each CFA phase of the first converted pixel
+   for ( r = 0; r < 2; r++ )
+      for ( c = 0; c < 2; c++ )
+         for ( k = 0; k < SER_NLANES; k++ )
+            _cfaWeights[r][c][k] = (_isBayer ? _whiteBalance[_bayerPlanes[r][(c+k)%2]]
+                                             : _whiteBalance[0]);
+
+   if ( _format == SER_RGB )
+      _convertRow = (_bytesPerPixel == 1 ? convertRGB8
+                                         : (swap ? convertRGB16Swapped : convertRGB16));
+   else if ( _format == SER_BGR )
+      _convertRow = (_bytesPerPixel == 1 ? convertBGR8
+                                         : (swap ? convertBGR16Swapped : convertBGR16));
+   else
+      _convertRow = (_bytesPerPixel == 1 ? convertPlane8
+                                         : (swap ? convertPlane16Swapped : convertPlane16));
+}
 @end
 
 @implementation SER_Reader
@@ -62,10 +320,13 @@
       _height = 0;
       _bytesPerPixel = 0;
       _bytesPerRow = 0;
-      _filePos = 0;
+      _map = NULL;
+      _fileSize = 0;
       _format = SER_MONO;
       _byteOrder = SER_LITTLE_ENDIAN;
       _isBayer = NO;
+      _convertRow = NULL;
+      _maxValue = 255.0;
       double rw = [prefs doubleForKey:K_SER_RED_KEY];
       _whiteBalance[RED_PLANE] = (rw > 0.0 ? rw : 1.0);
       double rg = [prefs doubleForKey:K_SER_GREEN_KEY];
@@ -76,7 +337,6 @@
       _darkFrame = nil;
       _flatField = nil;
       _metadata = [[NSMutableDictionary alloc] init];
-      _mutex = [[NSLock alloc] init];
    }
    return( self );
 }
@@ -85,6 +345,7 @@
 {
    int          ret;
    SER_Header_t ser;
+   struct stat  st;
 
    self = [self init];
 
@@ -172,6 +433,27 @@
             break;
       }
 
+      [self selectConverter];
+
+      // Map the whole file, frames will then be accessed without any lock
+      if (fstat(fileno(_file), &st) == 0)
+      {
+         _fileSize = st.st_size;
+         _map = mmap(NULL, (size_t)_fileSize, PROT_READ, MAP_SHARED,
+                     fileno(_file), 0);
+         if (_map == MAP_FAILED)
+         {
+            NSLog( @"Could not map SER file, using plain reads" );
+            _map = NULL;
+         }
+      }
+      else
+      {
+         NSLog( @"Could not get the SER file size" );
+         [self release];
+         return( nil );
+      }
+
       // Retrieve metadata
       if (strnlen(ser.Observer, SER_STRING_LENGTH) != 0)
          [_metadata setObject:[NSString stringWithCString:ser.Observer encoding:NSUTF8StringEncoding]
@@ -193,6 +475,11 @@
 
 - (void) dealloc
 {
+   // The frames cache does not retain us
+   [LynkeosObjectCache forgetOwner:self];
+
+   if (_map != NULL)
+      munmap(_map, (size_t)_fileSize);
    if (_file != NULL)
       fclose(_file);
    if (_darkFrame != nil)
@@ -200,7 +487,6 @@
    if (_flatField != nil)
       [_flatField release];
    [_metadata release];
-   [_mutex release];
 
    [super dealloc];
 }
@@ -254,32 +540,19 @@
       u_char *pixels = (u_char*)[bitmap bitmapData];
       int bpr = (int)[bitmap bytesPerRow];
       int bpp = (int)[bitmap bitsPerPixel]/8;
-      const size_t imageSize = _height*_bytesPerRow;
-      void *buffer = malloc(imageSize);
-      const off_t imageOffset = SER_START_OF_IMAGES + index*imageSize;
+      void *readBuffer;
+      const void *buffer = [self rowsAtIndex:index fromRow:0 count:_height
+                                      buffer:&readBuffer];
       u_short x, y, p;
-      int ret = 0;
-      size_t nread = 0;
-
-      [_mutex lock];
 
-      if (_filePos != imageOffset)
-         ret = fseeko(_file, imageOffset, SEEK_SET);
-      if (ret == 0)
-         nread = fread(buffer, _bytesPerRow, _height, _file);
-      if (nread == _height)
-         _filePos = imageOffset + imageSize;
-
-      [_mutex unlock];
-
-      if (nread == _height)
+      if (buffer != NULL)
       {
          for( y = 0; y < _height; y++ )
          {
-            void *linePtr = buffer + y*_bytesPerRow;
+            const void *linePtr = buffer + y*_bytesPerRow;
             for( x = 0; x < _width; x++ )
             {
-               void *pixPtr = linePtr + x*_bytesPerPixel;
+               const void *pixPtr = linePtr + x*_bytesPerPixel;
                u_char v;
                for ( p = 0 ; p < _numberOfPlanes; p++ )
                {
@@ -290,7 +563,7 @@
                         if (_bytesPerPixel == 2)
                         {
                            uint16 iv;
-                           iv = ((uint16*)pixPtr)[0];
+                           iv = ((const uint16*)pixPtr)[0];
                            if (_byteOrder == SER_BIG_ENDIAN)
                               v = (double)CFSwapInt16BigToHost(iv)/256.0;
                            else
@@ -298,7 +571,7 @@
                         }
                         else
                         {
-                           v = (double)((uint8*)pixPtr)[0];
+                           v = (double)((const uint8*)pixPtr)[0];
                         }
                         double vf = (double)v * _whiteBalance[p];
                         v = (vf < 256.0 ? (u_char)v : 255);
@@ -313,16 +586,16 @@
                         double sum = 0.0, weight = 0.0, vf;
                         for ( yl = syl; yl <= myl; yl++)
                         {
-                           void *interpolationLinePtr = buffer + yl*_bytesPerRow;
+                           const void *interpolationLinePtr = buffer + yl*_bytesPerRow;
                            for ( xl = sxl; xl <= mxl; xl++)
                            {
-                              void *interpolationPixPtr = interpolationLinePtr + xl*_bytesPerPixel;
+                              const void *interpolationPixPtr = interpolationLinePtr + xl*_bytesPerPixel;
                               if (_bayerPlanes[yl%2][xl%2] == p)
                               {
                                  if (_bytesPerPixel == 2)
                                  {
                                     uint16 iv;
-                                    iv = ((uint16*)interpolationPixPtr)[0];
+                                    iv = ((const uint16*)interpolationPixPtr)[0];
                                     if (_byteOrder == SER_BIG_ENDIAN)
                                        vf = (double)CFSwapInt16BigToHost(iv)/256.0 * _whiteBalance[p];
                                     else
@@ -332,7 +605,7 @@
                                  }
                                  else
                                  {
-                                    vf = (double)((uint8*)interpolationPixPtr)[0] * _whiteBalance[p];
+                                    vf = (double)((const uint8*)interpolationPixPtr)[0] * _whiteBalance[p];
                                     if (vf > 255.0)
                                        vf = 255.0;
                                  }
@@ -350,9 +623,9 @@
                      {
                         uint16 iv;
                         if (_format == SER_BGR)
-                           iv = ((uint16*)pixPtr)[2-p];
+                           iv = ((const uint16*)pixPtr)[2-p];
                         else
-                           iv = ((uint16*)pixPtr)[p];
+                           iv = ((const uint16*)pixPtr)[p];
                         if (_byteOrder == SER_BIG_ENDIAN)
                            v = CFSwapInt16BigToHost(iv)/256;
                         else
@@ -361,9 +634,9 @@
                      else
                      {
                         if (_format == SER_BGR)
-                           v = ((uint8*)pixPtr)[2-p];
+                           v = ((const uint8*)pixPtr)[2-p];
                         else
-                           v = ((uint8*)pixPtr)[p];
+                           v = ((const uint8*)pixPtr)[p];
                      }
                   }
                   pixels[y*bpr+x*bpp+p] = v;
@@ -372,7 +645,9 @@
          }
       }
 
-      free(buffer);
+      if (readBuffer != NULL)
+         [LynkeosBufferPool releaseBuffer:readBuffer
+                                     size:_height*_bytesPerRow];
 
       image = [[[NSImage alloc] initWithSize:NSMakeSize(_width, _height)] autorelease];
 
@@ -463,11 +738,20 @@
                     atX:(u_short)x Y:(u_short)y W:(u_short)w H:(u_short)h
               lineWidth:(u_short)lineW
 {
-   const NSAffineTransformStruct ident = {1.0, 0.0, 0.0, 1.0, 0.0, 0.0};
-   const NSPoint still[3] = {{0.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}};
-   LynkeosImageBuffer* customImage = [self getCustomImageSampleAtIndex:index atX:x Y:y W:w H:h
-                                                             withTransform:ident withOffsets:still];
-   [customImage convertToPlanar:sample withPlanes:nPlanes lineWidth:lineW];
+   if (!_isBayer && nPlanes == _numberOfPlanes)
+   {
+      // Convert only the requested rectangle, straight into the sample
+      if (![self convertFrame:index toPlanes:sample atX:x Y:y W:w H:h lineWidth:lineW])
+         NSLog( @"Failed to read SER sample" );
+   }
+   else
+   {
+      const NSAffineTransformStruct ident = {1.0, 0.0, 0.0, 1.0, 0.0, 0.0};
+      const NSPoint still[3] = {{0.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}};
+      LynkeosImageBuffer* customImage = [self getCustomImageSampleAtIndex:index atX:x Y:y W:w H:h
+                                                                withTransform:ident withOffsets:still];
+      [customImage convertToPlanar:sample withPlanes:nPlanes lineWidth:lineW];
+   }
 }
 
 - (LynkeosImageBuffer*) getCustomImageSampleAtIndex:(u_long)index
@@ -476,97 +760,117 @@
                                           withTransform:(NSAffineTransformStruct)transform
                                             withOffsets:(const NSPoint*)offsets
 {
-   // Read the data
-   const size_t imageSize = _height*_bytesPerRow;
-   void *buffer = malloc(imageSize);
-   u_short nPlanes = (_isBayer ? 1 : _numberOfPlanes);
-   REAL *imageData = (REAL*)malloc(_width*_height*nPlanes*sizeof(REAL));
-   const off_t imageOffset = SER_START_OF_IMAGES + index*imageSize;
-   int ret = 0;
-   size_t nread = 0;
    LynkeosImageBuffer* image = nil;
-   u_short xl, yl, p;
-   REAL v;
-
-   [_mutex lock];
+   BOOL isIdentity = (transform.m11 == 1.0 && transform.m12 == 0.0
+                      && transform.m21 == 0.0 && transform.m22 == 1.0
+                      && transform.tX == 0.0 && transform.tY == 0.0);
+   u_short p;
 
-   if (_filePos != imageOffset)
-      ret = fseeko(_file, imageOffset, SEEK_SET);
-   if (ret == 0)
-      nread = fread(buffer, _bytesPerRow, _height, _file);
-   if (nread == _height)
-      _filePos = imageOffset + imageSize;
-
-   [_mutex unlock];
-
-   if (nread == _height)
+   for (p = 0; offsets != NULL && p < _numberOfPlanes; p++)
    {
-      for( yl = 0; yl < _height; yl++ )
-      {
-         void *linePtr = buffer + yl*_bytesPerRow;
-         for( xl = 0; xl < _width; xl++ )
-         {
-            void *pixPtr = linePtr + xl*_bytesPerPixel;
-
-            for ( p = 0 ; p < nPlanes; p++ )
-            {
-               if (_bytesPerPixel == 2)
-               {
-                  uint16 iv;
-                  if (_format == SER_BGR)
-                     iv = ((uint16*)pixPtr)[2-p];
-                  else
-                     iv = ((uint16*)pixPtr)[p];
-                  if (_byteOrder == SER_BIG_ENDIAN)
-                     v = CFSwapInt16BigToHost(iv)/256;
-                  else
-                     v = CFSwapInt16LittleToHost(iv)/256;
-                  if (_isBayer)
-                     v *= _whiteBalance[_bayerPlanes[yl%2][xl%2]];
-                  else
-                     v *= _whiteBalance[p];
-                  if (v >= 256.0)
-                     v = 65535.0/256.0;
-               }
-               else
-               {
-                  if (_format == SER_BGR)
-                     v = ((uint8*)pixPtr)[2-p];
-                  else
-                     v = ((uint8*)pixPtr)[p];
-                  if (_isBayer)
-                     v *= _whiteBalance[_bayerPlanes[yl%2][xl%2]];
-                  else
-                     v *= _whiteBalance[p];
-                  if (v > 255.0)
-                     v = 255.0;
-               }
-               imageData[xl+_width*(yl+p*_height)] = v;
-            }
-         }
-      }
+      if (offsets[p].x != 0.0 || offsets[p].y != 0.0)
+         isIdentity = NO;
    }
 
-   free(buffer);
-
    if (_isBayer)
    {
-      image = [[[SER_ImageBuffer alloc] initWithData:imageData format:_format
-                                               width:_width lineW:_width height:_height
-                                                 atX:x Y:y W:w H:h
-                                       withTransform:transform withOffsets:offsets
-                                            withDark: _darkFrame withFlat:_flatField] autorelease];
-      free(imageData);
+      // The whole mosaic is needed for calibration and interpolation
+      const size_t imageSize = _width*_height*sizeof(REAL);
+      REAL *imageData = (REAL*)[LynkeosBufferPool allocateBuffer:imageSize];
+      REAL * const planes[1] = {imageData};
+
+      if ([self convertFrame:index toPlanes:planes atX:0 Y:0 W:_width H:_height
+                   lineWidth:_width])
+         image = [[[SER_ImageBuffer alloc] initWithData:imageData format:_format
+                                                  width:_width lineW:_width height:_height
+                                                    atX:x Y:y W:w H:h
+                                          withTransform:transform withOffsets:offsets
+                                               withDark: _darkFrame withFlat:_flatField] autorelease];
+      [LynkeosBufferPool releaseBuffer:imageData size:imageSize];
+   }
+   else if (isIdentity)
+   {
+      // Only the requested rectangle is read
+      image = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:_numberOfPlanes
+                                                          width:w height:h];
+      if (![self convertFrame:index toPlanes:[image colorPlanes] atX:x Y:y W:w H:h
+                    lineWidth:image->_padw])
+         image = nil;
    }
    else
-      image = [[[LynkeosImageBuffer alloc] initWithData:imageData copy:YES freeWhenDone:YES
-                                                 numberOfPlanes:_numberOfPlanes
-                                                          width:_width paddedWidth:_width height:_height]
-               autorelease];
-#warning Non bayer image is not the correct origin and size, neither has transform applied
+   {
+      // Read the whole frame and apply the transform to extract the sample
+      LynkeosImageBuffer *frame
+         = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:_numberOfPlanes
+                                                       width:_width height:_height];
+
+      if ([self convertFrame:index toPlanes:[frame colorPlanes] atX:0 Y:0 W:_width H:_height
+                   lineWidth:frame->_padw])
+      {
+         const LynkeosIntegerRect r = {{x, y}, {w, h}};
+         Class interpolatorClass = [LynkeosInterpolatorManager interpolatorWithScaling:UseTransform
+                                                                             transform:transform];
+         id <LynkeosInterpolator> interpolator
+            = [[[interpolatorClass alloc] initWithImage:frame
+                                                 inRect:r
+                                     withNumberOfPlanes:_numberOfPlanes
+                                           withTranform:transform
+                                            withOffsets:offsets
+                                         withParameters:nil] autorelease];
+         u_short xl, yl;
+
+         image = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:_numberOfPlanes
+                                                             width:w height:h];
+         for (p = 0; p < _numberOfPlanes; p++)
+            for (yl = 0; yl < h; yl++)
+               for (xl = 0; xl < w; xl += sizeof(REALVECT)/sizeof(REAL))
+                  *(REALVECT*)&stdColorValue(image, xl, yl, p)
+                     = [interpolator interpolateVectInPLane:p atX:xl atY:yl];
+      }
+   }
+
    return image;
 }
 
+- (void) prefetchFrameAtIndex:(u_long)index
+{
+   const size_t imageSize = _height*_bytesPerRow;
+   const off_t offset = SER_START_OF_IMAGES + index*imageSize;
+
+   if (index >= _numberOfFrames || offset + (off_t)imageSize > _fileSize)
+      return;
+
+   if (_map != NULL)
+      [LynkeosReadAhead adviseMemory:_map + offset length:imageSize];
+   else
+      [LynkeosReadAhead adviseFile:fileno(_file) offset:offset length:imageSize];
+}
+
+- (NSDate*) dateOfFrameAtIndex:(u_long)index
+{
+   // The dates trailer follows the frames, it is optional
+   const size_t imageSize = _height*_bytesPerRow;
+   const off_t offset = SER_START_OF_IMAGES + _numberOfFrames*imageSize
+                        + index*sizeof(int64_t);
+   int64_t date;
+
+   if (index >= _numberOfFrames || offset + (off_t)sizeof(int64_t) > _fileSize)
+      return( nil );
+
+   if (_map != NULL)
+      memcpy( &date, _map + offset, sizeof(int64_t) );
+   else if (pread(fileno(_file), &date, sizeof(int64_t), offset)
+            != (ssize_t)sizeof(int64_t))
+      return( nil );
+
+   date = CFSwapInt64LittleToHost( date );
+   if (date <= 0)
+      return( nil );
+
+   return( [NSDate dateWithTimeIntervalSinceReferenceDate:
+              (NSTimeInterval)(date - SER_DATE_ORIGIN)*SER_DATE_TIMEBASE] );
+}
+
 - (NSDictionary*) getMetaData 
 {
    return( _metadata );
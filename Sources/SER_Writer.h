@@ -0,0 +1,71 @@
+//
+//  Lynkeos
+//  $Id: $
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+// 
+
+/*!
+ * @header
+ * @abstract Writer for SER movie format.
+ */
+#ifndef __SERWRITER_H
+#define __SERWRITER_H
+
+#import <AppKit/AppKit.h>
+
+#include "LynkeosFileWriter.h"
+
+#include "SER.h"
+
+/*!
+ * @class SER_Writer
+ * @abstract Class for writing SER movie file format.
+ * @discussion The frames are streamed one at a time from the delegate to the
+ *    file, only one frame is held in memory.
+ * @ingroup FileAccess
+ */
+@interface SER_Writer : NSObject <LynkeosMovieFileWriter>
+{
+@private
+   IBOutlet NSPanel *_cfgPanel;      //!< Configuration panel
+
+   u_short        _nBits;            //!< Number of bits per pixel and plane
+}
+
+/*!
+ * @abstract Action connected to the "bits" popup
+ * @param sender The popup
+ */
+- (IBAction) changeBits :(id)sender ;
+
+/*!
+ * @abstract Action connected to the "OK" button
+ * @param sender The button
+ */
+- (IBAction) confirmParams :(id)sender ;
+
+/*!
+ * @abstract Action connected to the "Cancel" button
+ * @param sender The button
+ */
+- (IBAction) cancelParams :(id)sender ;
+
+@end
+
+#endif
@@ -0,0 +1,258 @@
+//
+//  Lynkeos
+//  $Id: $
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+// 
+
+#include <LynkeosCore/LynkeosMetadata.h>
+
+#include "SER_Writer.h"
+
+/* Conversion of a date to SER date, in 100ns ticks since year 1 */
+static int64_t SER_date( NSDate *date, BOOL localTime )
+{
+   NSTimeInterval t = [date timeIntervalSinceReferenceDate];
+
+   if ( localTime )
+      t += [[NSTimeZone localTimeZone] secondsFromGMTForDate:date];
+
+   return( (int64_t)(t/SER_DATE_TIMEBASE) + SER_DATE_ORIGIN );
+}
+
+/* Copy a metadata string in a SER header field */
+static void SER_string( char *field, NSString *value )
+{
+   memset( field, ' ', SER_STRING_LENGTH );
+   field[SER_STRING_LENGTH] = '\0';
+   if ( value != nil )
+   {
+      const char *s = [value UTF8String];
+      size_t l = strlen(s);
+
+      memcpy( field, s, l < SER_STRING_LENGTH ? l : SER_STRING_LENGTH );
+   }
+}
+
+@implementation SER_Writer
+
++ (void) load
+{
+   // Nothing to do, this is just to force the runtime to load this class
+}
+
+- (id) init
+{
+   if ( (self = [super init]) != nil )
+   {
+      if ( ![[NSBundle mainBundle] loadNibNamed:@"SER_Writer" owner:self
+                                 topLevelObjects:nil] )
+         NSLog(@"Failed to load SER writer nib");
+
+      _nBits = 16;
+   }
+
+   return( self );
+}
+
+- (void) dealloc
+{
+   [_cfgPanel release];
+   [super dealloc];
+}
+
++ (NSString*) writerName { return( @"SER" ); }
+
++ (NSString*) fileExtension { return( @"ser" ); }
+
++ (BOOL) canSaveDataWithPlanes:(u_short)nPlanes 
+                         width:(u_short)w height:(u_short)h
+                      metaData:(NSDictionary*)metaData
+{
+   return( nPlanes == 1 || nPlanes == 3 );
+}
+
+- (NSPanel*) configurationPanel { return( _cfgPanel ); }
+
++ (id <LynkeosFileWriter>) writerForURL:(NSURL*)url 
+                                  planes:(u_short)nPlanes 
+                                   width:(u_short)w height:(u_short)h
+                                metaData:(NSDictionary*)metaData
+{
+   // No pre-processing needed
+   return( [[[self alloc] init] autorelease] );
+}
+
+- (void) saveMovieAtURL:(NSURL*)url
+           withDelegate:(id <LynkeosMovieFileWriterDelegate>)delegate
+             blackLevel:(double)black whiteLevel:(double)white
+             withPlanes:(u_short)nPlanes
+                  width:(u_short)w
+                 height:(u_short)h
+               metaData:(NSDictionary*)metaData
+{
+   const u_long nFrames = [delegate numberOfFrames];
+   const u_short bytesPerPixel = (_nBits + 7)/8;
+   const size_t bytesPerRow = w*nPlanes*bytesPerPixel;
+   const BOOL hasDates
+      = [(NSObject*)delegate respondsToSelector:@selector(dateOfFrameAtIndex:)];
+   const BOOL canCancel
+      = [(NSObject*)delegate respondsToSelector:@selector(isCancelled)];
+   const double vmax = (double)((1 << _nBits) - 1);
+   FILE *file;
+   SER_Header_t hdr;
+   NSDate *date;
+   REAL *planes[3];
+   void *row;
+   int64_t *dates = NULL;
+   u_long index;
+   u_short x, y, c;
+   BOOL success = YES, cancelled = NO;
+
+   file = fopen( [[url path] fileSystemRepresentation], "wb" );
+   if ( file == NULL )
+   {
+      NSLog( @"Could not create SER file %@", [url absoluteString] );
+      return;
+   }
+
+   // Header
+   memcpy( hdr.FileID, "LUCAM-RECORDER", SER_ID_LENGTH );
+   hdr.LuID = 0;
+   hdr.ColorID = (nPlanes == 1 ? SER_MONO : SER_RGB);
+   hdr.LittleEndian = SER_LITTLE_ENDIAN;
+   hdr.ImageWidth = w;
+   hdr.ImageHeight = h;
+   hdr.PixelDepthPerPlane = _nBits;
+   hdr.FrameCount = (int32_t)nFrames;
+   SER_string( hdr.Observer, [metaData objectForKey:LynkeosMD_Authors()] );
+   SER_string( hdr.Instrument, [metaData objectForKey:LynkeosMD_CameraModel()] );
+   SER_string( hdr.Telescope, [metaData objectForKey:LynkeosMD_Telescope()] );
+   date = [metaData objectForKey:LynkeosMD_CaptureDate()];
+   if ( date == nil )
+      date = [NSDate date];
+   hdr.DateTime = SER_date( date, YES );
+   hdr.DateTime_UTC = SER_date( date, NO );
+
+   if ( SER_write_header( file, &hdr ) != 0 )
+   {
+      NSLog( @"Could not write SER header" );
+      fclose( file );
+      return;
+   }
+
+   // Buffers for one frame only
+   for ( c = 0; c < nPlanes; c++ )
+      planes[c] = (REAL*)malloc( w*h*sizeof(REAL) );
+   row = malloc( bytesPerRow );
+   if ( hasDates )
+      dates = (int64_t*)malloc( nFrames*sizeof(int64_t) );
+
+   for ( index = 0; index < nFrames && success; index++ )
+   {
+      NSAutoreleasePool *pool;
+
+      if ( canCancel && [delegate isCancelled] )
+      {
+         cancelled = YES;
+         break;
+      }
+
+      pool = [[NSAutoreleasePool alloc] init];
+
+      [delegate getFrameAtIndex:index withData:planes lineWidth:w];
+
+      for ( y = 0; y < h && success; y++ )
+      {
+         for ( x = 0; x < w; x++ )
+         {
+            for ( c = 0; c < nPlanes; c++ )
+            {
+               double v = planes[c][x+y*w]*vmax + 0.5;
+
+               if ( v < 0.0 )
+                  v = 0.0;
+               else if ( v > vmax )
+                  v = vmax;
+
+               if ( bytesPerPixel == 1 )
+                  ((uint8_t*)row)[x*nPlanes+c] = (uint8_t)v;
+               else
+                  ((uint16_t*)row)[x*nPlanes+c] = CFSwapInt16HostToLittle((uint16_t)v);
+            }
+         }
+
+         success = (fwrite( row, bytesPerRow, 1, file ) == 1);
+      }
+
+      if ( dates != NULL )
+      {
+         date = [delegate dateOfFrameAtIndex:index];
+         if ( date != nil )
+            dates[index] = SER_date( date, NO );
+         else
+         {
+            // The trailer is all or nothing
+            free( dates );
+            dates = NULL;
+         }
+      }
+
+      [pool release];
+   }
+
+   // Trailer of frames capture dates
+   if ( success && !cancelled && dates != NULL )
+   {
+      for ( index = 0; index < nFrames; index++ )
+         dates[index] = CFSwapInt64HostToLittle( dates[index] );
+      success = (fwrite( dates, sizeof(int64_t), nFrames, file ) == nFrames);
+   }
+
+   if ( !success )
+      NSLog( @"Failed to write SER file %@", [url absoluteString] );
+
+   if ( dates != NULL )
+      free( dates );
+   free( row );
+   for ( c = 0; c < nPlanes; c++ )
+      free( planes[c] );
+   fclose( file );
+
+   // Do not leave an incomplete movie
+   if ( cancelled )
+      unlink( [[url path] fileSystemRepresentation] );
+}
+
+- (IBAction) changeBits :(id)sender
+{
+   _nBits = (u_short)[[sender selectedItem] tag];
+}
+
+- (IBAction) confirmParams :(id)sender
+{
+   [NSApp stopModalWithCode:NSModalResponseOK];
+   [_cfgPanel close];
+}
+
+- (IBAction) cancelParams :(id)sender 
+{
+   [NSApp stopModalWithCode:NSModalResponseCancel];
+   [_cfgPanel close];
+}
+@end
@@ -231,4 +231,85 @@ static void fillImage( LynkeosImageBuffer *img, TestImagePolynomial *poly )
    [self checkInterpolationWithPolynomial:saddle];
 }
 
+- (void) checkVectorInterpolation
+{
+   // The vector interpolation shall give the same result as the scalar one
+   const u_short nLanes = sizeof(REALVECT)/sizeof(REAL);
+   u_short x, y, k;
+
+   for (y = 0; y < _rect.size.height; y++)
+   {
+      for (x = 0; x < _rect.size.width; x += nLanes)
+      {
+         const REALVECT v = [_interpol interpolateVectInPLane:0 atX:x atY:y];
+
+         for (k = 0; k < nLanes; k++)
+         {
+            const double scalar = [_interpol interpolateInPLane:0 atX:x+k atY:y];
+            XCTAssertEqualWithAccuracy(v[k], scalar, 0.001,
+                                       @"Vector differs from scalar at x=%d y=%d", x+k, y);
+         }
+      }
+   }
+}
+
+- (void)testBicubicVectorTranslation
+{
+   // Create a sadle curve image
+   const LynkeosIntegerSize size = {20, 12};
+   LynkeosImageBuffer *img
+      = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:1 width:size.width height:size.height];
+   CGPoint offsets[1] = {CGPointMake(0.3, -0.6)};
+   TestImagePolynomial *saddle = [[[TestImagePolynomial alloc] initWithFirstZero:CGPointMake(3.0, 3.0)
+                                                                      secondZero:CGPointMake(7.0, 7.0)
+                                                                          factor:CGPointMake(1.0, -1.0)
+                                                                          offset:4.0]
+                                  autorelease];
+   fillImage(img, saddle);
+
+   // Create the interpolator, with a translation only (uses the row cache)
+   _transform = [NSAffineTransform transform];
+   [_transform translateXBy:1.25 yBy:-0.75];
+   _rect = LynkeosMakeIntegerRect(0, 0, 20, 12);
+   _interpol = [[[LynkeosBicubicInterpolator alloc] initWithImage:img
+                                                           inRect:_rect
+                                               withNumberOfPlanes:1
+                                                     withTranform:[_transform transformStruct]
+                                                      withOffsets:offsets
+                                                   withParameters:nil]
+                autorelease];
+
+   [self checkVectorInterpolation];
+}
+
+- (void)testBicubicVectorRotation
+{
+   // Create a sadle curve image
+   const LynkeosIntegerSize size = {10, 10};
+   LynkeosImageBuffer *img
+      = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:1 width:size.width height:size.height];
+   CGPoint offsets[1] = {CGPointZero};
+   TestImagePolynomial *saddle = [[[TestImagePolynomial alloc] initWithFirstZero:CGPointMake(3.0, 3.0)
+                                                                      secondZero:CGPointMake(7.0, 7.0)
+                                                                          factor:CGPointMake(1.0, -1.0)
+                                                                          offset:4.0]
+                                  autorelease];
+   fillImage(img, saddle);
+
+   // Create the interpolator
+   _transform = [NSAffineTransform transform];
+   [_transform rotateByDegrees:30.0];
+   [_transform scaleBy:2.0];
+   _rect = LynkeosMakeIntegerRect(2, 7, 16, 16);
+   _interpol = [[[LynkeosBicubicInterpolator alloc] initWithImage:img
+                                                           inRect:_rect
+                                               withNumberOfPlanes:1
+                                                     withTranform:[_transform transformStruct]
+                                                      withOffsets:offsets
+                                                   withParameters:nil]
+                autorelease];
+
+   [self checkVectorInterpolation];
+}
+
 @end
@@ -0,0 +1,130 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#import <XCTest/XCTest.h>
+
+#include "LynkeosItemQueue.h"
+
+@interface LynkeosItemQueueTest : XCTestCase
+{
+}
+@end
+
+//! Arguments of the producer threads
+@interface ItemQueueTestArgs : NSObject
+{
+@public
+   LynkeosItemQueue *queue;      //!< The shared queue
+   NSConditionLock  *lock;       //!< Counts the finished threads
+   int              producer;    //!< Index of the producer
+}
+@end
+
+@implementation ItemQueueTestArgs
+@end
+
+@implementation LynkeosItemQueueTest
+
+- (void) produce:(ItemQueueTestArgs*)args
+{
+   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+   int i;
+
+   for( i = 0; i < 1000; i++ )
+      [args->queue pushObject:[NSNumber numberWithInt:args->producer*1000 + i]];
+
+   [args->lock lock];
+   [args->lock unlockWithCondition:[args->lock condition]+1];
+   [pool release];
+}
+
+- (void) testOrder
+{
+   LynkeosItemQueue *queue = [[LynkeosItemQueue alloc] init];
+   NSArray *objects;
+
+   XCTAssertTrue( [queue isEmpty] );
+   XCTAssertNil( [queue drain] );
+
+   [queue pushObject:@"a"];
+   [queue pushObject:@"b"];
+   [queue pushObject:@"c"];
+   XCTAssertFalse( [queue isEmpty] );
+
+   objects = [queue drain];
+   XCTAssertEqualObjects( objects,
+                          ([NSArray arrayWithObjects:@"a", @"b", @"c", nil]) );
+   XCTAssertTrue( [queue isEmpty] );
+
+   [queue release];
+}
+
+- (void) testConcurrentProducers
+{
+   LynkeosItemQueue *queue = [[LynkeosItemQueue alloc] init];
+   NSConditionLock *lock = [[NSConditionLock alloc] initWithCondition:0];
+   NSMutableArray *received = [NSMutableArray array];
+   int last[4] = {-1, -1, -1, -1};
+   BOOL ordered = YES;
+   NSArray *objects;
+   int i;
+
+   for( i = 0; i < 4; i++ )
+   {
+      ItemQueueTestArgs *args = [[[ItemQueueTestArgs alloc] init] autorelease];
+      args->queue = queue;
+      args->lock = lock;
+      args->producer = i;
+      [NSThread detachNewThreadSelector:@selector(produce:)
+                               toTarget:self
+                             withObject:args];
+   }
+
+   // Drain while the producers are running
+   while ( ![lock tryLockWhenCondition:4] )
+   {
+      if ( (objects = [queue drain]) != nil )
+         [received addObjectsFromArray:objects];
+   }
+   [lock unlock];
+   if ( (objects = [queue drain]) != nil )
+      [received addObjectsFromArray:objects];
+
+   XCTAssertEqual( [received count], (NSUInteger)4000 );
+
+   // Each producer objects come in order
+   for( i = 0; i < (int)[received count]; i++ )
+   {
+      const int v = [[received objectAtIndex:i] intValue];
+
+      if ( v%1000 != last[v/1000] + 1 )
+         ordered = NO;
+      last[v/1000] = v%1000;
+   }
+   XCTAssertTrue( ordered );
+
+   [lock release];
+   [queue release];
+}
+
+@end
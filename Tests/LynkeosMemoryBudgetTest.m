@@ -0,0 +1,197 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#import <XCTest/XCTest.h>
+
+#include "LynkeosImageBuffer.h"
+#include "LynkeosObjectCache.h"
+#include "LynkeosBufferPool.h"
+#include "LynkeosMemoryBudget.h"
+
+@interface LynkeosMemoryBudgetTest : XCTestCase
+{
+}
+@end
+
+//! Consumer which gives back a fixed amount of memory
+@interface BudgetTestConsumer : NSObject <LynkeosMemoryConsumer>
+{
+@public
+   u_long   held;     //!< Memory registered by the consumer
+   u_int    calls;    //!< Number of calls to releaseMemory
+}
+@end
+
+@implementation BudgetTestConsumer
+- (void) releaseMemory
+{
+   calls++;
+   [LynkeosMemoryBudget freedMemory:held];
+   held = 0;
+}
+@end
+
+@implementation LynkeosMemoryBudgetTest
+
+- (void) tearDown
+{
+   [LynkeosMemoryBudget setBudget:0];
+   [super tearDown];
+}
+
+- (void) testBufferRegistration
+{
+   u_long before;
+   LynkeosImageBuffer *image;
+
+   [LynkeosBufferPool drain];
+   before = [LynkeosMemoryBudget usedMemory];
+   image = [[LynkeosImageBuffer alloc] initWithNumberOfPlanes:3
+                                                       width:100 height:100];
+
+   // The pool rounds the size up to its size class
+   XCTAssertGreaterThanOrEqual( [LynkeosMemoryBudget usedMemory] - before,
+                               (u_long)image->_padw*image->_h*3*sizeof(REAL) );
+
+   // The buffer stays counted while it is idle in the pool
+   [image release];
+   [LynkeosBufferPool drain];
+   XCTAssertEqual( [LynkeosMemoryBudget usedMemory], before );
+}
+
+- (void) testPoolReuse
+{
+   void *buf1, *buf2;
+
+   [LynkeosBufferPool drain];
+
+   buf1 = [LynkeosBufferPool allocateBuffer:100000];
+   XCTAssertTrue( buf1 != NULL );
+   XCTAssertEqual( (u_long)buf1 % 64, (u_long)0 );
+   [LynkeosBufferPool releaseBuffer:buf1 size:100000];
+
+   // A slightly different size falls in the same class
+   buf2 = [LynkeosBufferPool allocateBuffer:99000];
+   XCTAssertEqual( buf2, buf1 );
+   [LynkeosBufferPool releaseBuffer:buf2 size:99000];
+
+   [LynkeosBufferPool drain];
+}
+
+- (void) testAllowedWorkers
+{
+   LynkeosImageBuffer *image =
+      [LynkeosImageBuffer imageBufferWithNumberOfPlanes:1 width:100 height:100];
+   const u_long used = [LynkeosMemoryBudget usedMemory];
+
+   XCTAssertNotNil( image );
+
+   // No limit
+   XCTAssertEqual( [LynkeosMemoryBudget allowedWorkers:8], (u_long)8 );
+
+   // Far below the budget
+   [LynkeosMemoryBudget setBudget:used*2 + 1024*1024];
+   XCTAssertFalse( [LynkeosMemoryBudget isOverBudget] );
+   XCTAssertEqual( [LynkeosMemoryBudget allowedWorkers:8], (u_long)8 );
+
+   // Over the budget
+   [LynkeosMemoryBudget setBudget:used/2];
+   XCTAssertTrue( [LynkeosMemoryBudget isOverBudget] );
+   XCTAssertEqual( [LynkeosMemoryBudget allowedWorkers:8], (u_long)1 );
+   XCTAssertEqual( [LynkeosMemoryBudget readAheadDepth], (u_long)0 );
+}
+
+- (void) testListThreads
+{
+   [LynkeosMemoryBudget listThreadStarted];
+   [LynkeosMemoryBudget listThreadStarted];
+
+   XCTAssertFalse( [LynkeosMemoryBudget listThreadShallStop] );
+
+   // When over budget, only the last thread goes on
+   [LynkeosMemoryBudget setBudget:1];
+   XCTAssertTrue( [LynkeosMemoryBudget listThreadShallStop] );
+   XCTAssertFalse( [LynkeosMemoryBudget listThreadShallStop] );
+
+   [LynkeosMemoryBudget listThreadEnded];
+}
+
+- (void) testCacheShrinks
+{
+   LynkeosObjectCache *cache =
+      [[LynkeosObjectCache alloc] initWithStrategy:CacheNumberOfObjects
+                                          capacity:10
+                                            policy:WriteRefresh];
+   // Let the images be retained by the cache only
+   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+   int i;
+
+   for( i = 0; i < 4; i++ )
+      [cache setObject:[LynkeosImageBuffer imageBufferWithNumberOfPlanes:1
+                                                                   width:500
+                                                                  height:500]
+                forKey:[NSNumber numberWithInt:i]];
+   [cache setObject:@"not an image" forKey:@"string"];
+   [pool release];
+
+   [LynkeosMemoryBudget setBudget:[LynkeosMemoryBudget usedMemory] - 1];
+   [cache releaseMemory];
+
+   // The oldest image was enough to respect the budget
+   XCTAssertFalse( [LynkeosMemoryBudget isOverBudget] );
+   XCTAssertNil( [cache getObjectForKey:[NSNumber numberWithInt:0]] );
+   XCTAssertNotNil( [cache getObjectForKey:[NSNumber numberWithInt:1]] );
+   XCTAssertNotNil( [cache getObjectForKey:@"string"] );
+
+   [cache release];
+}
+
+- (void) testConsumers
+{
+   BudgetTestConsumer *consumer = [[BudgetTestConsumer alloc] init];
+
+   consumer->held = 1024*1024;
+   consumer->calls = 0;
+   [LynkeosMemoryBudget allocatedMemory:consumer->held];
+   [LynkeosMemoryBudget addConsumer:consumer];
+
+   // Not called below the budget
+   [LynkeosMemoryBudget relieveMemory];
+   XCTAssertEqual( consumer->calls, (u_int)0 );
+
+   // Called when over
+   [LynkeosMemoryBudget setBudget:[LynkeosMemoryBudget usedMemory] - 1];
+   [LynkeosMemoryBudget relieveMemory];
+   XCTAssertEqual( consumer->calls, (u_int)1 );
+   XCTAssertFalse( [LynkeosMemoryBudget isOverBudget] );
+
+   // And forgotten when removed
+   [LynkeosMemoryBudget removeConsumer:consumer];
+   [LynkeosMemoryBudget setBudget:1];
+   [LynkeosMemoryBudget relieveMemory];
+   XCTAssertEqual( consumer->calls, (u_int)1 );
+
+   [consumer release];
+}
+
+@end
@@ -0,0 +1,292 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+#import <XCTest/XCTest.h>
+
+#include "LynkeosImageBuffer.h"
+#include "LynkeosObjectCache.h"
+#include "LynkeosScratchFile.h"
+
+@interface LynkeosObjectCacheTest : XCTestCase
+{
+}
+@end
+
+//! Arguments of the concurrent access test
+@interface CacheTestThreadArgs : NSObject
+{
+@public
+   LynkeosObjectCache *cache;    //!< The tested cache
+   NSConditionLock    *lock;     //!< Counts the finished threads
+   u_long             base;      //!< First index for this thread
+   BOOL               success;   //!< Whether all the reads were consistent
+}
+@end
+
+@implementation CacheTestThreadArgs
+@end
+
+@implementation LynkeosObjectCacheTest
+
+- (void) accessCache:(CacheTestThreadArgs*)args
+{
+   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+   u_long i;
+
+   for( i = 0; i < 10000; i++ )
+   {
+      u_long index = args->base + i%100;
+      NSNumber *obj = [NSNumber numberWithUnsignedLong:index];
+      NSNumber *found;
+
+      [args->cache setObject:obj forOwner:self index:index];
+      found = (NSNumber*)[args->cache getObjectForOwner:self index:index];
+      if ( found != nil && [found unsignedLongValue] != index )
+         args->success = NO;
+   }
+
+   [args->lock lock];
+   [args->lock unlockWithCondition:[args->lock condition]+1];
+   [pool release];
+}
+
+- (void) testLeastRecentlyUsed
+{
+   LynkeosObjectCache *cache =
+      [[LynkeosObjectCache alloc] initWithStrategy:CacheNumberOfObjects
+                                          capacity:4
+                                            policy:ReadRefresh|WriteRefresh];
+   int i;
+
+   // The cache keeps one object less than its capacity
+   for( i = 0; i < 3; i++ )
+      [cache setObject:[NSNumber numberWithInt:i]
+                forKey:[NSString stringWithFormat:@"key%d", i]];
+
+   // Refresh the first one
+   XCTAssertEqualObjects( [cache getObjectForKey:@"key0"],
+                          [NSNumber numberWithInt:0] );
+
+   // The second one is now the oldest
+   [cache setObject:[NSNumber numberWithInt:3] forKey:@"key3"];
+   XCTAssertNil( [cache getObjectForKey:@"key1"] );
+   XCTAssertNotNil( [cache getObjectForKey:@"key0"] );
+   XCTAssertNotNil( [cache getObjectForKey:@"key2"] );
+   XCTAssertNotNil( [cache getObjectForKey:@"key3"] );
+
+   [cache removeObjectForKey:@"key2"];
+   XCTAssertNil( [cache getObjectForKey:@"key2"] );
+
+   // Reduce the capacity, the oldest go away
+   [cache setCapacity:2];
+   XCTAssertNil( [cache getObjectForKey:@"key0"] );
+   XCTAssertNotNil( [cache getObjectForKey:@"key3"] );
+
+   [cache release];
+}
+
+- (void) testOwnerKeys
+{
+   LynkeosObjectCache *cache =
+      [[LynkeosObjectCache alloc] initWithStrategy:CacheNumberOfObjects
+                                          capacity:10
+                                            policy:WriteRefresh];
+   NSObject *owner1 = [[[NSObject alloc] init] autorelease];
+   NSObject *owner2 = [[[NSObject alloc] init] autorelease];
+
+   [cache setObject:@"frame1/1" forOwner:owner1 index:1];
+   [cache setObject:@"frame2/1" forOwner:owner2 index:1];
+   [cache setObject:@"frame1/2" forOwner:owner1 index:2];
+
+   XCTAssertEqualObjects( [cache getObjectForOwner:owner1 index:1],
+                          @"frame1/1" );
+   XCTAssertEqualObjects( [cache getObjectForOwner:owner2 index:1],
+                          @"frame2/1" );
+   XCTAssertEqualObjects( [cache getObjectForOwner:owner1 index:2],
+                          @"frame1/2" );
+   XCTAssertNil( [cache getObjectForOwner:owner2 index:2] );
+
+   // Replace an object
+   [cache setObject:@"new" forOwner:owner1 index:1];
+   XCTAssertEqualObjects( [cache getObjectForOwner:owner1 index:1], @"new" );
+
+   // The owner is not retained, it removes its objects
+   XCTAssertEqual( [owner1 retainCount], (NSUInteger)1 );
+   [cache removeObjectsForOwner:owner1];
+   XCTAssertNil( [cache getObjectForOwner:owner1 index:1] );
+   XCTAssertNil( [cache getObjectForOwner:owner1 index:2] );
+   XCTAssertEqualObjects( [cache getObjectForOwner:owner2 index:1],
+                          @"frame2/1" );
+
+   [cache release];
+}
+
+- (void) testMemorySize
+{
+   LynkeosImageBuffer *image =
+      [LynkeosImageBuffer imageBufferWithNumberOfPlanes:1 width:100 height:100];
+   const u_long size = [image memorySize];
+   LynkeosObjectCache *cache =
+      [[LynkeosObjectCache alloc] initWithStrategy:CacheMemorySize
+                                          capacity:3*size
+                                            policy:WriteRefresh];
+   int i;
+
+   for( i = 0; i < 4; i++ )
+      [cache setObject:[LynkeosImageBuffer imageBufferWithNumberOfPlanes:1
+                                                                   width:100
+                                                                  height:100]
+                forKey:[NSNumber numberWithInt:i]];
+
+   // Only two images fit in
+   XCTAssertNil( [cache getObjectForKey:[NSNumber numberWithInt:0]] );
+   XCTAssertNil( [cache getObjectForKey:[NSNumber numberWithInt:1]] );
+   XCTAssertNotNil( [cache getObjectForKey:[NSNumber numberWithInt:2]] );
+   XCTAssertNotNil( [cache getObjectForKey:[NSNumber numberWithInt:3]] );
+
+   [cache release];
+}
+
+- (void) testSecondLevel
+{
+   LynkeosObjectCache *cache =
+      [[LynkeosObjectCache alloc] initWithStrategy:CacheNumberOfObjects
+                                          capacity:2
+                                            policy:WriteRefresh];
+   LynkeosScratchFile *scratch =
+      [[LynkeosScratchFile alloc] initInDirectory:NSTemporaryDirectory()
+                                         capacity:1024*1024
+                                           format:ScratchFloatSamples];
+   NSObject *owner = [[[NSObject alloc] init] autorelease];
+   LynkeosImageBuffer *image;
+   int i;
+
+   XCTAssertNotNil( scratch );
+   [cache setSecondLevel:scratch];
+
+   for( i = 0; i < 3; i++ )
+   {
+      image = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:1
+                                                          width:10
+                                                         height:10];
+      stdColorValue(image,3,4,0) = (REAL)i;
+      [cache setObject:image forOwner:owner index:i];
+   }
+
+   // The first images were removed from memory, and read back from disk
+   [cache waitForSecondLevel];
+   image = (LynkeosImageBuffer*)[cache getObjectForOwner:owner index:0];
+   XCTAssertNotNil( image );
+   XCTAssertEqual( stdColorValue(image,3,4,0), (REAL)0.0 );
+   image = (LynkeosImageBuffer*)[cache getObjectForOwner:owner index:1];
+   XCTAssertNotNil( image );
+   XCTAssertEqual( stdColorValue(image,3,4,0), (REAL)1.0 );
+
+   // A new image replaces the stored one
+   image = [LynkeosImageBuffer imageBufferWithNumberOfPlanes:1
+                                                       width:10
+                                                      height:10];
+   stdColorValue(image,3,4,0) = 5.0;
+   [cache setObject:image forOwner:owner index:0];
+   [cache setObject:image forOwner:owner index:3];
+   [cache setObject:image forOwner:owner index:4];
+   [cache waitForSecondLevel];
+   image = (LynkeosImageBuffer*)[cache getObjectForOwner:owner index:0];
+   XCTAssertEqual( stdColorValue(image,3,4,0), (REAL)5.0 );
+
+   [cache release];
+   [scratch release];
+}
+
+- (void) testScratchFileRing
+{
+   LynkeosImageBuffer *image =
+      [LynkeosImageBuffer imageBufferWithNumberOfPlanes:3 width:100 height:100];
+   // Room for 2 images and a half
+   LynkeosScratchFile *scratch =
+      [[LynkeosScratchFile alloc] initInDirectory:NSTemporaryDirectory()
+                                         capacity:5*3*100*100
+                                           format:ScratchShortSamples];
+   LynkeosImageBuffer *read;
+   int i;
+
+   XCTAssertNotNil( scratch );
+
+   stdColorValue(image,0,0,1) = 100.0;
+   stdColorValue(image,99,99,1) = 200.0;
+   for( i = 0; i < 3; i++ )
+      [scratch setImage:image forKey:[NSNumber numberWithInt:i]];
+
+   // The first image was overwritten
+   XCTAssertFalse( [scratch hasImageForKey:[NSNumber numberWithInt:0]] );
+   XCTAssertTrue( [scratch hasImageForKey:[NSNumber numberWithInt:1]] );
+   read = [scratch imageForKey:[NSNumber numberWithInt:2]];
+   XCTAssertNotNil( read );
+   XCTAssertEqual( read->_nPlanes, 3 );
+   XCTAssertEqualWithAccuracy( stdColorValue(read,0,0,1), 100.0, 0.01 );
+   XCTAssertEqualWithAccuracy( stdColorValue(read,99,99,1), 200.0, 0.01 );
+   XCTAssertEqualWithAccuracy( stdColorValue(read,50,50,1), 0.0, 0.01 );
+
+   // Then the second one is overwritten by the next one
+   [scratch setImage:image forKey:[NSNumber numberWithInt:3]];
+   XCTAssertFalse( [scratch hasImageForKey:[NSNumber numberWithInt:1]] );
+   XCTAssertTrue( [scratch hasImageForKey:[NSNumber numberWithInt:2]] );
+
+   [scratch release];
+}
+
+- (void) testConcurrentAccess
+{
+   LynkeosObjectCache *cache =
+      [[LynkeosObjectCache alloc] initWithStrategy:CacheNumberOfObjects
+                                          capacity:50
+                                            policy:ReadRefresh|WriteRefresh];
+   NSConditionLock *lock = [[NSConditionLock alloc] initWithCondition:0];
+   CacheTestThreadArgs *args[4];
+   int i;
+
+   for( i = 0; i < 4; i++ )
+   {
+      args[i] = [[CacheTestThreadArgs alloc] init];
+      args[i]->cache = cache;
+      args[i]->lock = lock;
+      args[i]->base = i*1000;
+      args[i]->success = YES;
+      [NSThread detachNewThreadSelector:@selector(accessCache:)
+                               toTarget:self
+                             withObject:args[i]];
+   }
+
+   [lock lockWhenCondition:4];
+   [lock unlock];
+
+   for( i = 0; i < 4; i++ )
+   {
+      XCTAssertTrue( args[i]->success, @"Inconsistent object in thread %d", i );
+      [args[i] release];
+   }
+
+   [lock release];
+   [cache release];
+}
+
+@end
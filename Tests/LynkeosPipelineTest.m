@@ -0,0 +1,142 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#import <XCTest/XCTest.h>
+
+#include "LynkeosPipeline.h"
+
+@interface LynkeosPipelineTest : XCTestCase
+{
+   NSLock         *_lock;       //!< Protects the processed array
+   NSMutableArray *_processed;  //!< Objects in the order of the last stage
+}
+@end
+
+@implementation LynkeosPipelineTest
+
+- (void) setUp
+{
+   [super setUp];
+   _lock = [[NSLock alloc] init];
+   _processed = [[NSMutableArray alloc] init];
+}
+
+- (void) tearDown
+{
+   [_lock release];
+   [_processed release];
+   [super tearDown];
+}
+
+- (id) doubleStage:(id)object
+{
+   int value;
+
+   if ( [object isKindOfClass:[NSNull class]] )
+      return( object );
+
+   // Drop the multiples of 5
+   value = [object intValue];
+   if ( value % 5 == 0 )
+      return( nil );
+
+   return( [NSNumber numberWithInt:value*2] );
+}
+
+- (id) recordStage:(id)object
+{
+   [_lock lock];
+   [_processed addObject:object];
+   [_lock unlock];
+
+   return( nil );
+}
+
+- (void) testQueue
+{
+   LynkeosPipelineQueue *queue =
+                        [[LynkeosPipelineQueue alloc] initWithCapacity:2];
+
+   XCTAssertTrue( [queue pushObject:@"first"] );
+   XCTAssertTrue( [queue pushObject:@"second"] );
+   XCTAssertEqual( [queue count], (NSUInteger)2 );
+   XCTAssertEqualObjects( [queue popObject], @"first" );
+   XCTAssertTrue( [queue pushObject:@"third"] );
+   XCTAssertEqualObjects( [queue popObject], @"second" );
+
+   // The remaining object is still delivered after closing
+   [queue close];
+   XCTAssertFalse( [queue pushObject:@"fourth"] );
+   XCTAssertEqualObjects( [queue popObject], @"third" );
+   XCTAssertNil( [queue popObject] );
+
+   [queue release];
+}
+
+- (void) testBarrier
+{
+   NSMutableArray *source = [NSMutableArray array];
+   LynkeosPipeline *pipeline;
+   NSUInteger barrier, i;
+   int n;
+
+   for( n = 1; n <= 20; n++ )
+   {
+      [source addObject:[NSNumber numberWithInt:n]];
+      if ( n == 10 )
+         [source addObject:[NSNull null]];
+   }
+
+   pipeline = [[LynkeosPipeline alloc] initWithSource:
+                                                   [source objectEnumerator]];
+   [pipeline addStageWithTarget:self selector:@selector(doubleStage:)
+                        workers:2 depth:0 name:@"double"];
+   [pipeline addStageWithTarget:self selector:@selector(recordStage:)
+                        workers:3 depth:2 name:@"record"];
+   [pipeline run];
+
+   XCTAssertEqual( [pipeline numberOfStages], (u_short)2 );
+   XCTAssertEqualObjects( [pipeline nameOfStage:1], @"record" );
+   XCTAssertEqual( [pipeline busyWorkersOfStage:1], (u_short)0 );
+   XCTAssertEqual( [pipeline queuedObjectsOfStage:1], (NSUInteger)0 );
+
+   // 16 numbers and the barrier went through
+   XCTAssertEqual( [_processed count], (NSUInteger)17 );
+   barrier = [_processed indexOfObject:[NSNull null]];
+   XCTAssertEqual( barrier, (NSUInteger)8 );
+
+   // No object crossed the barrier
+   for( i = 0; i < [_processed count]; i++ )
+   {
+      if ( i == barrier )
+         continue;
+      n = [[_processed objectAtIndex:i] intValue];
+      XCTAssertEqual( n % 2, 0 );
+      XCTAssertTrue( i < barrier ? n <= 20 : n > 20,
+                     @"Object %d on the wrong side of the barrier", n );
+   }
+
+   [pipeline release];
+}
+
+@end
@@ -0,0 +1,143 @@
+//
+//  Lynkeos
+//  $Id$
+//
+//  Created by Jean-Etienne LAMIAUD on Sun Oct 18 2026.
+//  Copyright (c) 2026. Jean-Etienne LAMIAUD
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+
+
+#import <XCTest/XCTest.h>
+
+#include "processing_core.h"
+#include "LynkeosMemoryBudget.h"
+#include "LynkeosThreadScheduler.h"
+
+extern BOOL testInitialized;
+
+@interface LynkeosThreadSchedulerTest : XCTestCase
+{
+}
+@end
+
+@implementation LynkeosThreadSchedulerTest
+
++ (void) initialize
+{
+   if ( !testInitialized )
+   {
+      testInitialized = YES;
+      // Initialize vector and multiprocessor stuff
+      initializeProcessing();
+   }
+}
+
+- (void) tearDown
+{
+   [LynkeosThreadScheduler endProcess];
+   [super tearDown];
+}
+
+- (void) testSmallImages
+{
+   const u_short listThreads =
+      [LynkeosThreadScheduler planProcessWithOptimization:
+                            FFTW3ThreadsOptimization|ListThreadsOptimizations
+                                            numberOfItems:1000
+                                                imageSize:
+                                            LynkeosMakeIntegerSize(128,128)];
+
+   // Item parallelism only
+   XCTAssertEqual( listThreads, numberOfCpus );
+   XCTAssertEqual( [LynkeosThreadScheduler rowThreads], (u_short)1 );
+   XCTAssertEqual( [LynkeosThreadScheduler fftwThreads], (u_short)1 );
+}
+
+- (void) testSingleLargeImage
+{
+   const u_short listThreads =
+      [LynkeosThreadScheduler planProcessWithOptimization:
+                            FFTW3ThreadsOptimization|ListThreadsOptimizations
+                                            numberOfItems:1
+                                                imageSize:
+                                          LynkeosMakeIntegerSize(2048,2048)];
+
+   // FFTW and rows parallelism
+   XCTAssertEqual( listThreads, (u_short)1 );
+   XCTAssertEqual( [LynkeosThreadScheduler rowThreads], numberOfCpus );
+   XCTAssertEqual( [LynkeosThreadScheduler fftwThreads], numberOfCpus );
+}
+
+- (void) testNoOversubscription
+{
+   u_long n;
+
+   for( n = 1; n <= 2*numberOfCpus; n++ )
+   {
+      const u_short listThreads =
+         [LynkeosThreadScheduler planProcessWithOptimization:
+                            FFTW3ThreadsOptimization|ListThreadsOptimizations
+                                               numberOfItems:n
+                                                   imageSize:
+                                          LynkeosMakeIntegerSize(1024,1024)];
+      XCTAssertLessThanOrEqual( listThreads
+                                * [LynkeosThreadScheduler rowThreads],
+                                numberOfCpus );
+      XCTAssertLessThanOrEqual( listThreads
+                                * [LynkeosThreadScheduler fftwThreads],
+                                numberOfCpus );
+      [LynkeosThreadScheduler endProcess];
+   }
+}
+
+- (void) testEndOfProcess
+{
+   const u_short listThreads =
+      [LynkeosThreadScheduler planProcessWithOptimization:
+                                                   ListThreadsOptimizations
+                                            numberOfItems:0
+                                                imageSize:
+                                          LynkeosMakeIntegerSize(1024,1024)];
+   XCTAssertEqual( listThreads, numberOfCpus );
+   XCTAssertEqual( [LynkeosThreadScheduler fftwThreads], (u_short)1 );
+
+   [LynkeosThreadScheduler endProcess];
+   XCTAssertEqual( [LynkeosThreadScheduler fftwThreads], numberOfCpus );
+}
+
+- (void) testConcurrentProcesses
+{
+   [LynkeosThreadScheduler planProcessWithOptimization:
+                                                   ListThreadsOptimizations
+                                         numberOfItems:0
+                                             imageSize:
+                                          LynkeosMakeIntegerSize(1024,1024)];
+   [LynkeosThreadScheduler planProcessWithOptimization:
+                                                   ListThreadsOptimizations
+                                         numberOfItems:0
+                                             imageSize:
+                                          LynkeosMakeIntegerSize(1024,1024)];
+
+   // The end of the second process leaves the first one split unchanged
+   [LynkeosThreadScheduler endProcess];
+   XCTAssertEqual( [LynkeosThreadScheduler fftwThreads], (u_short)1 );
+
+   [LynkeosThreadScheduler endProcess];
+   XCTAssertEqual( [LynkeosThreadScheduler fftwThreads], numberOfCpus );
+}
+
+@end
@@ -111,6 +111,19 @@ extern BOOL pluginsInitialized;
 }
 @end
 
+//! Arguments of the chunked enumeration test threads
+@interface EnumTestThreadArgs : NSObject
+{
+@public
+   MyImageListEnumerator *enumerator; //!< The shared enumerator
+   NSMutableArray        *items;      //!< Items enumerated by this thread
+   NSConditionLock       *lock;       //!< Counts the finished threads
+}
+@end
+
+@implementation EnumTestThreadArgs
+@end
+
 @implementation MyImageListEnumeratorTest
 + (void) initialize
 {
@@ -232,4 +245,103 @@ extern BOOL pluginsInitialized;
    XCTAssertEqual(item,[topItem getChildAtIndex:0],
                   @"Successor of top item is not the first child");
 }
+
+- (void) enumerateChunks:(EnumTestThreadArgs*)args
+{
+   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+   id item;
+
+   while ( (item = [args->enumerator nextObject]) != nil )
+      [args->items addObject:item];
+
+   [args->lock lock];
+   [args->lock unlockWithCondition:[args->lock condition]+1];
+   [pool release];
+}
+
+- (void) testChunkedSingleThread
+{
+   NSMutableArray *list = [NSMutableArray array];
+   MyImageListItem *topItem, *item;
+   int i;
+
+   // Construct a hierarchical list
+   [list addObject:[[[MyImageListItem alloc] init] autorelease]];
+   topItem = [[[MyImageListItem alloc] initWithURL:
+                                          [NSURL URLWithString:@"2.enum"]
+               ] autorelease];
+   [list addObject:topItem];
+
+   MyImageListEnumerator *enumerator =
+           [[[MyImageListEnumerator alloc] initWithImageList:list] autorelease];
+
+   // Counting does not enumerate
+   XCTAssertEqual([enumerator countRemainingItems:&item], (NSUInteger)5);
+   XCTAssertEqual(item,[list objectAtIndex:0],@"Bad first item");
+   [enumerator setChunkedSchedulingForThreads:2];
+   XCTAssertEqual([enumerator countRemainingItems:NULL], (NSUInteger)5);
+
+   // A lone thread gets all the items in order, then steals nothing
+   item = [enumerator nextObject];
+   XCTAssertEqual(item,[list objectAtIndex:0],@"Bad element at first iteration");
+   for( i = 0; i < 4; i++ )
+   {
+      item = [enumerator nextObject];
+      XCTAssertEqual(item,[topItem getChildAtIndex:i],
+                     @"Bad child %d at iteration", i);
+   }
+   XCTAssertNil([enumerator nextObject],@"List not ended");
+
+   // And again after a reset
+   [enumerator reset];
+   XCTAssertEqual([[enumerator allObjects] count], (NSUInteger)5);
+}
+
+- (void) testChunkedThreads
+{
+   NSMutableArray *list = [NSMutableArray array];
+   NSConditionLock *lock = [[NSConditionLock alloc] initWithCondition:0];
+   NSCountedSet *seen = [NSCountedSet set];
+   EnumTestThreadArgs *args[3];
+   MyImageListItem *item;
+   int i;
+
+   for( i = 0; i < 200; i++ )
+      [list addObject:[[[MyImageListItem alloc] init] autorelease]];
+
+   MyImageListEnumerator *enumerator =
+           [[[MyImageListEnumerator alloc] initWithImageList:list] autorelease];
+   [enumerator setChunkedSchedulingForThreads:3];
+
+   for( i = 0; i < 3; i++ )
+   {
+      args[i] = [[EnumTestThreadArgs alloc] init];
+      args[i]->enumerator = enumerator;
+      args[i]->items = [[NSMutableArray alloc] init];
+      args[i]->lock = lock;
+      [NSThread detachNewThreadSelector:@selector(enumerateChunks:)
+                               toTarget:self
+                             withObject:args[i]];
+   }
+
+   [lock lockWhenCondition:3];
+   [lock unlock];
+
+   // Each item is enumerated once and only once
+   for( i = 0; i < 3; i++ )
+   {
+      [seen addObjectsFromArray:args[i]->items];
+      [args[i]->items release];
+      [args[i] release];
+   }
+   XCTAssertEqual([seen count], [list count]);
+   for( i = 0; i < 200; i++ )
+   {
+      item = [list objectAtIndex:i];
+      XCTAssertEqual([seen countForObject:item], (NSUInteger)1,
+                     @"Item %d enumerated a wrong number of times", i);
+   }
+
+   [lock release];
+}
 @end
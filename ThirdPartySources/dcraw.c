@@ -91,58 +91,64 @@ typedef unsigned long long UINT64;
    non-const static local variables except cbrt[] must be declared
    "thread_local".
  */
-FILE *ifp, *ofp;
-short order;
-const char *ifname;
-char *meta_data, xtrans[6][6], xtrans_abs[6][6];
-char cdesc[5], desc[512], make[64], model[64], model2[64], artist[64];
-float flash_used, canon_ev, iso_speed, shutter, aperture, focal_len;
-time_t timestamp;
-off_t strip_offset, data_offset;
-off_t thumb_offset, meta_offset, profile_offset;
-unsigned shot_order, kodak_cbpp, exif_cfa, unique_id;
-unsigned thumb_length, meta_length, profile_length;
-unsigned thumb_misc, *oprof, fuji_layout, shot_select=0, multi_out=0;
-unsigned tiff_nifds, tiff_samples, tiff_bps, tiff_compress;
-unsigned black, maximum, mix_green, raw_color, zero_is_bad;
-unsigned zero_after_ff, is_raw, dng_version, is_foveon, data_error;
-unsigned tile_width, tile_length, gpsdata[32], load_flags;
-unsigned flip, tiff_flip, filters, colors;
-ushort raw_height, raw_width, height, width, top_margin, left_margin;
-ushort shrink, iheight, iwidth, fuji_width, thumb_width, thumb_height;
-ushort *raw_image, (*image)[4], cblack[4102];
-ushort white[8][8], curve[0x10000], cr2_slice[3], sraw_mul[4];
-double pixel_aspect, aber[4]={1,1,1,1}, gamm[6]={ 0.45,4.5,0,0,0,0 };
-float bright=1, user_mul[4]={0,0,0,0}, threshold=0;
-int mask[8][4];
-int half_size=0, four_color_rgb=0, document_mode=0, highlight=0;
-int verbose=0, use_auto_wb=0, use_camera_wb=0, use_camera_matrix=1;
-int output_color=1, output_bps=8, output_tiff=0, med_passes=0;
-int no_auto_bright=0;
-unsigned greybox[4] = { 0, 0, UINT_MAX, UINT_MAX };
-float cam_mul[4], pre_mul[4], cmatrix[3][4], rgb_cam[3][4];
+#ifdef DCRAW_LIBRARY
+#include "dcraw.h"
+#define thread_local __thread
+#else
+#define thread_local
+#endif
+thread_local FILE *ifp, *ofp;
+thread_local short order;
+thread_local const char *ifname;
+thread_local char *meta_data, xtrans[6][6], xtrans_abs[6][6];
+thread_local char cdesc[5], desc[512], make[64], model[64], model2[64], artist[64];
+thread_local float flash_used, canon_ev, iso_speed, shutter, aperture, focal_len;
+thread_local time_t timestamp;
+thread_local off_t strip_offset, data_offset;
+thread_local off_t thumb_offset, meta_offset, profile_offset;
+thread_local unsigned shot_order, kodak_cbpp, exif_cfa, unique_id;
+thread_local unsigned thumb_length, meta_length, profile_length;
+thread_local unsigned thumb_misc, *oprof, fuji_layout, shot_select=0, multi_out=0;
+thread_local unsigned tiff_nifds, tiff_samples, tiff_bps, tiff_compress;
+thread_local unsigned black, maximum, mix_green, raw_color, zero_is_bad;
+thread_local unsigned zero_after_ff, is_raw, dng_version, is_foveon, data_error;
+thread_local unsigned tile_width, tile_length, gpsdata[32], load_flags;
+thread_local unsigned flip, tiff_flip, filters, colors;
+thread_local ushort raw_height, raw_width, height, width, top_margin, left_margin;
+thread_local ushort shrink, iheight, iwidth, fuji_width, thumb_width, thumb_height;
+thread_local ushort *raw_image, (*image)[4], cblack[4102];
+thread_local ushort white[8][8], curve[0x10000], cr2_slice[3], sraw_mul[4];
+thread_local double pixel_aspect, aber[4]={1,1,1,1}, gamm[6]={ 0.45,4.5,0,0,0,0 };
+thread_local float bright=1, user_mul[4]={0,0,0,0}, threshold=0;
+thread_local int mask[8][4];
+thread_local int half_size=0, four_color_rgb=0, document_mode=0, highlight=0;
+thread_local int verbose=0, use_auto_wb=0, use_camera_wb=0, use_camera_matrix=1;
+thread_local int output_color=1, output_bps=8, output_tiff=0, med_passes=0;
+thread_local int no_auto_bright=0;
+thread_local unsigned greybox[4] = { 0, 0, UINT_MAX, UINT_MAX };
+thread_local float cam_mul[4], pre_mul[4], cmatrix[3][4], rgb_cam[3][4];
 const double xyz_rgb[3][3] = {			/* XYZ from RGB */
   { 0.412453, 0.357580, 0.180423 },
   { 0.212671, 0.715160, 0.072169 },
   { 0.019334, 0.119193, 0.950227 } };
 const float d65_white[3] = { 0.950456, 1, 1.088754 };
-int histogram[4][0x2000];
-void (*write_thumb)(), (*write_fun)();
-void (*load_raw)(), (*thumb_load_raw)();
-jmp_buf failure;
+thread_local int histogram[4][0x2000];
+thread_local void (*write_thumb)(), (*write_fun)();
+thread_local void (*load_raw)(), (*thumb_load_raw)();
+thread_local jmp_buf failure;
 
-struct decode {
+thread_local struct decode {
   struct decode *branch[2];
   int leaf;
 } first_decode[2048], *second_decode, *free_decode;
 
-struct tiff_ifd {
+thread_local struct tiff_ifd {
   int width, height, bps, comp, phint, offset, flip, samples, bytes;
   int tile_width, tile_length;
   float shutter;
 } tiff_ifd[10];
 
-struct ph1 {
+thread_local struct ph1 {
   int format, key_off, tag_21a;
   int black, split_col, black_col, split_row, black_row;
   float tag_210;
@@ -581,8 +587,8 @@ int CLASS canon_s2is()
 
 unsigned CLASS getbithuff (int nbits, ushort *huff)
 {
-  static unsigned bitbuf=0;
-  static int vbits=0, reset=0;
+  static thread_local unsigned bitbuf=0;
+  static thread_local int vbits=0, reset=0;
   unsigned c;
 
   if (nbits > 25) return 0;
@@ -1044,7 +1050,7 @@ void CLASS ljpeg_idct (struct jhead *jh)
 {
   int c, i, j, len, skip, coef;
   float work[3][8][8];
-  static float cs[106] = { 0 };
+  static thread_local float cs[106] = { 0 };
   static const uchar zigzag[80] =
   {  0, 1, 8,16, 9, 2, 3,10,17,24,32,25,18,11, 4, 5,12,19,26,33,
     40,48,41,34,27,20,13, 6, 7,14,21,28,35,42,49,56,57,50,43,36,
@@ -1693,8 +1699,8 @@ void CLASS phase_one_load_raw()
 
 unsigned CLASS ph1_bithuff (int nbits, ushort *huff)
 {
-  static UINT64 bitbuf=0;
-  static int vbits=0;
+  static thread_local UINT64 bitbuf=0;
+  static thread_local int vbits=0;
   unsigned c;
 
   if (nbits == -1)
@@ -1994,8 +2000,8 @@ void CLASS canon_rmf_load_raw()
 
 unsigned CLASS pana_bits (int nbits)
 {
-  static uchar buf[0x4000];
-  static int vbits;
+  static thread_local uchar buf[0x4000];
+  static thread_local int vbits;
   int byte;
 
   if (!nbits) return vbits=0;
@@ -2292,7 +2298,7 @@ void CLASS lossy_dng_load_raw() {}
 METHODDEF(boolean)
 fill_input_buffer (j_decompress_ptr cinfo)
 {
-  static uchar jpeg_buffer[4096];
+  static thread_local uchar jpeg_buffer[4096];
   size_t nbytes;
 
   nbytes = fread (jpeg_buffer, 1, 4096, ifp);
@@ -2648,7 +2654,7 @@ void CLASS kodak_thumb_load_raw()
 
 void CLASS sony_decrypt (unsigned *data, int len, int start, int key)
 {
-  static unsigned pad[128], p;
+  static thread_local unsigned pad[128], p;
 
   if (start) {
     for (p=0; p < 4; p++)
@@ -3036,7 +3042,7 @@ void CLASS redcine_load_raw()
 
 void CLASS foveon_decoder (unsigned size, unsigned code)
 {
-  static unsigned huff[1024];
+  static thread_local unsigned huff[1024];
   struct decode *cur;
   int i, len;
 
@@ -4602,7 +4608,8 @@ void CLASS cielab (ushort rgb[3], short lab[3])
 {
   int c, i, j, k;
   float r, xyz[3];
-  static float cbrt[0x10000], xyz_cam[3][4];
+  static float cbrt[0x10000];
+  static thread_local float xyz_cam[3][4];
 
   if (!rgb) {
     for (i=0; i < 0x10000; i++) {
@@ -6816,7 +6823,7 @@ void CLASS parse_riff()
 void CLASS parse_crx (int end)
 {
   unsigned i, save, size, tag, base;
-  static int index=0, wide, high, off, len;
+  static thread_local int index=0, wide, high, off, len;
 
   order = 0x4d4d;
   while (ftell(ifp)+7 < end) {
@@ -10070,7 +10077,79 @@ void CLASS write_ppm_tiff()
   free (ppm);
 }
 
+#ifdef DCRAW_LIBRARY
+void CLASS subtract_memory (const dcraw_dark_t *dark)
+{
+  int row, col;
+
+  if (dark->width != width || dark->height != height) {
+    fprintf (stderr,_("Dark frame has the wrong dimensions!\n"));
+    return;
+  }
+  for (row=0; row < height; row++)
+    for (col=0; col < width; col++)
+      BAYER(row,col) = MAX (BAYER(row,col) - dark->data[row*width+col], 0);
+  memset (cblack, 0, sizeof cblack);
+  black = 0;
+}
+
+void CLASS fill_info (dcraw_image_t *result)
+{
+  strcpy (result->make, make);
+  strcpy (result->model, model);
+  result->iso_speed = iso_speed;
+  result->shutter = shutter;
+  result->aperture = aperture;
+  result->focal_len = focal_len;
+  result->timestamp = timestamp;
+  result->width = width;
+  result->height = height;
+  result->out_width = iwidth;
+  result->out_height = iheight;
+  result->colors = colors;
+  result->filters = filters;
+}
+
+void CLASS write_memory (dcraw_image_t *result)
+{
+  ushort *out;
+  int c, row, col, soff, rstep, cstep;
+  int perc, val, total, white=0x2000;
+
+  perc = width * height * 0.01;		/* 99th percentile white level */
+  if (fuji_width) perc /= 2;
+  if (!((highlight & ~2) || no_auto_bright))
+    for (white=c=0; c < colors; c++) {
+      for (val=0x2000, total=0; --val > 32; )
+	if ((total += histogram[c][val]) > perc) break;
+      if (white < val) white = val;
+    }
+  gamma_curve (gamm[0], gamm[1], 2, (white << 3)/bright);
+  iheight = height;
+  iwidth  = width;
+  if (flip & 4) SWAP(height,width);
+  out = (ushort *) malloc ((size_t) width * height * colors * sizeof *out);
+  merror (out, "write_memory()");
+  result->data = out;
+  result->out_width = width;
+  result->out_height = height;
+  result->colors = colors;
+  result->maximum = (1 << output_bps)-1;
+  soff  = flip_index (0, 0);
+  cstep = flip_index (0, 1) - soff;
+  rstep = flip_index (1, 0) - flip_index (0, width);
+  for (row=0; row < height; row++, soff += rstep)
+    for (col=0; col < width; col++, soff += cstep)
+      if (output_bps == 8)
+	   FORCC *out++ = curve[image[soff][c]] >> 8;
+      else FORCC *out++ = curve[image[soff][c]];
+}
+
+static int CLASS dcraw_main (int argc, const char **argv,
+			     const dcraw_dark_t *dark, dcraw_image_t *result)
+#else
 int CLASS main (int argc, const char **argv)
+#endif
 {
   int arg, status=0, quality, i, c;
   int timestamp_only=0, thumbnail_only=0, identify_only=0;
@@ -10083,7 +10162,7 @@ int CLASS main (int argc, const char **argv)
   const char *cam_profile=0, *out_profile=0;
 #endif
 
-#ifndef LOCALTIME
+#if !defined(LOCALTIME) && !defined(DCRAW_LIBRARY)
   putenv ((char *) "TZ=UTC");
 #endif
 #ifdef LOCALEDIR
@@ -10231,6 +10310,10 @@ int CLASS main (int argc, const char **argv)
       if (fileno(ifp) > 2) fclose(ifp);
       if (fileno(ofp) > 2) fclose(ofp);
       status = 1;
+#ifdef DCRAW_LIBRARY
+      if (result->data) free (result->data);
+      result->data = 0;
+#endif
       goto cleanup;
     }
     ifname = argv[arg];
@@ -10281,6 +10364,7 @@ int CLASS main (int argc, const char **argv)
       height += height & 1;
       width  += width  & 1;
     }
+#ifndef DCRAW_LIBRARY
     if (identify_only && verbose && make[0]) {
       printf (_("\nFilename: %s\n"), ifname);
       printf (_("Timestamp: %s"), ctime(&timestamp));
@@ -10306,7 +10390,9 @@ int CLASS main (int argc, const char **argv)
       if (thumb_offset)
 	printf (_("Thumb size:  %4d x %d\n"), thumb_width, thumb_height);
       printf (_("Full size:   %4d x %d\n"), raw_width, raw_height);
-    } else if (!is_raw)
+    } else
+#endif
+    if (!is_raw)
       fprintf (stderr,_("Cannot decode file %s\n"), ifname);
     if (!is_raw) goto next;
     shrink = filters && (half_size || (!identify_only &&
@@ -10314,7 +10400,11 @@ int CLASS main (int argc, const char **argv)
     iheight = (height + shrink) >> shrink;
     iwidth  = (width  + shrink) >> shrink;
     if (identify_only) {
+#ifdef DCRAW_LIBRARY
+      if (1) {
+#else
       if (verbose) {
+#endif
 	if (document_mode == 3) {
 	  top_margin = left_margin = fuji_width = 0;
 	  height = raw_height;
@@ -10334,6 +10424,10 @@ int CLASS main (int argc, const char **argv)
 	}
 	if (flip & 4)
 	  SWAP(iheight,iwidth);
+#ifdef DCRAW_LIBRARY
+	fill_info (result);
+	goto next;
+#endif
 	printf (_("Image size:  %4d x %d\n"), width, height);
 	printf (_("Output size: %4d x %d\n"), iwidth, iheight);
 	printf (_("Raw colors: %d"), colors);
@@ -10398,6 +10492,9 @@ next:
     if (zero_is_bad) remove_zeroes();
     bad_pixels (bpfile);
     if (dark_frame) subtract (dark_frame);
+#ifdef DCRAW_LIBRARY
+    if (dark) subtract_memory (dark);
+#endif
     quality = 2 + !fuji_width;
     if (user_qual >= 0) quality = user_qual;
     i = cblack[3];
@@ -10449,6 +10546,15 @@ next:
     convert_to_rgb();
     if (use_fuji_rotate) stretch();
 thumbnail:
+#ifdef DCRAW_LIBRARY
+    fill_info (result);
+    if (write_fun == &CLASS write_ppm_tiff)
+      write_memory (result);
+    else
+      status = 1;
+    fclose(ifp);
+    goto cleanup;
+#endif
     if (write_fun == &CLASS jpeg_thumb)
       write_ext = ".jpg";
     else if (output_tiff && write_fun == &CLASS write_ppm_tiff)
@@ -10492,3 +10598,48 @@ cleanup:
   }
   return status;
 }
+
+#ifdef DCRAW_LIBRARY
+/* Reset the options, which are set by the command line */
+void CLASS reset_options()
+{
+  int c;
+
+  shot_select = multi_out = 0;
+  FORC4 aber[c] = 1;
+  gamm[0] = 0.45;  gamm[1] = 4.5;
+  gamm[2] = gamm[3] = gamm[4] = gamm[5] = 0;
+  bright = 1;
+  FORC4 user_mul[c] = 0;
+  threshold = 0;
+  half_size = four_color_rgb = document_mode = highlight = 0;
+  verbose = use_auto_wb = use_camera_wb = 0;
+  use_camera_matrix = 1;
+  output_color = 1;
+  output_bps = 8;
+  output_tiff = med_passes = no_auto_bright = 0;
+  greybox[0] = greybox[1] = 0;
+  greybox[2] = greybox[3] = UINT_MAX;
+}
+
+int dcraw_process (int argc, const char **argv,
+		   const dcraw_dark_t *dark, dcraw_image_t *result)
+{
+  const char **args;
+  int status;
+
+  /* main() writes past the last argument */
+  args = (const char **) calloc (argc+1, sizeof *args);
+  if (!args) return 1;
+  memcpy (args, argv, argc * sizeof *args);
+  memset (result, 0, sizeof *result);
+  reset_options();
+  status = dcraw_main (argc, args, dark, result);
+  free (args);
+  if (status && result->data) {
+    free (result->data);
+    result->data = 0;
+  }
+  return status;
+}
+#endif
@@ -0,0 +1,43 @@
+/*
+   dcraw.h -- In-process interface to dcraw.c
+
+   Compiling dcraw.c with DCRAW_LIBRARY defined replaces its main() with
+   dcraw_process(), which takes the same command line options.  The
+   image is decoded into memory instead of being written to a file, and
+   the decoder state is thread local, so that several images can be
+   decoded concurrently.
+ */
+#ifndef __DCRAW_H
+#define __DCRAW_H
+
+#include <time.h>
+
+/* Dark frame to subtract, in place of the "-K" option file */
+typedef struct {
+  const unsigned short *data;	/* Raw samples, native endianness */
+  unsigned width, height;
+} dcraw_dark_t;
+
+/* Decoded image and its information */
+typedef struct {
+  char make[64], model[64];
+  float iso_speed, shutter, aperture, focal_len;
+  time_t timestamp;
+  unsigned width, height;	/* Image size, before rotation */
+  unsigned out_width, out_height;	/* Output size */
+  unsigned colors;		/* Samples per pixel */
+  unsigned filters;		/* Sensor CFA pattern, see FC(), 0 if none */
+  unsigned maximum;		/* Maximum sample value */
+  unsigned short *data;		/* Interleaved samples, to be freed by the caller;
+				   NULL with the "-i" option */
+} dcraw_image_t;
+
+/*
+   Process one file with the given command line, argv[0] being the
+   program name and the last argument the file to decode.
+   Returns 0 on success.
+ */
+int dcraw_process (int argc, const char **argv,
+		   const dcraw_dark_t *dark, dcraw_image_t *result);
+
+#endif
@@ -35,6 +35,21 @@
 
 @class LynkeosThreadCnxEnd;
 
+/*!
+ * @abstract Protocol for objects having some methods callable from any thread
+ * @discussion The proxies of such an object call these methods directly in
+ *    the calling thread, instead of forwarding them over the connection.
+ * @ingroup Support
+ */
+@protocol LynkeosThreadSafeMethods
+/*!
+ * @abstract Whether a method can be called from any thread
+ * @param sel The method selector
+ * @result YES if the method is thread safe
+ */
+- (BOOL) isThreadSafeSelector:(SEL)sel ;
+@end
+
 /*!
  * @abstract This class implements a connection between threads in the same
  *   adress space.
@@ -210,6 +210,7 @@ static NSMutableDictionary *mainThreadCnxEnd = nil;
 @private
    id                  _object;    //!< Object for which we are a proxy
    BOOL                _inThread;  //!< Is the proxy for a "thread side" object
+   BOOL                _hasThreadSafeMethods; //!< Whether some calls are direct
    LynkeosThreadConnection *_cnx;       //!< Owner connection
 }
 
@@ -230,6 +231,7 @@ static NSMutableDictionary *mainThreadCnxEnd = nil;
 {
    _object = nil;
    _cnx = nil;
+   _hasThreadSafeMethods = NO;
 
    return( self );
 }
@@ -242,6 +244,8 @@ static NSMutableDictionary *mainThreadCnxEnd = nil;
       _object = object;
       _cnx = cnx;  // Loose binding
       _inThread = inThread;
+      _hasThreadSafeMethods =
+             [object conformsToProtocol:@protocol(LynkeosThreadSafeMethods)];
    }
 
    return( self );
@@ -256,7 +260,11 @@ static NSMutableDictionary *mainThreadCnxEnd = nil;
 - (void) forwardInvocation:(NSInvocation *)anInvocation
 {
    [anInvocation setTarget:_object];
-   [_cnx sendInvocation:anInvocation inThread:!_inThread];
+   if ( _hasThreadSafeMethods
+        && [_object isThreadSafeSelector:[anInvocation selector]] )
+      [anInvocation invoke];
+   else
+      [_cnx sendInvocation:anInvocation inThread:!_inThread];
 }
 
 @end